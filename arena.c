@@ -0,0 +1,252 @@
+/*
+ * arena.c
+ * Arena allocator for the hash ADT.
+ *
+ * Pages of ARENA_PAGE_SIZE bytes are taken from malloc() and
+ * carved up with a bump pointer.  There is no per-object
+ * header, so a 32 byte node costs 32 bytes rather than the
+ * 48 a malloc() chunk would, and destroying the arena is one
+ * free() per page instead of one per object.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/* Alignment of every allocation */
+#define ARENA_ALIGN  sizeof(void *)
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+int arenaNewPage(Arena *arena, size_t size);
+
+
+/* =================== Public Functions ====================== */
+/* =================== Public Functions ====================== */
+
+/*
+ * arenaCreate()
+ * This function creates an empty arena.  No page is
+ * allocated until the first arenaAlloc().
+ *
+ * INPUT:     objsize     Size of every object, or 0 for a
+ *                        string arena of mixed sizes
+ * RETURNS:   arena       Pointer to new arena
+ *            NULL        Error allocating memory
+ */
+Arena *arenaCreate(size_t objsize){
+
+  Arena *arena;
+
+  arena = (Arena *) malloc (sizeof(Arena));
+  if (arena == NULL)
+    return NULL;
+
+  memset(arena, 0, sizeof(Arena));
+
+  /* Room for the free list link, rounded to alignment */
+  if (objsize != 0){
+    if (objsize < sizeof(void *))
+      objsize = sizeof(void *);
+    objsize = (objsize + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  }
+  arena->objsize = objsize;
+
+  return arena;
+
+}
+
+
+/*
+ * arenaAlloc()
+ * This function returns uninitialized memory from the arena.
+ * A fixed size arena ignores size and reuses freed objects
+ * first.
+ *
+ * INPUT:     arena       Arena to allocate from
+ *            size        Bytes wanted (string arenas only)
+ * RETURNS:   void *      Pointer to memory
+ *            NULL        Error allocating memory
+ */
+void *arenaAlloc(Arena *arena, size_t size){
+
+  void *obj;
+
+  if (arena->objsize != 0){
+    if (arena->freelist != NULL){
+      obj = arena->freelist;
+      arena->freelist = *(void **) obj;
+      return obj;
+    }
+    size = arena->objsize;
+  }
+  else {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  }
+
+  if ((size_t) (arena->end - arena->next) < size)
+    if (arenaNewPage(arena, size) != 0)
+      return NULL;
+
+  obj = arena->next;
+  arena->next += size;
+
+  return obj;
+
+}
+
+
+/*
+ * arenaFree()
+ * This function gives an object back to a fixed size arena
+ * for reuse.  It does nothing for string arenas.
+ *
+ * INPUT:     arena       Arena the object came from
+ *            obj         Object to release
+ */
+void arenaFree(Arena *arena, void *obj){
+
+  if (arena->objsize != 0 && obj != NULL){
+    *(void **) obj = arena->freelist;
+    arena->freelist = obj;
+  }
+
+}
+
+
+/*
+ * arenaStrdup()
+ * This function copies a string, with its NUL, into the arena.
+ *
+ * INPUT:     arena       String arena
+ *            str         String to copy
+ * RETURNS:   char *      Copy of str
+ *            NULL        Error allocating memory
+ */
+char *arenaStrdup(Arena *arena, const char *str){
+
+  size_t  len = strlen(str) + 1;
+  char    *copy;
+
+  copy = (char *) arenaAlloc(arena, len);
+  if (copy != NULL)
+    memcpy(copy, str, len);
+
+  return copy;
+
+}
+
+
+/*
+ * arenaBytes()
+ * This function returns the bytes of page memory the arena
+ * holds, including unused space at the end of each page.
+ *
+ * INPUT:     arena       Arena
+ * RETURNS:   size_t      Bytes held
+ */
+size_t arenaBytes(Arena *arena){
+
+  return arena->bytes;
+
+}
+
+
+/*
+ * arenaAdopt()
+ * This function moves every page of from into arena and
+ * frees from.  Memory allocated from either stays valid until
+ * arenaDestroy(arena).  Objects on from's free list are not
+ * reused.  Used to back out of a half finished repack.
+ *
+ * INPUT:     arena       Arena taking the pages
+ *            from        Arena given up
+ */
+void arenaAdopt(Arena *arena, Arena *from){
+
+  struct ArenaPage *page;
+
+  if (from == NULL)
+    return;
+
+  /* Oldest pages go last, the bump pointer stays put */
+  if (arena->pages == NULL){
+    arena->pages = from->pages;
+    arena->next  = from->next;
+    arena->end   = from->end;
+  }
+  else {
+    for (page = arena->pages; page->next != NULL; page = page->next)
+      ;
+    page->next = from->pages;
+  }
+  arena->bytes += from->bytes;
+
+  free(from);
+
+}
+
+
+/*
+ * arenaDestroy()
+ * This function releases every page and the arena itself.
+ * Everything allocated from it becomes invalid.
+ *
+ * INPUT:     arena       Arena to destroy
+ */
+void arenaDestroy(Arena *arena){
+
+  struct ArenaPage *page;
+  struct ArenaPage *tmp;
+
+  if (arena == NULL)
+    return;
+
+  for (page = arena->pages; page != NULL; page = tmp){
+    tmp = page->next;
+    free(page);
+  }
+
+  free(arena);
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * arenaNewPage()
+ * This function starts a new page with room for at least size
+ * bytes.  Oversized requests get a page of their own.
+ */
+static
+int arenaNewPage(Arena *arena, size_t size){
+
+  struct ArenaPage *page;
+  size_t           header;
+  size_t           bytes = ARENA_PAGE_SIZE;
+
+  header = (sizeof(struct ArenaPage) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+  if (size + header > bytes)
+    bytes = size + header;
+
+  page = (struct ArenaPage *) malloc (bytes);
+  if (page == NULL)
+    return -1;
+
+  page->size   = bytes;
+  page->next   = arena->pages;
+  arena->pages = page;
+  arena->bytes += bytes;
+
+  arena->next = (char *) page + header;
+  arena->end  = (char *) page + bytes;
+
+  return 0;
+
+}
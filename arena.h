@@ -0,0 +1,61 @@
+/*
+ * arena.h
+ * Header file for the arena allocator used by HASH_ARENA tables.
+ *
+ * An arena hands out memory from large pages and releases all
+ * of it at once in arenaDestroy().  A fixed size arena also
+ * recycles freed objects through a free list; a string arena
+ * (objsize 0) only bump allocates, so freed strings are not
+ * reused until the arena is destroyed.
+ *
+ * FUNCTIONS:        arenaCreate        Create a new arena.
+ *                   arenaAlloc         Allocate from an arena.
+ *                   arenaFree          Return an object to an arena.
+ *                   arenaStrdup        Copy a string into an arena.
+ *                   arenaBytes         Bytes of pages held.
+ *                   arenaAdopt         Take over another arena's pages.
+ *                   arenaDestroy       Release every page.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes per arena page */
+#define ARENA_PAGE_SIZE  65536
+
+/* Arena page, data follows the header */
+struct ArenaPage {
+  struct ArenaPage  *next;
+  size_t            size;
+};
+
+typedef struct Arena {
+
+  size_t            objsize;     /* Fixed object size, 0 for strings */
+  struct ArenaPage  *pages;      /* Every page, newest first */
+  char              *next;       /* Bump pointer in newest page */
+  char              *end;        /* End of newest page */
+  void              *freelist;   /* Freed fixed size objects */
+  size_t            bytes;       /* Total bytes of pages */
+
+} Arena;
+
+Arena *arenaCreate(size_t objsize);
+void *arenaAlloc(Arena *arena, size_t size);
+void arenaFree(Arena *arena, void *obj);
+char *arenaStrdup(Arena *arena, const char *str);
+size_t arenaBytes(Arena *arena);
+void arenaAdopt(Arena *arena, Arena *from);
+void arenaDestroy(Arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
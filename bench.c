@@ -0,0 +1,1923 @@
+/*
+ * bench.c
+ * Benchmark driver for the Hash ADT.
+ *
+ * Usage:   bench <workload> [count]
+ *
+ * Each workload builds its own tables from synthetic keys
+ * and prints one line per measurement, except "suite"
+ * (benchsuite.c) which prints one JSON document for tracking
+ * runs against each other.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "hash.h"
+#include "grid.h"
+#include "quad.h"
+#include "str.h"
+
+/* Workload table entry */
+struct benchWorkload {
+  const char   *name;
+  void         (*run)(unsigned int count);
+  unsigned int defcount;
+  const char   *help;
+};
+
+/* Per thread state for the concurrent workload */
+struct benchThread {
+  Hash             *hash;
+  pthread_mutex_t  *mutex;      /* Global lock, NULL for none */
+  char             **keys;      /* Preloaded keys to look up */
+  unsigned int     nkeys;
+  char             **adds;      /* This thread's keys to add */
+  unsigned int     ops;
+  unsigned int     seed;
+  unsigned int     found;
+  unsigned int     wrong;       /* Lookups that returned bad data */
+  int              *stop;       /* Set when the readers are done */
+  int              node;        /* NUMA node to run on, -1 any */
+};
+
+/* Function Prototypes */
+void benchLookup(unsigned int count);
+void benchHashFn(unsigned int count);
+void benchGrowth(unsigned int count);
+void benchArena(unsigned int count);
+void benchArenaRun(const char *kname, char **keys, unsigned int count);
+size_t benchHeapBytes(void);
+void benchConcurrent(unsigned int count);
+void *benchMixedThread(void *arg);
+void benchBatch(unsigned int count);
+void benchLockFree(unsigned int count);
+void benchIngest(unsigned int count);
+void benchLoad(unsigned int count);
+void benchSnapshot(unsigned int count);
+void benchTemplate(unsigned int count);
+void benchSuite(unsigned int count);
+void benchGrid(unsigned int count);
+void benchGridRun(const char *name, Grid *grid, double south, double west,
+                  double north, double east, QuadFile *quad);
+void benchScan(unsigned int count);
+void benchScanVisit(void *arg, const char *vkey, uint64_t hashval, void *data);
+void benchBulk(unsigned int count);
+void benchBulkVisit(void *arg, const char *vkey, uint64_t hashval, void *data);
+void benchUpsert(unsigned int count);
+double benchUpsertRun(int engine, int way, char **keys,
+                      unsigned int *stream, unsigned int count,
+                      unsigned int *counts, unsigned int *found,
+                      uint64_t *total);
+void *benchUpsertMerge(void *old, void *data);
+long benchReplicate(char *path, unsigned int count);
+double benchIngestRun(const char *path, int mapped, double *parse);
+unsigned int benchLegacyLoad(Hash *hash, const char *path, void ***records);
+void *benchReaderThread(void *arg);
+void *benchChurnThread(void *arg);
+int benchCompareDouble(const void *a, const void *b);
+void benchHashFnRun(const char *fname, HashFunc fn, const char *kname,
+                    char **keys, unsigned int count);
+double benchNow(void);
+char **benchKeys(const char *prefix, unsigned int count);
+char **benchDrgKeys(const char *datafile, unsigned int *count);
+void benchFreeKeys(char **keys, unsigned int count);
+void benchUsage(void);
+uint64_t benchLegacyHash(const void *key, size_t len, uint64_t seed);
+
+static struct benchWorkload workloads[] = {
+  { "lookup", benchLookup, 1000000,
+    "hit and miss lookups per engine" },
+  { "hashfn", benchHashFn, 1000000,
+    "hash function speed and bucket spread" },
+  { "growth", benchGrowth, 4000000,
+    "insert latency percentiles while the table grows" },
+  { "arena", benchArena, 2000000,
+    "load, destroy time and bytes per entry with HASH_ARENA" },
+  { "concurrent", benchConcurrent, 1000000,
+    "90/10 get/add throughput by thread count" },
+  { "lockfree", benchLockFree, 200000,
+    "reader throughput and checking against resizing writers" },
+  { "batch", benchBatch, 4000000,
+    "hashGetBatch() against a hashGet() loop on a large table" },
+  { "ingest", benchIngest, 100,
+    "quadrangle file load, getc()/sscanf() against quadOpen(), "
+    "on the file and on count copies of it" },
+  { "load", benchLoad, 100,
+    "quadOpenParallel()/quadLoadParallel() MB/s by thread count "
+    "on count copies of the quadrangle file" },
+  { "snapshot", benchSnapshot, 2000000,
+    "start up by rebuilding a table against hashOpen() of its snapshot" },
+  { "template", benchTemplate, 2000000,
+    "HASH_FLAT of record pointers against hash::Table of records" },
+  { "grid", benchGrid, 1000000,
+    "gridPoint()/gridRange() on the quadrangles and on count "
+    "synthetic boxes" },
+  { "scan", benchScan, 2000000,
+    "full table scans by hashIterNext() and by hashScan() slices "
+    "per engine" },
+  { "bulk", benchBulk, 4000000,
+    "hashBuildBulk(), hashForEach() and hashDestroyParallel() "
+    "against hashAdd(), hashScan() and hashDestroy() by thread count" },
+  { "upsert", benchUpsert, 4000000,
+    "counting and deduplicating count keys with repeats, hashGet() "
+    "then hashAdd() against hashFindOrInsert(), hashUpsert() and "
+    "hashEmplace()" },
+  { "suite", benchSuite, 1000000,
+    "every engine on the DRG codes and 10^4 .. count synthetic keys, "
+    "as JSON" },
+  { NULL, NULL, 0, NULL }
+};
+
+/* Keeps timed results live */
+static volatile uint64_t benchSink;
+
+/* USGS quadrangle file */
+static const char  datafile[] = "data/63360.lst";
+
+static const int   engines[]     = { HASH_CHAINED, HASH_FLAT, HASH_SWISS };
+static const char *engineNames[] = { "chained", "flat", "swiss" };
+#define NUM_ENGINES  ((int) (sizeof(engines) / sizeof(engines[0])))
+
+
+int main(int argc, char *argv[]){
+
+  struct benchWorkload *w;
+  unsigned int          count;
+
+  if (argc < 2){
+    benchUsage();
+    return 1;
+  }
+
+  for (w = workloads; w->name != NULL; w++){
+    if (strcmp(w->name, argv[1]) == 0){
+      count = (argc > 2) ? (unsigned int) strtoul(argv[2], NULL, 10)
+                         : w->defcount;
+      w->run(count);
+      return 0;
+    }
+  }
+
+  benchUsage();
+  return 1;
+}
+
+
+/* ===================== benchLookup() =================== */
+/* ===================== benchLookup() =================== */
+
+/*
+ * benchLookup()
+ * This function loads count keys into each engine and times
+ * a pass of hashGet() over keys that are present and a pass
+ * over keys that are not.
+ *
+ * INPUT:     count     Number of keys
+ */
+void benchLookup(unsigned int count){
+
+  Hash          *hash;
+  char          **keys;
+  char          **misses;
+  unsigned int  i;
+  unsigned int  found;
+  double        t0, t1;
+  int           e;
+
+  keys   = benchKeys("key", count);
+  misses = benchKeys("miss", count);
+
+  for (e = 0; e < NUM_ENGINES; e++){
+
+    hash = hashCreateEngine(10, engines[e]);
+
+    t0 = benchNow();
+    for (i = 0; i < count; i++)
+      hashAdd(hash, keys[i], keys[i]);
+    t1 = benchNow();
+    printf("lookup %-8s n=%u insert %.1f ns/op\n",
+           engineNames[e], count, (t1 - t0) * 1e9 / count);
+
+    found = 0;
+    t0 = benchNow();
+    for (i = 0; i < count; i++)
+      found += (hashGet(hash, keys[i]) != NULL);
+    t1 = benchNow();
+    printf("lookup %-8s n=%u hit    %.1f ns/op  %.0f ops/sec  found %u\n",
+           engineNames[e], count, (t1 - t0) * 1e9 / count,
+           count / (t1 - t0), found);
+
+    found = 0;
+    t0 = benchNow();
+    for (i = 0; i < count; i++)
+      found += (hashGet(hash, misses[i]) != NULL);
+    t1 = benchNow();
+    printf("lookup %-8s n=%u miss   %.1f ns/op  %.0f ops/sec  found %u\n",
+           engineNames[e], count, (t1 - t0) * 1e9 / count,
+           count / (t1 - t0), found);
+
+    hashDestroy(hash, NULL);
+  }
+
+  benchFreeKeys(keys, count);
+  benchFreeKeys(misses, count);
+
+}
+
+
+/* ===================== benchHashFn() =================== */
+/* ===================== benchHashFn() =================== */
+
+/*
+ * benchHashFn()
+ * This function compares the hash functions on the DRG codes
+ * from the quadrangle file, on short synthetic keys and on
+ * long synthetic keys sharing a 40 byte prefix.  "legacy" is
+ * the original hash_fval_string(), first 32 characters modulo
+ * a prime from sizes[].
+ *
+ * INPUT:     count     Number of synthetic keys
+ */
+void benchHashFn(unsigned int count){
+
+  static const char *fnames[] = { "legacy", "fval", "fnv1a", "wy" };
+  HashFunc           fns[4];
+  const char         prefix[] = "/usgs/quadrangles/63360/archive/records/";
+  char               **sets[3];
+  const char         *snames[] = { "drg", "short", "long" };
+  unsigned int       counts[3];
+  int                f, k;
+
+  fns[0] = benchLegacyHash;
+  fns[1] = hashFnFval;
+  fns[2] = hashFnFnv1a;
+  fns[3] = hashFnWy;
+
+  sets[0]   = benchDrgKeys(datafile, &counts[0]);
+  sets[1]   = benchKeys("key", count);
+  counts[1] = count;
+  sets[2]   = benchKeys(prefix, count);
+  counts[2] = count;
+
+  for (k = 0; k < 3; k++)
+    for (f = 0; f < 4; f++)
+      benchHashFnRun(fnames[f], fns[f], snames[k], sets[k], counts[k]);
+
+  for (k = 0; k < 3; k++)
+    benchFreeKeys(sets[k], counts[k]);
+
+}
+
+/*
+ * benchHashFnRun()
+ * This function times one hash function over a key set and
+ * reports how evenly it spreads the keys over as many buckets
+ * as there are keys.  With a good function about 36.8% of keys
+ * land in an already occupied bucket.
+ */
+void benchHashFnRun(const char *fname, HashFunc fn, const char *kname,
+                    char **keys, unsigned int count){
+
+  unsigned int  *lens;
+  unsigned int  *buckets;
+  unsigned int  nbuckets;
+  unsigned int  i, b;
+  unsigned int  rounds;
+  unsigned int  r;
+  unsigned int  colliding = 0;
+  unsigned int  maxchain = 0;
+  uint64_t      h;
+  uint64_t      sink = 0;
+  double        bytes = 0;
+  double        t0, t1;
+
+  lens = (unsigned int *) malloc (count * sizeof(unsigned int));
+  for (i = 0; i < count; i++){
+    lens[i] = (unsigned int) strlen(keys[i]);
+    bytes  += lens[i];
+  }
+
+  /* Repeat small sets so timings are not all noise */
+  rounds = 1 + 4000000 / count;
+
+  t0 = benchNow();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < count; i++)
+      sink += fn(keys[i], lens[i], 0x1234567);
+  t1 = benchNow();
+
+  /* Bucket spread, reduced the way the tables reduce */
+  nbuckets = count;
+  if (fn == benchLegacyHash){
+    for (i = 0; (sizes[i] < count) && (sizes[i + 1] != 0); i++);
+    nbuckets = sizes[i];
+  }
+  buckets = (unsigned int *) calloc (nbuckets, sizeof(unsigned int));
+
+  for (i = 0; i < count; i++){
+    h = fn(keys[i], lens[i], 0x1234567);
+    if (fn == benchLegacyHash)
+      b = (unsigned int) (h % nbuckets);
+    else
+      b = (unsigned int) ((((h * 0x9E3779B97F4A7C15ULL) >> 32) *
+                           (uint64_t) nbuckets) >> 32);
+    if (buckets[b]++ != 0)
+      colliding++;
+    if (buckets[b] > maxchain)
+      maxchain = buckets[b];
+  }
+
+  printf("hashfn %-6s %-5s n=%u %.2f ns/key  %.2f GB/s  "
+         "colliding %.1f%%  max chain %u\n",
+         fname, kname, count,
+         (t1 - t0) * 1e9 / ((double) count * rounds),
+         bytes * rounds / (t1 - t0) / 1e9,
+         100.0 * colliding / count, maxchain);
+
+  benchSink = sink;
+
+  free(buckets);
+  free(lens);
+
+}
+
+/*
+ * benchLegacyHash()
+ * The original hash_fval_string() loop, which only looked at
+ * the first 32 characters and ignored the seed.
+ */
+uint64_t benchLegacyHash(const void *key, size_t len, uint64_t seed){
+
+  const char   *p     = (const char *) key;
+  unsigned     result = 0;
+  size_t       i;
+
+  (void) seed;
+
+  for (i = 0; i < len && i < 32; i++)
+    result = result * 33U + p[i];
+
+  return result;
+
+}
+
+
+/* ===================== benchGrowth() =================== */
+/* ===================== benchGrowth() =================== */
+
+/*
+ * benchGrowth()
+ * This function times every single hashAdd() while count keys
+ * are loaded into an initially tiny table, so the load walks
+ * through each resize.  The stop-the-world rehash shows up in
+ * the tail percentiles; HASH_INCREMENTAL spreads it out.  Each
+ * engine is run again after hashReserve() for count keys,
+ * which should leave no resize at all.
+ *
+ * INPUT:     count     Number of keys
+ */
+void benchGrowth(unsigned int count){
+
+  static const int   modes[] = { HASH_CHAINED,
+                                 HASH_CHAINED | HASH_INCREMENTAL,
+                                 HASH_FLAT, HASH_SWISS };
+  static const char *names[] = { "chained", "incremental",
+                                 "flat", "swiss" };
+  Hash          *hash;
+  HashStats     stats;
+  char          **keys;
+  double        *lat;
+  double        t0, t1, total;
+  double        reserve;
+  unsigned int  i;
+  int           m;
+
+  keys = benchKeys("key", count);
+  lat  = (double *) malloc (count * sizeof(double));
+  if (lat == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+
+  for (m = 0; m < 8; m++){
+
+    hash    = hashCreateEngine(10, modes[m % 4]);
+    total   = 0;
+    reserve = 0;
+    if (m >= 4){
+      t0      = benchNow();
+      hashReserve(hash, count);
+      reserve = benchNow() - t0;
+    }
+
+    for (i = 0; i < count; i++){
+      t0 = benchNow();
+      hashAdd(hash, keys[i], keys[i]);
+      t1 = benchNow();
+      lat[i] = (t1 - t0) * 1e9;
+      total += lat[i];
+    }
+
+    qsort(lat, count, sizeof(double), benchCompareDouble);
+    hashStats(hash, &stats);
+
+    printf("growth %-11s %s n=%u mean %.0f ns  p50 %.0f ns  p99 %.0f ns  "
+           "p999 %.0f ns  max %.3f ms  %u rehashes",
+           names[m % 4], (m >= 4) ? "reserved" : "        ", count,
+           total / count,
+           lat[(size_t) (count * 0.50)],
+           lat[(size_t) (count * 0.99)],
+           lat[(size_t) (count * 0.999)],
+           lat[count - 1] / 1e6, stats.rehashes);
+    if (m >= 4)
+      printf(" (reserve %.1f ms)", reserve * 1e3);
+    printf("\n");
+
+    hashDestroy(hash, NULL);
+  }
+
+  free(lat);
+  benchFreeKeys(keys, count);
+
+}
+
+/*
+ * benchArena()
+ * This function compares malloc() and HASH_ARENA tables on
+ * the quadrangle DRG codes and on count synthetic keys.
+ *
+ * INPUT:     count     Number of synthetic keys
+ */
+void benchArena(unsigned int count){
+
+  char          **keys;
+  unsigned int  n;
+
+  keys = benchDrgKeys(datafile, &n);
+  benchArenaRun("drg", keys, n);
+  benchFreeKeys(keys, n);
+
+  keys = benchKeys("key", count);
+  benchArenaRun("synthetic", keys, count);
+  benchFreeKeys(keys, count);
+
+}
+
+/*
+ * benchArenaRun()
+ * This function loads the keys into each engine with and
+ * without HASH_ARENA, reporting the best load and destroy
+ * times of three runs and heap bytes per entry (table, nodes
+ * and key copies).
+ */
+void benchArenaRun(const char *kname, char **keys, unsigned int count){
+
+  static const int   modes[] = { HASH_CHAINED, HASH_CHAINED | HASH_ARENA,
+                                 HASH_FLAT,    HASH_FLAT | HASH_ARENA,
+                                 HASH_SWISS,   HASH_SWISS | HASH_ARENA };
+  static const char *names[] = { "chained", "chained+arena",
+                                 "flat", "flat+arena",
+                                 "swiss", "swiss+arena" };
+  Hash          *hash;
+  double        t0, t1, t2;
+  double        load, destroy;
+  size_t        before, after;
+  unsigned int  i;
+  int           m, r;
+
+  for (m = 0; m < 6; m++){
+
+    load = destroy = 1e9;
+
+    for (r = 0; r < 3; r++){
+      before = benchHeapBytes();
+      t0     = benchNow();
+
+      hash = hashCreateEngine(10, modes[m]);
+      for (i = 0; i < count; i++)
+        hashAdd(hash, keys[i], keys[i]);
+
+      t1    = benchNow();
+      after = benchHeapBytes();
+
+      hashDestroy(hash, NULL);
+      t2 = benchNow();
+
+      if (t1 - t0 < load)
+        load = t1 - t0;
+      if (t2 - t1 < destroy)
+        destroy = t2 - t1;
+    }
+
+    printf("arena %-9s %-13s n=%-9u load %7.1f ns/key  "
+           "destroy %7.2f ms  %6.1f bytes/entry\n",
+           kname, names[m], count, load * 1e9 / count, destroy * 1e3,
+           (double) (after - before) / count);
+  }
+
+}
+
+/*
+ * benchHeapBytes()
+ * This function returns the bytes malloc() has handed out,
+ * or 0 where mallinfo2() isn't available.
+ */
+size_t benchHeapBytes(void){
+
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 mi = mallinfo2();
+
+  return mi.uordblks + mi.hblkhd;
+#else
+  return 0;
+#endif
+
+}
+
+/*
+ * benchConcurrent()
+ * This function preloads count keys and has 1, 2, 4 ... threads
+ * share 4 * count operations, 90% hashGet() hits and 10%
+ * hashAdd() of new keys.  A plain table behind one global
+ * mutex is the baseline for the HASH_CONCURRENT tables.  In
+ * the HASH_NUMA run thread t runs on node t % nodes.
+ *
+ * INPUT:     count     Number of preloaded keys
+ */
+void benchConcurrent(unsigned int count){
+
+  static const int   modes[] = { HASH_SWISS, HASH_CHAINED | HASH_CONCURRENT,
+                                 HASH_FLAT | HASH_CONCURRENT,
+                                 HASH_SWISS | HASH_CONCURRENT,
+                                 HASH_FLAT | HASH_NUMA };
+  static const char *names[] = { "swiss+mutex", "chained+conc",
+                                 "flat+conc", "swiss+conc", "flat+numa" };
+  struct benchThread  th[64];
+  pthread_t           tid[64];
+  pthread_mutex_t     mutex = PTHREAD_MUTEX_INITIALIZER;
+  Hash                *hash;
+  char                **keys;
+  char                **adds;
+  unsigned int        ops = 4 * count;
+  unsigned int        found;
+  unsigned int        i;
+  int                 maxthreads;
+  int                 nthreads;
+  int                 m, t;
+  double              t0, t1;
+
+  maxthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (maxthreads < 4)
+    maxthreads = 4;
+  if (maxthreads > 64)
+    maxthreads = 64;
+
+  keys = benchKeys("key", count);
+  adds = benchKeys("add", ops / 10 + 64);
+
+  for (m = 0; m < 5; m++){
+    for (nthreads = 1; nthreads <= maxthreads; nthreads *= 2){
+
+      hash = hashCreateEngine(count, modes[m]);
+      for (i = 0; i < count; i++)
+        hashAdd(hash, keys[i], keys[i]);
+
+      for (t = 0; t < nthreads; t++){
+        th[t].hash  = hash;
+        th[t].mutex = (modes[m] & HASH_CONCURRENT) ? NULL : &mutex;
+        th[t].keys  = keys;
+        th[t].nkeys = count;
+        th[t].ops   = ops / nthreads;
+        th[t].adds  = adds + (size_t) t * (th[t].ops / 10 + 1);
+        th[t].seed  = 2463534242U + t;
+        th[t].found = 0;
+        th[t].node  = (modes[m] & HASH_NUMA) ? t % hashNumaNodes() : -1;
+      }
+
+      t0 = benchNow();
+      for (t = 0; t < nthreads; t++)
+        pthread_create(&tid[t], NULL, benchMixedThread, &th[t]);
+      found = 0;
+      for (t = 0; t < nthreads; t++){
+        pthread_join(tid[t], NULL);
+        found += th[t].found;
+      }
+      t1 = benchNow();
+
+      printf("concurrent %-13s threads %-3d %6.2f Mops/s  "
+             "found %u  count %u\n",
+             names[m], nthreads, ops / (t1 - t0) / 1e6,
+             found, hashCount(hash));
+
+      hashDestroy(hash, NULL);
+    }
+  }
+
+  benchFreeKeys(keys, count);
+  benchFreeKeys(adds, ops / 10 + 64);
+
+}
+
+/*
+ * benchMixedThread()
+ * Thread body for benchConcurrent(), one add in ten.
+ */
+void *benchMixedThread(void *arg){
+
+  struct benchThread  *th   = (struct benchThread *) arg;
+  unsigned int        x     = th->seed;
+  unsigned int        added = 0;
+  unsigned int        i;
+
+  if (th->node >= 0)
+    hashRunOnNode(th->node);
+
+  for (i = 0; i < th->ops; i++){
+
+    /* xorshift32 */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    if (th->mutex != NULL)
+      pthread_mutex_lock(th->mutex);
+
+    if (x % 10 == 0 && added <= th->ops / 10)
+      hashAdd(th->hash, th->adds[added++], NULL);
+    else
+      th->found += (hashGet(th->hash, th->keys[x % th->nkeys]) != NULL);
+
+    if (th->mutex != NULL)
+      pthread_mutex_unlock(th->mutex);
+  }
+
+  return NULL;
+
+}
+
+/*
+ * benchBatch()
+ * This function loads count keys with hashAddBatch() and looks
+ * them all up in a different random order, once with a loop
+ * over hashGet() and once with hashGetBatch(), then does the
+ * same for count missing keys.  The lookup keys are packed in
+ * order like a request buffer.  Pick count so the table is
+ * well past the last level cache.
+ *
+ * INPUT:     count     Number of keys
+ */
+void benchBatch(unsigned int count){
+
+  Hash          *hash;
+  char          **keys;
+  char          **misses;
+  char          **order;
+  char          **set;
+  char          *block;
+  char          *p;
+  void          **out;
+  double        t0, t1, loop, batch;
+  unsigned int  found;
+  unsigned int  i, j;
+  int           e, pass;
+
+  keys   = benchKeys("key", count);
+  misses = benchKeys("miss", count);
+  order  = (char **) malloc (count * sizeof(char *));
+  out    = (void **) malloc (count * sizeof(void *));
+  block  = (char *) malloc ((size_t) count * 16);
+  if (order == NULL || out == NULL || block == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+
+  for (e = 0; e < NUM_ENGINES; e++){
+
+    hash = hashCreateEngine(10, engines[e]);
+
+    t0 = benchNow();
+    hashAddBatch(hash, keys, count, (void **) keys);
+    t1 = benchNow();
+    printf("batch %-8s n=%u add    %.1f ns/key\n",
+           engineNames[e], count, (t1 - t0) * 1e9 / count);
+
+    for (pass = 0; pass < 2; pass++){
+
+      /* Lookup order unrelated to the insert order */
+      set = pass ? misses : keys;
+      memcpy(order, set, count * sizeof(char *));
+      for (i = count - 1; i > 0; i--){
+        j = (unsigned int) (rand() % (i + 1));
+        set = (char **) order[i];
+        order[i] = order[j];
+        order[j] = (char *) set;
+      }
+      for (i = 0, p = block; i < count; i++){
+        strcpy(p, order[i]);
+        order[i] = p;
+        p += strlen(p) + 1;
+      }
+
+      found = 0;
+      t0 = benchNow();
+      for (i = 0; i < count; i++)
+        found += (hashGet(hash, order[i]) != NULL);
+      t1 = benchNow();
+      loop = t1 - t0;
+
+      t0 = benchNow();
+      hashGetBatch(hash, order, count, out);
+      t1 = benchNow();
+      batch = t1 - t0;
+      for (i = 0; i < count; i++)
+        found -= (out[i] != NULL);
+
+      printf("batch %-8s n=%u %-4s   hashGet %.1f ns/key  "
+             "hashGetBatch %.1f ns/key  speedup %.2fx%s\n",
+             engineNames[e], count, pass ? "miss" : "hit",
+             loop * 1e9 / count, batch * 1e9 / count, loop / batch,
+             found ? "  MISMATCH" : "");
+    }
+
+    hashDestroy(hash, NULL);
+  }
+
+  free(order);
+  free(out);
+  free(block);
+  benchFreeKeys(keys, count);
+  benchFreeKeys(misses, count);
+
+}
+
+/*
+ * benchIngest()
+ * This function times loading the quadrangle file into a
+ * chained table the old way (lineRead(), sscanf() and a
+ * malloc() per record) and with quadOpen()/quadLoad(), first
+ * on the file itself and then on a temporary file holding
+ * count copies of it.  Parse time excludes the hash adds.
+ * Each figure is the best of three runs with the file cached.
+ *
+ * INPUT:     count     Copies of the file in the large run
+ */
+void benchIngest(unsigned int count){
+
+  char          path[] = "/tmp/benchquadXXXXXX";
+  const char    *files[2];
+  double        legacy, mapped, lparse, mparse, t, parse, mb;
+  long          size;
+  int           f, r;
+
+  size = benchReplicate(path, count);
+
+  files[0] = datafile;
+  files[1] = path;
+
+  for (f = 0; f < 2; f++){
+
+    legacy = mapped = lparse = mparse = 1e30;
+    for (r = 0; r < 3; r++){
+      t = benchIngestRun(files[f], 0, &parse);
+      legacy = (t < legacy) ? t : legacy;
+      lparse = (parse < lparse) ? parse : lparse;
+      t = benchIngestRun(files[f], 1, &parse);
+      mapped = (t < mapped) ? t : mapped;
+      mparse = (parse < mparse) ? parse : mparse;
+    }
+
+    mb = size * (f ? (double) count : 1.0) / 1e6;
+    printf("ingest x%-4u %7.1f MB  parse: sscanf %8.1f ms  quadOpen %7.1f ms"
+           "  %5.1fx\n", f ? count : 1, mb, lparse * 1e3, mparse * 1e3,
+           lparse / mparse);
+    printf("ingest x%-4u %7.1f MB  load:  sscanf %8.1f ms  quadOpen %7.1f ms"
+           "  %5.1fx  %.0f MB/s\n", f ? count : 1, mb, legacy * 1e3,
+           mapped * 1e3, legacy / mapped, mb / mapped);
+  }
+
+  unlink(path);
+
+}
+
+/*
+ * benchLoad()
+ * This function times loading count copies of the quadrangle
+ * file into a HASH_CONCURRENT table, parsing with
+ * quadOpenParallel() and adding with quadLoadParallel(), for
+ * 1, 2, 4 ... threads up to twice the online CPUs.  Each
+ * figure is the best of three runs with the file cached.
+ *
+ * INPUT:     count     Copies of the file
+ */
+void benchLoad(unsigned int count){
+
+  char          path[] = "/tmp/benchquadXXXXXX";
+  Hash          *hash;
+  QuadFile      *quad;
+  double        t0, t1, t2, parse, total, mb;
+  long          size;
+  long          ncpu;
+  unsigned int  added = 0;
+  int           nthreads, r;
+
+  size = benchReplicate(path, count);
+  mb   = size * (double) count / 1e6;
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpu < 1)
+    ncpu = 1;
+
+  printf("load %.1f MB, %ld online CPUs\n", mb, ncpu);
+
+  for (nthreads = 1; nthreads <= 2 * ncpu && nthreads <= QUAD_MAX_THREADS;
+       nthreads *= 2){
+
+    parse = total = 1e30;
+    for (r = 0; r < 3; r++){
+      t0   = benchNow();
+      quad = quadOpenParallel(path, nthreads);
+      if (quad == NULL){
+        printf("Cannot open file: %s\n", path);
+        exit(1);
+      }
+      t1   = benchNow();
+      hash = hashCreateEngine(10, HASH_CHAINED | HASH_CONCURRENT |
+                                  HASH_BORROWED);
+      added = quadLoadParallel(hash, quad, nthreads);
+      t2   = benchNow();
+      hashDestroy(hash, NULL);
+      quadClose(quad);
+
+      parse = (t1 - t0 < parse) ? t1 - t0 : parse;
+      total = (t2 - t0 < total) ? t2 - t0 : total;
+    }
+
+    printf("load threads %-3d parse %7.1f ms %7.0f MB/s  "
+           "parse+add %7.1f ms %7.0f MB/s  (%u records)\n",
+           nthreads, parse * 1e3, mb / parse, total * 1e3, mb / total,
+           added);
+  }
+
+  unlink(path);
+
+}
+
+/*
+ * benchSnapshot()
+ * This function compares two ways to get a table of count
+ * keys, each with a 32 byte payload, ready to serve: adding
+ * every key to a new table, and hashOpen() of a snapshot
+ * saved from it.  Both are then timed over a lookup pass of
+ * every key, the snapshot's first pass paying its page faults.
+ * Last the same table is saved with hashSavePerfect() and its
+ * size and warm lookups compared with the bucketed snapshot.
+ *
+ * INPUT:     count     Number of keys
+ */
+void benchSnapshot(unsigned int count){
+
+  char          path[] = "/tmp/benchsnapXXXXXX";
+  Hash          *hash;
+  Hash          *image;
+  char          **keys;
+  char          *payload;
+  void          **data;
+  double        t0, t1, build, open, get, getimg;
+  double        warm[2];
+  off_t         size[2] = { 0, 0 };
+  struct stat   st;
+  unsigned int  found = 0;
+  int           perfect;
+  unsigned int  i;
+  int           fd;
+
+  keys    = benchKeys("key", count);
+  payload = (char *) malloc ((size_t) count * 32);
+  data    = (void **) malloc (count * sizeof(void *));
+  if (payload == NULL || data == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+  for (i = 0; i < count; i++){
+    data[i] = payload + (size_t) i * 32;
+    snprintf((char *) data[i], 32, "%s", keys[i]);
+  }
+
+  t0   = benchNow();
+  hash = hashCreate(10);
+  hashAddBatch(hash, keys, count, data);
+  t1   = benchNow();
+  build = t1 - t0;
+
+  if ((fd = mkstemp(path)) < 0){
+    printf("Cannot create file: %s\n", path);
+    exit(1);
+  }
+  close(fd);
+  t0 = benchNow();
+  if (hashSave(hash, path, 32) != 0){
+    printf("hashSave failed: %s\n", path);
+    exit(1);
+  }
+  t1 = benchNow();
+  printf("snapshot n=%u save   %.1f ms\n", count, (t1 - t0) * 1e3);
+
+  t0    = benchNow();
+  image = hashOpen(path);
+  t1    = benchNow();
+  open  = t1 - t0;
+  if (image == NULL){
+    printf("hashOpen failed: %s\n", path);
+    exit(1);
+  }
+
+  t0 = benchNow();
+  for (i = 0; i < count; i++)
+    found += (hashGet(hash, keys[i]) != NULL);
+  t1  = benchNow();
+  get = t1 - t0;
+
+  t0 = benchNow();
+  for (i = 0; i < count; i++)
+    found -= (strcmp((char *) hashGet(image, keys[i]), keys[i]) == 0);
+  t1     = benchNow();
+  getimg = t1 - t0;
+
+  printf("snapshot n=%u start  rebuild %.1f ms  hashOpen %.3f ms\n",
+         count, build * 1e3, open * 1e3);
+  printf("snapshot n=%u lookup rebuilt %.1f ns/key  snapshot first pass "
+         "%.1f ns/key%s\n", count, get * 1e9 / count, getimg * 1e9 / count,
+         found ? "  MISMATCH" : "");
+
+  for (perfect = 0; perfect < 2; perfect++){
+    if (perfect){
+      hashDestroy(image, NULL);
+      t0 = benchNow();
+      if (hashSavePerfect(hash, path, 32) != 0 ||
+          (image = hashOpen(path)) == NULL){
+        printf("hashSavePerfect failed: %s\n", path);
+        exit(1);
+      }
+      t1 = benchNow();
+      printf("snapshot n=%u save   perfect %.1f ms\n", count,
+             (t1 - t0) * 1e3);
+    }
+    stat(path, &st);
+    size[perfect] = st.st_size;
+
+    /* The perfect snapshot's first pass pays its page faults */
+    if (perfect)
+      for (i = 0; i < count; i++)
+        found += (hashGet(image, keys[i]) == NULL);
+
+    t0 = benchNow();
+    for (i = 0; i < count; i++)
+      found += (hashGet(image, keys[i]) == NULL);
+    t1 = benchNow();
+    warm[perfect] = t1 - t0;
+  }
+
+  printf("snapshot n=%u warm   buckets %.1f ns/key  perfect %.1f ns/key%s\n",
+         count, warm[0] * 1e9 / count, warm[1] * 1e9 / count,
+         found ? "  MISMATCH" : "");
+  printf("snapshot n=%u file   buckets %.1f MB  perfect %.1f MB  "
+         "index %.1f bits/key smaller\n", count, size[0] / 1e6,
+         size[1] / 1e6, (size[0] - size[1]) * 8.0 / count);
+
+  hashDestroy(image, NULL);
+  hashDestroy(hash, NULL);
+  unlink(path);
+  free(data);
+  free(payload);
+  benchFreeKeys(keys, count);
+
+}
+
+/*
+ * benchGrid()
+ * This function builds a grid over the quadrangle corners and
+ * another over count synthetic 7.5 minute boxes tiling a
+ * square, and times point and 1 degree range queries at
+ * random places on each.  For the quadrangles the point
+ * queries are also timed as a walk of every record, the only
+ * way to answer them without an index.
+ *
+ * INPUT:     count     Number of synthetic boxes
+ */
+void benchGrid(unsigned int count){
+
+  Grid          *grid;
+  QuadFile      *quad;
+  double        t0, t1;
+  double        edge = 0.125;
+  unsigned int  side;
+  unsigned int  i;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n", datafile);
+    exit(1);
+  }
+
+  grid = gridCreate(0);
+  t0   = benchNow();
+  quadIndex(grid, quad);
+  t1   = benchNow();
+  printf("grid quads     n=%u build %.1f ms  %u cells\n", quad->count,
+         (t1 - t0) * 1e3, hashCount(grid->cells));
+  benchGridRun("quads", grid, 25, -125, 49, -67, quad);
+  gridDestroy(grid);
+  quadClose(quad);
+
+  for (side = 1; (double) side * side < count; side++)
+    ;
+
+  grid = gridCreate(0);
+  t0   = benchNow();
+  for (i = 0; i < count; i++)
+    gridAdd(grid, (float) ((i / side) * edge), (float) ((i % side) * edge),
+            (float) ((i / side + 1) * edge), (float) ((i % side + 1) * edge),
+            NULL);
+  t1   = benchNow();
+  printf("grid synthetic n=%u build %.1f ms  %u cells\n", count,
+         (t1 - t0) * 1e3, hashCount(grid->cells));
+  benchGridRun("synthetic", grid, 0, 0, side * edge, side * edge, NULL);
+  gridDestroy(grid);
+
+}
+
+/*
+ * benchGridRun()
+ * This function times gridPoint() and 1 by 1 degree
+ * gridRange() queries at random places in a bounding box, and
+ * with quad given, the same points by walking its records.
+ */
+void benchGridRun(const char *name, Grid *grid, double south, double west,
+                  double north, double east, QuadFile *quad){
+
+  struct quadRecord  *rec;
+  void               *out[1024];
+  double             *lat;
+  double             *lon;
+  double             t0, t1;
+  unsigned long      hits;
+  unsigned int       nq = 1000000;
+  unsigned int       nscan = 2000;
+  unsigned int       i, j;
+
+  lat = (double *) malloc (nq * sizeof(double));
+  lon = (double *) malloc (nq * sizeof(double));
+  if (lat == NULL || lon == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+  srand(12345);
+  for (i = 0; i < nq; i++){
+    lat[i] = south + (north - south) * rand() / RAND_MAX;
+    lon[i] = west + (east - west) * rand() / RAND_MAX;
+  }
+
+  hits = 0;
+  t0   = benchNow();
+  for (i = 0; i < nq; i++)
+    hits += gridPoint(grid, lat[i], lon[i], out, 1024);
+  t1   = benchNow();
+  printf("grid %-9s point  %.1f ns/query  %.2f boxes/query\n", name,
+         (t1 - t0) * 1e9 / nq, (double) hits / nq);
+
+  hits = 0;
+  t0   = benchNow();
+  for (i = 0; i < nq / 10; i++)
+    hits += gridRange(grid, lat[i], lon[i], lat[i] + 1, lon[i] + 1, out, 1024);
+  t1   = benchNow();
+  printf("grid %-9s range  %.1f ns/query  %.1f boxes/query\n", name,
+         (t1 - t0) * 1e9 / (nq / 10), (double) hits / (nq / 10));
+
+  if (quad != NULL){
+    hits = 0;
+    t0   = benchNow();
+    for (i = 0; i < nscan; i++)
+      for (j = 0; j < quad->count; j++){
+        rec   = &quad->records[j];
+        hits += (lat[i] >= rec->y1 && lat[i] <= rec->x1 &&
+                 lon[i] >= rec->y2 && lon[i] <= rec->x2);
+      }
+    t1   = benchNow();
+    printf("grid %-9s walk   %.1f ns/query  %.2f boxes/query\n", name,
+           (t1 - t0) * 1e9 / nscan, (double) hits / nscan);
+  }
+
+  free(lat);
+  free(lon);
+
+}
+
+/*
+ * benchScan()
+ * This function loads count synthetic keys into a table of
+ * each engine, and a HASH_LOCKFREE one, then times a full
+ * pass with hashIterNext(), both as ns per entry and as MB/s
+ * of the bucket or slot arrays swept, and one with hashScan()
+ * slices of 1024 buckets.
+ *
+ * INPUT:     count     Number of keys
+ */
+void benchScan(unsigned int count){
+
+  static const int   kinds[] = { HASH_CHAINED, HASH_FLAT, HASH_SWISS,
+                                 HASH_CHAINED | HASH_LOCKFREE };
+  static const char *names[] = { "chained", "flat", "swiss", "lockfree" };
+
+  Hash          *hash;
+  HashIter      it;
+  HashStats     stats;
+  char          **keys;
+  double        t0, t1, t2;
+  uint64_t      cursor;
+  uint64_t      seen;
+  unsigned int  n;
+  unsigned int  e;
+  unsigned int  i;
+
+  keys = benchKeys("scan", count);
+
+  for (e = 0; e < sizeof(kinds) / sizeof(kinds[0]); e++){
+
+    hash = hashCreateEngine(10, kinds[e]);
+    for (i = 0; i < count; i++)
+      hashAdd(hash, keys[i], keys[i]);
+    hashStats(hash, &stats);
+
+    t0 = benchNow();
+    n  = 0;
+    hashIterBegin(hash, &it);
+    while (hashIterNext(&it))
+      n += (it.data == it.key);
+    t1 = benchNow();
+    seen   = 0;
+    cursor = 0;
+    do
+      cursor = hashScan(hash, cursor, 1024, benchScanVisit, &seen);
+    while (cursor != 0);
+    t2 = benchNow();
+    benchSink += n;
+
+    printf("scan %-8s n=%u iter %.2f ns/entry %7.0f MB/s  "
+           "scan %.2f ns/entry  %s\n", names[e], count,
+           (t1 - t0) * 1e9 / count,
+           stats.bucket_bytes / (t1 - t0) / 1e6,
+           (t2 - t1) * 1e9 / count,
+           (seen == count) ? "ok" : "MISSED");
+
+    hashDestroy(hash, NULL);
+  }
+
+  benchFreeKeys(keys, count);
+
+}
+
+/*
+ * benchScanVisit()
+ * hashScan() visitor counting entries into *arg.
+ */
+void benchScanVisit(void *arg, const char *vkey, uint64_t hashval, void *data){
+
+  (void) vkey;
+  (void) hashval;
+  (void) data;
+  (*(uint64_t *) arg)++;
+
+}
+
+/*
+ * benchBulk()
+ * This function builds a table of count synthetic keys per
+ * engine with a hashAdd() loop and with hashBuildBulk() on
+ * one thread and on one per CPU, then times a full visit by
+ * hashScan() against hashForEach(), and hashDestroy() against
+ * hashDestroyParallel(), all in ns per entry.
+ *
+ * INPUT:     count     Number of keys
+ */
+void benchBulk(unsigned int count){
+
+  static const int   kinds[] = { HASH_CHAINED, HASH_CHAINED | HASH_ARENA,
+                                 HASH_FLAT, HASH_SWISS };
+  static const char *names[] = { "chained", "arena", "flat", "swiss" };
+
+  Hash          *hash;
+  char          **keys;
+  double        t0, t1;
+  double        add, destroy;
+  uint64_t      cursor;
+  uint64_t      seen;
+  unsigned int  added;
+  unsigned int  e;
+  unsigned int  i;
+  int           cpus;
+  int           threads[2];
+  int           k;
+
+  cpus       = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  threads[0] = 1;
+  threads[1] = (cpus > 1) ? cpus : 1;
+  keys       = benchKeys("bulk", count);
+
+  for (e = 0; e < sizeof(kinds) / sizeof(kinds[0]); e++){
+
+    hash = hashCreateEngine(10, kinds[e]);
+    t0   = benchNow();
+    for (i = 0; i < count; i++)
+      hashAdd(hash, keys[i], keys[i]);
+    add = benchNow() - t0;
+
+    seen   = 0;
+    cursor = 0;
+    t0     = benchNow();
+    do
+      cursor = hashScan(hash, cursor, 1024, benchScanVisit, &seen);
+    while (cursor != 0);
+    t1 = benchNow();
+
+    printf("bulk %-8s n=%u add %.1f ns/entry  scan %.2f ns/entry",
+           names[e], count, add * 1e9 / count, (t1 - t0) * 1e9 / count);
+
+    t0 = benchNow();
+    hashDestroy(hash, NULL);
+    destroy = benchNow() - t0;
+    printf("  destroy %.1f ns/entry\n", destroy * 1e9 / count);
+
+    for (k = 0; k < 2; k++){
+      if (k > 0 && threads[k] == threads[0])
+        break;
+
+      hash  = hashCreateEngine(10, kinds[e]);
+      t0    = benchNow();
+      added = hashBuildBulk(hash, keys, (void **) keys, count, threads[k]);
+      t1    = benchNow();
+      printf("bulk %-8s %2d thread%s build %.1f ns/entry (%.2fx add)",
+             names[e], threads[k], (threads[k] > 1) ? "s" : " ",
+             (t1 - t0) * 1e9 / count, add / (t1 - t0));
+
+      seen = 0;
+      t0   = benchNow();
+      hashForEach(hash, benchBulkVisit, &seen, threads[k]);
+      t1   = benchNow();
+      printf("  foreach %.2f ns/entry", (t1 - t0) * 1e9 / count);
+
+      t0 = benchNow();
+      hashDestroyParallel(hash, NULL, threads[k]);
+      t1 = benchNow();
+      printf("  destroy %.1f ns/entry  %s\n", (t1 - t0) * 1e9 / count,
+             (added == count && seen == count) ? "ok" : "MISSED");
+    }
+  }
+
+  benchFreeKeys(keys, count);
+
+}
+
+/*
+ * benchBulkVisit()
+ * hashForEach() visitor counting entries into *arg from
+ * several threads.
+ */
+void benchBulkVisit(void *arg, const char *vkey, uint64_t hashval,
+                    void *data){
+
+  (void) vkey;
+  (void) hashval;
+  (void) data;
+  __atomic_fetch_add((uint64_t *) arg, 1, __ATOMIC_RELAXED);
+
+}
+
+/*
+ * benchUpsert()
+ * This function runs a stream of count keys drawn from count/4
+ * distinct ones through each engine, see benchUpsertRun(),
+ * and prints the best of three runs of each way in ns per key
+ * of the stream.
+ *
+ * INPUT:     count     Length of the key stream
+ */
+void benchUpsert(unsigned int count){
+
+  static const char *ways[] = { "get+add", "findorinsert", "upsert",
+                                "get+add", "emplace" };
+
+  char          **keys;
+  unsigned int  *stream;
+  unsigned int  *counts;
+  unsigned int  distinct = (count >= 4) ? count / 4 : 1;
+  unsigned int  found;
+  unsigned int  seen = 0;
+  unsigned int  e;
+  unsigned int  i;
+  uint64_t      total;
+  double        best[5];
+  double        t;
+  int           ok;
+  int           r;
+  int           w;
+
+  keys   = benchKeys("upsert", distinct);
+  stream = (unsigned int *) malloc (count * sizeof(unsigned int));
+  counts = (unsigned int *) malloc (distinct * sizeof(unsigned int));
+  if (stream == NULL || counts == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+
+  srand(count);
+  for (i = 0; i < count; i++)
+    stream[i] = (unsigned int) (((double) rand() / ((double) RAND_MAX + 1)) *
+                                distinct);
+
+  for (e = 0; e < sizeof(engines) / sizeof(engines[0]); e++){
+
+    ok = 1;
+    for (w = 0; w < 5; w++){
+      best[w] = 0;
+      for (r = 0; r < 3; r++){
+        t = benchUpsertRun(engines[e], w, keys, stream, count, counts,
+                           &found, &total);
+        if (best[w] == 0 || t < best[w])
+          best[w] = t;
+        if (w == 0 && r == 0)
+          seen = found;
+        ok &= (found == seen) && (w > 2 || total == count);
+      }
+    }
+
+    printf("upsert %-8s n=%u count: %s %.1f  %s %.1f (%.2fx)  "
+           "%s %.1f (%.2fx)  dedupe: %s %.1f  %s %.1f (%.2fx) ns/key  %s\n",
+           engineNames[e], count,
+           ways[0], best[0] * 1e9 / count,
+           ways[1], best[1] * 1e9 / count, best[0] / best[1],
+           ways[2], best[2] * 1e9 / count, best[0] / best[2],
+           ways[3], best[3] * 1e9 / count,
+           ways[4], best[4] * 1e9 / count, best[3] / best[4],
+           ok ? "ok" : "MISCOUNTED");
+  }
+
+  free(counts);
+  free(stream);
+  benchFreeKeys(keys, distinct);
+
+}
+
+/*
+ * benchUpsertRun()
+ * This function times one way of running the key stream into
+ * a new table and returns the seconds taken.  Counting keeps
+ * a counter per key: 0 does a hashGet() and, the first time,
+ * a hashAdd() of a new counter, 1 one hashFindOrInsert(), 2
+ * one hashUpsert() with a merge adding up the counters.
+ * Deduplicating keeps the first data container per key: 3
+ * does a hashGet() then hashAdd(), 4 one hashEmplace().
+ * Found is set to the keys in the table and total to the
+ * counters added up.
+ */
+double benchUpsertRun(int engine, int way, char **keys,
+                      unsigned int *stream, unsigned int count,
+                      unsigned int *counts, unsigned int *found,
+                      uint64_t *total){
+
+  Hash          *hash = hashCreateEngine(10, engine);
+  unsigned int  *c;
+  unsigned int  next = 0;
+  unsigned int  i;
+  double        t0;
+  double        t1;
+  void          **slot;
+  int           ins;
+
+  t0 = benchNow();
+  switch (way){
+    case 0:
+      for (i = 0; i < count; i++){
+        if ((c = (unsigned int *) hashGet(hash, keys[stream[i]])) != NULL)
+          (*c)++;
+        else {
+          counts[next] = 1;
+          hashAdd(hash, keys[stream[i]], &counts[next++]);
+        }
+      }
+      break;
+    case 1:
+      for (i = 0; i < count; i++){
+        slot = hashFindOrInsert(hash, keys[stream[i]], &ins);
+        if (ins){
+          counts[next] = 0;
+          *slot = &counts[next++];
+        }
+        (*(unsigned int *) *slot)++;
+      }
+      break;
+    case 2:
+      for (i = 0; i < count; i++){
+        counts[next] = 1;
+        if (hashUpsert(hash, keys[stream[i]], &counts[next],
+                       benchUpsertMerge, NULL) == 1)
+          next++;
+      }
+      break;
+    case 3:
+      for (i = 0; i < count; i++)
+        if (hashGet(hash, keys[stream[i]]) == NULL)
+          hashAdd(hash, keys[stream[i]], &stream[i]);
+      break;
+    default:
+      for (i = 0; i < count; i++)
+        hashEmplace(hash, keys[stream[i]], &stream[i], NULL);
+      break;
+  }
+  t1 = benchNow();
+
+  for (i = 0, *total = 0; i < next; i++)
+    *total += counts[i];
+  *found = hashCount(hash);
+  hashDestroy(hash, NULL);
+
+  return t1 - t0;
+
+}
+
+/*
+ * benchUpsertMerge()
+ * hashUpsert() merge for benchUpsert(), adds the new count to
+ * the one stored.
+ */
+void *benchUpsertMerge(void *old, void *data){
+
+  *(unsigned int *) old += *(unsigned int *) data;
+
+  return old;
+
+}
+
+/*
+ * benchReplicate()
+ * This function writes count copies of the quadrangle file to
+ * a new temporary file named from the mkstemp() template in
+ * path, and returns the size of one copy.
+ */
+long benchReplicate(char *path, unsigned int count){
+
+  char          *buf;
+  long          size;
+  unsigned int  i;
+  int           fd;
+  FILE          *fp;
+
+  if ((fp = fopen(datafile, "r")) == NULL){
+    printf("Cannot open file: %s\n", datafile);
+    exit(1);
+  }
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  rewind(fp);
+  buf = (char *) malloc (size);
+  if (buf == NULL || fread(buf, 1, size, fp) != (size_t) size){
+    printf("Cannot read file: %s\n", datafile);
+    exit(1);
+  }
+  fclose(fp);
+
+  if ((fd = mkstemp(path)) < 0 || (fp = fdopen(fd, "w")) == NULL){
+    printf("Cannot create file: %s\n", path);
+    exit(1);
+  }
+  for (i = 0; i < count; i++)
+    fwrite(buf, 1, size, fp);
+  fclose(fp);
+  free(buf);
+
+  return size;
+
+}
+
+/*
+ * benchIngestRun()
+ * This function loads path into a new chained table once and
+ * returns the seconds taken; *parse is set to the part spent
+ * reading and parsing, without hashing.
+ */
+double benchIngestRun(const char *path, int mapped, double *parse){
+
+  Hash          *hash;
+  QuadFile      *quad;
+  void          **records;
+  double        t0, t1, t2;
+  unsigned int  n;
+  unsigned int  i;
+
+  if (mapped){
+    t0   = benchNow();
+    quad = quadOpen(path);
+    if (quad == NULL){
+      printf("Cannot open file: %s\n", path);
+      exit(1);
+    }
+    t1   = benchNow();
+    hash = hashCreateEngine(10, HASH_CHAINED | HASH_BORROWED);
+    quadLoad(hash, quad);
+    t2   = benchNow();
+    hashDestroy(hash, NULL);
+    quadClose(quad);
+  }
+  else {
+    t0   = benchNow();
+    n    = benchLegacyLoad(NULL, path, &records);
+    *parse = benchNow() - t0;
+    for (i = 0; i < n; i++)
+      free(records[i]);
+    free(records);
+
+    /* Parse again, adding as it goes, as main.c did */
+    t0   = benchNow();
+    hash = hashCreate(10);
+    benchLegacyLoad(hash, path, NULL);
+    t2   = benchNow();
+    hashDestroy(hash, free);
+
+    return t2 - t0;
+  }
+
+  *parse = t1 - t0;
+
+  return t2 - t0;
+
+}
+
+/*
+ * benchLegacyLoad()
+ * This function is the loader main.c used before quad.c: a
+ * getc() per byte, sscanf() and a malloc() per record.  With
+ * a NULL hash the records are handed back in *records
+ * instead of being added.
+ */
+unsigned int benchLegacyLoad(Hash *hash, const char *path, void ***records){
+
+  struct legacyQuad {
+    char      quadname[41];
+    char      state[3];
+    char      drgname[9];
+    float     x1,y1,x2,y2;
+  } *data;
+
+  char          line[256];
+  void          **list = NULL;
+  unsigned int  count = 0;
+  unsigned int  size = 0;
+  FILE          *fp;
+
+  if ((fp = fopen(path, "r")) == NULL){
+    printf("Cannot open file: %s\n", path);
+    exit(1);
+  }
+
+  while (lineRead(fp, line, 256) != EOF){
+
+    data = (struct legacyQuad *) malloc (sizeof(struct legacyQuad));
+    if (data == NULL){
+      printf("Error allocating memory, aborting...\n");
+      exit(1);
+    }
+    memset(data, 0, sizeof(struct legacyQuad));
+
+    sscanf(line, "%40c%2s%8s%f%f%f%f", data->quadname, data->state,
+           data->drgname, &data->x1, &data->y1, &data->x2, &data->y2);
+    strTrimTail(data->quadname);
+    strStrip(data->drgname);
+
+    if (hash != NULL)
+      hashAdd(hash, data->drgname, data);
+    else {
+      if (count == size){
+        size = size ? size * 2 : 1024;
+        list = (void **) realloc (list, size * sizeof(void *));
+        if (list == NULL){
+          printf("Error allocating memory, aborting...\n");
+          exit(1);
+        }
+      }
+      list[count] = data;
+    }
+    count++;
+  }
+
+  fclose(fp);
+
+  if (records != NULL)
+    *records = list;
+
+  return count;
+
+}
+
+/*
+ * benchLockFree()
+ * This function runs reader threads over count fixed keys
+ * while a writer thread adds count more keys, growing every
+ * segment through several resizes, then deletes them, over and
+ * over.  Every fixed key must always be found with its own
+ * data.  HASH_CONCURRENT readers queue behind the writer's
+ * segment locks, HASH_LOCKFREE ones don't.
+ *
+ * INPUT:     count     Number of fixed keys
+ */
+void benchLockFree(unsigned int count){
+
+  static const int   modes[] = { HASH_CHAINED | HASH_CONCURRENT,
+                                 HASH_CHAINED | HASH_LOCKFREE };
+  static const char *names[] = { "concurrent", "lockfree" };
+  struct benchThread  th[65];
+  pthread_t           tid[65];
+  Hash                *hash;
+  char                **keys;
+  char                **churn;
+  int                 stop;
+  unsigned int        found, wrong, i;
+  int                 nreaders;
+  int                 m, t;
+  double              t0, t1;
+
+  nreaders = (int) sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  if (nreaders < 2)
+    nreaders = 2;
+  if (nreaders > 64)
+    nreaders = 64;
+
+  keys  = benchKeys("key", count);
+  churn = benchKeys("churn", count);
+
+  for (m = 0; m < 2; m++){
+
+    hash = hashCreateEngine(10, modes[m]);
+    for (i = 0; i < count; i++)
+      hashAdd(hash, keys[i], keys[i]);
+
+    stop = 0;
+    for (t = 0; t <= nreaders; t++){
+      th[t].hash  = hash;
+      th[t].keys  = (t < nreaders) ? keys : churn;
+      th[t].nkeys = count;
+      th[t].ops   = 20 * count;
+      th[t].seed  = 2463534242U + t;
+      th[t].found = 0;
+      th[t].wrong = 0;
+      th[t].stop  = &stop;
+    }
+
+    pthread_create(&tid[nreaders], NULL, benchChurnThread, &th[nreaders]);
+    t0 = benchNow();
+    for (t = 0; t < nreaders; t++)
+      pthread_create(&tid[t], NULL, benchReaderThread, &th[t]);
+    found = wrong = 0;
+    for (t = 0; t < nreaders; t++){
+      pthread_join(tid[t], NULL);
+      found += th[t].found;
+      wrong += th[t].wrong;
+    }
+    t1 = benchNow();
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    pthread_join(tid[nreaders], NULL);
+
+    printf("lockfree %-10s readers %-3d %6.2f Mgets/s  writer %u ops  "
+           "found %u/%u  wrong %u  count %u\n",
+           names[m], nreaders, found / (t1 - t0) / 1e6, th[nreaders].found,
+           found, nreaders * th[0].ops, wrong, hashCount(hash));
+
+    hashDestroy(hash, NULL);
+  }
+
+  benchFreeKeys(keys, count);
+  benchFreeKeys(churn, count);
+
+}
+
+/*
+ * benchReaderThread()
+ * Thread body for benchLockFree(), looks up fixed keys.
+ */
+void *benchReaderThread(void *arg){
+
+  struct benchThread  *th = (struct benchThread *) arg;
+  unsigned int        x   = th->seed;
+  unsigned int        i;
+  char                *key;
+  void                *data;
+
+  for (i = 0; i < th->ops; i++){
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    key  = th->keys[x % th->nkeys];
+    data = hashGet(th->hash, key);
+    if (data == key)
+      th->found++;
+    else
+      th->wrong++;
+  }
+
+  return NULL;
+
+}
+
+/*
+ * benchChurnThread()
+ * Thread body for benchLockFree(), fills and empties the
+ * table with its own keys until told to stop.  found counts
+ * its operations.
+ */
+void *benchChurnThread(void *arg){
+
+  struct benchThread  *th = (struct benchThread *) arg;
+  unsigned int        i;
+
+  while (!__atomic_load_n(th->stop, __ATOMIC_RELAXED)){
+    for (i = 0; i < th->nkeys; i++, th->found++)
+      hashAdd(th->hash, th->keys[i], th->keys[i]);
+    for (i = 0; i < th->nkeys; i++, th->found++)
+      hashDelete(th->hash, th->keys[i], NULL);
+  }
+
+  return NULL;
+
+}
+
+/*
+ * benchCompareDouble()
+ * qsort() comparison for doubles.
+ */
+int benchCompareDouble(const void *a, const void *b){
+
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+
+  return (x > y) - (x < y);
+
+}
+
+
+/* ====================== Utilities ====================== */
+/* ====================== Utilities ====================== */
+
+/*
+ * benchNow()
+ * This function returns a monotonic time stamp in seconds.
+ */
+double benchNow(void){
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
+
+/*
+ * benchKeys()
+ * This function builds count distinct keys of the form
+ * <prefix><number> in shuffled order so lookups do not follow
+ * insertion order.  The strings are packed back to back in one
+ * block, in array order, so walking the key array does not
+ * itself miss the cache.
+ */
+char **benchKeys(const char *prefix, unsigned int count){
+
+  char          **keys;
+  char          *block;
+  unsigned int  *order;
+  unsigned int  i;
+  unsigned int  j;
+  unsigned int  tmp;
+  size_t        len = strlen(prefix) + 11;
+
+  keys  = (char **) malloc ((count + 1) * sizeof(char *));
+  block = (char *) malloc (count * len + 1);
+  order = (unsigned int *) malloc ((count + 1) * sizeof(unsigned int));
+  if (keys == NULL || block == NULL || order == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+
+  for (i = 0; i < count; i++)
+    order[i] = i;
+
+  srand(count);
+  for (i = count; i > 1; i--){
+    j = (unsigned int) (((double) rand() / ((double) RAND_MAX + 1)) * i);
+    tmp = order[i - 1];  order[i - 1] = order[j];  order[j] = tmp;
+  }
+
+  for (i = 0; i < count; i++){
+    keys[i] = block;
+    block  += sprintf(block, "%s%u", prefix, order[i]) + 1;
+  }
+
+  free(order);
+
+  return keys;
+
+}
+
+/*
+ * benchDrgKeys()
+ * This function reads the DRG codes out of the quadrangle
+ * file, keeping only alphanumerics the way strStrip() does in
+ * main.c.  Keys are packed in one block like benchKeys() ones.
+ */
+char **benchDrgKeys(const char *datafile, unsigned int *count){
+
+  char          line[256];
+  char          drg[16];
+  char          **keys;
+  char          *block;
+  char          *p, *q;
+  unsigned int  n = 0;
+  unsigned int  i;
+  unsigned int  size = 16384;
+  FILE          *fp;
+
+  if ((fp = fopen(datafile, "r")) == NULL){
+    printf("Cannot open file: %s\n", datafile);
+    exit(1);
+  }
+
+  block = (char *) malloc (size * sizeof(drg));
+
+  while (fgets(line, sizeof(line), fp) != NULL){
+
+    if (strlen(line) < 44 || sscanf(line + 44, "%15s", drg) != 1)
+      continue;
+
+    if (n == size){
+      size *= 2;
+      block = (char *) realloc (block, size * sizeof(drg));
+    }
+    if (block == NULL){
+      printf("Error allocating memory, aborting...\n");
+      exit(1);
+    }
+
+    q = block + (size_t) n * sizeof(drg);
+    for (p = drg; *p; p++)
+      if (isalnum((unsigned char) *p))
+        *q++ = *p;
+    *q = '\0';
+    n++;
+  }
+  fclose(fp);
+
+  keys = (char **) malloc ((n + 1) * sizeof(char *));
+  if (keys == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+  for (i = 0; i < n; i++)
+    keys[i] = block + (size_t) i * sizeof(drg);
+
+  *count = n;
+
+  return keys;
+
+}
+
+/*
+ * benchFreeKeys()
+ * This function frees a key array from benchKeys().
+ */
+void benchFreeKeys(char **keys, unsigned int count){
+
+  if (count > 0)
+    free(keys[0]);
+  free(keys);
+
+}
+
+/*
+ * benchUsage()
+ * This function lists the workloads.
+ */
+void benchUsage(void){
+
+  struct benchWorkload *w;
+
+  printf("Usage: bench <workload> [count]\n");
+  for (w = workloads; w->name != NULL; w++)
+    printf("  %-12s %s (default %u)\n", w->name, w->help, w->defcount);
+
+}
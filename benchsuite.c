@@ -0,0 +1,476 @@
+/*
+ * benchsuite.c
+ * The "suite" workload of the benchmark driver: a fixed set of
+ * cases run on every engine, written to stdout as one JSON
+ * document that later runs can be diffed against.
+ *
+ *   bench suite [count] > bench.json
+ *
+ * Key sets are the DRG codes of data/63360.lst and synthetic
+ * keys at 10^4, 10^5 ... up to count, so "bench suite
+ * 100000000" reaches 100M.  For each key set and engine:
+ *
+ *   growth    count hashAdd()s into a table created at the
+ *             bottom of the sizes[] ladder
+ *   insert    the same into a table presized for count keys
+ *   hit       hashGet() of every key
+ *   miss      hashGet() of as many absent keys
+ *   zipf      90% hashGet(), 10% hashDelete() or hashAdd() of
+ *             keys drawn from a Zipf distribution (theta 0.99)
+ *   churn     hashDelete() of every key, each followed by
+ *             hashAdd() of a new one
+ *
+ * growth and insert time every operation on its own, so their
+ * latency percentiles are of single operations and show the
+ * occasional resize.  Each includes one clock read, whose cost
+ * is given as clock_ns in the context.  The other cases are
+ * timed in batches of BENCH_BATCH, so one clock read is spread
+ * over the batch, and their percentiles are of the per batch
+ * mean; each result gives its batch size.  Every random choice
+ * comes from a fixed seed so two runs do the same operations
+ * in the same order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "hash.h"
+
+/* Operations per clock read */
+#define BENCH_BATCH   16
+
+/* Skew of the zipf workload, as in YCSB */
+#define BENCH_THETA   0.99
+
+/* Seed of the zipf draws */
+#define BENCH_SEED    0x5EEDULL
+
+/* Smallest synthetic key set */
+#define BENCH_MIN_KEYS  10000
+
+/* One key set on one engine */
+struct benchSuite {
+  Hash           *hash;
+  char           **keys;
+  char           **misses;
+  unsigned int   n;
+  uint32_t       *draws;      /* zipf: key index of each operation */
+  unsigned char  *present;    /* zipf: key i is in the table */
+  unsigned int   found;
+  double         *lat;        /* ns per operation of each batch */
+  unsigned int   batch;       /* Operations per clock read */
+  const char     *kname;
+  const char     *ename;
+  int            count;       /* Results written so far */
+};
+
+/* One timed operation, returns 1 for a lookup that found its key */
+typedef unsigned int (*BenchOp)(struct benchSuite *s, unsigned int i);
+
+/* Function Prototypes */
+double benchNow(void);
+char **benchKeys(const char *prefix, unsigned int count);
+char **benchDrgKeys(const char *datafile, unsigned int *count);
+void benchFreeKeys(char **keys, unsigned int count);
+size_t benchHeapBytes(void);
+int benchCompareDouble(const void *a, const void *b);
+void benchSuite(unsigned int count);
+void benchSuiteKeys(struct benchSuite *s, const char *kname,
+                    char **keys, char **misses, unsigned int n);
+double benchSuiteTime(struct benchSuite *s, BenchOp op, unsigned int ops,
+                      unsigned int batch);
+double benchSuiteClock(void);
+void benchSuiteResult(struct benchSuite *s, const char *workload,
+                      unsigned int ops, double secs, double bytes);
+uint32_t *benchZipf(unsigned int n, unsigned int ops, uint64_t seed);
+double benchRandom(uint64_t *state);
+unsigned int benchOpAdd(struct benchSuite *s, unsigned int i);
+unsigned int benchOpHit(struct benchSuite *s, unsigned int i);
+unsigned int benchOpMiss(struct benchSuite *s, unsigned int i);
+unsigned int benchOpZipf(struct benchSuite *s, unsigned int i);
+unsigned int benchOpChurn(struct benchSuite *s, unsigned int i);
+
+/* USGS quadrangle file */
+static const char  suiteDatafile[] = "data/63360.lst";
+
+static const int   suiteEngines[] = { HASH_CHAINED, HASH_FLAT, HASH_SWISS };
+static const char *suiteNames[]   = { "chained", "flat", "swiss" };
+#define SUITE_ENGINES  ((int) (sizeof(suiteEngines) / sizeof(suiteEngines[0])))
+
+
+/* ===================== benchSuite() ==================== */
+/* ===================== benchSuite() ==================== */
+
+/*
+ * benchSuite()
+ * This function runs every case on the DRG codes and on each
+ * synthetic key set up to count keys, and prints the JSON
+ * document.
+ *
+ * INPUT:     count     Largest synthetic key set
+ */
+void benchSuite(unsigned int count){
+
+  struct benchSuite s;
+  char              host[64];
+  char              date[32];
+  char              **keys;
+  char              **misses;
+  unsigned int      n;
+  time_t            now;
+
+  memset(&s, 0, sizeof(s));
+
+  now = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+  if (gethostname(host, sizeof(host)) != 0)
+    strcpy(host, "unknown");
+  host[sizeof(host) - 1] = '\0';
+
+  printf("{\n");
+  printf("  \"context\": {\n");
+  printf("    \"date\": \"%s\",\n", date);
+  printf("    \"host_name\": \"%s\",\n", host);
+  printf("    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+  printf("    \"max_keys\": %u,\n", count);
+  printf("    \"batch\": %d,\n", BENCH_BATCH);
+  printf("    \"clock_ns\": %.1f,\n", benchSuiteClock());
+  printf("    \"zipf_theta\": %.2f,\n", BENCH_THETA);
+  printf("    \"seed\": %llu\n", (unsigned long long) BENCH_SEED);
+  printf("  },\n");
+  printf("  \"benchmarks\": [");
+
+  keys   = benchDrgKeys(suiteDatafile, &n);
+  misses = benchKeys("miss", n);
+  benchSuiteKeys(&s, "drg", keys, misses, n);
+  benchFreeKeys(keys, n);
+  benchFreeKeys(misses, n);
+
+  for (n = BENCH_MIN_KEYS; count > 0; n *= 10){
+    if (n > count)
+      n = count;
+    keys   = benchKeys("key", n);
+    misses = benchKeys("miss", n);
+    benchSuiteKeys(&s, "synthetic", keys, misses, n);
+    benchFreeKeys(keys, n);
+    benchFreeKeys(misses, n);
+    if (n == count || n > UINT32_MAX / 10)
+      break;
+  }
+
+  printf("\n  ]\n}\n");
+
+}
+
+
+/*
+ * benchSuiteKeys()
+ * This function runs every case on every engine for one key
+ * set.  Tables are reloaded for the cases that change them.
+ */
+void benchSuiteKeys(struct benchSuite *s, const char *kname,
+                    char **keys, char **misses, unsigned int n){
+
+  size_t        before;
+  double        secs;
+  unsigned int  i;
+  int           e;
+
+  s->keys    = keys;
+  s->misses  = misses;
+  s->n       = n;
+  s->kname   = kname;
+  s->lat     = (double *) malloc ((n + 2 * n / BENCH_BATCH + 2) *
+                                  sizeof(double));
+  s->present = (unsigned char *) malloc (n + 1);
+  s->draws   = benchZipf(n, n, BENCH_SEED);
+  if (s->lat == NULL || s->present == NULL){
+    fprintf(stderr, "Error allocating memory, aborting...\n");
+    exit(1);
+  }
+
+  for (e = 0; e < SUITE_ENGINES; e++){
+
+    s->ename = suiteNames[e];
+
+    /* Grow from the bottom of sizes[] */
+    before  = benchHeapBytes();
+    s->hash = hashCreateEngine(10, suiteEngines[e]);
+    secs    = benchSuiteTime(s, benchOpAdd, n, 1);
+    benchSuiteResult(s, "growth", n, secs,
+                     (double) (benchHeapBytes() - before) / n);
+    hashDestroy(s->hash, NULL);
+
+    /* Presized, then read and mutate the same table */
+    before  = benchHeapBytes();
+    s->hash = hashCreateEngine(2 * n, suiteEngines[e]);
+    secs    = benchSuiteTime(s, benchOpAdd, n, 1);
+    benchSuiteResult(s, "insert", n, secs,
+                     (double) (benchHeapBytes() - before) / n);
+
+    secs = benchSuiteTime(s, benchOpHit, n, BENCH_BATCH);
+    benchSuiteResult(s, "hit", n, secs, 0);
+
+    secs = benchSuiteTime(s, benchOpMiss, n, BENCH_BATCH);
+    benchSuiteResult(s, "miss", n, secs, 0);
+
+    for (i = 0; i < n; i++)
+      s->present[i] = 1;
+    secs = benchSuiteTime(s, benchOpZipf, n, BENCH_BATCH);
+    benchSuiteResult(s, "zipf", n, secs, 0);
+
+    /* Put back what zipf deleted, so churn starts full */
+    for (i = 0; i < n; i++)
+      if (!s->present[i])
+        hashAdd(s->hash, keys[i], keys[i]);
+    secs = benchSuiteTime(s, benchOpChurn, 2 * n, BENCH_BATCH);
+    benchSuiteResult(s, "churn", 2 * n, secs, 0);
+
+    hashDestroy(s->hash, NULL);
+  }
+
+  free(s->lat);
+  free(s->present);
+  free(s->draws);
+
+}
+
+
+/*
+ * benchSuiteTime()
+ * This function runs op for i = 0 .. ops-1 in batches of
+ * batch, keeping the ns per operation of each batch in
+ * s->lat.  A batch of 1 times single operations.
+ *
+ * RETURNS:   double    Seconds spent in op
+ */
+double benchSuiteTime(struct benchSuite *s, BenchOp op, unsigned int ops,
+                      unsigned int batch){
+
+  double        t0, t1;
+  double        total = 0;
+  unsigned int  i, j, end;
+
+  s->found = 0;
+  s->batch = batch;
+
+  for (i = 0; i < ops; i = end){
+    end = (ops - i > batch) ? i + batch : ops;
+    t0  = benchNow();
+    for (j = i; j < end; j++)
+      s->found += op(s, j);
+    t1  = benchNow();
+    total += t1 - t0;
+    s->lat[i / batch] = (t1 - t0) * 1e9 / (end - i);
+  }
+
+  return total;
+
+}
+
+
+/*
+ * benchSuiteResult()
+ * This function prints one result object, sorting s->lat for
+ * the percentiles, which are of single operations when
+ * s->batch is 1 and of batch means otherwise.
+ *
+ * INPUT:     s         Key set, engine and batch latencies
+ *            workload  Case name
+ *            ops       Operations timed
+ *            secs      Their total time
+ *            bytes     Heap bytes per entry, 0 to leave out
+ */
+void benchSuiteResult(struct benchSuite *s, const char *workload,
+                      unsigned int ops, double secs, double bytes){
+
+  unsigned int nlat = (ops + s->batch - 1) / s->batch;
+  double       *lat = s->lat;
+
+  if (ops == 0 || secs <= 0)
+    return;
+
+  qsort(lat, nlat, sizeof(double), benchCompareDouble);
+
+  printf("%s\n    {\n", (s->count++ > 0) ? "," : "");
+  printf("      \"name\": \"%s/%s/%s/%u\",\n",
+         workload, s->ename, s->kname, s->n);
+  printf("      \"workload\": \"%s\",\n", workload);
+  printf("      \"engine\": \"%s\",\n", s->ename);
+  printf("      \"keys\": \"%s\",\n", s->kname);
+  printf("      \"n\": %u,\n", s->n);
+  printf("      \"iterations\": %u,\n", ops);
+  printf("      \"ns_per_op\": %.2f,\n", secs * 1e9 / ops);
+  printf("      \"ops_per_sec\": %.0f,\n", ops / secs);
+  if (bytes > 0)
+    printf("      \"bytes_per_entry\": %.1f,\n", bytes);
+  printf("      \"found\": %u,\n", s->found);
+  printf("      \"batch\": %u,\n", s->batch);
+  printf("      \"p50_ns\": %.1f,\n", lat[(size_t) (nlat * 0.50)]);
+  printf("      \"p90_ns\": %.1f,\n", lat[(size_t) (nlat * 0.90)]);
+  printf("      \"p99_ns\": %.1f,\n", lat[(size_t) (nlat * 0.99)]);
+  printf("      \"p999_ns\": %.1f,\n", lat[(size_t) (nlat * 0.999)]);
+  printf("      \"max_ns\": %.1f\n", lat[nlat - 1]);
+  printf("    }");
+  fflush(stdout);
+
+}
+
+
+/* ==================== Operations ======================= */
+/* ==================== Operations ======================= */
+
+unsigned int benchOpAdd(struct benchSuite *s, unsigned int i){
+
+  hashAdd(s->hash, s->keys[i], s->keys[i]);
+  return 0;
+
+}
+
+unsigned int benchOpHit(struct benchSuite *s, unsigned int i){
+
+  return hashGet(s->hash, s->keys[i]) != NULL;
+
+}
+
+unsigned int benchOpMiss(struct benchSuite *s, unsigned int i){
+
+  return hashGet(s->hash, s->misses[i]) != NULL;
+
+}
+
+/*
+ * benchOpZipf()
+ * Every tenth operation deletes its key if present and adds
+ * it back if not; the rest look it up.
+ */
+unsigned int benchOpZipf(struct benchSuite *s, unsigned int i){
+
+  uint32_t k = s->draws[i];
+
+  if (i % 10 != 9)
+    return hashGet(s->hash, s->keys[k]) != NULL;
+
+  if (s->present[k])
+    hashDelete(s->hash, s->keys[k], NULL);
+  else
+    hashAdd(s->hash, s->keys[k], s->keys[k]);
+  s->present[k] = !s->present[k];
+
+  return 0;
+
+}
+
+/*
+ * benchOpChurn()
+ * Even operations delete key i / 2, odd ones add the miss key
+ * of the same index, so the table stays at n entries.
+ */
+unsigned int benchOpChurn(struct benchSuite *s, unsigned int i){
+
+  if (i & 1)
+    hashAdd(s->hash, s->misses[i / 2], s->misses[i / 2]);
+  else
+    hashDelete(s->hash, s->keys[i / 2], NULL);
+
+  return 0;
+
+}
+
+
+/* ====================== Utilities ====================== */
+/* ====================== Utilities ====================== */
+
+/*
+ * benchSuiteClock()
+ * This function returns the least time between two clock
+ * reads, in ns, which every single operation timing carries.
+ */
+double benchSuiteClock(void){
+
+  double        t0, t1;
+  double        least = 1e9;
+  unsigned int  i;
+
+  for (i = 0; i < 1000; i++){
+    t0 = benchNow();
+    t1 = benchNow();
+    if ((t1 - t0) * 1e9 < least)
+      least = (t1 - t0) * 1e9;
+  }
+
+  return least;
+
+}
+
+/*
+ * benchZipf()
+ * This function draws ops key indexes in 0..n-1 from a Zipf
+ * distribution, with the generator of Gray et al. "Quickly
+ * generating billion-record synthetic databases" as used by
+ * YCSB.  Rank r is then scattered to index r * P mod n, P a
+ * prime above any n, so the hot keys are not the ones loaded
+ * first.
+ *
+ * INPUT:     n         Number of keys
+ *            ops       Number of draws
+ *            seed      benchRandom() seed
+ * RETURNS:   uint32_t  malloc()ed array of ops indexes
+ */
+uint32_t *benchZipf(unsigned int n, unsigned int ops, uint64_t seed){
+
+  uint32_t      *draws;
+  uint64_t      state = seed;
+  double        zetan = 0, zeta2, alpha, eta, u, uz;
+  uint64_t      rank;
+  unsigned int  i;
+
+  draws = (uint32_t *) malloc ((ops + 1) * sizeof(uint32_t));
+  if (draws == NULL){
+    fprintf(stderr, "Error allocating memory, aborting...\n");
+    exit(1);
+  }
+
+  for (i = 1; i <= n; i++)
+    zetan += 1.0 / pow((double) i, BENCH_THETA);
+  zeta2 = 1.0 + 1.0 / pow(2.0, BENCH_THETA);
+  alpha = 1.0 / (1.0 - BENCH_THETA);
+  eta   = (1.0 - pow(2.0 / n, 1.0 - BENCH_THETA)) / (1.0 - zeta2 / zetan);
+
+  for (i = 0; i < ops; i++){
+    u  = benchRandom(&state);
+    uz = u * zetan;
+    if (uz < 1.0)
+      rank = 0;
+    else if (uz < zeta2)
+      rank = 1;
+    else
+      rank = (uint64_t) (n * pow(eta * u - eta + 1.0, alpha));
+    if (rank >= n)
+      rank = n - 1;
+    draws[i] = (uint32_t) ((rank * 4294967311ULL) % n);
+  }
+
+  return draws;
+
+}
+
+/*
+ * benchRandom()
+ * This function returns a double in [0, 1) from a splitmix64
+ * sequence.
+ */
+double benchRandom(uint64_t *state){
+
+  uint64_t x = (*state += 0x9E3779B97F4A7C15ULL);
+
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+
+  return (x >> 11) * (1.0 / 9007199254740992.0);
+
+}
@@ -0,0 +1,108 @@
+/*
+ * benchtable.cc
+ * hash::Table workload for the benchmark driver, the only
+ * C++ part of it.  bench.c calls benchTemplate() through the
+ * prototype in its function list.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "hash.hpp"
+#include "quad.h"
+
+extern "C" {
+double benchNow(void);
+char **benchKeys(const char *prefix, unsigned int count);
+void benchFreeKeys(char **keys, unsigned int count);
+void benchTemplate(unsigned int count);
+}
+
+/* Keeps timed results live */
+static volatile double benchTableSink;
+
+
+/* ==================== benchTemplate() ================== */
+/* ==================== benchTemplate() ================== */
+
+/*
+ * benchTemplate()
+ * This function loads count quadData records keyed by
+ * synthetic names twice: into a HASH_FLAT table holding a
+ * pointer to each record, and into a
+ * hash::Table<std::string, quadData> holding the keys and
+ * records themselves.  Both are timed over the load and over
+ * a lookup pass that reads a field of every record; the
+ * Table is searched with the char * keys directly.  Last, a
+ * full scan of each, hash::entries() over the C table and
+ * forEach() over the Table, is timed.
+ *
+ * INPUT:     count     Number of keys
+ */
+void benchTemplate(unsigned int count){
+
+  Hash                                *hash;
+  hash::Table<std::string, quadData>  table;
+  struct quadData                     *records;
+  struct quadData                     rec = {};
+  char                                **keys;
+  double                              t0, t1, t2;
+  double                              sum;
+  unsigned int                        i;
+
+  keys    = benchKeys("quad", count);
+  records = (struct quadData *) malloc ((count + 1) * sizeof(struct quadData));
+  if (records == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+
+  t0   = benchNow();
+  hash = hashCreateEngine(10, HASH_FLAT);
+  for (i = 0; i < count; i++){
+    records[i]    = rec;
+    records[i].x1 = (float) i;
+    hashAdd(hash, keys[i], &records[i]);
+  }
+  t1 = benchNow();
+  for (i = 0, sum = 0; i < count; i++)
+    sum += ((struct quadData *) hashGet(hash, keys[i]))->x1;
+  t2 = benchNow();
+  benchTableSink = sum;
+
+  printf("template n=%u flat  void *     add %.1f ns/key  get %.1f ns/key\n",
+         count, (t1 - t0) * 1e9 / count, (t2 - t1) * 1e9 / count);
+
+  t0 = benchNow();
+  for (i = 0; i < count; i++){
+    rec.x1 = (float) i;
+    table.emplace(keys[i], rec);
+  }
+  t1 = benchNow();
+  for (i = 0, sum = 0; i < count; i++)
+    sum += table.find(keys[i])->x1;
+  t2 = benchNow();
+  benchTableSink += sum;
+
+  printf("template n=%u Table quadData  add %.1f ns/key  get %.1f ns/key\n",
+         count, (t1 - t0) * 1e9 / count, (t2 - t1) * 1e9 / count);
+
+  t0 = benchNow();
+  sum = 0;
+  for (const HashIter &e : hash::entries(hash))
+    sum += ((struct quadData *) e.data)->x1;
+  t1 = benchNow();
+  table.forEach([&sum](const std::string &, const quadData &q){
+    sum += q.x1;
+  });
+  t2 = benchNow();
+  benchTableSink += sum;
+
+  printf("template n=%u scan  entries %.1f ns/key  forEach %.1f ns/key\n",
+         count, (t1 - t0) * 1e9 / count, (t2 - t1) * 1e9 / count);
+
+  hashDestroy(hash, NULL);
+  free(records);
+  benchFreeKeys(keys, count);
+
+}
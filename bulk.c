@@ -0,0 +1,766 @@
+/*
+ * bulk.c
+ * Parallel bulk operations for the Hash ADT.
+ *
+ * hashBuildBulk() loads an empty table from arrays of keys and
+ * data containers.  The table is sized for all of them first,
+ * so it never resizes on the way.  Then threads hash the keys,
+ * each over its own share of the arrays, build the nodes or
+ * open addressing entries, and count how many fall in each of
+ * BULK_PARTS runs of buckets or slots.  A prefix sum of the
+ * counts gives each thread where its nodes go in one array
+ * ordered by run, the radix partition, which the threads then
+ * fill without locks.  Last, threads take runs one at a time
+ * and put their nodes in the table, reading the run array
+ * straight through.  No two
+ * runs share a bucket or slot, so no locks are needed there
+ * either, and each run's buckets are written while they are
+ * in cache.
+ *
+ * Open addressing entries may probe past the end of their run.
+ * flatPlace() and swissPlace() stop at the run's end and hand
+ * such an entry back, and it is placed once the threads are
+ * done.  Keys of a HASH_ARENA table go to an arena per thread,
+ * adopted by the table's arenas afterwards.
+ *
+ * hashForEach() and hashDestroyParallel() cut a table into
+ * runs of hash values, buckets or segments in the same way.
+ * Threads take runs off a shared counter, so a slow run does
+ * not hold up the rest.
+ *
+ * The calling thread always works too.  The threads only live
+ * for one call; should one fail to start, its share is done by
+ * the caller afterwards.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "hash.h"
+#include "hashpriv.h"
+
+/* Runs the table is cut into, a power of two */
+#define BULK_PARTS       1024
+
+/* Fewer entries than this are not worth starting threads for */
+#define BULK_MIN_COUNT   16384
+
+/* One call's shared state */
+struct bulkJob {
+  Hash              *hash;
+  char              **keys;
+  void              **values;
+  unsigned int      n;
+  uint64_t          *hashes;    /* hashKeyValue() of each key */
+  struct HashNode   **nodes;    /* Chained, built nodes */
+  struct HashNode   **runNodes; /*   and the same by run */
+  struct HashEntry  *entries;   /* Open addressing, built entries */
+  struct HashEntry  *runEntries;/*   and the same by run */
+  unsigned int      *start;     /* First of each run in the above */
+  unsigned int      claim;      /* Next run to take */
+  unsigned int      parts;      /* Runs */
+  HashVisit         visit;
+  void              *arg;
+  void              (*destructor)(void *data);
+};
+
+/* One thread's share */
+struct bulkChunk {
+  struct bulkJob    *job;
+  Hash              local;      /* hash with this thread's arenas */
+  unsigned int      first;      /* Share of the key arrays */
+  unsigned int      count;
+  unsigned int      added;
+  unsigned int      failed;
+  struct HashEntry  *spill;     /* Entries that left their run */
+  unsigned int      nspill;
+  unsigned int      spill_size;
+  unsigned int      hist[BULK_PARTS];
+};
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+int bulkThreads(int nthreads, unsigned int n);
+
+static
+void bulkRun(struct bulkChunk *chunks, int nthreads,
+             void *(*worker)(void *arg));
+
+static
+unsigned int bulkPart(Hash *hash, uint64_t hashval);
+
+static
+unsigned int bulkPartEnd(Hash *hash, unsigned int part);
+
+static
+unsigned int bulkSerial(Hash *hash, char **keys, void **values,
+                        unsigned int n, int nthreads);
+
+static
+void *bulkHashWorker(void *arg);
+
+static
+void *bulkScatterWorker(void *arg);
+
+static
+void *bulkLinkWorker(void *arg);
+
+static
+void *bulkPlaceWorker(void *arg);
+
+static
+void *bulkAddWorker(void *arg);
+
+static
+void *bulkVisitWorker(void *arg);
+
+static
+void *bulkReleaseWorker(void *arg);
+
+static
+int bulkSpill(struct bulkChunk *chunk, struct HashEntry *entry);
+
+static
+void bulkFreeJob(struct bulkJob *job);
+
+
+/* ==================== hashBuildBulk() ====================== */
+/* ==================== hashBuildBulk() ====================== */
+
+/*
+ * hashBuildBulk()
+ * This function adds n key/data pairs to an empty table,
+ * sized once for all of them and filled by nthreads threads,
+ * see the top of this file.  The table holds what n hashAdd()
+ * calls would have added, duplicate keys included, though
+ * only a chained table is sure to find the later of two
+ * equal keys.  A HASH_CONCURRENT table is loaded by the
+ * threads with hashAdd() under its segment locks, and a table
+ * that is not empty, or a small load, by the caller alone.
+ *
+ * INPUT:     hash        Empty hash table
+ *            keys        Keys
+ *            values      Data container of each key
+ *            n           Number of keys
+ *            nthreads    Number of threads, the caller's
+ *                        included, 0 for one per CPU
+ * RETURNS:   unsigned    Number of pairs added, less than n
+ *                        if memory ran out
+ */
+unsigned int hashBuildBulk(Hash *hash, char **keys, void **values,
+                           unsigned int n, int nthreads){
+
+  struct bulkJob    job;
+  struct bulkChunk  *chunks;
+  unsigned int      sum;
+  unsigned int      added = 0;
+  unsigned int      p, k;
+  int               open;
+  int               t;
+
+  nthreads = bulkThreads(nthreads, n);
+
+  if (hash->count != 0 || (hash->flags & HASH_CONCURRENT) ||
+      hash->engine == HASH_IMAGE || n < BULK_MIN_COUNT)
+    return bulkSerial(hash, keys, values, n, nthreads);
+
+  if (hashReserve(hash, n) != 0)
+    return 0;
+
+  open = (hash->engine == HASH_FLAT || hash->engine == HASH_SWISS);
+
+  memset(&job, 0, sizeof(job));
+  job.hash    = hash;
+  job.keys    = keys;
+  job.values  = values;
+  job.n       = n;
+  job.parts   = BULK_PARTS;
+  job.hashes  = (uint64_t *) malloc (n * sizeof(uint64_t));
+  job.start   = (unsigned int *) malloc ((BULK_PARTS + 1) *
+                                         sizeof(unsigned int));
+  if (open){
+    job.entries    = (struct HashEntry *)
+                     malloc (n * sizeof(struct HashEntry));
+    job.runEntries = (struct HashEntry *)
+                     malloc (n * sizeof(struct HashEntry));
+  }
+  else {
+    job.nodes    = (struct HashNode **) malloc (n * sizeof(void *));
+    job.runNodes = (struct HashNode **) malloc (n * sizeof(void *));
+  }
+  chunks      = (struct bulkChunk *) calloc (nthreads,
+                                             sizeof(struct bulkChunk));
+
+  if (job.hashes == NULL || job.start == NULL || chunks == NULL ||
+      (open && (job.entries == NULL || job.runEntries == NULL)) ||
+      (!open && (job.nodes == NULL || job.runNodes == NULL))){
+    bulkFreeJob(&job);
+    free(chunks);
+    return 0;
+  }
+
+  /* Threads past the first copy keys into arenas of their own */
+  for (t = 0; t < nthreads; t++){
+    chunks[t].local = *hash;
+    if (t > 0 && hash->keyArena != NULL)
+      chunks[t].local.keyArena = arenaCreate(0);
+    if (t > 0 && hash->nodeArena != NULL)
+      chunks[t].local.nodeArena = arenaCreate(sizeof(struct HashNode));
+    if ((hash->keyArena != NULL && chunks[t].local.keyArena == NULL) ||
+        (hash->nodeArena != NULL && chunks[t].local.nodeArena == NULL)){
+      for (; t > 0; t--){
+        arenaDestroy(chunks[t].local.keyArena);
+        arenaDestroy(chunks[t].local.nodeArena);
+      }
+      nthreads = 1;
+      break;
+    }
+  }
+
+  for (t = 0; t < nthreads; t++){
+    chunks[t].job   = &job;
+    chunks[t].first = (unsigned int) ((uint64_t) n * t / nthreads);
+    chunks[t].count = (unsigned int) ((uint64_t) n * (t + 1) / nthreads) -
+                      chunks[t].first;
+  }
+
+  bulkRun(chunks, nthreads, bulkHashWorker);
+
+  /* Runs in order, and within a run the threads in order */
+  for (p = 0, sum = 0; p < BULK_PARTS; p++){
+    job.start[p] = sum;
+    for (t = 0; t < nthreads; t++){
+      k                 = chunks[t].hist[p];
+      chunks[t].hist[p] = sum;
+      sum              += k;
+    }
+  }
+  job.start[BULK_PARTS] = sum;
+
+  bulkRun(chunks, nthreads, bulkScatterWorker);
+  bulkRun(chunks, nthreads, open ? bulkPlaceWorker : bulkLinkWorker);
+
+  for (t = 0; t < nthreads; t++){
+    for (k = 0; k < chunks[t].nspill; k++)
+      if (hash->engine == HASH_FLAT)
+        flatPlace(hash, &chunks[t].spill[k], 0);
+      else
+        swissPlace(hash, &chunks[t].spill[k], 0);
+    added += chunks[t].added + chunks[t].nspill;
+    free(chunks[t].spill);
+    if (t > 0 && hash->keyArena != NULL)
+      arenaAdopt(hash->keyArena, chunks[t].local.keyArena);
+    if (t > 0 && hash->nodeArena != NULL)
+      arenaAdopt(hash->nodeArena, chunks[t].local.nodeArena);
+  }
+
+  hash->count += added;
+
+  bulkFreeJob(&job);
+  free(chunks);
+
+  return added;
+
+}
+
+
+/* ===================== hashForEach() ======================= */
+/* ===================== hashForEach() ======================= */
+
+/*
+ * hashForEach()
+ * This function calls visit once for every entry of a table
+ * from nthreads threads at once, so visit must be safe to
+ * call from several threads.  A HASH_CONCURRENT table is
+ * visited a segment at a time under its read lock, and other
+ * threads may keep writing to it.  Any other table must not
+ * change meanwhile.
+ *
+ * INPUT:     hash        Hash table
+ *            visit       Called with arg, key, hash and data
+ *            arg         Passed through to visit
+ *            nthreads    Number of threads, the caller's
+ *                        included, 0 for one per CPU
+ */
+void hashForEach(Hash *hash, HashVisit visit, void *arg, int nthreads){
+
+  struct bulkJob    job;
+  struct bulkChunk  *chunks;
+  int               t;
+
+  nthreads = bulkThreads(nthreads, hashCount(hash));
+
+  if (nthreads < 2 ||
+      (chunks = (struct bulkChunk *)
+                calloc (nthreads, sizeof(struct bulkChunk))) == NULL){
+    hashWalk(hash, visit, arg);
+    return;
+  }
+
+  memset(&job, 0, sizeof(job));
+  job.hash  = hash;
+  job.visit = visit;
+  job.arg   = arg;
+  job.parts = (hash->flags & HASH_CONCURRENT) ? HASH_SEGMENTS : BULK_PARTS;
+
+  for (t = 0; t < nthreads; t++)
+    chunks[t].job = &job;
+
+  bulkRun(chunks, nthreads, bulkVisitWorker);
+
+  free(chunks);
+
+}
+
+
+/* ================= hashDestroyParallel() =================== */
+/* ================= hashDestroyParallel() =================== */
+
+/*
+ * hashDestroyParallel()
+ * This function is hashDestroy() with the entries freed by
+ * nthreads threads, each taking runs of buckets, slots or
+ * segments, so destructor must be safe to call from several
+ * threads.  No other thread may be using the table.
+ *
+ * INPUT:     hash        Pointer to hash table
+ *            destructor  Function pointer to destructor
+ *            nthreads    Number of threads, the caller's
+ *                        included, 0 for one per CPU
+ */
+void hashDestroyParallel(Hash *hash, void (*destructor)(void *data),
+                         int nthreads){
+
+  struct bulkJob    job;
+  struct bulkChunk  *chunks = NULL;
+  int               t;
+
+  nthreads = bulkThreads(nthreads, hashCount(hash));
+
+  /* Unless hashDestroy() never visits the entries anyway */
+  if (nthreads > 1 && hash->engine != HASH_IMAGE &&
+      (destructor != NULL || (hash->flags & HASH_CONCURRENT) ||
+       !HASH_KEYS_UNOWNED(hash) ||
+       (hash->engine == HASH_CHAINED && hash->nodeArena == NULL)))
+    chunks = (struct bulkChunk *) calloc (nthreads, sizeof(struct bulkChunk));
+
+  if (chunks != NULL){
+    memset(&job, 0, sizeof(job));
+    job.hash       = hash;
+    job.destructor = destructor;
+    job.parts      = (hash->flags & HASH_CONCURRENT) ? HASH_SEGMENTS
+                                                     : BULK_PARTS;
+    for (t = 0; t < nthreads; t++)
+      chunks[t].job = &job;
+
+    bulkRun(chunks, nthreads, bulkReleaseWorker);
+    free(chunks);
+    destructor = NULL;
+  }
+
+  hashDestroy(hash, destructor);
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * bulkThreads()
+ * This function returns the threads to use for n entries:
+ * nthreads, or one per CPU for 0, at most HASH_MAX_THREADS,
+ * and one for fewer than BULK_MIN_COUNT entries.
+ */
+static
+int bulkThreads(int nthreads, unsigned int n){
+
+  long cpus;
+
+  if (nthreads <= 0){
+    cpus     = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (cpus > 0) ? (int) cpus : 1;
+  }
+  if (nthreads > HASH_MAX_THREADS)
+    nthreads = HASH_MAX_THREADS;
+  if (n < BULK_MIN_COUNT)
+    nthreads = 1;
+
+  return nthreads;
+
+}
+
+/*
+ * bulkRun()
+ * This function runs worker on every chunk, chunk 0 on the
+ * calling thread, and waits for them all.  A chunk whose
+ * thread cannot be started is run by the caller afterwards.
+ */
+static
+void bulkRun(struct bulkChunk *chunks, int nthreads,
+             void *(*worker)(void *arg)){
+
+  pthread_t  threads[HASH_MAX_THREADS];
+  int        started[HASH_MAX_THREADS];
+  int        i;
+
+  chunks[0].job->claim = 0;
+
+  for (i = 1; i < nthreads; i++)
+    started[i] = (pthread_create(&threads[i], NULL, worker,
+                                 &chunks[i]) == 0);
+
+  worker(&chunks[0]);
+
+  for (i = 1; i < nthreads; i++){
+    if (started[i])
+      pthread_join(threads[i], NULL);
+    else
+      worker(&chunks[i]);
+  }
+
+}
+
+/*
+ * bulkPart()
+ * This function returns the run of a hash value's bucket, or
+ * home slot.  Runs are BULK_PARTS equal shares of the table,
+ * in bucket order, so no bucket is in two of them.
+ */
+static
+unsigned int bulkPart(Hash *hash, uint64_t hashval){
+
+  unsigned int slot = (hash->engine == HASH_CHAINED)
+                      ? HASH_FASTRANGE(hashval, hash->num_buckets)
+                      : (unsigned int) (hashval >> hash->shift);
+
+  return (unsigned int) ((uint64_t) slot * BULK_PARTS / hash->num_buckets);
+
+}
+
+/*
+ * bulkPartEnd()
+ * This function returns the first bucket or slot past a run.
+ */
+static
+unsigned int bulkPartEnd(Hash *hash, unsigned int part){
+
+  return (unsigned int) (((uint64_t) (part + 1) * hash->num_buckets +
+                          BULK_PARTS - 1) / BULK_PARTS);
+
+}
+
+/*
+ * bulkSerial()
+ * This function is hashBuildBulk() for the tables it can't
+ * build in runs: hashAdd() on nthreads threads for a
+ * HASH_CONCURRENT table, else hashAddBatch() by the caller.
+ */
+static
+unsigned int bulkSerial(Hash *hash, char **keys, void **values,
+                        unsigned int n, int nthreads){
+
+  struct bulkJob    job;
+  struct bulkChunk  *chunks;
+  unsigned int      added = 0;
+  int               t;
+
+  if ((hash->flags & HASH_CONCURRENT) == 0 || nthreads < 2 ||
+      (chunks = (struct bulkChunk *)
+                calloc (nthreads, sizeof(struct bulkChunk))) == NULL)
+    return hashAddBatch(hash, keys, n, values);
+
+  memset(&job, 0, sizeof(job));
+  job.hash   = hash;
+  job.keys   = keys;
+  job.values = values;
+  for (t = 0; t < nthreads; t++){
+    chunks[t].job   = &job;
+    chunks[t].first = (unsigned int) ((uint64_t) n * t / nthreads);
+    chunks[t].count = (unsigned int) ((uint64_t) n * (t + 1) / nthreads) -
+                      chunks[t].first;
+  }
+
+  bulkRun(chunks, nthreads, bulkAddWorker);
+
+  for (t = 0; t < nthreads; t++)
+    added += chunks[t].added;
+  free(chunks);
+
+  return added;
+
+}
+
+/*
+ * bulkHashWorker()
+ * Hashes a share of the keys, builds their nodes, or entries
+ * for an open addressing table, and counts them by run.  The
+ * keys are read in the order given, so this is the only pass
+ * that touches them.  A key that can't be copied gets hash 0
+ * and is left out from here on.
+ */
+static
+void *bulkHashWorker(void *arg){
+
+  struct bulkChunk  *chunk = (struct bulkChunk *) arg;
+  struct bulkJob    *job   = chunk->job;
+  Hash              *hash  = job->hash;
+  Hash              *local = &chunk->local;
+  struct HashEntry  *e;
+  struct HashNode   *node;
+  uint64_t          h;
+  unsigned int      i;
+
+  for (i = chunk->first; i < chunk->first + chunk->count; i++){
+    h              = hashKeyValue(hash, job->keys[i]);
+    job->hashes[i] = 0;
+    if (job->entries != NULL){
+      e = &job->entries[i];
+      if (hashKeySet(local, &e->key, job->keys[i]) != 0){
+        chunk->failed++;
+        continue;
+      }
+      e->hashval = h;
+      e->data    = job->values[i];
+    }
+    else {
+      node = (local->nodeArena != NULL)
+             ? (struct HashNode *) arenaAlloc(local->nodeArena, 0)
+             : (struct HashNode *) malloc (sizeof(struct HashNode));
+      if (node == NULL || hashKeySet(local, &node->key, job->keys[i]) != 0){
+        if (node != NULL && local->nodeArena != NULL)
+          arenaFree(local->nodeArena, node);
+        else
+          free(node);
+        chunk->failed++;
+        continue;
+      }
+      node->hashval = h;
+      node->data    = job->values[i];
+      job->nodes[i] = node;
+    }
+    job->hashes[i] = h;
+    chunk->hist[bulkPart(hash, h)]++;
+  }
+
+  return NULL;
+
+}
+
+/*
+ * bulkScatterWorker()
+ * Copies the nodes or entries of a share of the keys into the
+ * run array.  hist[] holds where this share's keys of each
+ * run go.
+ */
+static
+void *bulkScatterWorker(void *arg){
+
+  struct bulkChunk  *chunk = (struct bulkChunk *) arg;
+  struct bulkJob    *job   = chunk->job;
+  unsigned int      pos;
+  unsigned int      i;
+
+  for (i = chunk->first; i < chunk->first + chunk->count; i++){
+    if (job->hashes[i] == 0)
+      continue;
+    pos = chunk->hist[bulkPart(job->hash, job->hashes[i])]++;
+    if (job->entries != NULL)
+      job->runEntries[pos] = job->entries[i];
+    else
+      job->runNodes[pos] = job->nodes[i];
+  }
+
+  return NULL;
+
+}
+
+/*
+ * bulkLinkWorker()
+ * Takes runs of a chained table and puts each key of the run
+ * at the head of its bucket.  Keys are in the order given, so
+ * of two equal keys the later is found, as with hashAdd().
+ */
+static
+void *bulkLinkWorker(void *arg){
+
+  struct bulkChunk  *chunk = (struct bulkChunk *) arg;
+  struct bulkJob    *job   = chunk->job;
+  Hash              *hash  = job->hash;
+  struct HashNode   **bucket;
+  struct HashNode   *node;
+  unsigned int      p, k;
+
+  while ((p = __atomic_fetch_add(&job->claim, 1, __ATOMIC_RELAXED))
+         < job->parts){
+    for (k = job->start[p]; k < job->start[p + 1]; k++){
+      node       = job->runNodes[k];
+      bucket     = &hash->array[HASH_FASTRANGE(node->hashval,
+                                               hash->num_buckets)];
+      node->next = *bucket;
+      *bucket    = node;
+      chunk->added++;
+    }
+  }
+
+  return NULL;
+
+}
+
+/*
+ * bulkPlaceWorker()
+ * Takes runs of an open addressing table and places the
+ * entries of each within the run.  Entries pushed past the
+ * end of the run are kept for hashBuildBulk() to place.
+ */
+static
+void *bulkPlaceWorker(void *arg){
+
+  struct bulkChunk  *chunk = (struct bulkChunk *) arg;
+  struct bulkJob    *job   = chunk->job;
+  Hash              *hash  = job->hash;
+  struct HashEntry  entry;
+  unsigned int      limit;
+  unsigned int      p, k;
+  int               left;
+
+  while ((p = __atomic_fetch_add(&job->claim, 1, __ATOMIC_RELAXED))
+         < job->parts){
+    limit = bulkPartEnd(hash, p);
+    for (k = job->start[p]; k < job->start[p + 1]; k++){
+      entry = job->runEntries[k];
+      left  = (hash->engine == HASH_FLAT) ? flatPlace(hash, &entry, limit)
+                                          : swissPlace(hash, &entry, limit);
+      if (left == 0)
+        chunk->added++;
+      else if (bulkSpill(chunk, &entry) != 0)
+        hashKeyRelease(&chunk->local, &entry.key);
+    }
+  }
+
+  return NULL;
+
+}
+
+/*
+ * bulkAddWorker()
+ * Adds a share of the keys with hashAdd().
+ */
+static
+void *bulkAddWorker(void *arg){
+
+  struct bulkChunk  *chunk = (struct bulkChunk *) arg;
+  struct bulkJob    *job   = chunk->job;
+  unsigned int      i;
+
+  for (i = chunk->first; i < chunk->first + chunk->count; i++)
+    if (hashAdd(job->hash, job->keys[i], job->values[i]) == 0)
+      chunk->added++;
+
+  return NULL;
+
+}
+
+/*
+ * bulkVisitWorker()
+ * Takes runs of hash values, or segments, or of a snapshot's
+ * entries, and visits their entries.
+ */
+static
+void *bulkVisitWorker(void *arg){
+
+  struct bulkChunk  *chunk = (struct bulkChunk *) arg;
+  struct bulkJob    *job   = chunk->job;
+  Hash              *hash  = job->hash;
+  unsigned int      first, last;
+  unsigned int      p;
+
+  while ((p = __atomic_fetch_add(&job->claim, 1, __ATOMIC_RELAXED))
+         < job->parts){
+    if (hash->flags & HASH_CONCURRENT)
+      concScan(hash, p, 0, ~0U, job->visit, job->arg);
+    else if (hash->engine == HASH_IMAGE){
+      first = (unsigned int) ((uint64_t) hash->count * p / job->parts);
+      last  = (unsigned int) ((uint64_t) hash->count * (p + 1) / job->parts);
+      if (last > first)
+        imageScan(hash, first, last - first, job->visit, job->arg);
+    }
+    else
+      hashScanRange(hash, HASH_SCAN_END * p / job->parts,
+                    HASH_SCAN_END * (p + 1) / job->parts,
+                    job->visit, job->arg);
+  }
+
+  return NULL;
+
+}
+
+/*
+ * bulkReleaseWorker()
+ * Takes runs of buckets, slots or segments and frees their
+ * entries, see hashReleasePart().
+ */
+static
+void *bulkReleaseWorker(void *arg){
+
+  struct bulkChunk  *chunk = (struct bulkChunk *) arg;
+  struct bulkJob    *job   = chunk->job;
+  unsigned int      p;
+
+  while ((p = __atomic_fetch_add(&job->claim, 1, __ATOMIC_RELAXED))
+         < job->parts)
+    hashReleasePart(job->hash, p, job->parts, job->destructor);
+
+  return NULL;
+
+}
+
+/*
+ * bulkSpill()
+ * Keeps an entry that left its run, growing the list as
+ * needed.
+ *
+ * RETURNS:   0     Success
+ *            -1    Error allocating memory, entry dropped
+ */
+static
+int bulkSpill(struct bulkChunk *chunk, struct HashEntry *entry){
+
+  struct HashEntry  *spill;
+  unsigned int      size;
+
+  if (chunk->nspill == chunk->spill_size){
+    size  = chunk->spill_size ? chunk->spill_size * 2 : 64;
+    spill = (struct HashEntry *) realloc (chunk->spill,
+                                          size * sizeof(struct HashEntry));
+    if (spill == NULL)
+      return -1;
+    chunk->spill      = spill;
+    chunk->spill_size = size;
+  }
+
+  chunk->spill[chunk->nspill++] = *entry;
+
+  return 0;
+
+}
+
+/*
+ * bulkFreeJob()
+ * Frees the work arrays of a hashBuildBulk() call.
+ */
+static
+void bulkFreeJob(struct bulkJob *job){
+
+  free(job->hashes);
+  free(job->nodes);
+  free(job->runNodes);
+  free(job->entries);
+  free(job->runEntries);
+  free(job->start);
+
+}
@@ -0,0 +1,633 @@
+/*
+ * conc.c
+ * HASH_CONCURRENT mode for the Hash ADT.
+ *
+ * The table is split into HASH_SEGMENTS segments, each an
+ * ordinary table of the chosen engine behind its own
+ * reader/writer lock.  A key is hashed once; bits 16 and up of
+ * the hash pick the segment and the segment table uses the same
+ * hash to pick the bucket or slot from its top bits, so the two
+ * choices don't interfere.  hashGet() takes a read lock, so
+ * lookups in the same segment run side by side, and hashAdd()
+ * and hashDelete() lock only the segment they touch.
+ *
+ * A segment grows by itself, under its own write lock, when it
+ * reaches its load factor, MAX_UTILIZATION unless set by
+ * hashCreateOptions().  Threads working in the other
+ * segments never wait on that resize.
+ *
+ * Each segment is padded to its own cache line so the lock
+ * words of neighbouring segments don't share one.
+ *
+ * HASH_LOCKFREE segments (lockfree.c) keep the lock for
+ * writers only; hashGet() goes straight to the buckets.
+ *
+ * HASH_NUMA segments each have a home node.  Their arrays are
+ * moved there (place.c) once created and again whenever an
+ * add or delete finds that the segment was resized, which the
+ * rehash counter of the segment tells.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "hash.h"
+#include "hashpriv.h"
+#include "ebr.h"
+#include "place.h"
+
+/* Resizes of a segment so far */
+#define CONC_REHASHES(seg) \
+        ((seg)->table != NULL ? (seg)->table->rehashes : (seg)->rehashes)
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+struct HashSegment *concSegment(Hash *hash, uint64_t hashval);
+
+static
+void concFreeSegment(struct HashSegment *seg, void (*destructor)(void *data));
+
+static
+void concPlace(struct HashSegment *seg);
+
+
+/* ================= Engine Functions ========================= */
+/* ================= Engine Functions ========================= */
+
+/*
+ * concInit()
+ * This function creates the segments of a HASH_CONCURRENT
+ * table.  Every segment table shares the hash function, seed
+ * and key size of the outer table.
+ *
+ * INPUT:     hash          Hash table with engine and flags set
+ *            num_buckets   Hint for the size of the whole table
+ * RETURNS:   0             Success
+ *            -1            Error allocating memory
+ */
+int concInit(Hash *hash, unsigned int num_buckets){
+
+  struct HashSegment  *seg;
+  int                 engine;
+  int                 nodes;
+  unsigned int        i;
+
+  engine = hash->engine |
+           (hash->flags & ~(HASH_CONCURRENT | HASH_LOCKFREE | HASH_NUMA));
+  nodes  = (hash->flags & HASH_NUMA) ? placeNodes() : 0;
+
+  if (posix_memalign((void **) &hash->segments, HASH_CACHE_LINE,
+                     HASH_SEGMENTS * sizeof(struct HashSegment)) != 0)
+    return -1;
+  memset(hash->segments, 0, HASH_SEGMENTS * sizeof(struct HashSegment));
+
+  for (i = 0; i < HASH_SEGMENTS; i++){
+    seg       = &hash->segments[i];
+    seg->node = (nodes > 0) ? (int) (i * nodes / HASH_SEGMENTS) : -1;
+
+    if (hash->flags & HASH_LOCKFREE)
+      lockfreeInit(seg, num_buckets / HASH_SEGMENTS);
+    else {
+      seg->lfarray = NULL;
+      seg->table   = hashCreateEngine(num_buckets / HASH_SEGMENTS, engine);
+    }
+
+    if ((seg->table == NULL && seg->lfarray == NULL) ||
+        pthread_rwlock_init(&seg->lock, NULL) != 0){
+      concFreeSegment(seg, NULL);
+      while (i-- > 0){
+        pthread_rwlock_destroy(&hash->segments[i].lock);
+        concFreeSegment(&hash->segments[i], NULL);
+      }
+      free(hash->segments);
+      hash->segments = NULL;
+      return -1;
+    }
+
+    if (seg->table != NULL){
+      seg->table->hashfn  = hash->hashfn;
+      seg->table->seed    = hash->seed;
+      seg->table->keysize = hash->keysize;
+    }
+
+    if (seg->node >= 0)
+      concPlace(seg);
+  }
+
+  return 0;
+
+}
+
+
+/*
+ * concAdd()
+ * This function adds a new key/data pair under the write
+ * lock of the key's segment.
+ *
+ * INPUT:    hash    Hash table to add key/data to.
+ *           vkey    String key (that gets hashed)
+ *           data    Void pointer to data container
+ * RETURNS:  0       Success
+ *           -1      Failure
+ */
+int concAdd(Hash *hash, const char *vkey, void *data){
+
+  uint64_t            hashval = hashKeyValue(hash, vkey);
+  struct HashSegment  *seg    = concSegment(hash, hashval);
+  unsigned int        rehashes;
+  int                 ret;
+
+  pthread_rwlock_wrlock(&seg->lock);
+  rehashes = CONC_REHASHES(seg);
+  if (seg->table == NULL)
+    ret = lockfreeAdd(hash, seg, vkey, hashval, data);
+  else
+    ret = hashAddValue(seg->table, vkey, hashval, data);
+  if (seg->node >= 0 && CONC_REHASHES(seg) != rehashes)
+    concPlace(seg);
+  pthread_rwlock_unlock(&seg->lock);
+
+  return ret;
+
+}
+
+
+/*
+ * concUpsert()
+ * This function is hashUpsert() and hashEmplace() under the
+ * write lock of the key's segment, so the lookup, the add and
+ * the merge happen as one step for every other thread.
+ *
+ * INPUT:    hash    Hash table
+ *           vkey    String key (that gets hashed)
+ *           data    Void pointer to data container
+ *           merge   Merge function, or NULL to replace
+ *           old     Set to the data container that was stored
+ *                   if vkey was there.  May be NULL.
+ * RETURNS:  1       vkey added
+ *           0       vkey was there
+ *           -1      Failure
+ */
+int concUpsert(Hash *hash, const char *vkey, void *data, HashMerge merge,
+               void **old){
+
+  uint64_t            hashval = hashKeyValue(hash, vkey);
+  struct HashSegment  *seg    = concSegment(hash, hashval);
+  unsigned int        rehashes;
+  int                 ret;
+
+  pthread_rwlock_wrlock(&seg->lock);
+  rehashes = CONC_REHASHES(seg);
+  if (seg->table == NULL)
+    ret = lockfreeUpsert(hash, seg, vkey, hashval, data, merge, old);
+  else
+    ret = hashUpsertValue(seg->table, vkey, hashval, data, merge, old);
+  if (seg->node >= 0 && CONC_REHASHES(seg) != rehashes)
+    concPlace(seg);
+  pthread_rwlock_unlock(&seg->lock);
+
+  return ret;
+
+}
+
+
+/*
+ * concGet()
+ * This function looks vkey up under the read lock of its
+ * segment.  The data container is returned after the lock is
+ * dropped, so the caller must not delete it from another
+ * thread while still using it.
+ *
+ * INPUT:     hash      Pointer to hash table.
+ *            vkey      String key for lookup
+ * RETURNS:   data      Pointer to data container
+ *            NULL      vkey not found in hash table
+ */
+void *concGet(Hash *hash, const char *vkey){
+
+  uint64_t            hashval = hashKeyValue(hash, vkey);
+  struct HashSegment  *seg    = concSegment(hash, hashval);
+  void                *data;
+
+  if (seg->table == NULL)
+    return HASH_STAT_GET(&seg->hits, &seg->misses,
+                         lockfreeGet(hash, seg, vkey, hashval));
+
+  pthread_rwlock_rdlock(&seg->lock);
+  data = hashGetValue(seg->table, vkey, hashval);
+  pthread_rwlock_unlock(&seg->lock);
+
+  return data;
+
+}
+
+
+/*
+ * concDelete()
+ * This function removes vkey under the write lock of its
+ * segment.
+ *
+ * INPUT:     hash         Pointer to hash table.
+ *            vkey         String key to remove
+ *            destructor   Destructor for the data container
+ */
+void concDelete(Hash *hash, const char *vkey, void (*destructor)(void *data)){
+
+  uint64_t            hashval = hashKeyValue(hash, vkey);
+  struct HashSegment  *seg    = concSegment(hash, hashval);
+  unsigned int        rehashes;
+
+  pthread_rwlock_wrlock(&seg->lock);
+  rehashes = CONC_REHASHES(seg);
+  if (seg->table == NULL)
+    lockfreeDelete(hash, seg, vkey, hashval, destructor);
+  else
+    hashDeleteValue(seg->table, vkey, hashval, destructor);
+  if (seg->node >= 0 && CONC_REHASHES(seg) != rehashes)
+    concPlace(seg);
+  pthread_rwlock_unlock(&seg->lock);
+
+}
+
+
+/*
+ * concCount()
+ * This function sums the entries of every segment, or their
+ * buckets when size is non-zero.  Each segment is read under
+ * its lock, but the total is only a snapshot while other
+ * threads are writing.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            size       0 for entries, else buckets
+ * RETURNS:   unsigned   Total over all segments
+ */
+unsigned int concCount(Hash *hash, int size){
+
+  struct HashSegment  *seg;
+  unsigned int        total = 0;
+  unsigned int        i;
+
+  for (i = 0; i < HASH_SEGMENTS; i++){
+    seg = &hash->segments[i];
+    pthread_rwlock_rdlock(&seg->lock);
+    if (seg->table == NULL)
+      total += size ? lockfreeSize(seg)
+                    : __atomic_load_n(&seg->count, __ATOMIC_RELAXED);
+    else
+      total += size ? hashSize(seg->table) : hashCount(seg->table);
+    pthread_rwlock_unlock(&seg->lock);
+  }
+
+  return total;
+
+}
+
+
+/*
+ * concSetHash()
+ * This function copies the outer table's hash function, seed
+ * and key size into every segment, after hashSetHashFunc(),
+ * hashSetSeed() or hashSetKeySize() changed them.
+ *
+ * INPUT:     hash       Pointer to hash table
+ */
+void concSetHash(Hash *hash){
+
+  unsigned int i;
+
+  for (i = 0; i < HASH_SEGMENTS; i++){
+    if (hash->segments[i].table != NULL){
+      hash->segments[i].table->hashfn  = hash->hashfn;
+      hash->segments[i].table->seed    = hash->seed;
+      hash->segments[i].table->keysize = hash->keysize;
+    }
+  }
+
+}
+
+
+/*
+ * concDestroy()
+ * This function destroys every segment.  No other thread may
+ * be using the table.  Nodes this thread retired from a
+ * HASH_LOCKFREE table are waited out and freed too.
+ * hashDestroy() frees the rest.
+ *
+ * INPUT:    hash         Pointer to hash table
+ *           destructor   Function pointer to destructor
+ */
+void concDestroy(Hash *hash, void (*destructor)(void *data)){
+
+  unsigned int i;
+
+  for (i = 0; i < HASH_SEGMENTS; i++){
+    pthread_rwlock_destroy(&hash->segments[i].lock);
+    concFreeSegment(&hash->segments[i], destructor);
+  }
+
+  free(hash->segments);
+
+  if (hash->flags & HASH_LOCKFREE)
+    ebrDrain();
+
+}
+
+
+/*
+ * concPrint()
+ * This function prints every segment in turn.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            printer    Function point to printer function.
+ */
+void concPrint(Hash *hash, void (*printer)(void *data)){
+
+  unsigned int i;
+
+  for (i = 0; i < HASH_SEGMENTS; i++){
+    pthread_rwlock_wrlock(&hash->segments[i].lock);
+    if (hash->segments[i].table == NULL)
+      lockfreePrint(&hash->segments[i], printer);
+    else
+      hashPrint(hash->segments[i].table, printer);
+    pthread_rwlock_unlock(&hash->segments[i].lock);
+  }
+
+}
+
+
+/*
+ * concWalk()
+ * This function walks every segment in turn, each under its
+ * write lock.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            visit      Called with arg, key, hash and data
+ *            arg        Passed through to visit
+ */
+void concWalk(Hash *hash, HashVisit visit, void *arg){
+
+  unsigned int i;
+
+  for (i = 0; i < HASH_SEGMENTS; i++){
+    pthread_rwlock_wrlock(&hash->segments[i].lock);
+    if (hash->segments[i].table == NULL)
+      lockfreeWalk(&hash->segments[i], visit, arg);
+    else
+      hashWalk(hash->segments[i].table, visit, arg);
+    pthread_rwlock_unlock(&hash->segments[i].lock);
+  }
+
+}
+
+
+/*
+ * concScan()
+ * This function visits one slice of a segment under its read
+ * lock, see hashScan().
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            segment    Segment number
+ *            lo         First hash prefix of the slice
+ *            count      Buckets or slots to look at, about
+ *            visit      Called with arg, key, hash and data
+ *            arg        Passed through to visit
+ * RETURNS:   uint64_t   First hash prefix of the next slice
+ */
+uint64_t concScan(Hash *hash, unsigned int segment, uint64_t lo,
+                  unsigned int count, HashVisit visit, void *arg){
+
+  struct HashSegment  *seg = &hash->segments[segment];
+  uint64_t            hi;
+
+  pthread_rwlock_rdlock(&seg->lock);
+  if (seg->table == NULL)
+    hi = lockfreeScan(seg, lo, count, visit, arg);
+  else
+    hi = hashScanTable(seg->table, lo, count, visit, arg);
+  pthread_rwlock_unlock(&seg->lock);
+
+  return hi;
+
+}
+
+
+/*
+ * concStats()
+ * This function adds every segment to stats, each under its
+ * read lock.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            stats      Running totals, see hashStatsAdd()
+ */
+void concStats(Hash *hash, HashStats *stats){
+
+  struct HashSegment  *seg;
+  unsigned int        i;
+
+  for (i = 0; i < HASH_SEGMENTS; i++){
+    seg = &hash->segments[i];
+    pthread_rwlock_rdlock(&seg->lock);
+    if (seg->table == NULL)
+      lockfreeStats(hash, seg, stats);
+    else
+      hashStatsAdd(seg->table, stats);
+    pthread_rwlock_unlock(&seg->lock);
+  }
+
+}
+
+
+/*
+ * concSegmentOf()
+ * This function returns the number of the segment a hash
+ * value lives in.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            hashval    hashKeyValue() of the key
+ * RETURNS:   unsigned   Segment, 0 .. HASH_SEGMENTS - 1
+ */
+unsigned int concSegmentOf(Hash *hash, uint64_t hashval){
+
+  return (unsigned int) (concSegment(hash, hashval) - hash->segments);
+
+}
+
+
+/*
+ * concCompact()
+ * This function compacts every segment in turn under its
+ * write lock, see hashCompact().  Readers and writers of the
+ * other segments carry on meanwhile.
+ *
+ * INPUT:     hash       Pointer to hash table
+ * RETURNS:   0          Success
+ *            -1         Error allocating memory for some
+ *                       segment, the rest are compacted
+ */
+int concCompact(Hash *hash){
+
+  struct HashSegment  *seg;
+  unsigned int        i;
+  int                 ret = 0;
+
+  for (i = 0; i < HASH_SEGMENTS; i++){
+    seg = &hash->segments[i];
+    pthread_rwlock_wrlock(&seg->lock);
+    if (seg->table == NULL){
+      if (lockfreeCompact(hash, seg) != 0)
+        ret = -1;
+    }
+    else if (hashCompact(seg->table) != 0)
+      ret = -1;
+    if (seg->node >= 0)
+      concPlace(seg);
+    pthread_rwlock_unlock(&seg->lock);
+  }
+
+  return ret;
+
+}
+
+
+/*
+ * concReserve()
+ * This function makes room in every segment for count
+ * entries of the whole table, a segment at a time under its
+ * write lock.  Keys don't split exactly evenly, so each
+ * segment takes an eighth more than its share, plus 32 for
+ * small tables where the spread is wider than an eighth.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            count      Entries to make room for
+ * RETURNS:   0          Success
+ *            -1         Error allocating memory for some
+ *                       segment, the rest are grown
+ */
+int concReserve(Hash *hash, unsigned int count){
+
+  struct HashSegment  *seg;
+  unsigned int        share = count / HASH_SEGMENTS;
+  unsigned int        i;
+  int                 ret = 0;
+
+  share += share / 8 + 32;
+
+  for (i = 0; i < HASH_SEGMENTS; i++){
+    seg = &hash->segments[i];
+    pthread_rwlock_wrlock(&seg->lock);
+    if (seg->table == NULL){
+      if (lockfreeReserve(hash, seg, share) != 0)
+        ret = -1;
+    }
+    else if (hashReserve(seg->table, share) != 0)
+      ret = -1;
+    if (seg->node >= 0)
+      concPlace(seg);
+    pthread_rwlock_unlock(&seg->lock);
+  }
+
+  return ret;
+
+}
+
+
+/*
+ * concSetOptions()
+ * This function hands the options of a new HASH_CONCURRENT
+ * table on to its segments, each with an even share of the
+ * size limit.  HASH_LOCKFREE segments keep their limit
+ * themselves and read the rest from the outer table.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            options    Table options
+ */
+void concSetOptions(Hash *hash, const HashOptions *options){
+
+  struct HashSegment  *seg;
+  HashOptions         share = *options;
+  unsigned int        i;
+
+  if (share.max_buckets != 0)
+    share.max_buckets = (share.max_buckets + HASH_SEGMENTS - 1) /
+                        HASH_SEGMENTS;
+
+  for (i = 0; i < HASH_SEGMENTS; i++){
+    seg = &hash->segments[i];
+    if (seg->table != NULL)
+      hashSetOptions(seg->table, &share);
+    else if (share.max_buckets != 0)
+      seg->max_buckets = (share.max_buckets > lockfreeSize(seg))
+                         ? share.max_buckets : lockfreeSize(seg);
+  }
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * concSegment()
+ * This function returns the segment a hash value lives in.
+ */
+static
+struct HashSegment *concSegment(Hash *hash, uint64_t hashval){
+
+  return &hash->segments[(hashval >> 16) & (HASH_SEGMENTS - 1)];
+
+}
+
+/*
+ * concFreeSegment()
+ * This function frees a segment's table or lock-free buckets,
+ * whichever it has.
+ */
+static
+void concFreeSegment(struct HashSegment *seg, void (*destructor)(void *data)){
+
+  if (seg->table != NULL)
+    hashDestroy(seg->table, destructor);
+  else if (seg->lfarray != NULL)
+    lockfreeDestroy(seg, destructor);
+
+}
+
+/*
+ * concPlace()
+ * This function moves a HASH_NUMA segment's bucket or slot
+ * arrays to its home node.  The caller holds the write lock,
+ * or is concInit().
+ */
+static
+void concPlace(struct HashSegment *seg){
+
+  Hash          *table = seg->table;
+  unsigned int  n;
+
+  if (table == NULL){
+    /* Bucket array plus its small header, close enough for pages */
+    placeMove(seg->lfarray,
+              (lockfreeSize(seg) + 1) * sizeof(struct HashNode *), seg->node);
+    return;
+  }
+
+  n = table->num_buckets;
+
+  switch (table->engine){
+    case HASH_CHAINED:
+      placeMove(table->array, n * sizeof(struct HashNode *), seg->node);
+      break;
+    case HASH_SWISS:
+      placeMove(table->ctrl, n, seg->node);
+      /* fall through */
+    case HASH_FLAT:
+      placeMove(table->hashes, n * sizeof(uint64_t), seg->node);
+      placeMove(table->keys, n * sizeof(HashKey), seg->node);
+      placeMove(table->values, n * sizeof(void *), seg->node);
+      break;
+  }
+
+}
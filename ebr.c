@@ -0,0 +1,325 @@
+/*
+ * ebr.c
+ * Epoch based reclamation for the Hash ADT.
+ *
+ * There is one global epoch and one record per thread.  A
+ * reader copies the global epoch into its record on
+ * ebrEnter() and clears it on ebrExit(); that is all a read
+ * costs, it never waits.  Objects handed to ebrRetire() are
+ * tagged with the epoch current when they were unlinked and
+ * kept on the retiring thread's list.
+ *
+ * The epoch can only move from E to E + 1 once every thread
+ * inside a read section has announced E.  So when the global
+ * epoch reaches tag + 2, every reader that started before the
+ * object was unlinked has finished and it can be freed.
+ *
+ * Records are never freed.  A thread's record is released when
+ * it exits and handed, with anything still retired on it, to
+ * the next thread that registers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include "ebr.h"
+
+/* Object waiting for its grace period */
+struct EbrRetired {
+  void      *ptr;
+  void      (*freefn)(void *ptr);
+  uint64_t  epoch;
+};
+
+/* Per thread record */
+struct EbrThread {
+  uint64_t           epoch;      /* Announced epoch, 0 outside */
+  int                in_use;     /* Owned by a live thread */
+  struct EbrThread   *next;      /* Every record */
+  struct EbrRetired  *retired;   /* Objects retired by this thread */
+  unsigned int       count;
+  unsigned int       size;
+  unsigned int       since;      /* Retirements since last collect */
+};
+
+static uint64_t           ebrGlobal = 1;
+static struct EbrThread   *ebrThreads;
+static pthread_mutex_t    ebrLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t     ebrOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t      ebrKey;
+static __thread struct EbrThread *ebrSelf;
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+struct EbrThread *ebrRegister(void);
+
+static
+void ebrKeyInit(void);
+
+static
+void ebrRelease(void *arg);
+
+static
+void ebrAdvance(void);
+
+static
+void ebrCollect(struct EbrThread *self);
+
+static
+void ebrFreeExpired(struct EbrThread *rec, uint64_t global);
+
+
+/* =================== Public Functions ====================== */
+/* =================== Public Functions ====================== */
+
+/*
+ * ebrEnter()
+ * This function starts a read side section.  Sections may not
+ * be nested.
+ */
+void ebrEnter(void){
+
+  struct EbrThread *self = ebrSelf;
+
+  if (self == NULL)
+    self = ebrRegister();
+
+  /* Announce, as a full barrier, before reading any shared pointer */
+  __atomic_exchange_n(&self->epoch,
+                      __atomic_load_n(&ebrGlobal, __ATOMIC_RELAXED),
+                      __ATOMIC_SEQ_CST);
+
+}
+
+
+/*
+ * ebrExit()
+ * This function ends a read side section.
+ */
+void ebrExit(void){
+
+  __atomic_store_n(&ebrSelf->epoch, 0, __ATOMIC_RELEASE);
+
+}
+
+
+/*
+ * ebrRetire()
+ * This function frees ptr with freefn once no reader can still
+ * hold it.  The caller must already have unlinked it.
+ *
+ * INPUT:     ptr       Object to free
+ *            freefn    Function that frees it
+ */
+void ebrRetire(void *ptr, void (*freefn)(void *ptr)){
+
+  struct EbrThread   *self = ebrSelf;
+  struct EbrRetired  *grown;
+  unsigned int       size;
+
+  if (self == NULL)
+    self = ebrRegister();
+
+  /* Out of memory, wait for readers rather than fail */
+  while (self->count == self->size){
+    size  = self->size ? self->size * 2 : EBR_COLLECT_EVERY;
+    grown = (struct EbrRetired *) realloc (self->retired,
+                                           size * sizeof(*grown));
+    if (grown != NULL){
+      self->retired = grown;
+      self->size    = size;
+      break;
+    }
+    ebrCollect(self);
+    sched_yield();
+  }
+
+  /* Full barrier, the tag is read after the unlink is visible */
+  self->retired[self->count].ptr    = ptr;
+  self->retired[self->count].freefn = freefn;
+  self->retired[self->count].epoch  = __atomic_fetch_add(&ebrGlobal, 0,
+                                                         __ATOMIC_SEQ_CST);
+  self->count++;
+
+  if (++self->since >= EBR_COLLECT_EVERY)
+    ebrCollect(self);
+
+}
+
+
+/*
+ * ebrDrain()
+ * This function waits until everything the calling thread, or
+ * an exited thread, has retired can be freed and frees it.  It
+ * must not be called inside a read side section.
+ */
+void ebrDrain(void){
+
+  struct EbrThread  *rec;
+  uint64_t          global;
+  int               busy;
+
+  do {
+    busy = 0;
+
+    ebrAdvance();
+    global = __atomic_load_n(&ebrGlobal, __ATOMIC_ACQUIRE);
+
+    if (ebrSelf != NULL){
+      ebrFreeExpired(ebrSelf, global);
+      busy = (ebrSelf->count != 0);
+    }
+
+    pthread_mutex_lock(&ebrLock);
+    for (rec = ebrThreads; rec != NULL; rec = rec->next){
+      if (!rec->in_use){
+        ebrFreeExpired(rec, global);
+        busy |= (rec->count != 0);
+      }
+    }
+    pthread_mutex_unlock(&ebrLock);
+
+    if (busy)
+      sched_yield();
+
+  } while (busy);
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * ebrRegister()
+ * This function gives the calling thread a record, reusing one
+ * left by an exited thread if there is one.
+ */
+static
+struct EbrThread *ebrRegister(void){
+
+  struct EbrThread *rec;
+
+  pthread_once(&ebrOnce, ebrKeyInit);
+
+  pthread_mutex_lock(&ebrLock);
+
+  for (rec = ebrThreads; rec != NULL; rec = rec->next)
+    if (!rec->in_use)
+      break;
+
+  if (rec == NULL){
+    rec = (struct EbrThread *) calloc (1, sizeof(struct EbrThread));
+    if (rec == NULL){
+      printf("Error allocating memory, aborting...\n");
+      exit(1);
+    }
+    rec->next  = ebrThreads;
+    ebrThreads = rec;
+  }
+  rec->in_use = 1;
+
+  pthread_mutex_unlock(&ebrLock);
+
+  pthread_setspecific(ebrKey, rec);
+  ebrSelf = rec;
+
+  return rec;
+
+}
+
+/*
+ * ebrKeyInit()
+ * Creates the key whose destructor releases a record.
+ */
+static
+void ebrKeyInit(void){
+
+  pthread_key_create(&ebrKey, ebrRelease);
+
+}
+
+/*
+ * ebrRelease()
+ * Thread exit, the record and its retired list go back to the
+ * pool.
+ */
+static
+void ebrRelease(void *arg){
+
+  struct EbrThread *rec = (struct EbrThread *) arg;
+
+  pthread_mutex_lock(&ebrLock);
+  __atomic_store_n(&rec->epoch, 0, __ATOMIC_RELEASE);
+  rec->in_use = 0;
+  pthread_mutex_unlock(&ebrLock);
+
+}
+
+/*
+ * ebrAdvance()
+ * This function moves the global epoch on by one if every
+ * thread in a read section has seen the current one.
+ */
+static
+void ebrAdvance(void){
+
+  struct EbrThread  *rec;
+  uint64_t          global;
+  uint64_t          epoch;
+
+  pthread_mutex_lock(&ebrLock);
+
+  global = __atomic_load_n(&ebrGlobal, __ATOMIC_SEQ_CST);
+
+  for (rec = ebrThreads; rec != NULL; rec = rec->next){
+    epoch = __atomic_load_n(&rec->epoch, __ATOMIC_SEQ_CST);
+    if (epoch != 0 && epoch != global)
+      break;
+  }
+
+  if (rec == NULL)
+    __atomic_store_n(&ebrGlobal, global + 1, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&ebrLock);
+
+}
+
+/*
+ * ebrCollect()
+ * This function tries to advance the epoch, then frees every
+ * object on the record's list whose grace period is over.
+ */
+static
+void ebrCollect(struct EbrThread *self){
+
+  self->since = 0;
+
+  ebrAdvance();
+  ebrFreeExpired(self, __atomic_load_n(&ebrGlobal, __ATOMIC_ACQUIRE));
+
+}
+
+/*
+ * ebrFreeExpired()
+ * Frees the objects on a record's list retired two or more
+ * epochs before global.
+ */
+static
+void ebrFreeExpired(struct EbrThread *rec, uint64_t global){
+
+  unsigned int  i;
+  unsigned int  kept = 0;
+
+  for (i = 0; i < rec->count; i++){
+    if (rec->retired[i].epoch + 2 <= global)
+      rec->retired[i].freefn(rec->retired[i].ptr);
+    else
+      rec->retired[kept++] = rec->retired[i];
+  }
+  rec->count = kept;
+
+}
@@ -0,0 +1,34 @@
+/*
+ * ebr.h
+ * Header file for epoch based reclamation used by HASH_LOCKFREE
+ * tables.
+ *
+ * Readers bracket every access to shared nodes with ebrEnter()
+ * and ebrExit(), which only publish the global epoch in the
+ * thread's record.  Writers unlink a node, then hand it to
+ * ebrRetire() instead of freeing it.  It is freed once the
+ * global epoch has moved on twice, which can only happen after
+ * every reader that could have seen the node has left.
+ *
+ * FUNCTIONS:        ebrEnter           Start a read side section.
+ *                   ebrExit            End a read side section.
+ *                   ebrRetire          Free an object after a
+ *                                      grace period.
+ *                   ebrDrain           Wait out and free everything
+ *                                      this thread has retired.
+ */
+
+#ifndef EBR_H
+#define EBR_H
+
+#include <stdint.h>
+
+/* Retirements between attempts to advance the epoch */
+#define EBR_COLLECT_EVERY  64
+
+void ebrEnter(void);
+void ebrExit(void);
+void ebrRetire(void *ptr, void (*freefn)(void *ptr));
+void ebrDrain(void);
+
+#endif
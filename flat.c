@@ -0,0 +1,784 @@
+/*
+ * flat.c
+ * HASH_FLAT engine for the Hash ADT.
+ *
+ * Open addressing with Robin Hood linear probing.  Each slot
+ * is split across three parallel arrays in the Hash structure:
+ * hashes[], keys[] and values[].  A probe compares the cached
+ * hash values first and only touches the key when the hashes
+ * match, so most probes stay within one or two cache lines of
+ * the hashes[] array.  Short keys sit in keys[] itself.
+ *
+ * The home slot of an entry is the top bits of its hash, and
+ * Robin Hood insertion keeps every probe sequence ordered by
+ * distance from home.  That lets a lookup stop as soon as it
+ * meets an entry closer to its own home than the probe is.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "hashpriv.h"
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+int flatAlloc(Hash *hash, unsigned int num_slots);
+
+static
+void flatInsert(Hash *hash, uint64_t hashval, HashKey key, void *data);
+
+static
+void flatInsertAt(Hash *hash, unsigned int pos, unsigned int dist,
+                  uint64_t hashval, HashKey key, void *data);
+
+static
+int flatFind(Hash *hash, const char *vkey, uint64_t hashval);
+
+static
+int flatResize(Hash *hash, unsigned int num_slots);
+
+static
+int flatGrow(Hash *hash);
+
+static
+unsigned int flatSlots(unsigned int count);
+
+/* One more entry would pass the load factor */
+#define FLAT_FULL(hash)          ((double) ((hash)->count + 1) > \
+                                  (hash)->max_load * (hash)->num_buckets)
+
+/* Home slot and probe distance of a slot's entry */
+#define FLAT_HOME(hash, h)       ((unsigned int) ((h) >> (hash)->shift))
+#define FLAT_DIST(hash, h, pos)  (((pos) - FLAT_HOME(hash, h)) & \
+                                  ((hash)->num_buckets - 1))
+
+
+/* ================= Engine Functions ========================= */
+/* ================= Engine Functions ========================= */
+
+/*
+ * flatInit()
+ * This function sets up an empty HASH_FLAT table.  The
+ * slot count is num_slots rounded up to a power of two.
+ *
+ * INPUT:     hash        Hash table with engine set
+ *            num_slots   Hint for the number of slots
+ * RETURNS:   0           Success
+ *            -1          Error allocating memory
+ */
+int flatInit(Hash *hash, unsigned int num_slots){
+
+  hash->count = 0;
+
+  return flatAlloc(hash, flatSlots(num_slots));
+
+}
+
+
+/*
+ * flatAdd()
+ * This function adds a new key/data pair to a HASH_FLAT
+ * table, growing the table first if the new entry would
+ * take it past its load factor.
+ *
+ * INPUT:    hash     Hash table to add key/data to.
+ *           vkey     String key
+ *           hashval  hashKeyValue() of vkey
+ *           data     Void pointer to data container
+ * RETURNS:  0        Success
+ *           -1       Failure
+ */
+int flatAdd(Hash *hash, const char *vkey, uint64_t hashval, void *data){
+
+  HashKey key;
+
+  if (FLAT_FULL(hash) && flatGrow(hash) != 0)
+    return -1;
+
+  if (hashKeySet(hash, &key, vkey) != 0)
+    return -1;
+
+  flatInsert(hash, hashval, key, data);
+  hash->count++;
+
+  return 0;
+
+}
+
+
+/*
+ * flatFindOrAdd()
+ * This function returns the value slot of vkey, adding vkey
+ * with data first if it is not there.  A lookup that misses
+ * stops at an empty slot or at the first entry closer to its
+ * home than vkey would be, which is just where Robin Hood
+ * insertion from the home slot would put vkey, so the insert
+ * carries on from there instead of probing again.  Only when
+ * the table has to grow first is the new entry looked up
+ * again.
+ *
+ * INPUT:    hash     Hash table
+ *           vkey     String key
+ *           hashval  hashKeyValue() of vkey
+ *           data     Void pointer to data container for a new key
+ *           added    Set to 1 if vkey was added, else 0
+ * RETURNS:  slot     Value slot of vkey
+ *           NULL     Failure
+ */
+void **flatFindOrAdd(Hash *hash, const char *vkey, uint64_t hashval,
+                     void *data, int *added){
+
+  unsigned int  mask = hash->num_buckets - 1;
+  unsigned int  pos  = FLAT_HOME(hash, hashval);
+  unsigned int  dist = 0;
+  uint64_t      h;
+  HashKey       key;
+
+  *added = 0;
+
+  while ((h = hash->hashes[pos]) != 0){
+
+    if (FLAT_DIST(hash, h, pos) < dist)
+      break;
+
+    if (h == hashval && HASH_KEY_EQ(hash, &hash->keys[pos], vkey))
+      return &hash->values[pos];
+
+    pos = (pos + 1) & mask;
+    dist++;
+  }
+
+  if (FLAT_FULL(hash)){
+    if (flatGrow(hash) != 0 || hashKeySet(hash, &key, vkey) != 0)
+      return NULL;
+    flatInsert(hash, hashval, key, data);
+    pos = (unsigned int) flatFind(hash, vkey, hashval);
+  }
+  else {
+    if (hashKeySet(hash, &key, vkey) != 0)
+      return NULL;
+    flatInsertAt(hash, pos, dist, hashval, key, data);
+  }
+
+  hash->count++;
+  *added = 1;
+
+  return &hash->values[pos];
+
+}
+
+
+/*
+ * flatGet()
+ * This function returns the data container for vkey.
+ *
+ * INPUT:     hash      Pointer to hash table.
+ *            vkey      String key for lookup
+ *            hashval   hashKeyValue() of vkey
+ * RETURNS:   data      Pointer to data container
+ *            NULL      vkey not found in hash table
+ */
+void *flatGet(Hash *hash, const char *vkey, uint64_t hashval){
+
+  int pos = flatFind(hash, vkey, hashval);
+
+  return (pos < 0) ? NULL : hash->values[pos];
+
+}
+
+
+/*
+ * flatDelete()
+ * This function removes vkey from the table.  Rather than
+ * leave a tombstone the entries that follow are shifted
+ * back one slot until an empty slot or an entry sitting in
+ * its home slot is reached.  A table left below
+ * MIN_UTILIZATION shrinks.
+ *
+ * INPUT:     hash         Pointer to hash table.
+ *            vkey         String key to remove
+ *            hashval      hashKeyValue() of vkey
+ *            destructor   Destructor for the data container
+ */
+void flatDelete(Hash *hash, const char *vkey, uint64_t hashval,
+                void (*destructor)(void *data)){
+
+  unsigned int  mask = hash->num_buckets - 1;
+  unsigned int  pos;
+  unsigned int  next;
+  int           found;
+
+  found = flatFind(hash, vkey, hashval);
+  if (found < 0)
+    return;
+
+  pos = (unsigned int) found;
+
+  hashKeyRelease(hash, &hash->keys[pos]);
+  if (destructor != NULL)
+    destructor(hash->values[pos]);
+
+  /* Backward shift the rest of the cluster */
+  next = (pos + 1) & mask;
+  while (hash->hashes[next] != 0 &&
+         FLAT_DIST(hash, hash->hashes[next], next) != 0){
+
+    hash->hashes[pos] = hash->hashes[next];
+    hash->keys[pos]   = hash->keys[next];
+    hash->values[pos] = hash->values[next];
+
+    pos  = next;
+    next = (next + 1) & mask;
+  }
+
+  hash->hashes[pos] = 0;
+  hash->values[pos] = NULL;
+
+  hash->count--;
+
+  /* Failing to shrink just leaves the table as it is */
+  if (HASH_SHRINK(hash->count, hash->num_buckets, hash->min_buckets,
+                  hash->max_load))
+    flatResize(hash, flatSlots(HASH_SHRINK_SIZE(hash->count,
+                                                 hash->min_buckets,
+                                                 hash->max_load)));
+
+}
+
+
+/*
+ * flatDestroy()
+ * This function frees every key, data container and
+ * the slot arrays.  hashDestroy() frees the rest.
+ *
+ * INPUT:    hash         Pointer to hash table
+ *           destructor   Function pointer to destructor
+ */
+void flatDestroy(Hash *hash, void (*destructor)(void *data)){
+
+  unsigned int i;
+
+  /* Nothing to free but the arrays, so don't read them */
+  if (destructor != NULL || !HASH_KEYS_UNOWNED(hash)){
+    for (i = 0; i < hash->num_buckets; i++){
+      if (hash->hashes[i] != 0){
+        hashKeyRelease(hash, &hash->keys[i]);
+        if (destructor != NULL)
+          destructor(hash->values[i]);
+      }
+    }
+  }
+
+  free(hash->hashes);
+  free(hash->keys);
+  free(hash->values);
+
+}
+
+
+/*
+ * flatPrefetch()
+ * This function starts loading what a lookup of hashval will
+ * read, so a batch can overlap the cache misses of many keys.
+ * Stage 0 fetches the hashes[] line at the home slot.  Stage 1,
+ * once that line has arrived, fetches the key and value of the
+ * slot whose hash matches, if any, so misses cost one line.
+ *
+ * INPUT:     hash      Pointer to hash table
+ *            hashval   hashKeyValue() of the key
+ *            stage     0 or 1
+ */
+void flatPrefetch(Hash *hash, uint64_t hashval, int stage){
+
+  unsigned int  mask = hash->num_buckets - 1;
+  unsigned int  pos  = FLAT_HOME(hash, hashval);
+  unsigned int  i;
+
+  if (stage == 0){
+    __builtin_prefetch(&hash->hashes[pos]);
+    return;
+  }
+
+  for (i = 0; i < 4; i++, pos = (pos + 1) & mask){
+    if (hash->hashes[pos] == hashval){
+      __builtin_prefetch(&hash->keys[pos]);
+      __builtin_prefetch(&hash->values[pos]);
+      return;
+    }
+  }
+
+}
+
+
+/*
+ * flatPrint()
+ * This function prints every occupied slot.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            printer    Function point to printer function.
+ */
+void flatPrint(Hash *hash, void (*printer)(void *data)){
+
+  unsigned int i;
+
+  for (i = 0; i < hash->num_buckets; i++){
+    if (hash->hashes[i] != 0){
+      printf ("key: %u ",i);
+      printer(hash->values[i]);
+    }
+  }
+
+}
+
+
+/*
+ * flatWalk()
+ * This function calls visit on every occupied slot.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            visit      Called with arg, key, hash and data
+ *            arg        Passed through to visit
+ */
+void flatWalk(Hash *hash, HashVisit visit, void *arg){
+
+  unsigned int i;
+
+  for (i = 0; i < hash->num_buckets; i++)
+    if (hash->hashes[i] != 0)
+      visit(arg, HASH_KEY_STR(&hash->keys[i]), hash->hashes[i],
+            hash->values[i]);
+
+}
+
+
+/*
+ * flatIterNext()
+ * This function moves an iterator to the next occupied slot.
+ * Only hashes[] is read until one is found.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            it         Iterator, it->pos the next slot to try
+ * RETURNS:   1          it holds the entry
+ *            0          No occupied slots left
+ */
+int flatIterNext(Hash *hash, HashIter *it){
+
+  unsigned int i = it->pos;
+
+  while (i < hash->num_buckets && hash->hashes[i] == 0)
+    i++;
+
+  if (i >= hash->num_buckets){
+    it->pos = i;
+    return 0;
+  }
+
+  it->key     = HASH_KEY_STR(&hash->keys[i]);
+  it->hashval = hash->hashes[i];
+  it->data    = hash->values[i];
+  it->pos     = i + 1;
+
+  return 1;
+
+}
+
+
+/*
+ * flatScan()
+ * This function visits the entries whose hash prefix is at
+ * least lo and below hi, see hashScan().  Their home slots are
+ * a run of the table, but Robin Hood probing may have pushed
+ * them past its end, so the scan carries on until a slot is
+ * empty or holds an entry whose home is past the run.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            lo, hi     Hash prefixes of the slice
+ *            visit      Called with arg, key, hash and data
+ *            arg        Passed through to visit
+ */
+void flatScan(Hash *hash, uint64_t lo, uint64_t hi, HashVisit visit,
+              void *arg){
+
+  unsigned int  mask  = hash->num_buckets - 1;
+  unsigned int  first = (unsigned int) (lo >> (hash->shift - 32));
+  unsigned int  span  = (unsigned int) ((hi - 1) >> (hash->shift - 32)) - first;
+  unsigned int  off, pos, dist;
+  uint64_t      h, prefix;
+
+  for (off = 0; off < hash->num_buckets; off++){
+    pos = (first + off) & mask;
+    h   = hash->hashes[pos];
+    if (off > span){
+      if (h == 0)
+        break;
+      dist = FLAT_DIST(hash, h, pos);
+      if (dist <= off && off - dist > span)
+        break;
+    }
+    prefix = HASH_SCAN_PREFIX(h);
+    if (h != 0 && prefix >= lo && prefix < hi)
+      visit(arg, HASH_KEY_STR(&hash->keys[pos]), h, hash->values[pos]);
+  }
+
+}
+
+
+/*
+ * flatStats()
+ * This function adds the table to stats, with each entry's
+ * distance from its home slot in the histogram.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            stats      Running totals, see hashStatsAdd()
+ */
+void flatStats(Hash *hash, HashStats *stats){
+
+  unsigned int i;
+  unsigned int dist;
+
+  for (i = 0; i < hash->num_buckets; i++){
+    if (hash->hashes[i] == 0){
+      stats->empty++;
+      continue;
+    }
+    dist = FLAT_DIST(hash, hash->hashes[i], i);
+    hashStatsHist(stats, dist);
+    hashStatsProbe(stats, dist + 1);
+    stats->key_bytes += hashKeyBytes(hash, &hash->keys[i]);
+  }
+
+  stats->count        += hash->count;
+  stats->size         += hash->num_buckets;
+  stats->bucket_bytes += (size_t) hash->num_buckets *
+                         (sizeof(uint64_t) + sizeof(HashKey) + sizeof(void *));
+
+}
+
+
+/*
+ * flatCompact()
+ * This function resizes the table to the fewest slots that
+ * hold its entries within its load factor and makes that the
+ * size it won't shrink below.
+ *
+ * INPUT:    hash     Hash table
+ * RETURNS:  0        Success
+ *           -1       Error allocating memory
+ */
+int flatCompact(Hash *hash){
+
+  unsigned int slots = HASH_CAP(hash,
+                                flatSlots(HASH_COMPACT_SIZE(hash->count,
+                                                            hash->max_load)));
+
+  if (slots != hash->num_buckets && flatResize(hash, slots) != 0)
+    return -1;
+
+  hash->min_buckets = hash->num_buckets;
+
+  return 0;
+
+}
+
+
+/*
+ * flatReserve()
+ * This function grows the table, if need be, so count
+ * entries fit within its load factor, up to its size limit.
+ *
+ * INPUT:    hash     Hash table
+ *           count    Entries to make room for
+ * RETURNS:  0        Success
+ *           -1       Error allocating memory
+ */
+int flatReserve(Hash *hash, unsigned int count){
+
+  unsigned int slots = HASH_CAP(hash,
+                                flatSlots(HASH_COMPACT_SIZE(count,
+                                                            hash->max_load)));
+
+  if (slots <= hash->num_buckets)
+    return 0;
+
+  return flatResize(hash, slots);
+
+}
+
+
+/*
+ * flatPlace()
+ * This function is flatInsert() kept below slot limit, so
+ * threads building a table with hashBuildBulk() can each fill
+ * their own run of slots.  Should the probe reach limit, the
+ * entry then in hand, which may be one displaced on the way,
+ * is left in entry for the caller to place later with a limit
+ * of 0, meaning none.  The caller counts the entries.
+ *
+ * INPUT:    hash     Hash table with room for the entry
+ *           entry    Entry to place
+ *           limit    First slot not to use, 0 for no limit
+ * RETURNS:  0        Placed
+ *           -1       Reached limit, entry holds what is left
+ */
+int flatPlace(Hash *hash, struct HashEntry *entry, unsigned int limit){
+
+  struct HashEntry  held;
+  unsigned int      pos;
+  unsigned int      dist = 0;
+  unsigned int      resident;
+
+  if (limit == 0){
+    flatInsert(hash, entry->hashval, entry->key, entry->data);
+    return 0;
+  }
+
+  for (pos = FLAT_HOME(hash, entry->hashval); pos < limit; pos++, dist++){
+
+    if (hash->hashes[pos] == 0){
+      hash->hashes[pos] = entry->hashval;
+      hash->keys[pos]   = entry->key;
+      hash->values[pos] = entry->data;
+      return 0;
+    }
+
+    resident = FLAT_DIST(hash, hash->hashes[pos], pos);
+    if (resident < dist){
+      held.hashval      = hash->hashes[pos];
+      held.key          = hash->keys[pos];
+      held.data         = hash->values[pos];
+      hash->hashes[pos] = entry->hashval;
+      hash->keys[pos]   = entry->key;
+      hash->values[pos] = entry->data;
+      *entry            = held;
+      dist              = resident;
+    }
+  }
+
+  return -1;
+
+}
+
+
+/*
+ * flatRelease()
+ * This function frees the keys and data containers of slots
+ * first up to last and empties them, so hashDestroyParallel()
+ * threads can each take a share of the table.
+ *
+ * INPUT:    hash         Hash table
+ *           first, last  Slots, last not included
+ *           destructor   Function pointer to destructor
+ */
+void flatRelease(Hash *hash, unsigned int first, unsigned int last,
+                 void (*destructor)(void *data)){
+
+  unsigned int i;
+
+  for (i = first; i < last; i++){
+    if (hash->hashes[i] != 0){
+      hashKeyRelease(hash, &hash->keys[i]);
+      if (destructor != NULL)
+        destructor(hash->values[i]);
+      hash->hashes[i] = 0;
+    }
+  }
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * flatAlloc()
+ * This function allocates zeroed slot arrays of num_slots
+ * entries and installs them in the hash.
+ */
+static
+int flatAlloc(Hash *hash, unsigned int num_slots){
+
+  unsigned int bits = 0;
+
+  hash->hashes = (uint64_t *) calloc (num_slots, sizeof(uint64_t));
+  hash->keys   = (HashKey *) calloc (num_slots, sizeof(HashKey));
+  hash->values = (void **) calloc (num_slots, sizeof(void *));
+
+  if (hash->hashes == NULL || hash->keys == NULL || hash->values == NULL){
+    free(hash->hashes);
+    free(hash->keys);
+    free(hash->values);
+    return -1;
+  }
+
+  while ((1U << bits) < num_slots)
+    bits++;
+
+  hash->num_buckets = num_slots;
+  hash->shift       = 64 - bits;
+
+  return 0;
+
+}
+
+
+/*
+ * flatInsert()
+ * This function places an entry using Robin Hood probing.
+ * Whenever the entry being placed is further from home than
+ * the resident entry they swap and the resident carries on
+ * probing.  The caller must make sure a free slot exists.
+ */
+static
+void flatInsert(Hash *hash, uint64_t hashval, HashKey key, void *data){
+
+  flatInsertAt(hash, FLAT_HOME(hash, hashval), 0, hashval, key, data);
+
+}
+
+
+/*
+ * flatInsertAt()
+ * This function is flatInsert() carrying on from slot pos,
+ * dist slots from home, where a lookup left off.  The new
+ * entry always lands in pos.
+ */
+static
+void flatInsertAt(Hash *hash, unsigned int pos, unsigned int dist,
+                  uint64_t hashval, HashKey key, void *data){
+
+  unsigned int  mask = hash->num_buckets - 1;
+  unsigned int  resident;
+  uint64_t      th;
+  HashKey       tk;
+  void          *td;
+
+  while (hash->hashes[pos] != 0){
+
+    resident = FLAT_DIST(hash, hash->hashes[pos], pos);
+
+    if (resident < dist){
+      th = hash->hashes[pos];  hash->hashes[pos] = hashval;  hashval = th;
+      tk = hash->keys[pos];    hash->keys[pos]   = key;      key     = tk;
+      td = hash->values[pos];  hash->values[pos] = data;     data    = td;
+      dist = resident;
+    }
+
+    pos = (pos + 1) & mask;
+    dist++;
+  }
+
+  hash->hashes[pos] = hashval;
+  hash->keys[pos]   = key;
+  hash->values[pos] = data;
+
+}
+
+
+/*
+ * flatFind()
+ * This function returns the slot holding vkey or -1.
+ */
+static
+int flatFind(Hash *hash, const char *vkey, uint64_t hashval){
+
+  unsigned int  mask    = hash->num_buckets - 1;
+  unsigned int  pos     = FLAT_HOME(hash, hashval);
+  unsigned int  dist    = 0;
+  uint64_t      h;
+
+  while ((h = hash->hashes[pos]) != 0){
+
+    /* Anything here is closer to home than we would be */
+    if (FLAT_DIST(hash, h, pos) < dist)
+      break;
+
+    if (h == hashval && HASH_KEY_EQ(hash, &hash->keys[pos], vkey))
+      return (int) pos;
+
+    pos = (pos + 1) & mask;
+    dist++;
+  }
+
+  return -1;
+
+}
+
+
+/*
+ * flatResize()
+ * This function moves every entry to new slot arrays of
+ * num_slots, a power of two, using its cached hash value.
+ * The caller makes sure the entries fit.
+ */
+static
+int flatResize(Hash *hash, unsigned int num_slots){
+
+  uint64_t      *oldHashes = hash->hashes;
+  HashKey       *oldKeys   = hash->keys;
+  void          **oldVals  = hash->values;
+  unsigned int  oldSlots   = hash->num_buckets;
+  unsigned int  oldShift   = hash->shift;
+  unsigned int  i;
+  double        start      = hashNow();
+
+  if (flatAlloc(hash, num_slots) != 0){
+    hash->hashes = oldHashes;
+    hash->keys   = oldKeys;
+    hash->values = oldVals;
+    hash->shift  = oldShift;
+    return -1;
+  }
+
+  for (i = 0; i < oldSlots; i++)
+    if (oldHashes[i] != 0)
+      flatInsert(hash, oldHashes[i], oldKeys[i], oldVals[i]);
+
+  free(oldHashes);
+  free(oldKeys);
+  free(oldVals);
+
+  hash->rehashes++;
+  hash->rehash_secs += hashNow() - start;
+
+  return 0;
+
+}
+
+
+/*
+ * flatGrow()
+ * This function makes room for one more entry, called when
+ * FLAT_FULL().  A table at its size limit takes no more.
+ */
+static
+int flatGrow(Hash *hash){
+
+  unsigned int slots = hashGrowSize(hash->num_buckets, hash->growth,
+                                    hash->max_buckets, 1);
+
+  if (slots == hash->num_buckets)
+    return -1;
+
+  return flatResize(hash, slots);
+
+}
+
+
+/*
+ * flatSlots()
+ * This function returns the power of two slot count, no
+ * smaller than FLAT_MIN_SLOTS, for at least count slots.
+ */
+static
+unsigned int flatSlots(unsigned int count){
+
+  unsigned int slots = FLAT_MIN_SLOTS;
+
+  while (slots < count && slots < 0x80000000U)
+    slots <<= 1;
+
+  return slots;
+
+}
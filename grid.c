@@ -0,0 +1,301 @@
+/*
+ * grid.c
+ * Uniform grid spatial index over latitude/longitude boxes.
+ *
+ * The only way into a quadrangle table is an exact hashGet()
+ * on its DRG code, so asking which quadrangles hold a point
+ * meant walking every record.  A Grid cuts the plane into
+ * cells of cell degrees and copies each box into every cell
+ * it touches.  A point query is one hashGetInt() for its cell
+ * and a test of the few boxes stored there, all in one block.
+ * A range query visits each cell the range covers.
+ *
+ * A box touching several cells would be found once per cell
+ * by a range query.  Rather than mark boxes as seen, a box is
+ * reported only from the cell holding the south-west corner of
+ * its overlap with the range, which is exactly one of the
+ * cells visited.  Queries write nothing, so any number of
+ * threads may query a grid no one is adding to.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hash.h"
+#include "grid.h"
+
+/* Boxes listed in one cell, copied so a query reads one block */
+struct GridCell {
+  unsigned int  count;
+  unsigned int  size;
+  GridBox       boxes[];
+};
+
+/* Row or column of a coordinate */
+#define GRID_INDEX(grid, v)      ((int32_t) floor((v) / (grid)->cell))
+
+/* Table key of a cell */
+#define GRID_KEY(row, col)       (((uint64_t) (uint32_t) (row) << 32) | \
+                                  (uint32_t) (col))
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+int gridList(Grid *grid, int32_t row, int32_t col, GridBox *box);
+
+
+/* =================== Public Functions ====================== */
+/* =================== Public Functions ====================== */
+
+/*
+ * gridCreate()
+ * This function creates an empty grid.  Cells about the size
+ * of a typical box work best: much larger and a query tests
+ * boxes that are nowhere near, much smaller and every box is
+ * listed in many cells.
+ *
+ * INPUT:     cell        Cell edge in degrees, 0 for GRID_CELL
+ * RETURNS:   grid        Pointer to new grid
+ *            NULL        Error allocating memory
+ */
+Grid *gridCreate(double cell){
+
+  Grid *grid;
+
+  grid = (Grid *) malloc (sizeof(Grid));
+  if (grid == NULL)
+    return NULL;
+
+  memset(grid, 0, sizeof(Grid));
+  grid->cell  = (cell > 0) ? cell : GRID_CELL;
+  grid->cells = hashCreateEngine(10, HASH_FLAT);
+  if (grid->cells == NULL ||
+      hashSetKeySize(grid->cells, HASH_KEY_U64) != 0){
+    if (grid->cells != NULL)
+      hashDestroy(grid->cells, NULL);
+    free(grid);
+    return NULL;
+  }
+
+  return grid;
+
+}
+
+
+/*
+ * gridAdd()
+ * This function adds a box given by two opposite corners, in
+ * either order, and lists it in every cell it touches.
+ *
+ * INPUT:     grid        Grid
+ *            lat1, lon1  One corner
+ *            lat2, lon2  The opposite corner
+ *            data        Data container handed back by queries
+ * RETURNS:   0           Success
+ *            -1          Error allocating memory, or the box
+ *                        covers more than GRID_MAX_SPAN cells
+ */
+int gridAdd(Grid *grid, float lat1, float lon1, float lat2, float lon2,
+            void *data){
+
+  GridBox       box;
+  int32_t       row, row0, row1;
+  int32_t       col, col0, col1;
+
+  box.south = (lat1 < lat2) ? lat1 : lat2;
+  box.north = (lat1 < lat2) ? lat2 : lat1;
+  box.west  = (lon1 < lon2) ? lon1 : lon2;
+  box.east  = (lon1 < lon2) ? lon2 : lon1;
+  box.data  = data;
+
+  row0 = GRID_INDEX(grid, box.south);
+  row1 = GRID_INDEX(grid, box.north);
+  col0 = GRID_INDEX(grid, box.west);
+  col1 = GRID_INDEX(grid, box.east);
+  if ((double) (row1 - row0 + 1) * (col1 - col0 + 1) > GRID_MAX_SPAN)
+    return -1;
+
+  /* A failed listing leaves the box in some cells, harmless */
+  for (row = row0; row <= row1; row++)
+    for (col = col0; col <= col1; col++)
+      if (gridList(grid, row, col, &box) != 0)
+        return -1;
+
+  grid->count++;
+
+  return 0;
+
+}
+
+
+/*
+ * gridPoint()
+ * This function finds the boxes holding a point.  Up to max
+ * of their data containers are stored in out.
+ *
+ * INPUT:     grid        Grid
+ *            lat, lon    Point
+ *            out         Filled in with data containers
+ *            max         Room in out
+ * RETURNS:   unsigned    Number of boxes holding the point,
+ *                        which may be more than max
+ */
+unsigned int gridPoint(Grid *grid, double lat, double lon,
+                       void **out, unsigned int max){
+
+  struct GridCell  *cell;
+  GridBox          *box;
+  unsigned int     found = 0;
+  unsigned int     i;
+
+  cell = (struct GridCell *)
+         hashGetInt(grid->cells, GRID_KEY(GRID_INDEX(grid, lat),
+                                          GRID_INDEX(grid, lon)));
+  if (cell == NULL)
+    return 0;
+
+  for (i = 0; i < cell->count; i++){
+    box = &cell->boxes[i];
+    if (lat >= box->south && lat <= box->north &&
+        lon >= box->west && lon <= box->east){
+      if (found < max)
+        out[found] = box->data;
+      found++;
+    }
+  }
+
+  return found;
+
+}
+
+
+/*
+ * gridRange()
+ * This function finds the boxes that meet a range, edges
+ * included.  Up to max of their data containers are stored
+ * in out.  Each box is reported once however many of the
+ * range's cells it touches.
+ *
+ * INPUT:     grid          Grid
+ *            south, west   South-west corner of the range
+ *            north, east   North-east corner of the range
+ *            out           Filled in with data containers
+ *            max           Room in out
+ * RETURNS:   unsigned      Number of boxes meeting the range,
+ *                          which may be more than max
+ */
+unsigned int gridRange(Grid *grid, double south, double west,
+                       double north, double east,
+                       void **out, unsigned int max){
+
+  struct GridCell  *cell;
+  GridBox          *box;
+  unsigned int     found = 0;
+  unsigned int     i;
+  int32_t          row, row0, row1;
+  int32_t          col, col0, col1;
+
+  row0 = GRID_INDEX(grid, south);
+  row1 = GRID_INDEX(grid, north);
+  col0 = GRID_INDEX(grid, west);
+  col1 = GRID_INDEX(grid, east);
+
+  for (row = row0; row <= row1; row++){
+    for (col = col0; col <= col1; col++){
+
+      cell = (struct GridCell *) hashGetInt(grid->cells, GRID_KEY(row, col));
+      if (cell == NULL)
+        continue;
+
+      for (i = 0; i < cell->count; i++){
+        box = &cell->boxes[i];
+        if (box->south > north || box->north < south ||
+            box->west > east || box->east < west)
+          continue;
+
+        /* Only the cell of the overlap's south-west corner */
+        if (GRID_INDEX(grid, (box->south > south) ? box->south : south)
+              != row ||
+            GRID_INDEX(grid, (box->west > west) ? box->west : west) != col)
+          continue;
+
+        if (found < max)
+          out[found] = box->data;
+        found++;
+      }
+
+    } /* end for (col = col0; col <= col1; col++) */
+  } /* end for (row = row0; row <= row1; row++) */
+
+  return found;
+
+}
+
+
+/*
+ * gridDestroy()
+ * This function frees the grid.  The data containers belong
+ * to the caller.
+ *
+ * INPUT:     grid        Grid
+ */
+void gridDestroy(Grid *grid){
+
+  if (grid == NULL)
+    return;
+
+  hashDestroy(grid->cells, free);
+  free(grid);
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * gridList()
+ * This function copies a box into a cell, creating the cell
+ * on first use.  A full cell is copied into one twice the
+ * size, which takes the old one's place under the same key
+ * without the key ever leaving the table, so a failure keeps
+ * every box the cell held.
+ */
+static
+int gridList(Grid *grid, int32_t row, int32_t col, GridBox *box){
+
+  struct GridCell  *cell;
+  struct GridCell  *grown;
+  unsigned int     size;
+  uint64_t         key = GRID_KEY(row, col);
+
+  cell = (struct GridCell *) hashGetInt(grid->cells, key);
+
+  if (cell == NULL || cell->count == cell->size){
+    size  = (cell != NULL) ? cell->size * 2 : 4;
+    grown = (struct GridCell *) malloc (sizeof(struct GridCell) +
+                                        size * sizeof(GridBox));
+    if (grown == NULL)
+      return -1;
+    grown->count = 0;
+    grown->size  = size;
+    if (cell != NULL){
+      memcpy(grown->boxes, cell->boxes, cell->count * sizeof(GridBox));
+      grown->count = cell->count;
+    }
+    /* The old cell stays listed until the grown one replaces it */
+    if (hashUpsertInt(grid->cells, key, grown, NULL, NULL) < 0){
+      free(grown);
+      return -1;
+    }
+    free(cell);
+    cell = grown;
+  }
+
+  cell->boxes[cell->count++] = *box;
+
+  return 0;
+
+}
@@ -0,0 +1,65 @@
+/*
+ * grid.h
+ * Header file for the uniform grid spatial index.
+ *
+ * A Grid holds latitude/longitude boxes, such as the corners
+ * of USGS quadrangles, and answers which boxes hold a point
+ * or meet a range.  The plane is cut into square cells and a
+ * box is copied into every cell it touches.  The cells live in
+ * a HASH_FLAT table keyed by the packed row and column, so
+ * only cells that hold something take memory.  Boxes are
+ * closed, a point on a shared edge is in both boxes, and must
+ * not cross the 180th meridian.
+ *
+ * FUNCTIONS:        gridCreate         Create an empty index.
+ *                   gridAdd            Add a box.
+ *                   gridPoint          Boxes holding a point.
+ *                   gridRange          Boxes meeting a range.
+ *                   gridDestroy        Free the index.
+ */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include "hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default cell edge in degrees, one 15 minute quadrangle */
+#define GRID_CELL        0.25
+
+/* Most cells one box may cover */
+#define GRID_MAX_SPAN    65536
+
+/* Box and its data container */
+typedef struct GridBox {
+  float     south, west;
+  float     north, east;
+  void      *data;
+} GridBox;
+
+typedef struct Grid {
+
+  Hash          *cells;     /* Packed row/column to struct GridCell */
+  double        cell;       /* Cell edge in degrees */
+  unsigned int  count;      /* Boxes added */
+
+} Grid;
+
+Grid *gridCreate(double cell);
+int gridAdd(Grid *grid, float lat1, float lon1, float lat2, float lon2,
+            void *data);
+unsigned int gridPoint(Grid *grid, double lat, double lon,
+                       void **out, unsigned int max);
+unsigned int gridRange(Grid *grid, double south, double west,
+                       double north, double east,
+                       void **out, unsigned int max);
+void gridDestroy(Grid *grid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -8,17 +8,28 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "hash.h"
+#include "hashpriv.h"
+#include "place.h"
 
 /* =============== Private Function Prototypes ================*/
 /* =============== Private Function Prototypes ================*/
 
 static
-unsigned int hash_fval_string(const void *vkey,
-			      unsigned int num_buckets);
+unsigned int hashBucket(uint64_t hashval, unsigned int num_buckets);
 
 static
-void hashFreeNode(struct HashNode *hashNodePtr,
+unsigned int hashBatch(Hash *hash, char **keys, unsigned int n,
+                       void **data, int add);
+
+static
+void hashPrefetch(Hash *hash, uint64_t *hashvals, char **keys,
+                  unsigned int i, int stage);
+
+static
+void hashFreeNode(Hash *hash, struct HashNode *hashNodePtr,
                   void (*destructor)(void *data));
 
 static
@@ -29,7 +40,33 @@ static
 void hashRehash(Hash *hash, unsigned int num_buckets);
 
 static
-unsigned int hashPrime(unsigned int value);
+void hashRehashStep(Hash *hash, unsigned int steps);
+
+static
+int hashRepack(Hash *hash);
+
+static
+int hashIterTable(Hash *hash, HashIter *it);
+
+static
+void hashDestroyArray(Hash *hash, struct HashNode **hashArray,
+                      unsigned int num_buckets,
+                      void (*destructor)(void *data));
+
+static
+void hashPrintArray(struct HashNode **hashArray,
+                    unsigned int num_buckets,
+                    void (*printer)(void *data));
+
+static
+struct HashNode **hashBucketOf(Hash *hash, uint64_t hashval);
+
+static
+struct HashNode *hashNodeNew(Hash *hash, struct HashNode **bucket,
+                             const char *vkey, uint64_t hashval, void *data);
+
+static
+void *hashKeep(void *old, void *data);
 
 static
 void freemem(void *mem);
@@ -53,14 +90,105 @@ void freemem(void *mem);
 
 Hash *hashCreate(unsigned int num_buckets){
 
+  return hashCreateEngine(num_buckets, HASH_CHAINED);
+
+}
+
+
+/* =================== hashCreateEngine() ==================== */
+/* =================== hashCreateEngine() ==================== */
+
+/*
+ * hashCreateEngine()
+ * This function creates a new hash table using the
+ * specified table engine (see hash.h).  For the open
+ * addressing engines num_buckets is rounded up to a power
+ * of two.
+ *
+ * INPUT:     num_buckets     Number of hash table entries.
+ *            engine          HASH_CHAINED, HASH_FLAT or
+ *                            HASH_SWISS, optionally or'ed
+ *                            with HASH_ARENA, HASH_BORROWED,
+ *                            HASH_CONCURRENT
+ *                            and, for HASH_CHAINED,
+ *                            HASH_INCREMENTAL
+ * RETURNS:   hash            Pointer to new hash table
+ *            NULL            Error allocating memory or
+ *                            unknown engine
+ */
+
+Hash *hashCreateEngine(unsigned int num_buckets, int engine){
+
   Hash *hash;
   unsigned int  bucket_count;
 
   hash = (Hash *) malloc (sizeof(Hash));
+  if (hash == NULL)
+    return NULL;
+
+  memset(hash, 0, sizeof(Hash));
+  hash->flags    = engine & ~HASH_ENGINE_MASK;
+  hash->engine   = engine = engine & HASH_ENGINE_MASK;
+  hash->hashfn   = HASH_FN_DEFAULT;
+  hash->seed     = hashFnSeed();
+  hash->max_load = MAX_UTILIZATION;
+
+  if (hash->flags & (HASH_LOCKFREE | HASH_NUMA))
+    hash->flags |= HASH_CONCURRENT;
+
+  /* Segments are whole tables of their own */
+  if (hash->flags & HASH_CONCURRENT){
+    if ((hash->flags & HASH_INCREMENTAL) != 0 ||
+        ((hash->flags & HASH_LOCKFREE) != 0 &&
+         (engine != HASH_CHAINED ||
+          (hash->flags & (HASH_ARENA | HASH_BORROWED)) != 0)) ||
+        (engine != HASH_CHAINED && engine != HASH_FLAT &&
+         engine != HASH_SWISS) ||
+        concInit(hash, num_buckets) != 0){
+      free(hash);
+      return NULL;
+    }
+    return hash;
+  }
+
+  /* Keys, and chained nodes, come from arenas */
+  if (hash->flags & HASH_ARENA){
+    hash->keyArena = arenaCreate(0);
+    if (engine == HASH_CHAINED)
+      hash->nodeArena = arenaCreate(sizeof(struct HashNode));
+    if (hash->keyArena == NULL ||
+        (engine == HASH_CHAINED && hash->nodeArena == NULL)){
+      arenaDestroy(hash->keyArena);
+      arenaDestroy(hash->nodeArena);
+      free(hash);
+      return NULL;
+    }
+  }
+
+  if (engine == HASH_FLAT || engine == HASH_SWISS){
+    if ((hash->flags & ~(HASH_ARENA | HASH_BORROWED)) != 0 ||
+        (engine == HASH_FLAT  && flatInit(hash, num_buckets) != 0) ||
+        (engine == HASH_SWISS && swissInit(hash, num_buckets) != 0)){
+      arenaDestroy(hash->keyArena);
+      free(hash);
+      return NULL;
+    }
+    hash->min_buckets = hash->num_buckets;
+    return hash;
+  }
+
+  if (engine != HASH_CHAINED ||
+      (hash->flags & ~(HASH_INCREMENTAL | HASH_ARENA | HASH_BORROWED)) != 0){
+    arenaDestroy(hash->keyArena);
+    arenaDestroy(hash->nodeArena);
+    free(hash);
+    return NULL;
+  }
 
   bucket_count = hashPrime(num_buckets);
 
   hash->num_buckets = bucket_count;
+  hash->min_buckets = bucket_count;
   hash->count       = 0;
 
   /*
@@ -69,6 +197,12 @@ Hash *hashCreate(unsigned int num_buckets){
    */
   hash->array = (struct HashNode **) malloc ((bucket_count) *
                                              sizeof (struct HashNode *));
+  if (hash->array == NULL){
+    arenaDestroy(hash->keyArena);
+    arenaDestroy(hash->nodeArena);
+    free(hash);
+    return NULL;
+  }
 
   /* Initialize array pointers to null */
   memset(hash->array, 0 ,bucket_count * sizeof (struct HashNode *));
@@ -78,6 +212,46 @@ Hash *hashCreate(unsigned int num_buckets){
 }
 
 
+/* =================== hashCreateOptions() =================== */
+/* =================== hashCreateOptions() =================== */
+
+/*
+ * hashCreateOptions()
+ * This function creates a new hash table like
+ * hashCreateEngine(), starting at options->min_buckets and
+ * growing by the load factor, growth factor and size limit of
+ * options (see HashOptions in hash.h) rather than by
+ * MAX_UTILIZATION and sizes[].
+ *
+ * INPUT:     engine          As for hashCreateEngine()
+ *            options         Table options
+ * RETURNS:   hash            Pointer to new hash table
+ *            NULL            Error allocating memory, unknown
+ *                            engine or options out of range
+ */
+Hash *hashCreateOptions(int engine, const HashOptions *options){
+
+  Hash  *hash;
+  int   open;
+
+  open = ((engine & HASH_ENGINE_MASK) == HASH_FLAT ||
+          (engine & HASH_ENGINE_MASK) == HASH_SWISS);
+
+  if (options->max_load < 0 || (open && options->max_load >= 1) ||
+      (options->growth != 0 && options->growth <= 1) ||
+      (options->max_buckets != 0 &&
+       options->max_buckets < options->min_buckets))
+    return NULL;
+
+  hash = hashCreateEngine(options->min_buckets, engine);
+  if (hash != NULL)
+    hashSetOptions(hash, options);
+
+  return hash;
+
+} /* end hashCreateOptions() */
+
+
 /* ====================== hashCount() ======================== */
 /* ====================== hashCount() ======================== */
 
@@ -90,6 +264,8 @@ Hash *hashCreate(unsigned int num_buckets){
  * RETURNS:    unsigned int    Number of nodes in hash table
  */
 unsigned int hashCount(Hash *hash){
+  if (hash->flags & HASH_CONCURRENT)
+    return concCount(hash,0);
   return (hash->count);
 }
 
@@ -105,358 +281,1936 @@ unsigned int hashCount(Hash *hash){
  * RETURNS:    unsigned int    Size of hash table
  */
 unsigned int hashSize(Hash *hash){
+  if (hash->flags & HASH_CONCURRENT)
+    return concCount(hash,1);
   return (hash->num_buckets);
 }
 
 
-
-/* ===================== hashDestroy() ======================= */
-/* ===================== hashDestroy() ======================= */
+/* ====================== hashStats() ======================== */
+/* ====================== hashStats() ======================== */
 
 /*
- * hashDestroy()
- * This function destroys the hash table.
- * The function requires a destructor function
- * which deallocates the data container.
+ * hashStats()
+ * This function fills in the health of a table: load, the
+ * chain or probe length histogram, resizes so far and the
+ * bytes it holds (see HashStats in hash.h).  It walks every
+ * bucket or slot, so it costs about as much as hashWalk().
+ * A HASH_CONCURRENT table is read one segment at a time under
+ * its lock, so the figures are only a snapshot while other
+ * threads write.
  *
- * INPUT:    hash         Pointer to hash table
- *           destructor   Function pointer to destructor
- * RETURNS:  None.
+ * INPUT:      hash            Hash table
+ *             stats           Filled in
+ * RETURNS:    0               Success
  */
-void hashDestroy(Hash *hash, void (*destructor)(void *data)){
+int hashStats(Hash *hash, HashStats *stats){
+
+  memset(stats,0,sizeof(HashStats));
+  stats->engine = hash->engine;
+
+  if (hash->flags & HASH_CONCURRENT)
+    concStats(hash,stats);
+  else
+    hashStatsAdd(hash,stats);
+
+  /* mean_probe has summed the probe lengths so far */
+  if (stats->count > 0)
+    stats->mean_probe /= stats->count;
+  if (stats->size > 0){
+    stats->load_factor = (double) stats->count / stats->size;
+    stats->empty_ratio = (double) stats->empty / stats->size;
+  }
 
-  unsigned int      i;
-  struct HashNode   *hashNodePtr;
-  struct HashNode   *tmp;
+  return 0;
 
-  /* Loop through hash table and deallocate buckets */
-  for (i = 0; i < hash->num_buckets; i++){
+} /* end hashStats() */
 
-    /* Get first node of bucket list */
-    hashNodePtr = hash->array[i];
 
-    while (hashNodePtr != NULL){
+/* ===================== hashCompact() ======================= */
+/* ===================== hashCompact() ======================= */
+
+/*
+ * hashCompact()
+ * This function rebuilds a table into the smallest bucket or
+ * slot array that holds its entries within its load factor,
+ * finishing any HASH_INCREMENTAL resize and dropping HASH_SWISS
+ * tombstones on the way.  A HASH_ARENA table also has its keys,
+ * and chained nodes, copied into fresh arenas, so the memory
+ * of deleted entries is given back.  The new size becomes the
+ * floor automatic shrinking stops at.
+ *
+ * Deletes shrink a table on their own once it is less than
+ * MIN_UTILIZATION full.  hashCompact() is for when the entry
+ * count has settled, say after a bulk delete, and scans and
+ * memory should follow it exactly.  It costs about as much as
+ * a resize.  A HASH_CONCURRENT table is compacted a segment at
+ * a time.  A HASH_IMAGE table is packed already.
+ *
+ * INPUT:      hash            Hash table
+ * RETURNS:    0               Success
+ *             -1              Error allocating memory, the
+ *                             table is intact but may not be
+ *                             compacted
+ */
+int hashCompact(Hash *hash){
+
+  unsigned int  size;
+  int           flags;
+
+  if (hash->flags & HASH_CONCURRENT)
+    return concCompact(hash);
+
+  switch (hash->engine){
+    case HASH_FLAT:
+      if (flatCompact(hash) != 0)
+        return -1;
+      break;
+    case HASH_SWISS:
+      if (swissCompact(hash) != 0)
+        return -1;
+      break;
+    case HASH_IMAGE:
+      return 0;
+    default:
+      while (hash->oldArray != NULL)
+        hashRehashStep(hash,hash->old_buckets);
 
       /*
-       * Save pointer to next node,
-       * free current node, and continue.
+       * Rehash in one go, not incrementally.  Buckets are picked
+       * by HASH_FASTRANGE(), so any size will do and sizes[] is
+       * too coarse to round up to: 1041 entries would get 8191.
        */
-      tmp = hashNodePtr->next;
-      hashFreeNode(hashNodePtr,destructor);
-      hashNodePtr = tmp;
-
-    } /* end while (hashNodePtr != NULL) */
-
-  } /* end for (i = 0; i <= hash.num_buckets; i++) */
-
-  /* Free hash table array */
-  if (hash->array != NULL)
-    free(hash->array);
+      size  = HASH_CAP(hash,HASH_COMPACT_SIZE(hash->count,hash->max_load));
+      flags = hash->flags;
+      hash->flags &= ~HASH_INCREMENTAL;
+      if (size != hash->num_buckets)
+        hashRehash(hash,size);
+      hash->flags = flags;
+      if (hash->num_buckets != size)
+        return -1;
+      hash->min_buckets = size;
+      break;
+  }
 
-  /* Free hash structure */
-  if (hash != NULL)
-    free(hash);
+  return hashRepack(hash);
 
-} /* end hashDestroy() */
+} /* end hashCompact() */
 
 
-/* ======================= hashAdd() ========================= */
-/* ======================= hashAdd() ========================= */
+/* ===================== hashReserve() ======================= */
+/* ===================== hashReserve() ======================= */
 
 /*
- * hashAdd()
- * This function adds a new key/data pair to the
- * hash table.
+ * hashReserve()
+ * This function grows a table, if need be, so that count
+ * entries in all fit without a resize, as far as its
+ * max_buckets allows.  A loader that knows how many entries
+ * are coming calls it first and never rehashes on the way.
+ * A chained table finishes any HASH_INCREMENTAL resize and is
+ * rehashed in one go.  A HASH_CONCURRENT table reserves a
+ * little over an even share in every segment, since keys do
+ * not spread exactly evenly.
  *
- * INPUT:    hash    Hash table to add key/data to.
- *           vkey    String key (that gets hashed)
- *           data    Void pointer to data container
- * RETURNS:  0       Success
- *           -1      Failure
+ * INPUT:      hash            Hash table
+ *             count           Entries to make room for
+ * RETURNS:    0               Success
+ *             -1              Error allocating memory, or a
+ *                             HASH_IMAGE table
  */
-int hashAdd(Hash *hash, char *vkey, void *data){
-  unsigned int      key;
-  struct HashNode   *hashNode;
-  int               ret = -1;
+int hashReserve(Hash *hash, unsigned int count){
 
-  hashNode = (struct HashNode *) malloc (sizeof(struct HashNode));
-  if (hashNode != NULL) {
+  unsigned int  size;
+  int           flags;
 
-    /* Allocate space for vkey */
-    hashNode->vkey = (char *) malloc (strlen(vkey) * sizeof(char));
+  if (hash->flags & HASH_CONCURRENT)
+    return concReserve(hash,count);
 
-    if (hashNode->vkey != NULL){
+  switch (hash->engine){
+    case HASH_FLAT:   return flatReserve(hash,count);
+    case HASH_SWISS:  return swissReserve(hash,count);
+    case HASH_IMAGE:  return -1;
+  }
 
-      strcpy(hashNode->vkey,vkey);       /* Copy vkey to hashNode */
-      hashNode->data = data;             /* Point data to data container */
+  /* Exact, as for hashCompact(), sizes[] would overshoot */
+  size = HASH_CAP(hash,HASH_COMPACT_SIZE(count,hash->max_load));
+  if (size <= hash->num_buckets)
+    return 0;
 
-      /* Insert node into bucket array */
-      hashArrayInsert(hash->array,hashNode,hash->num_buckets);
+  while (hash->oldArray != NULL)
+    hashRehashStep(hash,hash->old_buckets);
 
-      hash->count++;                     /* Increase node count */
+  flags = hash->flags;
+  hash->flags &= ~HASH_INCREMENTAL;
+  hashRehash(hash,size);
+  hash->flags = flags;
 
-      /*
-       * Check if we're reached max allowable table
-       * utilization then rehash with next largest
-       * prime from sizes[] array.
-       */
-      if (hash->count/hash->num_buckets > MAX_UTILIZATION)
-	hashRehash(hash, hashPrime(hash->num_buckets + 1));
+  return (hash->num_buckets == size) ? 0 : -1;
 
-      ret = 0;                           /* Return success */
-    }
-    else {
-      free(hashNode);                    /* Malloc failure free node */
-    }
+} /* end hashReserve() */
 
-  } /* end if (hashNode != NULL) */
- 
 
-  return ret;
+/* ==================== hashIterBegin() ====================== */
+/* ==================== hashIterBegin() ====================== */
 
-} /* end hashAdd() */
+/*
+ * hashIterBegin()
+ * This function sets an iterator before the first entry of
+ * a table, see Iteration in hash.h.  No memory is allocated,
+ * so there is nothing to end.
+ *
+ *   HashIter it;
+ *
+ *   hashIterBegin(hash,&it);
+ *   while (hashIterNext(&it))
+ *     use(it.key,it.data);
+ *
+ * INPUT:      hash            Hash table
+ *             it              Iterator to set up
+ */
+void hashIterBegin(Hash *hash, HashIter *it){
 
+  memset(it,0,sizeof(HashIter));
+  it->hash = hash;
 
-/* ======================= hashDelete() ====================== */
-/* ======================= hashDelete() ====================== */
+} /* end hashIterBegin() */
+
+
+/* ==================== hashIterNext() ======================= */
+/* ==================== hashIterNext() ======================= */
 
 /*
- * hashDelete()
- * This function deletes the specified note
- * from the hash table given the key.
+ * hashIterNext()
+ * This function moves an iterator to the next entry and sets
+ * its key, hashval and data.  A HASH_CONCURRENT table is
+ * walked a segment at a time without locks, so no thread may
+ * write to it meanwhile; use hashScan() for that.
+ *
+ * INPUT:      it              Iterator from hashIterBegin()
+ * RETURNS:    1               it holds the next entry
+ *             0               No entries left
  */
-void hashDelete(Hash *hash, char *vkey,
-                void (*destructor)(void *data)){
-
-  unsigned int     key;
-  struct HashNode  *prevHashNodePtr;
-  struct HashNode  *nextHashNodePtr;
+int hashIterNext(HashIter *it){
+
+  Hash                *hash = it->hash;
+  struct HashSegment  *seg;
+
+  if ((hash->flags & HASH_CONCURRENT) == 0)
+    return hashIterTable(hash,it);
+
+  for (; it->segment < HASH_SEGMENTS; it->segment++){
+    seg = &hash->segments[it->segment];
+    if (seg->table != NULL ? hashIterTable(seg->table,it)
+                           : lockfreeIterNext(seg,it))
+      return 1;
+    it->pos  = 0;
+    it->node = NULL;
+    it->old  = 0;
+  }
 
-  if (hash != NULL){
+  return 0;
 
-    /* Get hashed key */
-    key = hash_fval_string(vkey,hash->num_buckets);
+} /* end hashIterNext() */
 
-    if (hash->array[key] != NULL) {
 
-      /* Get bucket pointer */
-      prevHashNodePtr = hash->array[key];
+/* ====================== hashScan() ========================= */
+/* ====================== hashScan() ========================= */
 
-      /* Handle case when first node matches */
-      if (strcmp(prevHashNodePtr->vkey,vkey) == 0){
-	    hash->array[key] = prevHashNodePtr->next;
-	    hashFreeNode(prevHashNodePtr,destructor);
-      }
-      else {
-	    nextHashNodePtr = prevHashNodePtr->next;
+/*
+ * hashScan()
+ * This function visits one slice of a table, about count
+ * buckets or slots of it, and returns the cursor for the next
+ * call, see Iteration in hash.h.  The table may be resized,
+ * added to and deleted from between calls.  A HASH_CONCURRENT
+ * table's slice is visited under its segment's read lock, so
+ * other threads may keep writing; visit must not write to the
+ * table itself.  A HASH_IMAGE table never changes, so its
+ * cursor is simply an entry number.
+ *
+ * INPUT:      hash            Hash table
+ *             cursor          0 to start, else the last return
+ *             count           Buckets or slots to look at, about
+ *             visit           Called with arg, key, hash and data
+ *             arg             Passed through to visit
+ * RETURNS:    uint64_t        Cursor for the next call, 0 once
+ *                             the whole table is done
+ */
+uint64_t hashScan(Hash *hash, uint64_t cursor, unsigned int count,
+                  HashVisit visit, void *arg){
 
-	    /* Loop through bucket list */
-	    while (nextHashNodePtr != NULL){
+  unsigned int  segment = (unsigned int) (cursor >> 32);
+  uint64_t      lo      = cursor & (HASH_SCAN_END - 1);
+  uint64_t      hi;
 
-	      if (strcmp(nextHashNodePtr->vkey,vkey) == 0){
-	        prevHashNodePtr->next = nextHashNodePtr->next;
-	        break;
-	      }
+  if (count == 0)
+    count = 1;
 
-	      /* Update prev and next pointers */
-	      prevHashNodePtr = nextHashNodePtr;
-	      nextHashNodePtr->next = nextHashNodePtr->next;
+  if (hash->engine == HASH_IMAGE)
+    return imageScan(hash,cursor,count,visit,arg);
 
-	    } /* end while (hashNodePtr != NULL ) */
+  if (hash->flags & HASH_CONCURRENT){
+    if (segment >= HASH_SEGMENTS)
+      return 0;
+    hi = concScan(hash,segment,lo,count,visit,arg);
+  }
+  else
+    hi = hashScanTable(hash,lo,count,visit,arg);
 
-      } /* else */
+  if (hi < HASH_SCAN_END)
+    return ((uint64_t) segment << 32) | hi;
 
-      hash->count--;
+  /* Slice ended the segment, or the table */
+  if ((hash->flags & HASH_CONCURRENT) == 0 || ++segment >= HASH_SEGMENTS)
+    return 0;
 
-    } /* end if (hash->array[key] != NULL) */
+  return (uint64_t) segment << 32;
 
-  } /* end if (hash != NULL) */
+} /* end hashScan() */
 
-} /* hashDelete() */
 
+/* ==================== hashSegmentOf() ====================== */
+/* ==================== hashSegmentOf() ====================== */
 
 /*
- * hashGet()
- * This function accepts a value and returns a
- * pointer to the associated data container.
+ * hashSegmentOf()
+ * This function returns the segment a key belongs to in a
+ * HASH_CONCURRENT table, so work on a key can be handed to a
+ * thread running near it.  Other tables have one segment.
  *
- * INPUT:     hash      Pointer to hash table.
- *            vkey      String key for lookup
- * RETURNS:   data      Pointer to data container
- *            NULL      vkey not found in hash table
+ * INPUT:      hash            Hash table
+ *             vkey            Key
+ * RETURNS:    unsigned int    Segment, 0 .. HASH_SEGMENTS - 1
  */
-void *hashGet(Hash *hash, char *vkey){
-  unsigned int     key;
-  struct HashNode  *hashNodePtr;
-  void             *ret = NULL;
+unsigned int hashSegmentOf(Hash *hash, char *vkey){
 
-  /* Get hashed key */
-  key = hash_fval_string(vkey,hash->num_buckets);
+  if ((hash->flags & HASH_CONCURRENT) == 0)
+    return 0;
 
-  if (hash->array[key] != NULL) {
+  return concSegmentOf(hash,hashKeyValue(hash,vkey));
 
-    hashNodePtr = hash->array[key];
+} /* end hashSegmentOf() */
 
-    while (hashNodePtr != NULL) {
-
-      /* Check node for vkey match */
-      if (strcmp(hashNodePtr->vkey,vkey) == 0){
-
-	  /* Return pointer to data */
-	  ret = hashNodePtr->data;
 
-	  break;
-      }
+/* =================== hashSegmentNode() ===================== */
+/* =================== hashSegmentNode() ===================== */
 
-      /* Get next node in hash bucket list */
-      hashNodePtr = hashNodePtr->next;
+/*
+ * hashSegmentNode()
+ * This function returns the NUMA node a segment of a
+ * HASH_NUMA table lives on.  A thread that mostly works on
+ * the keys of that segment should run there, see
+ * hashRunOnNode().
+ *
+ * INPUT:      hash            Hash table
+ *             segment         From hashSegmentOf()
+ * RETURNS:    int             Node
+ *             -1              Not a HASH_NUMA table
+ */
+int hashSegmentNode(Hash *hash, unsigned int segment){
 
-    } /* end while (hashNodePtr != NULL) */
+  if ((hash->flags & HASH_NUMA) == 0 || segment >= HASH_SEGMENTS)
+    return -1;
 
-  } /* end if (hash.array != NULL) */
+  return hash->segments[segment].node;
 
-  return ret;
+} /* end hashSegmentNode() */
 
-} /* end hashGet() */
 
-/* ===================== hashPrint() ==================== */
-/* ===================== hashPrint() ==================== */
+/* ==================== hashNumaNodes() ====================== */
+/* ==================== hashNumaNodes() ====================== */
 
 /*
- * hashPrint()
- * This function prints the entire hash table.
- * Used for testing purposes, not advisable
- * for large maps!
+ * hashNumaNodes()
+ * This function returns the number of NUMA nodes HASH_NUMA
+ * tables spread their segments over, 1 without NUMA.
  *
- * INPUT:     hash       Pointer to hash table
- *            printer    Function point to printer function.
- * RETURNS:   NONE
+ * RETURNS:    int             Nodes
  */
+int hashNumaNodes(void){
 
-void hashPrint(Hash *hash, void (*printer)(void *data)){
+  return placeNodes();
 
-  unsigned int             i;
-  struct HashNode  *hashNode;
+} /* end hashNumaNodes() */
 
-  if (hash != NULL){
-    for (i = 0; i < hash->num_buckets; i++){
 
-      hashNode = hash->array[i];
+/* ==================== hashRunOnNode() ====================== */
+/* ==================== hashRunOnNode() ====================== */
 
-      while (hashNode != NULL){
+/*
+ * hashRunOnNode()
+ * This function moves the calling thread onto the CPUs of a
+ * NUMA node, for threads working on the segments homed there.
+ *
+ * INPUT:      node            Node, 0 .. hashNumaNodes() - 1
+ * RETURNS:    0               Success
+ *             -1              No such node, or not supported
+ */
+int hashRunOnNode(int node){
 
-	    printf ("key: %u ",i);
-	    printer(hashNode->data);
-	    hashNode = hashNode->next;
+  return placeRunOnNode(node);
 
-      } /* end while (hashNode != NULL) */
+} /* end hashRunOnNode() */
 
-    } /* end for (i = 0; i < hash->count; i++) */
 
-  } /* end if (hash != NULL) */
+/* ==================== hashSetHashFunc() ==================== */
+/* ==================== hashSetHashFunc() ==================== */
 
-} /* end hashPrint() */
+/*
+ * hashSetHashFunc()
+ * This function replaces the hash function of a table.  Keys
+ * already stored were placed with the old function, so this
+ * is only allowed while the table is empty.
+ *
+ * INPUT:      hash            Hash table
+ *             hashfn          Hash function, see hashfn.h
+ * RETURNS:    0               Success
+ *             -1              Table is not empty
+ */
+int hashSetHashFunc(Hash *hash, HashFunc hashfn){
 
+  if (hashCount(hash) != 0 || hashfn == NULL)
+    return -1;
 
-/* ====================== Private Functions ====================== */
-/* ====================== Private Functions ====================== */
+  hash->hashfn = hashfn;
+  if (hash->flags & HASH_CONCURRENT)
+    concSetHash(hash);
+
+  return 0;
+}
 
 
+/* ====================== hashSetSeed() ====================== */
+/* ====================== hashSetSeed() ====================== */
+
 /*
- * hash_fval_string()
- * This function accepts a string and generates
- * a hash key from it. I found this function when doing
- * a search for good hash functions on the net. This one
- * looked pretty reasonable.
+ * hashSetSeed()
+ * This function replaces the random seed a table was created
+ * with, for repeatable runs.  Only allowed while the table
+ * is empty.
  *
- * INPUT:     vkey           String to generate hash key for
- *            num_buckets    Number of buckets in hash.
- * RETURNS:   int            Hash values
+ * INPUT:      hash            Hash table
+ *             seed            New seed
+ * RETURNS:    0               Success
+ *             -1              Table is not empty
  */
+int hashSetSeed(Hash *hash, uint64_t seed){
 
-static
-unsigned int hash_fval_string(const void *vkey,
-                               unsigned int num_buckets){
-
-  const char   *key   = (const char *)vkey;
-  unsigned     result = 0;
-  int          i;
+  if (hashCount(hash) != 0)
+    return -1;
 
-  for (i = 0; *key && i<32; i++)
-    result = result * 33U + *key++;
-
-  return (result % num_buckets);
+  hash->seed = seed;
+  if (hash->flags & HASH_CONCURRENT)
+    concSetHash(hash);
 
+  return 0;
 }
 
-/* ==================== hashFreeNode() ======================= */
-/* ==================== hashFreeNode() ======================= */
+
+/* ==================== hashSetKeySize() ===================== */
+/* ==================== hashSetKeySize() ===================== */
 
 /*
- * hashFreeNode()
- * This private function completely frees a hash
- * node.  Make sure you've saved all pointers
- * before calling this function!
- *
- * INPUT:    hashNode    Pointer to hash node to free.
- *           destructor  Destructor function for data container.
+ * hashSetKeySize()
+ * This function sets the key type of a table (see hash.h).
+ * HASH_KEY_U32 and HASH_KEY_U64 tables take integer keys
+ * through hashAddInt(), hashGetInt() and hashDeleteInt(), or
+ * a pointer to the integer through hashAdd() and the rest.
+ * Any other non-zero size makes the keys fixed length binary
+ * blobs.  Only allowed while the table is empty.
  *
+ * INPUT:      hash            Hash table
+ *             keysize         HASH_KEY_STRING, HASH_KEY_U32,
+ *                             HASH_KEY_U64 or bytes per key
+ * RETURNS:    0               Success
+ *             -1              Table is not empty, or is a
+ *                             HASH_IMAGE snapshot
  */
-static
-void hashFreeNode(struct HashNode *hashNodePtr,
-                  void (*destructor)(void *data)){
+int hashSetKeySize(Hash *hash, unsigned int keysize){
 
-  if (hashNodePtr != NULL){
-    freemem(hashNodePtr->data);          /* Free data container */
-    freemem(hashNodePtr->vkey);          /* Free string key */
-    freemem(hashNodePtr);                /* Free node struct */
-  }
+  if (hashCount(hash) != 0 || hash->engine == HASH_IMAGE)
+    return -1;
 
-} /* end hashFreeData() */
+  hash->keysize = keysize;
+  if (hash->flags & HASH_CONCURRENT)
+    concSetHash(hash);
+
+  return 0;
+}
 
 
 
-/* ======================== hashRehash() ======================= */
-/* ======================== hashRehash() ======================= */
+/* ===================== hashDestroy() ======================= */
+/* ===================== hashDestroy() ======================= */
 
 /*
- * hashRehash()
- * This function will rehash the hash table to any specified
- * size.  For growing the hash table this be a prime number
- * about twice the size of the current hash. It is also possible
- * to shrink the hash table if the number of nodes decreases.
+ * hashDestroy()
+ * This function destroys the hash table.
+ * The function requires a destructor function
+ * which deallocates the data container.
  *
- * INPUT:       hash            Pointer to hash table
- *              num_buckets     New number of buckets in hash table
+ * HASH_ARENA tables release nodes and keys a page at a
+ * time, and with a NULL destructor never visit the entries.
+ *
+ * INPUT:    hash         Pointer to hash table
+ *           destructor   Function pointer to destructor
+ * RETURNS:  None.
  */
-static
-void hashRehash(Hash *hash, unsigned int num_buckets){
-
-  struct HashNode   **newArray;          /* Array to hold rehash */
-  struct HashNode   *hashNode;
-  struct HashNode   *tmp;
-  unsigned int      key;
-  int               i;
+void hashDestroy(Hash *hash, void (*destructor)(void *data)){
 
-  if (hash != NULL){
-    /*
-     * Allocate space for rehash table
-     * This is an array of pointers to hash nodes.
-     */
-    newArray = (struct HashNode **) malloc ((num_buckets) *
-                                         sizeof (struct HashNode *));
+  if (hash->flags & HASH_CONCURRENT){
+    concDestroy(hash,destructor);
+    free(hash);
+    return;
+  }
 
-    /* Initialize array pointers to null */
-    memset(newArray, 0 ,num_buckets * sizeof (struct HashNode *));
+  switch (hash->engine){
+    case HASH_FLAT:   flatDestroy(hash,destructor);   break;
+    case HASH_SWISS:  swissDestroy(hash,destructor);  break;
+    case HASH_IMAGE:  imageDestroy(hash);             break;
 
-    /* Loop through old hash table */
-    for (i = 0; i < hash->num_buckets; i++){
+    default:
+      /* Deallocate buckets of both arrays while rehashing */
+      if (hash->oldArray != NULL){
+        hashDestroyArray(hash,hash->oldArray,hash->old_buckets,destructor);
+        free(hash->oldArray);
+      }
+      hashDestroyArray(hash,hash->array,hash->num_buckets,destructor);
 
-      /* Get start of bucket list */
-      hashNode = hash->array[i];
+      /* Free hash table array */
+      if (hash->array != NULL)
+        free(hash->array);
+  }
 
-      /* Loop though bucket list */
-      while (hashNode != NULL){
+  /* Release arena pages */
+  arenaDestroy(hash->nodeArena);
+  arenaDestroy(hash->keyArena);
+
+  /* Free hash structure */
+  if (hash != NULL)
+    free(hash);
+
+} /* end hashDestroy() */
+
+
+/* ======================= hashAdd() ========================= */
+/* ======================= hashAdd() ========================= */
+
+/*
+ * hashAdd()
+ * This function adds a new key/data pair to the
+ * hash table.
+ *
+ * INPUT:    hash    Hash table to add key/data to.
+ *           vkey    String key (that gets hashed)
+ *           data    Void pointer to data container
+ * RETURNS:  0       Success
+ *           -1      Failure
+ */
+int hashAdd(Hash *hash, char *vkey, void *data){
+
+  if (hash->flags & HASH_CONCURRENT)
+    return concAdd(hash,vkey,data);
+
+  return hashAddValue(hash,vkey,hashKeyValue(hash,vkey),data);
+
+} /* end hashAdd() */
+
+
+/*
+ * hashAddValue()
+ * This function is hashAdd() for a key that has already
+ * been hashed with hashKeyValue().
+ *
+ * INPUT:    hash     Hash table to add key/data to.
+ *           vkey     String key
+ *           hashval  hashKeyValue() of vkey
+ *           data     Void pointer to data container
+ * RETURNS:  0        Success
+ *           -1       Failure
+ */
+int hashAddValue(Hash *hash, const char *vkey, uint64_t hashval, void *data){
+
+  switch (hash->engine){
+    case HASH_FLAT:   return flatAdd(hash,vkey,hashval,data);
+    case HASH_SWISS:  return swissAdd(hash,vkey,hashval,data);
+    case HASH_IMAGE:  return -1;
+  }
+
+  /* Move a few more buckets of a resize in progress */
+  if (hash->oldArray != NULL)
+    hashRehashStep(hash,HASH_REHASH_STEP);
+
+  /*
+   * Insert node at head of its bucket list.  While an
+   * incremental resize runs this may be a bucket of the
+   * old array, so each key has exactly one home.
+   */
+  if (hashNodeNew(hash,hashBucketOf(hash,hashval),vkey,hashval,data) == NULL)
+    return -1;
+
+  return 0;
+
+} /* end hashAddValue() */
+
+
+/* =================== hashFindOrInsert() ==================== */
+/* =================== hashFindOrInsert() ==================== */
+
+/*
+ * hashFindOrInsert()
+ * This function returns the data slot of vkey, adding vkey
+ * with a NULL data container first if it is not there.  The
+ * caller reads or fills in the data through the slot, which
+ * only stays valid until the table next changes.
+ *
+ * INPUT:    hash      Hash table
+ *           vkey      String key (that gets hashed)
+ *           inserted  Set to 1 if vkey was added, else 0.
+ *                     May be NULL.
+ * RETURNS:  slot      Pointer to the data container pointer
+ *           NULL      Failure, or a HASH_CONCURRENT or
+ *                     HASH_IMAGE table
+ */
+void **hashFindOrInsert(Hash *hash, char *vkey, int *inserted){
+
+  void  **slot = NULL;
+  int   added  = 0;
+
+  if (!(hash->flags & HASH_CONCURRENT))
+    slot = hashFindOrAddValue(hash,vkey,hashKeyValue(hash,vkey),NULL,&added);
+
+  if (inserted != NULL)
+    *inserted = added;
+
+  return slot;
+
+} /* end hashFindOrInsert() */
+
+
+/*
+ * hashUpsert()
+ * This function adds vkey with data, or if vkey is already
+ * there replaces its data container with merge(old, data).
+ * A NULL merge stores data itself and hands the container it
+ * replaced back in old, for the caller to free.  Either way
+ * vkey is only looked up once.
+ *
+ * INPUT:    hash      Hash table
+ *           vkey      String key (that gets hashed)
+ *           data      Void pointer to data container
+ *           merge     Merge function, or NULL
+ *           old       Set to the data container stored before
+ *                     if vkey was there, left alone if it was
+ *                     added.  May be NULL.
+ * RETURNS:  1         vkey added
+ *           0         vkey was there, data merged
+ *           -1        Failure
+ */
+int hashUpsert(Hash *hash, char *vkey, void *data, HashMerge merge,
+               void **old){
+
+  if (hash->flags & HASH_CONCURRENT)
+    return concUpsert(hash,vkey,data,merge,old);
+
+  return hashUpsertValue(hash,vkey,hashKeyValue(hash,vkey),data,merge,old);
+
+} /* end hashUpsert() */
+
+
+/*
+ * hashEmplace()
+ * This function adds vkey with data unless vkey is already
+ * there, in which case the table is left as it is and the
+ * data container stored for vkey is handed back.  Data is
+ * then still the caller's.
+ *
+ * INPUT:    hash      Hash table
+ *           vkey      String key (that gets hashed)
+ *           data      Void pointer to data container
+ *           existing  Set to the data container already stored
+ *                     for vkey.  May be NULL.
+ * RETURNS:  1         vkey added
+ *           0         vkey was there
+ *           -1        Failure
+ */
+int hashEmplace(Hash *hash, char *vkey, void *data, void **existing){
+
+  if (hash->flags & HASH_CONCURRENT)
+    return concUpsert(hash,vkey,data,hashKeep,existing);
+
+  return hashUpsertValue(hash,vkey,hashKeyValue(hash,vkey),data,hashKeep,
+                         existing);
+
+} /* end hashEmplace() */
+
+
+/*
+ * hashFindOrAddValue()
+ * This function is the lookup behind hashFindOrInsert(),
+ * hashUpsert() and hashEmplace(), for a key that has already
+ * been hashed.  A chained table walks the bucket list once
+ * and links a new node at its head if vkey is not on it.
+ * Growing relinks nodes without moving them, so the slot of
+ * a new chained entry survives the resize it may cause.
+ *
+ * INPUT:    hash     Hash table
+ *           vkey     String key
+ *           hashval  hashKeyValue() of vkey
+ *           data     Void pointer to data container for a new key
+ *           added    Set to 1 if vkey was added, else 0
+ * RETURNS:  slot     Pointer to the data container pointer
+ *           NULL     Failure
+ */
+void **hashFindOrAddValue(Hash *hash, const char *vkey, uint64_t hashval,
+                          void *data, int *added){
+
+  struct HashNode  **bucket;
+  struct HashNode  *hashNodePtr;
+
+  switch (hash->engine){
+    case HASH_FLAT:   return flatFindOrAdd(hash,vkey,hashval,data,added);
+    case HASH_SWISS:  return swissFindOrAdd(hash,vkey,hashval,data,added);
+    case HASH_IMAGE:  *added = 0; return NULL;
+  }
+
+  *added = 0;
+
+  if (hash->oldArray != NULL)
+    hashRehashStep(hash,HASH_REHASH_STEP);
+
+  bucket = hashBucketOf(hash,hashval);
+
+  for (hashNodePtr = *bucket; hashNodePtr != NULL;
+       hashNodePtr = hashNodePtr->next)
+    if (hashNodePtr->hashval == hashval &&
+        HASH_KEY_EQ(hash,&hashNodePtr->key,vkey))
+      return &hashNodePtr->data;
+
+  if ((hashNodePtr = hashNodeNew(hash,bucket,vkey,hashval,data)) == NULL)
+    return NULL;
+
+  *added = 1;
+
+  return &hashNodePtr->data;
+
+} /* end hashFindOrAddValue() */
+
+
+/*
+ * hashUpsertValue()
+ * This function is hashUpsert() for a key that has already
+ * been hashed, and hashEmplace() with merge hashKeep().
+ *
+ * INPUT:    hash     Hash table
+ *           vkey     String key
+ *           hashval  hashKeyValue() of vkey
+ *           data     Void pointer to data container
+ *           merge    Merge function, or NULL to replace
+ *           old      Set to the data container that was stored
+ *                    if vkey was there.  May be NULL.
+ * RETURNS:  1        vkey added
+ *           0        vkey was there
+ *           -1       Failure
+ */
+int hashUpsertValue(Hash *hash, const char *vkey, uint64_t hashval,
+                    void *data, HashMerge merge, void **old){
+
+  void  **slot;
+  int   added;
+
+  if ((slot = hashFindOrAddValue(hash,vkey,hashval,data,&added)) == NULL)
+    return -1;
+
+  if (added)
+    return 1;
+
+  if (old != NULL)
+    *old = *slot;
+  *slot = (merge != NULL) ? merge(*slot,data) : data;
+
+  return 0;
+
+} /* end hashUpsertValue() */
+
+
+/* ======================= hashDelete() ====================== */
+/* ======================= hashDelete() ====================== */
+
+/*
+ * hashDelete()
+ * This function deletes the specified note
+ * from the hash table given the key.
+ *
+ * INPUT:     hash         Pointer to hash table.
+ *            vkey         String key to remove
+ *            destructor   Destructor for the data container
+ */
+void hashDelete(Hash *hash, char *vkey,
+                void (*destructor)(void *data)){
+
+  if (hash != NULL){
+
+    if (hash->flags & HASH_CONCURRENT)
+      concDelete(hash,vkey,destructor);
+    else
+      hashDeleteValue(hash,vkey,hashKeyValue(hash,vkey),destructor);
+
+  } /* end if (hash != NULL) */
+
+} /* hashDelete() */
+
+
+/*
+ * hashDeleteValue()
+ * This function is hashDelete() for a key that has already
+ * been hashed with hashKeyValue().
+ *
+ * INPUT:     hash         Pointer to hash table.
+ *            vkey         String key to remove
+ *            hashval      hashKeyValue() of vkey
+ *            destructor   Destructor for the data container
+ */
+void hashDeleteValue(Hash *hash, const char *vkey, uint64_t hashval,
+                     void (*destructor)(void *data)){
+
+  struct HashNode  **bucket;
+  struct HashNode  *prevHashNodePtr;
+  struct HashNode  *hashNodePtr;
+  unsigned int     size;
+
+  switch (hash->engine){
+    case HASH_FLAT:   flatDelete(hash,vkey,hashval,destructor);   return;
+    case HASH_SWISS:  swissDelete(hash,vkey,hashval,destructor);  return;
+    case HASH_IMAGE:  return;
+  }
+
+  if (hash->oldArray != NULL)
+    hashRehashStep(hash,HASH_REHASH_STEP);
+
+  bucket = hashBucketOf(hash,hashval);
+
+  prevHashNodePtr = NULL;
+  hashNodePtr     = *bucket;
+
+  /* Loop through bucket list */
+  while (hashNodePtr != NULL){
+
+    /* Only compare strings when the cached hash matches */
+    if (hashNodePtr->hashval == hashval &&
+        HASH_KEY_EQ(hash,&hashNodePtr->key,vkey)){
+
+      /* Unlink node from bucket list */
+      if (prevHashNodePtr == NULL)
+        *bucket = hashNodePtr->next;
+      else
+        prevHashNodePtr->next = hashNodePtr->next;
+
+      hashFreeNode(hash,hashNodePtr,destructor);
+      hash->count--;
+
+      /*
+       * Shrink once under MIN_UTILIZATION, unless sizes[]
+       * has nothing smaller to offer.
+       */
+      if (hash->oldArray == NULL &&
+          HASH_SHRINK(hash->count,hash->num_buckets,hash->min_buckets,
+                      hash->max_load)){
+        size = hashPrime(HASH_SHRINK_SIZE(hash->count,hash->min_buckets,
+                                          hash->max_load));
+        if (size < hash->num_buckets)
+          hashRehash(hash,size);
+      }
+      break;
+    }
+
+    /* Update prev and current pointers */
+    prevHashNodePtr = hashNodePtr;
+    hashNodePtr     = hashNodePtr->next;
+
+  } /* end while (hashNodePtr != NULL) */
+
+} /* end hashDeleteValue() */
+
+
+/*
+ * hashGet()
+ * This function accepts a value and returns a
+ * pointer to the associated data container.
+ *
+ * INPUT:     hash      Pointer to hash table.
+ *            vkey      String key for lookup
+ * RETURNS:   data      Pointer to data container
+ *            NULL      vkey not found in hash table
+ */
+void *hashGet(Hash *hash, char *vkey){
+
+  if (hash->flags & HASH_CONCURRENT)
+    return concGet(hash,vkey);
+
+  return hashGetValue(hash,vkey,hashKeyValue(hash,vkey));
+
+} /* end hashGet() */
+
+
+/*
+ * hashGetValue()
+ * This function is hashGet() for a key that has already
+ * been hashed with hashKeyValue().  Only an incremental
+ * resize makes it write to the table.
+ *
+ * INPUT:     hash      Pointer to hash table.
+ *            vkey      String key for lookup
+ *            hashval   hashKeyValue() of vkey
+ * RETURNS:   data      Pointer to data container
+ *            NULL      vkey not found in hash table
+ */
+void *hashGetValue(Hash *hash, const char *vkey, uint64_t hashval){
+  struct HashNode  *hashNodePtr;
+  void             *ret = NULL;
+
+  switch (hash->engine){
+    case HASH_FLAT:
+      return HASH_STAT_GET(&hash->hits,&hash->misses,
+                           flatGet(hash,vkey,hashval));
+    case HASH_SWISS:
+      return HASH_STAT_GET(&hash->hits,&hash->misses,
+                           swissGet(hash,vkey,hashval));
+    case HASH_IMAGE:
+      return HASH_STAT_GET(&hash->hits,&hash->misses,
+                           imageGet(hash,vkey,hashval));
+  }
+
+  if (hash->oldArray != NULL)
+    hashRehashStep(hash,HASH_REHASH_STEP);
+
+  hashNodePtr = *hashBucketOf(hash,hashval);
+
+  if (hashNodePtr != NULL) {
+
+    while (hashNodePtr != NULL) {
+
+      /* Check node for vkey match, cached hash first */
+      if (hashNodePtr->hashval == hashval &&
+          HASH_KEY_EQ(hash,&hashNodePtr->key,vkey)){
+
+	  /* Return pointer to data */
+	  ret = hashNodePtr->data;
+
+	  break;
+      }
+
+      /* Get next node in hash bucket list */
+      hashNodePtr = hashNodePtr->next;
+
+    } /* end while (hashNodePtr != NULL) */
+
+  } /* end if (hash.array != NULL) */
+
+  return HASH_STAT_GET(&hash->hits,&hash->misses,ret);
+
+} /* end hashGetValue() */
+
+
+/* ===================== hashAddInt() ======================= */
+/* ===================== hashAddInt() ======================= */
+
+/*
+ * hashAddInt()
+ * This function is hashAdd() for a HASH_KEY_U32 or
+ * HASH_KEY_U64 table, taking the key by value.  A u32 table
+ * uses the low 32 bits of key.
+ *
+ * INPUT:    hash    Hash table to add key/data to.
+ *           key     Integer key
+ *           data    Void pointer to data container
+ * RETURNS:  0       Success
+ *           -1      Failure, or not an integer key table
+ */
+int hashAddInt(Hash *hash, uint64_t key, void *data){
+
+  uint32_t key32 = (uint32_t) key;
+
+  switch (hash->keysize){
+    case HASH_KEY_U32:  return hashAdd(hash,(char *) &key32,data);
+    case HASH_KEY_U64:  return hashAdd(hash,(char *) &key,data);
+  }
+
+  return -1;
+
+} /* end hashAddInt() */
+
+
+/*
+ * hashGetInt()
+ * This function is hashGet() for an integer key table.
+ *
+ * INPUT:     hash      Pointer to hash table.
+ *            key       Integer key
+ * RETURNS:   data      Pointer to data container
+ *            NULL      key not found, or not an integer key
+ *                      table
+ */
+void *hashGetInt(Hash *hash, uint64_t key){
+
+  uint32_t key32 = (uint32_t) key;
+
+  switch (hash->keysize){
+    case HASH_KEY_U32:  return hashGet(hash,(char *) &key32);
+    case HASH_KEY_U64:  return hashGet(hash,(char *) &key);
+  }
+
+  return NULL;
+
+} /* end hashGetInt() */
+
+
+/*
+ * hashDeleteInt()
+ * This function is hashDelete() for an integer key table.
+ *
+ * INPUT:     hash         Pointer to hash table.
+ *            key          Integer key
+ *            destructor   Destructor for the data container
+ */
+void hashDeleteInt(Hash *hash, uint64_t key, void (*destructor)(void *data)){
+
+  uint32_t key32 = (uint32_t) key;
+
+  switch (hash->keysize){
+    case HASH_KEY_U32:  hashDelete(hash,(char *) &key32,destructor);  break;
+    case HASH_KEY_U64:  hashDelete(hash,(char *) &key,destructor);    break;
+  }
+
+} /* end hashDeleteInt() */
+
+
+/*
+ * hashUpsertInt()
+ * This function is hashUpsert() for an integer key table.
+ * With a NULL merge it swaps the data container of a key
+ * already there without taking the key out of the table.
+ *
+ * INPUT:     hash      Pointer to hash table.
+ *            key       Integer key
+ *            data      Void pointer to data container
+ *            merge     Merge function, or NULL
+ *            old       Set to the data container stored before
+ *                      if key was there.  May be NULL.
+ * RETURNS:   1         key added
+ *            0         key was there, data merged
+ *            -1        Failure, or not an integer key table
+ */
+int hashUpsertInt(Hash *hash, uint64_t key, void *data, HashMerge merge,
+                  void **old){
+
+  uint32_t key32 = (uint32_t) key;
+
+  switch (hash->keysize){
+    case HASH_KEY_U32:  return hashUpsert(hash,(char *) &key32,data,merge,old);
+    case HASH_KEY_U64:  return hashUpsert(hash,(char *) &key,data,merge,old);
+  }
+
+  return -1;
+
+} /* end hashUpsertInt() */
+
+
+/* ===================== hashGetBatch() ====================== */
+/* ===================== hashGetBatch() ====================== */
+
+/*
+ * hashGetBatch()
+ * This function looks up n keys at once.  The keys go through
+ * a software pipeline (see hashBatch()) that has the memory
+ * each lookup needs on its way well before the lookup runs,
+ * so the cache misses of many keys overlap instead of being
+ * paid one after another as in a loop over hashGet().
+ *
+ * HASH_CONCURRENT tables just call hashGet() per key.
+ *
+ * INPUT:     hash      Pointer to hash table.
+ *            keys      String keys for lookup
+ *            n         Number of keys
+ *            out       Filled with each key's data container,
+ *                      NULL where a key is not found
+ */
+void hashGetBatch(Hash *hash, char **keys, unsigned int n, void **out){
+
+  unsigned int i;
+
+  if (hash->flags & HASH_CONCURRENT){
+    for (i = 0; i < n; i++)
+      out[i] = hashGet(hash,keys[i]);
+    return;
+  }
+
+  hashBatch(hash,keys,n,out,0);
+
+} /* end hashGetBatch() */
+
+
+/* ===================== hashAddBatch() ====================== */
+/* ===================== hashAddBatch() ====================== */
+
+/*
+ * hashAddBatch()
+ * This function adds n key/data pairs through the same
+ * pipeline as hashGetBatch().
+ *
+ * INPUT:     hash      Hash table to add key/data to.
+ *            keys      String keys
+ *            n         Number of keys
+ *            data      Data container of each key
+ * RETURNS:   unsigned  Number of pairs added, less than n if
+ *                      an add failed
+ */
+unsigned int hashAddBatch(Hash *hash, char **keys, unsigned int n,
+                          void **data){
+
+  unsigned int i;
+
+  if (hash->flags & HASH_CONCURRENT){
+    for (i = 0; i < n; i++)
+      if (hashAdd(hash,keys[i],data[i]) != 0)
+        break;
+    return i;
+  }
+
+  return hashBatch(hash,keys,n,data,1);
+
+} /* end hashAddBatch() */
+
+/* ===================== hashPrint() ==================== */
+/* ===================== hashPrint() ==================== */
+
+/*
+ * hashPrint()
+ * This function prints the entire hash table.
+ * Used for testing purposes, not advisable
+ * for large maps!
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            printer    Function point to printer function.
+ * RETURNS:   NONE
+ */
+
+void hashPrint(Hash *hash, void (*printer)(void *data)){
+
+  if (hash != NULL){
+
+    if (hash->flags & HASH_CONCURRENT){
+      concPrint(hash,printer);
+      return;
+    }
+
+    switch (hash->engine){
+      case HASH_FLAT:   flatPrint(hash,printer);   return;
+      case HASH_SWISS:  swissPrint(hash,printer);  return;
+      case HASH_IMAGE:  imagePrint(hash,printer);  return;
+    }
+
+    if (hash->oldArray != NULL)
+      hashPrintArray(hash->oldArray,hash->old_buckets,printer);
+    hashPrintArray(hash->array,hash->num_buckets,printer);
+
+  } /* end if (hash != NULL) */
+
+} /* end hashPrint() */
+
+
+/* ===================== hashSave() ====================== */
+/* ===================== hashSave() ====================== */
+
+/*
+ * hashSave()
+ * This function writes the table to path as a snapshot that
+ * hashOpen() can map and serve without rebuilding (see
+ * image.c).  Each data container is copied into the file as
+ * datasize bytes, so containers must be flat structures with
+ * no pointers; with datasize 0 only the keys are saved.  The
+ * file is written under a temporary name and renamed over
+ * path, so a reader never sees half a snapshot.
+ *
+ * Tables using a hash function other than those in hashfn.h
+ * can't be saved.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            path       File to write
+ *            datasize   Bytes of each data container
+ * RETURNS:   0          Success
+ *            -1         Error writing the file, allocating
+ *                       memory or unknown hash function
+ */
+int hashSave(Hash *hash, const char *path, size_t datasize){
+
+  return imageSave(hash,path,datasize,0);
+
+} /* end hashSave() */
+
+
+/* ================= hashSavePerfect() =================== */
+/* ================= hashSavePerfect() =================== */
+
+/*
+ * hashSavePerfect()
+ * This function is hashSave() with the bucket array replaced
+ * by a minimal perfect hash (see mph.c).  Building it takes
+ * longer, but the index costs about 3.5 bits per key instead
+ * of 32 and every hashGet() on the snapshot reads exactly one
+ * entry.  Meant for key sets that are built once and served
+ * many times.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            path       File to write
+ *            datasize   Bytes of each data container
+ * RETURNS:   0          Success
+ *            -1         As hashSave(), or two keys have the
+ *                       same 64 bit hash value
+ */
+int hashSavePerfect(Hash *hash, const char *path, size_t datasize){
+
+  return imageSave(hash,path,datasize,1);
+
+} /* end hashSavePerfect() */
+
+
+/* ===================== hashOpen() ====================== */
+/* ===================== hashOpen() ====================== */
+
+/*
+ * hashOpen()
+ * This function maps a snapshot written by hashSave() or
+ * hashSavePerfect() and returns it as a read-only HASH_IMAGE
+ * table.  Nothing is rebuilt: lookups read the mapping
+ * directly, so opening costs
+ * the same for any size of table and the pages are shared
+ * through the page cache with every other process that opens
+ * the file.  hashGet() returns pointers into the mapping,
+ * which must not be written.  hashAdd() fails and hashDelete()
+ * does nothing.  hashDestroy() unmaps the file and ignores its
+ * destructor.
+ *
+ * INPUT:     path       Snapshot file
+ * RETURNS:   hash       Pointer to new read-only table
+ *            NULL       Cannot open or map the file, or it
+ *                       is not a snapshot of this version
+ */
+Hash *hashOpen(const char *path){
+
+  Hash *hash;
+
+  hash = (Hash *) malloc (sizeof(Hash));
+  if (hash == NULL)
+    return NULL;
+
+  memset(hash, 0, sizeof(Hash));
+  hash->engine   = HASH_IMAGE;
+  hash->max_load = MAX_UTILIZATION;
+
+  if (imageOpen(hash,path) != 0){
+    free(hash);
+    return NULL;
+  }
+
+  return hash;
+
+} /* end hashOpen() */
+
+
+/* ================== Engine Shared Functions ================== */
+/* ================== Engine Shared Functions ================== */
+
+/*
+ * hashKeyValue()
+ * This function hashes a string key with the table's hash
+ * function and seed, then spreads the result with a Fibonacci
+ * multiply so the top bits, which pick the bucket or home
+ * slot, depend on the whole key even for weak functions such
+ * as hashFnFval().  Integer keys go through hashFnInt(),
+ * which mixes well enough on its own, and binary keys hash
+ * keysize bytes.  Zero marks an empty slot in the open
+ * addressing engines so it is never returned.
+ *
+ * INPUT:     hash           Hash table
+ *            vkey           Key to generate hash value for
+ * RETURNS:   uint64_t       Non-zero hash value
+ */
+uint64_t hashKeyValue(Hash *hash, const char *vkey){
+
+  uint64_t h;
+  uint32_t h32;
+
+  switch (hash->keysize){
+    case HASH_KEY_STRING:
+      h = hash->hashfn(vkey, strlen(vkey), hash->seed) * 0x9E3779B97F4A7C15ULL;
+      break;
+    case HASH_KEY_U32:
+      memcpy(&h32, vkey, sizeof(h32));
+      h = hashFnInt(h32, hash->seed);
+      break;
+    case HASH_KEY_U64:
+      memcpy(&h, vkey, sizeof(h));
+      h = hashFnInt(h, hash->seed);
+      break;
+    default:
+      h = hash->hashfn(vkey, hash->keysize, hash->seed) * 0x9E3779B97F4A7C15ULL;
+  }
+
+  return (h != 0) ? h : 1;
+
+}
+
+/*
+ * hashKeyDup()
+ * This function makes a private heap copy of a string key,
+ * including room for the terminating NUL.
+ *
+ * INPUT:     vkey           String key to copy
+ * RETURNS:   char *         Copy of vkey
+ *            NULL           Error allocating memory
+ */
+char *hashKeyDup(const char *vkey){
+
+  char   *copy;
+  size_t len = strlen(vkey) + 1;
+
+  copy = (char *) malloc (len * sizeof(char));
+  if (copy != NULL)
+    memcpy(copy,vkey,len);
+
+  return copy;
+
+}
+
+
+/*
+ * hashKeySet()
+ * This function stores a copy of vkey in a HashKey.  Keys of
+ * up to HASH_KEY_INLINE bytes are copied into the HashKey
+ * itself; a HASH_BORROWED table points at longer ones where
+ * they are, else they go to the key arena of a HASH_ARENA
+ * table or the heap.  String keys are copied with their NUL,
+ * binary keys as keysize bytes.
+ *
+ * INPUT:     hash           Hash table
+ *            key            HashKey to fill in
+ *            vkey           Key to copy
+ * RETURNS:   0              Success
+ *            -1             Error allocating memory
+ */
+int hashKeySet(Hash *hash, HashKey *key, const char *vkey){
+
+  size_t len = (hash->keysize != HASH_KEY_STRING) ? hash->keysize
+                                                  : strlen(vkey);
+
+  if (len <= HASH_KEY_INLINE){
+    memcpy(key->buf,vkey,(hash->keysize != HASH_KEY_STRING) ? len : len + 1);
+    key->buf[HASH_KEY_INLINE] = '\0';
+    return 0;
+  }
+
+  if (hash->flags & HASH_BORROWED)
+    key->ptr = (char *) vkey;
+  else if (hash->keysize != HASH_KEY_STRING){
+    key->ptr = (hash->keyArena != NULL)
+               ? (char *) arenaAlloc(hash->keyArena,len)
+               : (char *) malloc (len);
+    if (key->ptr != NULL)
+      memcpy(key->ptr,vkey,len);
+  }
+  else if (hash->keyArena != NULL)
+    key->ptr = arenaStrdup(hash->keyArena,vkey);
+  else
+    key->ptr = hashKeyDup(vkey);
+
+  if (key->ptr == NULL)
+    return -1;
+
+  key->buf[HASH_KEY_INLINE] = HASH_KEY_HEAP;
+
+  return 0;
+
+}
+
+/*
+ * hashKeyRelease()
+ * This function frees the out of line copy of a stored key,
+ * if it has one.  Arena keys stay put until the table is
+ * destroyed and borrowed keys belong to the caller.
+ *
+ * INPUT:     hash           Hash table
+ *            key            Stored key
+ */
+void hashKeyRelease(Hash *hash, HashKey *key){
+
+  if (HASH_KEY_ISHEAP(key) && hash->keyArena == NULL &&
+      (hash->flags & HASH_BORROWED) == 0)
+    freemem(key->ptr);
+
+}
+
+/*
+ * hashWalk()
+ * This function calls visit once for every entry of any
+ * table, with its key, hash value and data container.  The
+ * table must not change during the walk.
+ *
+ * INPUT:     hash           Hash table
+ *            visit          Called with arg, key, hash and data
+ *            arg            Passed through to visit
+ */
+void hashWalk(Hash *hash, HashVisit visit, void *arg){
+
+  struct HashNode  *node;
+  unsigned int     i;
+
+  if (hash->flags & HASH_CONCURRENT){
+    concWalk(hash,visit,arg);
+    return;
+  }
+
+  switch (hash->engine){
+    case HASH_FLAT:   flatWalk(hash,visit,arg);   return;
+    case HASH_SWISS:  swissWalk(hash,visit,arg);  return;
+    case HASH_IMAGE:  imageWalk(hash,visit,arg);  return;
+  }
+
+  if (hash->oldArray != NULL)
+    for (i = 0; i < hash->old_buckets; i++)
+      for (node = hash->oldArray[i]; node != NULL; node = node->next)
+        visit(arg,HASH_KEY_STR(&node->key),node->hashval,node->data);
+
+  for (i = 0; i < hash->num_buckets; i++)
+    for (node = hash->array[i]; node != NULL; node = node->next)
+      visit(arg,HASH_KEY_STR(&node->key),node->hashval,node->data);
+
+}
+
+
+/*
+ * hashScanTable()
+ * This function is hashScan() of one table or segment table,
+ * visiting the entries whose hash prefix is from lo up to the
+ * value it returns.
+ *
+ * INPUT:     hash           Hash table, not HASH_CONCURRENT
+ *            lo             First hash prefix of the slice
+ *            count          Buckets or slots to look at, about
+ *            visit          Called with arg, key, hash and data
+ *            arg            Passed through to visit
+ * RETURNS:   uint64_t       First hash prefix of the next slice
+ */
+uint64_t hashScanTable(Hash *hash, uint64_t lo, unsigned int count,
+                       HashVisit visit, void *arg){
+
+  uint64_t hi = hashScanEnd(lo,count,hash->num_buckets);
+
+  hashScanRange(hash,lo,hi,visit,arg);
+
+  return hi;
+
+}
+
+/*
+ * hashScanRange()
+ * This function visits the entries of a table whose hash
+ * prefix is at least lo and below hi.
+ *
+ * INPUT:     hash           Hash table, not HASH_CONCURRENT or
+ *                           HASH_IMAGE
+ *            lo, hi         Hash prefixes, hi HASH_SCAN_END at most
+ *            visit          Called with arg, key, hash and data
+ *            arg            Passed through to visit
+ */
+void hashScanRange(Hash *hash, uint64_t lo, uint64_t hi, HashVisit visit,
+                   void *arg){
+
+  switch (hash->engine){
+    case HASH_FLAT:   flatScan(hash,lo,hi,visit,arg);   return;
+    case HASH_SWISS:  swissScan(hash,lo,hi,visit,arg);  return;
+  }
+
+  if (hash->oldArray != NULL)
+    hashScanBuckets(hash->oldArray,hash->old_buckets,lo,hi,visit,arg);
+  hashScanBuckets(hash->array,hash->num_buckets,lo,hi,visit,arg);
+
+}
+
+/*
+ * hashScanEnd()
+ * This function returns where a scan slice starting at hash
+ * prefix lo ends to cover about count of n buckets.
+ *
+ * INPUT:     lo             First hash prefix of the slice
+ *            count          Buckets wanted
+ *            n              Buckets in the table
+ * RETURNS:   uint64_t       First hash prefix past the slice
+ */
+uint64_t hashScanEnd(uint64_t lo, unsigned int count, unsigned int n){
+
+  uint64_t width = ((uint64_t) count << 32) / n;
+
+  if (width == 0)
+    width = 1;
+
+  return (lo + width < HASH_SCAN_END) ? lo + width : HASH_SCAN_END;
+
+}
+
+/*
+ * hashScanBuckets()
+ * This function visits the entries of a chained bucket array
+ * whose hash prefix is at least lo and below hi.  Buckets are
+ * picked with HASH_FASTRANGE(), which keeps hash order, so
+ * they lie in one run of the array.
+ *
+ * INPUT:     array          Bucket array
+ *            n              Buckets in the array
+ *            lo, hi         Hash prefixes of the slice
+ *            visit          Called with arg, key, hash and data
+ *            arg            Passed through to visit
+ */
+void hashScanBuckets(struct HashNode **array, unsigned int n,
+                     uint64_t lo, uint64_t hi, HashVisit visit, void *arg){
+
+  struct HashNode  *node;
+  uint64_t         prefix;
+  unsigned int     b;
+  unsigned int     last = (unsigned int) (((hi - 1) * n) >> 32);
+
+  for (b = (unsigned int) ((lo * n) >> 32); b <= last; b++)
+    for (node = array[b]; node != NULL; node = node->next){
+      prefix = HASH_SCAN_PREFIX(node->hashval);
+      if (prefix >= lo && prefix < hi)
+        visit(arg,HASH_KEY_STR(&node->key),node->hashval,node->data);
+    }
+
+}
+
+/*
+ * hashSetOptions()
+ * This function gives a table the load factor, growth factor
+ * and size limit of options, already checked by
+ * hashCreateOptions().  The table was created at
+ * min_buckets.  The limit is rounded down to a power of two
+ * for the open addressing engines, and never below the size
+ * the table has.  A HASH_CONCURRENT table passes a share of
+ * the limit on to each segment.
+ *
+ * INPUT:     hash           Hash table
+ *            options        Table options
+ */
+void hashSetOptions(Hash *hash, const HashOptions *options){
+
+  unsigned int max = options->max_buckets;
+
+  hash->max_load = (options->max_load > 0) ? options->max_load
+                                           : MAX_UTILIZATION;
+  hash->growth   = options->growth;
+
+  if (max != 0 && (hash->engine == HASH_FLAT || hash->engine == HASH_SWISS))
+    while (max & (max - 1))
+      max &= max - 1;
+  if (max != 0 && max < hash->num_buckets)
+    max = hash->num_buckets;
+  hash->max_buckets = max;
+
+  if (hash->flags & HASH_CONCURRENT)
+    concSetOptions(hash,options);
+
+}
+
+/*
+ * hashReleasePart()
+ * This function frees the entries in part of parts equal
+ * shares of a table's buckets or slots, or of its segments,
+ * and leaves them empty.  Run over every part, on as many
+ * threads, it does the work of hashDestroy() that touches the
+ * entries, and hashDestroy() then only frees the arrays.
+ *
+ * INPUT:     hash           Hash table
+ *            part           Share, 0 .. parts - 1
+ *            parts          Number of shares
+ *            destructor     Destructor for data containers
+ */
+void hashReleasePart(Hash *hash, unsigned int part, unsigned int parts,
+                     void (*destructor)(void *data)){
+
+  struct HashSegment  *seg;
+  unsigned int        first, last;
+  unsigned int        i;
+
+  if (hash->flags & HASH_CONCURRENT){
+    for (i = HASH_SEGMENTS * part / parts;
+         i < HASH_SEGMENTS * (part + 1) / parts; i++){
+      seg = &hash->segments[i];
+      if (seg->table != NULL)
+        hashReleasePart(seg->table,0,1,destructor);
+      else if (seg->lfarray != NULL)
+        lockfreeRelease(seg,destructor);
+    }
+    return;
+  }
+
+  first = (unsigned int) ((uint64_t) hash->num_buckets * part / parts);
+  last  = (unsigned int) ((uint64_t) hash->num_buckets * (part + 1) / parts);
+
+  switch (hash->engine){
+    case HASH_FLAT:   flatRelease(hash,first,last,destructor);   return;
+    case HASH_SWISS:  swissRelease(hash,first,last,destructor);  return;
+    case HASH_IMAGE:  return;
+  }
+
+  /* Arena nodes go with their pages, see hashDestroyArray() */
+  if (hash->nodeArena != NULL && destructor == NULL)
+    return;
+
+  hashDestroyArray(hash,hash->array + first,last - first,destructor);
+  memset(hash->array + first,0,(last - first) * sizeof(struct HashNode *));
+
+  if (hash->oldArray != NULL){
+    first = (unsigned int) ((uint64_t) hash->old_buckets * part / parts);
+    last  = (unsigned int) ((uint64_t) hash->old_buckets * (part + 1) / parts);
+    hashDestroyArray(hash,hash->oldArray + first,last - first,destructor);
+    memset(hash->oldArray + first,0,
+           (last - first) * sizeof(struct HashNode *));
+  }
+
+}
+
+/*
+ * hashStatsAdd()
+ * This function adds one table that is not HASH_CONCURRENT
+ * into stats, leaving the probe lengths summed in mean_probe
+ * for hashStats() to divide.
+ *
+ * INPUT:     hash           Hash table, or a segment's table
+ *            stats          Running totals
+ */
+void hashStatsAdd(Hash *hash, HashStats *stats){
+
+  struct HashNode  **arrays[2];
+  unsigned int     sizes_of[2];
+  struct HashNode  *node;
+  size_t           key_bytes = stats->key_bytes;
+  unsigned int     len;
+  unsigned int     a, i;
+
+  stats->rehashes    += hash->rehashes;
+  stats->rehash_secs += hash->rehash_secs;
+  stats->hits        += hash->hits;
+  stats->misses      += hash->misses;
+
+  switch (hash->engine){
+
+    case HASH_FLAT:
+      flatStats(hash,stats);
+      break;
+
+    case HASH_SWISS:
+      swissStats(hash,stats);
+      break;
+
+    case HASH_IMAGE:
+      stats->count += hash->count;
+      stats->size  += hash->num_buckets;
+      break;
+
+    default:
+      arrays[0]   = hash->array;
+      sizes_of[0] = hash->num_buckets;
+      arrays[1]   = hash->oldArray;
+      sizes_of[1] = (hash->oldArray != NULL) ? hash->old_buckets : 0;
+
+      for (a = 0; a < 2; a++){
+        for (i = 0; i < sizes_of[a]; i++){
+          len = 0;
+          for (node = arrays[a][i]; node != NULL; node = node->next){
+            hashStatsProbe(stats,++len);
+            stats->key_bytes += hashKeyBytes(hash,&node->key);
+          }
+          hashStatsHist(stats,len);
+          stats->empty += (len == 0);
+        }
+        stats->size         += sizes_of[a];
+        stats->bucket_bytes += sizes_of[a] * sizeof(struct HashNode *);
+      }
+
+      stats->count += hash->count;
+      if (hash->nodeArena != NULL)
+        stats->node_bytes += arenaBytes(hash->nodeArena);
+      else
+        stats->node_bytes += hash->count * sizeof(struct HashNode);
+      break;
+  }
+
+  /* Arena keys are counted by the pages they take */
+  if (hash->keyArena != NULL)
+    stats->key_bytes = key_bytes + arenaBytes(hash->keyArena);
+
+}
+
+/*
+ * hashStatsProbe()
+ * This function counts one stored key that a lookup finds
+ * after probing probe nodes, slots or groups.
+ */
+void hashStatsProbe(HashStats *stats, unsigned int probe){
+
+  stats->mean_probe += probe;
+  if (probe > stats->max_chain)
+    stats->max_chain = probe;
+
+}
+
+/*
+ * hashStatsHist()
+ * This function counts n in the histogram, the last entry
+ * taking everything from HASH_STATS_HIST - 1 up.
+ */
+void hashStatsHist(HashStats *stats, unsigned int n){
+
+  stats->histogram[n < HASH_STATS_HIST ? n : HASH_STATS_HIST - 1]++;
+
+}
+
+/*
+ * hashKeyBytes()
+ * This function returns the bytes a stored key holds out of
+ * line: none for inline and borrowed keys.
+ */
+size_t hashKeyBytes(Hash *hash, const HashKey *key){
+
+  if (!HASH_KEY_ISHEAP(key) || (hash->flags & HASH_BORROWED))
+    return 0;
+
+  if (hash->keysize != HASH_KEY_STRING)
+    return hash->keysize;
+
+  return strlen(key->ptr) + 1;
+
+}
+
+/*
+ * hashNow()
+ * This function returns a monotonic time stamp in seconds,
+ * used to time resizes.
+ */
+double hashNow(void){
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+
+/*
+ * hashBucket()
+ * This function reduces a hash value to a bucket number.
+ * Rather than a slow integer divide by the table size it
+ * scales the top 32 bits of the hash into [0, num_buckets)
+ * with one multiply and shift (Lemire's fastrange), which
+ * works for any bucket count.
+ *
+ * INPUT:     hashval        Value from hashKeyValue()
+ *            num_buckets    Number of buckets in hash.
+ * RETURNS:   unsigned int   Bucket number
+ */
+
+static
+unsigned int hashBucket(uint64_t hashval, unsigned int num_buckets){
+
+  return HASH_FASTRANGE(hashval,num_buckets);
+
+}
+
+/*
+ * hashBatch()
+ * This function runs n keys through a four stage pipeline,
+ * HASH_BATCH / 2 keys apart:
+ *
+ *   key i + 3d    prefetch the key string
+ *   key i + 2d    hash it, prefetch its bucket or first group
+ *   key i + d     prefetch the first chain node, or the slot
+ *                 whose hash matches
+ *   key i         look it up, or add it
+ *
+ * INPUT:     hash      Hash table
+ *            keys      String keys
+ *            n         Number of keys
+ *            data      Output data containers, or those to add
+ *            add       0 for lookups, 1 for adds
+ * RETURNS:   unsigned  Number of keys done, less than n if an
+ *                      add failed
+ */
+static
+unsigned int hashBatch(Hash *hash, char **keys, unsigned int n,
+                       void **data, int add){
+
+  uint64_t      hashvals[2 * HASH_BATCH];
+  unsigned int  d    = HASH_BATCH / 2;
+  unsigned int  mask = 2 * HASH_BATCH - 1;
+  unsigned int  i;
+
+  /* Fill the pipeline */
+  for (i = 0; i < 3 * d && i < n; i++)
+    __builtin_prefetch(keys[i]);
+  for (i = 0; i < 2 * d && i < n; i++)
+    hashPrefetch(hash,hashvals,keys,i,0);
+  for (i = 0; i < d && i < n; i++)
+    hashPrefetch(hash,hashvals,keys,i,1);
+
+  for (i = 0; i < n; i++){
+
+    if (i + 3 * d < n)
+      __builtin_prefetch(keys[i + 3 * d]);
+    if (i + 2 * d < n)
+      hashPrefetch(hash,hashvals,keys,i + 2 * d,0);
+    if (i + d < n)
+      hashPrefetch(hash,hashvals,keys,i + d,1);
+
+    if (!add)
+      data[i] = hashGetValue(hash,keys[i],hashvals[i & mask]);
+    else if (hashAddValue(hash,keys[i],hashvals[i & mask],data[i]) != 0)
+      return i;
+  }
+
+  return n;
+
+}
+
+/*
+ * hashPrefetch()
+ * One step of hashBatch() for keys[i].  Stage 0 hashes the key
+ * into hashvals[] and prefetches the bucket head or first
+ * probe; stage 1 follows what stage 0 brought in.
+ */
+static
+void hashPrefetch(Hash *hash, uint64_t *hashvals, char **keys,
+                  unsigned int i, int stage){
+
+  uint64_t         *hv = &hashvals[i & (2 * HASH_BATCH - 1)];
+  struct HashNode  *head;
+
+  if (stage == 0)
+    *hv = hashKeyValue(hash,keys[i]);
+
+  switch (hash->engine){
+    case HASH_FLAT:   flatPrefetch(hash,*hv,stage);   break;
+    case HASH_SWISS:  swissPrefetch(hash,*hv,stage);  break;
+    case HASH_IMAGE:  imagePrefetch(hash,*hv,stage);  break;
+
+    default:
+      if (stage == 0)
+        __builtin_prefetch(hashBucketOf(hash,*hv));
+      else if ((head = *hashBucketOf(hash,*hv)) != NULL)
+        __builtin_prefetch(head);
+  }
+
+}
+
+/* ==================== hashFreeNode() ======================= */
+/* ==================== hashFreeNode() ======================= */
+
+/*
+ * hashFreeNode()
+ * This private function completely frees a hash
+ * node.  Make sure you've saved all pointers
+ * before calling this function!
+ *
+ * INPUT:    hash        Hash table the node belongs to.
+ *           hashNode    Pointer to hash node to free.
+ *           destructor  Destructor function for data container.
+ *
+ */
+static
+void hashFreeNode(Hash *hash, struct HashNode *hashNodePtr,
+                  void (*destructor)(void *data)){
+
+  if (hashNodePtr != NULL){
+    if (destructor != NULL)
+      destructor(hashNodePtr->data);     /* Free data container */
+    hashKeyRelease(hash,&hashNodePtr->key); /* Free string key */
+
+    /* Free node struct */
+    if (hash->nodeArena != NULL)
+      arenaFree(hash->nodeArena,hashNodePtr);
+    else
+      freemem(hashNodePtr);
+  }
+
+} /* end hashFreeData() */
+
+
+
+/* ======================== hashRehash() ======================= */
+/* ======================== hashRehash() ======================= */
+
+/*
+ * hashRehash()
+ * This function will rehash the hash table to any specified
+ * size.  For growing the hash table this be a prime number
+ * about twice the size of the current hash.  Deletes shrink
+ * it the same way once it drops below MIN_UTILIZATION, and
+ * hashCompact() to the smallest size that fits.
+ *
+ * With HASH_INCREMENTAL the new array is only allocated here
+ * and the current one becomes oldArray; hashRehashStep() then
+ * moves its buckets over a few at a time.  A resize requested
+ * while one is still running is ignored.
+ *
+ * INPUT:       hash            Pointer to hash table
+ *              num_buckets     New number of buckets in hash table
+ */
+static
+void hashRehash(Hash *hash, unsigned int num_buckets){
+
+  struct HashNode   **newArray;          /* Array to hold rehash */
+  struct HashNode   *hashNode;
+  struct HashNode   *tmp;
+  unsigned int      i;
+  double            start;
+
+  if (hash != NULL && hash->oldArray == NULL){
+    start = hashNow();
+
+    /*
+     * Allocate space for rehash table
+     * This is an array of pointers to hash nodes.  calloc()
+     * hands back large arrays as fresh zero pages, so there
+     * is no up front memset pass over them.
+     */
+    newArray = (struct HashNode **) calloc (num_buckets,
+                                         sizeof (struct HashNode *));
+    if (newArray == NULL)
+      return;
+
+    if (hash->flags & HASH_INCREMENTAL){
+      hash->oldArray    = hash->array;
+      hash->old_buckets = hash->num_buckets;
+      hash->rehash_idx  = 0;
+      hash->array       = newArray;
+      hash->num_buckets = num_buckets;
+      hash->rehashes++;
+      hash->rehash_secs += hashNow() - start;
+      return;
+    }
+
+    /* Loop through old hash table */
+    for (i = 0; i < hash->num_buckets; i++){
+
+      /* Get start of bucket list */
+      hashNode = hash->array[i];
+
+      /* Loop though bucket list */
+      while (hashNode != NULL){
 
         /* Rehash node into new bucket array */
         tmp = hashNode->next;
@@ -471,11 +2225,415 @@ void hashRehash(Hash *hash, unsigned int num_buckets){
     hash->array = newArray;             /* Save new array to hash */
     hash->num_buckets = num_buckets;    /* Save new hash table size */
 
-  } /* end if (hash != NULL) */
+    hash->rehashes++;
+    hash->rehash_secs += hashNow() - start;
+
+  } /* end if (hash != NULL && hash->oldArray == NULL) */
 
 } /* end hashRehash() */
 
 
+/* ====================== hashRehashStep() ===================== */
+/* ====================== hashRehashStep() ===================== */
+
+/*
+ * hashRehashStep()
+ * This function moves up to steps buckets of an incremental
+ * resize from oldArray into array.  Empty buckets are cheap
+ * but not free, so at most ten times steps of them are
+ * skipped per call.  The old array is freed once drained.
+ *
+ * INPUT:       hash            Pointer to hash table
+ *              steps           Number of non-empty buckets to move
+ */
+static
+void hashRehashStep(Hash *hash, unsigned int steps){
+
+  struct HashNode   *hashNode;
+  struct HashNode   *tmp;
+  unsigned int      empty = steps * 10;
+
+  while (steps > 0 && hash->rehash_idx < hash->old_buckets){
+
+    hashNode = hash->oldArray[hash->rehash_idx];
+
+    if (hashNode == NULL){
+      hash->rehash_idx++;
+      if (--empty == 0)
+        break;
+      continue;
+    }
+
+    while (hashNode != NULL){
+      tmp = hashNode->next;
+      hashArrayInsert(hash->array,hashNode,hash->num_buckets);
+      hashNode = tmp;
+    }
+
+    hash->oldArray[hash->rehash_idx++] = NULL;
+    steps--;
+
+  } /* end while (steps > 0 ...) */
+
+  if (hash->rehash_idx >= hash->old_buckets){
+    freemem(hash->oldArray);
+    hash->oldArray    = NULL;
+    hash->old_buckets = 0;
+    hash->rehash_idx  = 0;
+  }
+
+} /* end hashRehashStep() */
+
+
+/* ====================== hashIterTable() ====================== */
+/* ====================== hashIterTable() ====================== */
+
+/*
+ * hashIterTable()
+ * This function is hashIterNext() within one table or segment
+ * table.  Chained tables walk the old array of a resize in
+ * progress first; the bucket arrays are read in order and
+ * every empty bucket costs one pointer test.
+ *
+ * INPUT:       hash            Hash table, not HASH_CONCURRENT
+ *              it              Iterator
+ * RETURNS:     1               it holds the next entry
+ *              0               No entries left in this table
+ */
+static
+int hashIterTable(Hash *hash, HashIter *it){
+
+  struct HashNode   **array;
+  struct HashNode   *node;
+  unsigned int      n;
+
+  switch (hash->engine){
+    case HASH_FLAT:   return flatIterNext(hash,it);
+    case HASH_SWISS:  return swissIterNext(hash,it);
+    case HASH_IMAGE:  return imageIterNext(hash,it);
+  }
+
+  node = (it->node != NULL) ? it->node->next : NULL;
+
+  while (node == NULL){
+
+    if (it->old == 0 && hash->oldArray == NULL)
+      it->old = 1;
+    array = it->old ? hash->array : hash->oldArray;
+    n     = it->old ? hash->num_buckets : hash->old_buckets;
+
+    while (it->pos < n && array[it->pos] == NULL)
+      it->pos++;
+
+    if (it->pos < n)
+      node = array[it->pos++];
+    else if (it->old)
+      return 0;
+    else {
+      it->old = 1;
+      it->pos = 0;
+    }
+
+  } /* end while (node == NULL) */
+
+  it->node    = node;
+  it->key     = HASH_KEY_STR(&node->key);
+  it->hashval = node->hashval;
+  it->data    = node->data;
+
+  return 1;
+
+} /* end hashIterTable() */
+
+
+/* ======================== hashRepack() ======================= */
+/* ======================== hashRepack() ======================= */
+
+/*
+ * hashRepack()
+ * This function copies the keys of a HASH_ARENA table, and
+ * the nodes of a chained one, into fresh arenas and destroys
+ * the old ones, releasing the space deleted entries held.
+ * Inline and borrowed keys stay where they are.  A chained
+ * table must have no incremental resize running.  If memory
+ * runs out part way the old arenas are merged into the new
+ * ones, so every key and node stays valid.
+ *
+ * INPUT:       hash            Pointer to hash table
+ * RETURNS:     0               Success, or not HASH_ARENA
+ *              -1              Error allocating memory
+ */
+static
+int hashRepack(Hash *hash){
+
+  Arena             *oldKeys  = hash->keyArena;
+  Arena             *oldNodes = hash->nodeArena;
+  struct HashNode   **link;
+  struct HashNode   *node;
+  HashKey           *key;
+  HashKey           copy;
+  unsigned int      i;
+  int               ret = 0;
+
+  if (oldKeys == NULL)
+    return 0;
+
+  hash->keyArena  = arenaCreate(0);
+  hash->nodeArena = (oldNodes != NULL)
+                    ? arenaCreate(sizeof(struct HashNode)) : NULL;
+  if (hash->keyArena == NULL || (oldNodes != NULL && hash->nodeArena == NULL)){
+    arenaDestroy(hash->keyArena);
+    arenaDestroy(hash->nodeArena);
+    hash->keyArena  = oldKeys;
+    hash->nodeArena = oldNodes;
+    return -1;
+  }
+
+  for (i = 0; i < hash->num_buckets && ret == 0; i++){
+
+    if (hash->engine != HASH_CHAINED){
+      key = &hash->keys[i];
+      if (hash->hashes[i] != 0 && HASH_KEY_ISHEAP(key) &&
+          (hash->flags & HASH_BORROWED) == 0){
+        if (hashKeySet(hash,&copy,key->ptr) != 0)
+          ret = -1;
+        else
+          *key = copy;
+      }
+      continue;
+    }
+
+    /* Chained, copy each node and then its key */
+    for (link = &hash->array[i]; *link != NULL; link = &(*link)->next){
+      node = (struct HashNode *) arenaAlloc(hash->nodeArena, 0);
+      if (node == NULL){
+        ret = -1;
+        break;
+      }
+      *node = **link;
+      *link = node;
+      key   = &node->key;
+      if (HASH_KEY_ISHEAP(key) && (hash->flags & HASH_BORROWED) == 0){
+        if (hashKeySet(hash,&copy,key->ptr) != 0){
+          ret = -1;
+          break;
+        }
+        *key = copy;
+      }
+    }
+
+  } /* end for (i = 0; i < hash->num_buckets ...) */
+
+  if (ret == 0){
+    arenaDestroy(oldKeys);
+    arenaDestroy(oldNodes);
+  }
+  else {
+    arenaAdopt(hash->keyArena,oldKeys);
+    if (oldNodes != NULL)
+      arenaAdopt(hash->nodeArena,oldNodes);
+  }
+
+  return ret;
+
+} /* end hashRepack() */
+
+
+/* ======================= hashBucketOf() ====================== */
+/* ======================= hashBucketOf() ====================== */
+
+/*
+ * hashBucketOf()
+ * This function returns the bucket list a hash value belongs
+ * in.  While an incremental resize runs, buckets of oldArray
+ * that have not been moved yet still own their keys.
+ *
+ * INPUT:       hash            Pointer to hash table
+ *              hashval         Value from hashKeyValue()
+ * RETURNS:     Pointer to the head pointer of the bucket list
+ */
+static
+struct HashNode **hashBucketOf(Hash *hash, uint64_t hashval){
+
+  unsigned int key;
+
+  if (hash->oldArray != NULL){
+    key = hashBucket(hashval,hash->old_buckets);
+    if (key >= hash->rehash_idx)
+      return &hash->oldArray[key];
+  }
+
+  return &hash->array[hashBucket(hashval,hash->num_buckets)];
+
+} /* end hashBucketOf() */
+
+
+/* ======================= hashNodeNew() ======================= */
+/* ======================= hashNodeNew() ======================= */
+
+/*
+ * hashNodeNew()
+ * This function makes a node for vkey and links it at the
+ * head of bucket, then grows the table if that took it past
+ * its load factor.  The bucket pointer is stale after that,
+ * the node is not.
+ *
+ * INPUT:       hash            Pointer to hash table
+ *              bucket          From hashBucketOf()
+ *              vkey            String key
+ *              hashval         hashKeyValue() of vkey
+ *              data            Void pointer to data container
+ * RETURNS:     node            New node
+ *              NULL            Error allocating memory
+ */
+static
+struct HashNode *hashNodeNew(Hash *hash, struct HashNode **bucket,
+                             const char *vkey, uint64_t hashval, void *data){
+
+  struct HashNode  *hashNode;
+  unsigned int     size;
+
+  if (hash->nodeArena != NULL)
+    hashNode = (struct HashNode *) arenaAlloc(hash->nodeArena, 0);
+  else
+    hashNode = (struct HashNode *) malloc (sizeof(struct HashNode));
+
+  if (hashNode == NULL)
+    return NULL;
+
+  /* Copy vkey to hashNode */
+  if (hashKeySet(hash,&hashNode->key,vkey) != 0){
+    hashFreeNode(hash,hashNode,NULL);  /* Malloc failure free node */
+    return NULL;
+  }
+
+  hashNode->data = data;             /* Point data to data container */
+  hashNode->hashval = hashval;       /* Hash once, keep it */
+  hashNode->next = *bucket;
+  *bucket = hashNode;
+
+  hash->count++;                     /* Increase node count */
+
+  /*
+   * Check if we're reached max allowable table
+   * utilization then rehash with next largest
+   * size, see hashGrowSize().
+   */
+  if ((double) hash->count > hash->max_load * hash->num_buckets){
+    size = hashGrowSize(hash->num_buckets,hash->growth,
+                        hash->max_buckets,0);
+    if (size > hash->num_buckets)
+      hashRehash(hash,size);
+  }
+
+  return hashNode;
+
+} /* end hashNodeNew() */
+
+
+/*
+ * hashKeep()
+ * Merge function of hashEmplace(), keeps what is stored.
+ */
+static
+void *hashKeep(void *old, void *data){
+
+  (void) data;
+
+  return old;
+
+} /* end hashKeep() */
+
+
+/* ===================== hashDestroyArray() ==================== */
+/* ===================== hashDestroyArray() ==================== */
+
+/*
+ * hashDestroyArray()
+ * This function frees every node in an array of buckets,
+ * but not the array itself.  Arena nodes are left for the
+ * arena to release, only their data containers are freed.
+ *
+ * INPUT:       hash            Hash table
+ *              hashArray       Array of buckets
+ *              num_buckets     Number of buckets in the array
+ *              destructor      Destructor for data containers
+ */
+static
+void hashDestroyArray(Hash *hash, struct HashNode **hashArray,
+                      unsigned int num_buckets,
+                      void (*destructor)(void *data)){
+
+  unsigned int      i;
+  struct HashNode   *hashNodePtr;
+  struct HashNode   *tmp;
+
+  /* Nothing to visit when the arena owns everything */
+  if (hash->nodeArena != NULL && destructor == NULL)
+    return;
+
+  /* Loop through hash table and deallocate buckets */
+  for (i = 0; i < num_buckets; i++){
+
+    /* Get first node of bucket list */
+    hashNodePtr = hashArray[i];
+
+    while (hashNodePtr != NULL){
+
+      /*
+       * Save pointer to next node,
+       * free current node, and continue.
+       */
+      tmp = hashNodePtr->next;
+      if (hash->nodeArena != NULL)
+        destructor(hashNodePtr->data);
+      else
+        hashFreeNode(hash,hashNodePtr,destructor);
+      hashNodePtr = tmp;
+
+    } /* end while (hashNodePtr != NULL) */
+
+  } /* end for (i = 0; i < num_buckets; i++) */
+
+} /* end hashDestroyArray() */
+
+
+/* ====================== hashPrintArray() ===================== */
+/* ====================== hashPrintArray() ===================== */
+
+/*
+ * hashPrintArray()
+ * This function prints every node in an array of buckets.
+ *
+ * INPUT:       hashArray       Array of buckets
+ *              num_buckets     Number of buckets in the array
+ *              printer         Printer for data containers
+ */
+static
+void hashPrintArray(struct HashNode **hashArray,
+                    unsigned int num_buckets,
+                    void (*printer)(void *data)){
+
+  unsigned int      i;
+  struct HashNode   *hashNode;
+
+  for (i = 0; i < num_buckets; i++){
+
+    hashNode = hashArray[i];
+
+    while (hashNode != NULL){
+
+      printf ("key: %u ",i);
+      printer(hashNode->data);
+      hashNode = hashNode->next;
+
+    } /* end while (hashNode != NULL) */
+
+  } /* end for (i = 0; i < num_buckets; i++) */
+
+} /* end hashPrintArray() */
+
+
 
 /* ===================== hashArrayInsert() ===================== */
 /* ===================== hashArrayInsert() ===================== */
@@ -491,10 +2649,12 @@ void hashRehash(Hash *hash, unsigned int num_buckets){
  *            num_buckets       Number of buckets in the array
  * RETURNS:   0                 Success
  *            -1                Failure
- * USES:      hash_fval_string()
+ * USES:      hashBucket()
  *
- * NOTES:     hashNode->vkey    Initialized to key string
+ * NOTES:     hashNode->key     Initialized to key string
  *            hashNode->data    Initialized to point to data container
+ *            hashNode->hashval Initialized to hashKeyValue() of vkey,
+ *                              so rehashing never rereads the key
  *
  * Remember to increment hash->count as this function can't!
  *
@@ -510,7 +2670,7 @@ int hashArrayInsert(struct HashNode **hashArray,
     if (hashArray != NULL && hashNode != NULL){
 
       /* Get hashed key */
-      key = hash_fval_string(hashNode->vkey,num_buckets);
+      key = hashBucket(hashNode->hashval,num_buckets);
 
       /* Insert hash node at head of bucket list */
       hashNode->next = hashArray[key];
@@ -529,14 +2689,14 @@ int hashArrayInsert(struct HashNode **hashArray,
  * This function accepts a value and scans the
  * sizes[] array (a list of primes) and returns
  * the next value equal to or greater than the
- * value passed in.
+ * value passed in.  Past the end of sizes[] the
+ * value itself is returned.
  *
  * INPUT:     value      Minimum size threshold
  * RETURNS:   prime      Next prime in sizes[] table
  *                       larger than the specified
  *                       threshold.
  */
-static
 unsigned int hashPrime(unsigned int value){
   int i;
 
@@ -547,9 +2707,60 @@ unsigned int hashPrime(unsigned int value){
    */
   for (i = 0; (sizes[i] < value) && (sizes[i + 1] != 0); i++);
 
+  if (sizes[i] < value)
+    return(value);
+
   return(sizes[i]);
 }
 
+/*
+ * hashGrowSize()
+ * This function returns the size a full table of size
+ * buckets or slots grows to.  That is size times growth, or
+ * with growth 0 the next size in sizes[], or twice size once
+ * past its end.  Open addressing tables, pow2, round up to a
+ * power of two.  Never more than max, if not 0, or
+ * HASH_MAX_BUCKETS, so size itself means the table can't
+ * grow.
+ *
+ * INPUT:     size       Current size
+ *            growth     Table growth factor, 0 for sizes[]
+ *            max        Table size limit, 0 for none
+ *            pow2       Non-zero for a power of two size
+ * RETURNS:   size       New size, at least the current one
+ */
+unsigned int hashGrowSize(unsigned int size, double growth, unsigned int max,
+                          int pow2){
+
+  unsigned int  limit = HASH_MAX_BUCKETS;
+  unsigned int  grown;
+  double        target;
+
+  if (max != 0 && max < limit)
+    limit = max;
+  if (size >= limit)
+    return size;
+
+  target = (double) size * ((growth > 1) ? growth : 2);
+  if (target > limit)
+    target = limit;
+
+  if (pow2)
+    for (grown = size; grown < target; grown <<= 1);
+  else if (growth > 1)
+    grown = (unsigned int) target + 1;
+  else {
+    grown = hashPrime(size + 1);
+
+    /* Past the end of sizes[] that is just size + 1 */
+    if (grown == size + 1)
+      grown = (unsigned int) target;
+  }
+
+  return (grown < limit) ? grown : limit;
+
+}
+
 
 /* ========================== freemem() ======================== */
 /* ========================== freemem() ======================== */
@@ -6,25 +6,183 @@
 #ifndef HASH_H
 #define HASH_H
 
+#include <stdint.h>
+#include "hashfn.h"
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*
  * Utilization Factor
  * If the hash table has better than
  * the following percentage of utilization
- * rehashing will occur.
+ * rehashing will occur.  This is the default,
+ * a table made by hashCreateOptions() may
+ * set its own.
  */
 #define MAX_UTILIZATION .80
 
+/*
+ * Shrink Factor
+ * A table whose utilization drops below this after a delete
+ * shrinks to about half of MAX_UTILIZATION, but never below
+ * the size it was created with.  The gap between the two
+ * factors keeps a table hovering near one size from growing
+ * and shrinking on alternate operations.  A table with a load
+ * factor of its own shrinks at the same fraction of it.
+ */
+#define MIN_UTILIZATION .20
+
+/*
+ * Table engines
+ * The engine is picked when the table is created with
+ * hashCreateEngine(), hashCreate() gives HASH_CHAINED.
+ *
+ * HASH_CHAINED    Array of buckets, each a linked list of
+ *                 HashNode structures.
+ * HASH_FLAT       Open addressing with Robin Hood linear
+ *                 probing.  Hashes, keys and data pointers
+ *                 live in three contiguous arrays so a probe
+ *                 walks memory sequentially.
+ * HASH_SWISS      Open addressing with a control byte per slot
+ *                 holding 7 hash bits.  Lookups test a group of
+ *                 16 or 32 control bytes at once with SIMD and
+ *                 only compare keys on a fragment match.
+ * HASH_IMAGE      Read-only snapshot mapped from a file written
+ *                 by hashSave() or hashSavePerfect().  Only
+ *                 made by hashOpen().
+ */
+#define HASH_CHAINED    0
+#define HASH_FLAT       1
+#define HASH_SWISS      2
+#define HASH_IMAGE      3
+#define HASH_ENGINE_MASK 0xff
+
+/*
+ * Table modes, or'ed with the engine
+ *
+ * HASH_INCREMENTAL  HASH_CHAINED only.  Growing allocates the
+ *                   new bucket array and then moves the old
+ *                   buckets across HASH_REHASH_STEP at a time
+ *                   on each add, get and delete, instead of
+ *                   all at once inside one hashAdd().
+ */
+#define HASH_INCREMENTAL 0x100
+
+/*
+ * HASH_ARENA        Keys are bump allocated from a string arena
+ *                   and chained nodes come from slab pages, so
+ *                   an entry costs no malloc() overhead and
+ *                   hashDestroy() frees whole pages.  Deleted
+ *                   keys are only reclaimed at hashDestroy().
+ */
+#define HASH_ARENA       0x200
+
+/*
+ * HASH_CONCURRENT   Safe to share between threads.  The table
+ *                   is split into HASH_SEGMENTS tables of the
+ *                   chosen engine, each behind its own
+ *                   reader/writer lock and resized on its own.
+ *                   Not combinable with HASH_INCREMENTAL.
+ */
+#define HASH_CONCURRENT  0x400
+#define HASH_SEGMENTS    64
+
+/*
+ * HASH_LOCKFREE     HASH_CONCURRENT with readers that take no
+ *                   lock.  hashGet() never blocks; writers
+ *                   still lock their segment, and deleted or
+ *                   resized nodes are freed through epoch based
+ *                   reclamation (ebr.c) once no reader can hold
+ *                   them.  HASH_CHAINED only, implies
+ *                   HASH_CONCURRENT.
+ */
+#define HASH_LOCKFREE    0x800
+
+/*
+ * HASH_BORROWED     Keys longer than HASH_KEY_INLINE are not
+ *                   copied; the table keeps the caller's
+ *                   pointer, which must stay valid and unchanged
+ *                   until the key is deleted or the table
+ *                   destroyed.  Meant for keys that already sit
+ *                   in a long lived buffer, such as a mapped
+ *                   file (quad.c).  Not combinable with
+ *                   HASH_LOCKFREE.
+ */
+#define HASH_BORROWED    0x1000
+
+/*
+ * HASH_NUMA         HASH_CONCURRENT with segments spread over
+ *                   the NUMA nodes, segment i homed on node
+ *                   i * nodes / HASH_SEGMENTS.  A segment's
+ *                   bucket or slot arrays are moved to its node
+ *                   when allocated and after each resize, which
+ *                   only ever stalls that segment.  Chained
+ *                   nodes and key copies come from the node of
+ *                   the thread adding them, so writers should
+ *                   run on the segment's node: hashSegmentOf()
+ *                   and hashSegmentNode() tell which it is and
+ *                   hashRunOnNode() moves a thread there.
+ *                   Implies HASH_CONCURRENT.  Build with
+ *                   -DHASH_LIBNUMA and -lnuma to use libnuma,
+ *                   otherwise sysfs and mbind() are used.
+ */
+#define HASH_NUMA        0x2000
+
+/*
+ * Key types, set with hashSetKeySize() while a table is empty
+ *
+ * HASH_KEY_STRING   NUL terminated strings, the default.
+ * HASH_KEY_U32      uint32_t and uint64_t keys, stored inline,
+ * HASH_KEY_U64      hashed with hashFnInt() and compared with
+ *                   one load and compare.  hashAddInt() and
+ *                   friends take them by value.
+ * Any other size    Fixed length binary keys of that many
+ *                   bytes, hashed with the table's hash
+ *                   function and compared with memcmp().  They
+ *                   are passed by pointer to hashAdd() and the
+ *                   other key functions.
+ */
+#define HASH_KEY_STRING  0
+#define HASH_KEY_U32     4
+#define HASH_KEY_U64     8
+
+/* Keys hashed and prefetched ahead by hashGetBatch()/hashAddBatch() */
+#define HASH_BATCH       16
+
+/* Non-empty buckets moved per operation in HASH_INCREMENTAL */
+#define HASH_REHASH_STEP 16
+
+/* Most threads hashBuildBulk(), hashForEach() and
+   hashDestroyParallel() start, see bulk.c */
+#define HASH_MAX_THREADS 64
+
+/*
+ * Statistics, see hashStats()
+ *
+ * HASH_STATS        Build the library with -DHASH_STATS to have
+ *                   every lookup counted as a hit or a miss.
+ *                   Without it the counters stay 0 and lookups
+ *                   carry no extra code.
+ * HASH_STATS_HIST   Length of the HashStats histogram, the last
+ *                   entry counts everything longer.
+ */
+#define HASH_STATS_HIST  16
+
 /*
  * This is an array of primes. We grow the table rapidly
  * initially to avoid a lot of rehashing, then just double
  * the values.  The small sizes should rehash quickly and
  * large rehashes shouldn't happen often.
  *
- * Note these are in a sense magic numbers as the largest
- * hash possible is the largest number is the table.
- * However, it doesn't make sense to waste time calculating
- * large primes on the fly. The size range is 13 to roughly
- * 130 million, which should be sufficient for most purposes.
+ * Note these are in a sense magic numbers.  It doesn't make
+ * sense to waste time calculating large primes on the fly.
+ * The size range is 13 to roughly 130 million.  Buckets are
+ * picked from the top bits of the hash, which needs no prime,
+ * so past the top a table simply doubles, up to
+ * 2^31 buckets, enough for a billion entries.
  */
 
 static unsigned int sizes[] = {
@@ -50,12 +208,29 @@ static unsigned int sizes[] = {
 };
 
 
+/*
+ * Stored key.  Keys of up to HASH_KEY_INLINE bytes, such as
+ * the DRG codes, are kept NUL terminated in buf[] so comparing
+ * them touches no other cache line.  Longer keys are copied
+ * out of line to ptr and the last byte of buf[] is set to
+ * HASH_KEY_HEAP.  Integer keys, and binary keys of up to
+ * HASH_KEY_INLINE bytes, sit in buf[] the same way.
+ */
+#define HASH_KEY_INLINE  15
+#define HASH_KEY_HEAP    1
+
+typedef union HashKey {
+  char   *ptr;
+  char   buf[HASH_KEY_INLINE + 1];
+} HashKey;
+
 /* Hash node definition */
 struct HashNode {
   struct HashNode *next;
   void   *data;
-  char   *vkey;
-} HashNode;
+  uint64_t hashval;     /* Full hash of key */
+  HashKey key;
+};
 
 /* Hash table */
 /* typedef struct HashNode *Hash; */
@@ -65,19 +240,235 @@ typedef struct Hash {
   unsigned int          num_buckets;
   unsigned int          count;
   struct   HashNode     **array;
+  int                   engine;      /* HASH_CHAINED, HASH_FLAT, ... */
+  int                   flags;       /* HASH_INCREMENTAL, ... */
+  Arena                 *nodeArena;  /* HASH_ARENA node slabs */
+  Arena                 *keyArena;   /* HASH_ARENA key strings */
+  HashFunc              hashfn;      /* String hash function */
+  uint64_t              seed;        /* Per table hash seed */
+  unsigned int          keysize;     /* HASH_KEY_STRING or key bytes */
+  unsigned int          min_buckets; /* Never shrink below, see hashCompact() */
+  unsigned int          max_buckets; /* Never grow past, 0 for no limit */
+  double                max_load;    /* Grow past this, see HashOptions */
+  double                growth;      /* Size multiple, 0 for sizes[] */
+
+  /* HASH_INCREMENTAL resize in progress, oldArray NULL if none */
+  struct   HashNode     **oldArray;  /* Buckets being drained */
+  unsigned int          old_buckets; /* Size of oldArray */
+  unsigned int          rehash_idx;  /* Next oldArray bucket to move */
+
+  /* Open addressing engines, num_buckets is a power of two */
+  unsigned int          shift;       /* 64 - log2(num_buckets) */
+  HashKey               *keys;       /* Slot key */
+  void                  **values;    /* Slot data container */
+
+  uint64_t              *hashes;     /* Slot hash, 0 when empty */
+
+  /* HASH_CONCURRENT segments, NULL otherwise */
+  struct   HashSegment  *segments;
+
+  /* HASH_IMAGE mapped snapshot */
+  struct   HashImage    *image;
+
+  /* HASH_SWISS engine */
+  uint8_t               *ctrl;       /* Slot control bytes */
+  unsigned int          tombstones;  /* DELETED control bytes */
+  unsigned int          group;       /* Slots tested per probe step */
+  int                   (*probe)(struct Hash *hash, const char *vkey,
+                                 uint64_t hashval);
+
+  /* Statistics, hits and misses only counted with HASH_STATS */
+  unsigned int          rehashes;    /* Resizes and rebuilds */
+  double                rehash_secs; /* Time spent in them */
+  uint64_t              hits;
+  uint64_t              misses;
 
 } Hash;
 
+/*
+ * Table health, filled in by hashStats().  HASH_CONCURRENT
+ * tables report the sum over their segments.  The histogram
+ * is by engine:
+ *
+ * HASH_CHAINED    histogram[n] buckets holding n entries, so
+ *                 histogram[0] is the empty buckets.
+ * HASH_FLAT       histogram[d] entries d slots from their home
+ *                 slot.
+ * HASH_SWISS      histogram[d] entries d groups past their
+ *                 home group.
+ *
+ * max_chain is the longest chain, or the most slots (groups
+ * for HASH_SWISS) a lookup of a stored key probes, and
+ * mean_probe the mean of that over every stored key.
+ */
+typedef struct HashStats {
+  int           engine;
+  unsigned int  count;          /* Entries */
+  unsigned int  size;           /* Buckets or slots */
+  double        load_factor;    /* count / size */
+  unsigned int  empty;          /* Empty buckets or slots */
+  double        empty_ratio;    /* empty / size */
+  unsigned int  tombstones;     /* HASH_SWISS deleted slots */
+  unsigned int  max_chain;
+  double        mean_probe;
+  unsigned int  histogram[HASH_STATS_HIST];
+  unsigned int  rehashes;       /* Resizes and rebuilds so far */
+  double        rehash_secs;    /* Seconds spent in them */
+  size_t        bucket_bytes;   /* Bucket array, or slot arrays */
+  size_t        node_bytes;     /* HASH_CHAINED nodes */
+  size_t        key_bytes;      /* Keys stored out of line */
+  uint64_t      hits;           /* Lookups that found their key, */
+  uint64_t      misses;         /* and not, with HASH_STATS only */
+} HashStats;
+
+/*
+ * Table options, for hashCreateOptions()
+ *
+ * max_load      Entries per bucket or slot that makes the
+ *               table grow, 0 for MAX_UTILIZATION.  Below 1
+ *               for the open addressing engines, a chained
+ *               table may go past 1 to save memory.
+ * growth        What the size is multiplied by when the table
+ *               grows, more than 1.  0 steps through sizes[]
+ *               and doubles past it.  Open addressing tables
+ *               round up to a power of two, so always at
+ *               least double.
+ * min_buckets   Size to start at, and never shrink below.
+ * max_buckets   Size never to grow past, 0 for no limit.  A
+ *               chained table then keeps taking entries with
+ *               its chains getting longer, an open addressing
+ *               one refuses them once max_load is reached.
+ *               Rounded down to a power of two for those.
+ *
+ * A HASH_CONCURRENT table splits min_buckets and max_buckets
+ * between its segments.  hashReserve() sizes a table for a
+ * number of entries in one go, so a loader that knows how
+ * many are coming never rehashes on the way.
+ */
+typedef struct HashOptions {
+  double        max_load;
+  double        growth;
+  unsigned int  min_buckets;
+  unsigned int  max_buckets;
+} HashOptions;
+
+/*
+ * Iteration
+ *
+ * hashIterBegin() and hashIterNext() visit every entry once,
+ * in storage order: bucket by bucket for chained tables, slot
+ * by slot through the packed arrays of the open addressing
+ * engines, skipping empty HASH_SWISS groups eight control
+ * bytes at a time.  The table must not change meanwhile.
+ *
+ * hashScan() walks a table a slice per call, like the Redis
+ * SCAN command, and the table may change between calls.  The
+ * cursor is a position in hash value order rather than a
+ * bucket number, so a resize between calls loses nothing:
+ * every entry present for the whole scan is visited exactly
+ * once, entries added or deleted meanwhile may or may not be.
+ * Start with cursor 0 and pass back what each call returns
+ * until it returns 0 again.
+ */
+typedef void (*HashVisit)(void *arg, const char *vkey, uint64_t hashval,
+                          void *data);
+
+typedef struct HashIter {
+  const char        *key;       /* Current entry */
+  uint64_t          hashval;
+  void              *data;
+
+  Hash              *hash;      /* The rest is private */
+  struct HashNode   *node;
+  unsigned int      segment;
+  unsigned int      pos;
+  int               old;
+} HashIter;
+
+/*
+ * Insert or update
+ *
+ * hashFindOrInsert(), hashUpsert() and hashEmplace() hash the
+ * key once and probe once, where a hashGet() and then a
+ * hashAdd() do both twice.  The pointer hashFindOrInsert()
+ * returns is the entry's own data slot: read or set it before
+ * anything else is added to or deleted from the table, which
+ * may move the entry.  For that reason it refuses
+ * HASH_CONCURRENT tables; there hashUpsert() and hashEmplace()
+ * do the whole job under the segment lock, merge function
+ * included.  A HashMerge gets the data already stored and the
+ * data passed in, and returns what to store.  Without one,
+ * hashUpsert() replaces the data and hands the old container
+ * back to the caller.  Readers of a HASH_LOCKFREE table may
+ * still hold the old container, so there neither a merge nor
+ * the caller may free it straight away.
+ */
+typedef void *(*HashMerge)(void *old, void *data);
+
+/*
+ * Bulk operations
+ *
+ * hashBuildBulk(), hashForEach() and hashDestroyParallel()
+ * split one large job over nthreads threads, 0 for one per
+ * CPU.  The calling thread takes a share, so 1 runs it all
+ * in the caller.  hashBuildBulk() loads an empty table,
+ * anything else falls back to one hashAdd() per key.  The
+ * visit function of hashForEach() is called from several
+ * threads at once, in no particular order, and the table
+ * must not change meanwhile.
+ */
+
 
 /* ============== public functions ================ */
 /* ============== public functions ================ */
 
 Hash *hashCreate(unsigned int num_buckets);
+Hash *hashCreateEngine(unsigned int num_buckets, int engine);
+Hash *hashCreateOptions(int engine, const HashOptions *options);
+int hashReserve(Hash *hash, unsigned int count);
+Hash *hashOpen(const char *path);
+int hashSave(Hash *hash, const char *path, size_t datasize);
+int hashSavePerfect(Hash *hash, const char *path, size_t datasize);
 int hashAdd(Hash *hash, char *vkey, void *data);
 void *hashGet(Hash *hash, char *vkey);
+void **hashFindOrInsert(Hash *hash, char *vkey, int *inserted);
+int hashUpsert(Hash *hash, char *vkey, void *data, HashMerge merge,
+               void **old);
+int hashEmplace(Hash *hash, char *vkey, void *data, void **existing);
+unsigned int hashAddBatch(Hash *hash, char **keys, unsigned int n,
+                          void **data);
+void hashGetBatch(Hash *hash, char **keys, unsigned int n, void **out);
+void hashDelete(Hash *hash, char *vkey, void (*destructor)(void *data));
 void hashDestroy(Hash *hash, void (*destructor)(void *data));
 void hashPrint(Hash *hash, void (*printer)(void *data));
 unsigned int hashCount(Hash *hash);
 unsigned int hashSize(Hash *hash);
+int hashStats(Hash *hash, HashStats *stats);
+int hashCompact(Hash *hash);
+void hashIterBegin(Hash *hash, HashIter *it);
+int hashIterNext(HashIter *it);
+uint64_t hashScan(Hash *hash, uint64_t cursor, unsigned int count,
+                  HashVisit visit, void *arg);
+unsigned int hashBuildBulk(Hash *hash, char **keys, void **values,
+                           unsigned int n, int nthreads);
+void hashForEach(Hash *hash, HashVisit visit, void *arg, int nthreads);
+void hashDestroyParallel(Hash *hash, void (*destructor)(void *data),
+                         int nthreads);
+unsigned int hashSegmentOf(Hash *hash, char *vkey);
+int hashSegmentNode(Hash *hash, unsigned int segment);
+int hashNumaNodes(void);
+int hashRunOnNode(int node);
+int hashSetHashFunc(Hash *hash, HashFunc hashfn);
+int hashSetSeed(Hash *hash, uint64_t seed);
+int hashSetKeySize(Hash *hash, unsigned int keysize);
+int hashAddInt(Hash *hash, uint64_t key, void *data);
+void *hashGetInt(Hash *hash, uint64_t key);
+void hashDeleteInt(Hash *hash, uint64_t key, void (*destructor)(void *data));
+int hashUpsertInt(Hash *hash, uint64_t key, void *data, HashMerge merge,
+                  void **old);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
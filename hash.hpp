@@ -0,0 +1,549 @@
+/*
+ * hash.hpp
+ * Header only C++ template version of the Hash ADT.
+ *
+ * hash::Table<K, V, Hash, Eq> is the HASH_FLAT engine (see
+ * flat.c) with the key and value types fixed at compile time:
+ * Robin Hood linear probing over a hashes[] array of cached
+ * 64 bit hash values, 0 marking an empty slot, and a parallel
+ * slots[] array holding each key and value by value.  Hash and
+ * Eq are plain functors, so both are inlined into the probe
+ * loop instead of being called through a pointer, and a
+ * struct value such as quadData sits in its slot with no
+ * pointer to chase and nothing for the caller to free.
+ *
+ * hash::Hasher<K> picks the hash at compile time: integers
+ * are mixed inline, anything that converts to a string_view
+ * goes through the same seeded hashFnWy() as the C tables.
+ * Either result is spread with the Fibonacci multiply of
+ * hashKeyValue(), so link with hashfn.o.
+ *
+ * Values are moved, never copied, when the table grows or
+ * entries are shifted.  Allocation failures throw
+ * std::bad_alloc.  The C API in hash.h is unchanged and can be
+ * used from C++ alongside this header.
+ *
+ * FUNCTIONS:        find         Pointer to the value of a key.
+ *                   emplace      Add a key, value built in place.
+ *                   insert       Add a key/value pair.
+ *                   operator[]   Value of a key, added if absent.
+ *                   erase        Remove a key.
+ *                   reserve      Size for a number of entries.
+ *                   forEach      Call a functor on every entry.
+ *                   entries      Range over the entries of a C
+ *                                table, for a range-based for.
+ */
+
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "hash.h"
+
+namespace hash {
+
+/* Fewest slots a table has, a power of two */
+constexpr std::size_t MIN_SLOTS = 16;
+
+/*
+ * mix()
+ * The splitmix64 finalizer, for integer keys.
+ */
+constexpr uint64_t mix(uint64_t x){
+
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+
+  return x;
+
+}
+
+/* Lets a static_assert depend on a template parameter */
+template <class T>
+struct unsupported : std::false_type {};
+
+/* Keys hashed and compared as their characters */
+template <class K>
+constexpr bool is_string = std::is_convertible_v<const K &, std::string_view>;
+
+/*
+ * Hasher
+ * Default hash functor, picked by key type.  String keys take
+ * any string-like argument, so a Table<std::string, V> can be
+ * searched with a char * without building a std::string.
+ */
+template <class K>
+struct Hasher {
+
+  template <class Q>
+  uint64_t operator()(const Q &key, uint64_t seed) const noexcept {
+
+    if constexpr (std::is_integral_v<K> || std::is_enum_v<K>)
+      return mix(static_cast<uint64_t>(key) ^ seed);
+    else if constexpr (is_string<K>){
+      std::string_view s(key);
+      return hashFnWy(s.data(), s.size(), seed);
+    }
+    else
+      static_assert(unsupported<K>::value,
+                    "hash::Hasher: give the Table a hash functor for K");
+
+  }
+
+};
+
+/*
+ * Equal
+ * Default equality functor, strings compare by contents.
+ */
+template <class K>
+struct Equal {
+
+  template <class Q>
+  bool operator()(const K &a, const Q &b) const noexcept {
+
+    if constexpr (is_string<K>)
+      return std::string_view(a) == std::string_view(b);
+    else
+      return a == b;
+
+  }
+
+};
+
+
+/* ======================== Table ========================= */
+/* ======================== Table ========================= */
+
+template <class K, class V, class Hash = Hasher<K>, class Eq = Equal<K>>
+class Table {
+
+ public:
+
+  struct Slot {
+    K  key;
+    V  value;
+  };
+
+  explicit Table(std::size_t num_slots = MIN_SLOTS,
+                 uint64_t seed = hashFnSeed())
+    : seed_(seed) {
+
+    std::size_t slots = MIN_SLOTS;
+
+    while (slots < num_slots)
+      slots <<= 1;
+    alloc(slots);
+
+  }
+
+  ~Table(){
+    release();
+  }
+
+  Table(const Table &) = delete;
+  Table &operator=(const Table &) = delete;
+
+  Table(Table &&other) noexcept {
+    steal(other);
+  }
+
+  Table &operator=(Table &&other) noexcept {
+    if (this != &other){
+      release();
+      steal(other);
+    }
+    return *this;
+  }
+
+  std::size_t size() const noexcept      { return count_; }
+  std::size_t capacity() const noexcept  { return num_slots_; }
+  bool empty() const noexcept            { return count_ == 0; }
+
+  /*
+   * find()
+   * key is a K or anything Hash and Eq accept alongside one.
+   *
+   * RETURNS:   value       Pointer to the value of key
+   *            nullptr     key not in the table
+   */
+  template <class Q = K>
+  V *find(const Q &key) noexcept {
+
+    std::size_t pos = findSlot(key, hashOf(key));
+
+    return (pos == NPOS) ? nullptr : &slots_[pos].value;
+
+  }
+
+  template <class Q = K>
+  const V *find(const Q &key) const noexcept {
+    return const_cast<Table *>(this)->find(key);
+  }
+
+  /*
+   * emplace()
+   * Adds key with a value built from args, unless key is
+   * already present, growing first past MAX_UTILIZATION.
+   *
+   * RETURNS:   pair        Value of key, and true if it was
+   *                        added by this call
+   */
+  template <class... Args>
+  std::pair<V *, bool> emplace(K key, Args &&... args){
+
+    uint64_t     h   = hashOf(key);
+    std::size_t  pos = findSlot(key, h);
+
+    if (pos != NPOS)
+      return { &slots_[pos].value, false };
+
+    if ((double) (count_ + 1) > MAX_UTILIZATION * num_slots_)
+      grow((num_slots_ > 0) ? num_slots_ << 1 : MIN_SLOTS);
+
+    pos = place(h, Slot{ std::move(key), V(std::forward<Args>(args)...) });
+    count_++;
+
+    return { &slots_[pos].value, true };
+
+  }
+
+  bool insert(K key, V value){
+    return emplace(std::move(key), std::move(value)).second;
+  }
+
+  V &operator[](K key){
+    return *emplace(std::move(key)).first;
+  }
+
+  /*
+   * erase()
+   * Removes key, shifting the rest of its cluster back one
+   * slot as flatDelete() does, so no tombstones are left.
+   *
+   * RETURNS:   true        key was removed
+   *            false       key not in the table
+   */
+  template <class Q = K>
+  bool erase(const Q &key){
+
+    std::size_t  mask = num_slots_ - 1;
+    std::size_t  pos  = findSlot(key, hashOf(key));
+    std::size_t  next;
+
+    if (pos == NPOS)
+      return false;
+
+    slots_[pos].~Slot();
+
+    next = (pos + 1) & mask;
+    while (hashes_[next] != 0 && dist(hashes_[next], next) != 0){
+      new (&slots_[pos]) Slot(std::move(slots_[next]));
+      slots_[next].~Slot();
+      hashes_[pos] = hashes_[next];
+      pos  = next;
+      next = (next + 1) & mask;
+    }
+
+    hashes_[pos] = 0;
+    count_--;
+
+    return true;
+
+  }
+
+  /*
+   * reserve()
+   * Grows the table so n entries fit under MAX_UTILIZATION.
+   * A moved-from table has no slots and starts at MIN_SLOTS.
+   */
+  void reserve(std::size_t n){
+
+    std::size_t slots = (num_slots_ > MIN_SLOTS) ? num_slots_ : MIN_SLOTS;
+
+    while ((double) n > MAX_UTILIZATION * slots)
+      slots <<= 1;
+    if (slots != num_slots_)
+      grow(slots);
+
+  }
+
+  void clear() noexcept {
+
+    for (std::size_t i = 0; i < num_slots_; i++){
+      if (hashes_[i] != 0){
+        slots_[i].~Slot();
+        hashes_[i] = 0;
+      }
+    }
+    count_ = 0;
+
+  }
+
+  /*
+   * forEach()
+   * Calls visit(key, value) on every entry, in slot order.
+   * visit must not add or erase entries.
+   */
+  template <class F>
+  void forEach(F &&visit){
+
+    for (std::size_t i = 0; i < num_slots_; i++)
+      if (hashes_[i] != 0)
+        visit(static_cast<const K &>(slots_[i].key), slots_[i].value);
+
+  }
+
+ private:
+
+  static constexpr std::size_t NPOS = ~(std::size_t) 0;
+
+  uint64_t     *hashes_    = nullptr;
+  Slot         *slots_     = nullptr;
+  std::size_t  num_slots_  = 0;
+  std::size_t  count_      = 0;
+  unsigned     shift_      = 0;
+  uint64_t     seed_       = 0;
+  Hash         hash_;
+  Eq           eq_;
+
+  /* hashKeyValue() for a typed key, never 0 */
+  template <class Q>
+  uint64_t hashOf(const Q &key) const noexcept {
+
+    uint64_t h = hash_(key, seed_) * 0x9E3779B97F4A7C15ULL;
+
+    return (h != 0) ? h : 1;
+
+  }
+
+  /* Home slot and probe distance, FLAT_HOME() and FLAT_DIST() */
+  std::size_t home(uint64_t h) const noexcept {
+    return (std::size_t) (h >> shift_);
+  }
+
+  std::size_t dist(uint64_t h, std::size_t pos) const noexcept {
+    return (pos - home(h)) & (num_slots_ - 1);
+  }
+
+  /* Zeroed hashes[], uninitialised slots[]; unchanged on throw */
+  void alloc(std::size_t slots){
+
+    uint64_t  *hashes = new uint64_t[slots]();
+    unsigned  bits    = 0;
+
+    try {
+      slots_ = static_cast<Slot *>(::operator new(slots * sizeof(Slot),
+                                   std::align_val_t(alignof(Slot))));
+    }
+    catch (...){
+      delete[] hashes;
+      throw;
+    }
+
+    while (((std::size_t) 1 << bits) < slots)
+      bits++;
+
+    hashes_    = hashes;
+    num_slots_ = slots;
+    shift_     = 64 - bits;
+
+  }
+
+  void release() noexcept {
+
+    if (hashes_ == nullptr)
+      return;
+
+    clear();
+    delete[] hashes_;
+    ::operator delete(slots_, std::align_val_t(alignof(Slot)));
+    hashes_ = nullptr;
+    slots_  = nullptr;
+
+  }
+
+  void steal(Table &other) noexcept {
+
+    hashes_    = other.hashes_;
+    slots_     = other.slots_;
+    num_slots_ = other.num_slots_;
+    count_     = other.count_;
+    shift_     = other.shift_;
+    seed_      = other.seed_;
+    other.hashes_    = nullptr;
+    other.slots_     = nullptr;
+    other.num_slots_ = 0;
+    other.count_     = 0;
+
+  }
+
+  /* flatFind(), slot of key or NPOS */
+  template <class Q>
+  std::size_t findSlot(const Q &key, uint64_t h) const noexcept {
+
+    std::size_t  mask = num_slots_ - 1;
+    std::size_t  pos;
+    std::size_t  d    = 0;
+    uint64_t     sh;
+
+    if (hashes_ == nullptr)
+      return NPOS;
+
+    for (pos = home(h); (sh = hashes_[pos]) != 0; pos = (pos + 1) & mask){
+
+      /* Anything here is closer to home than we would be */
+      if (dist(sh, pos) < d)
+        break;
+
+      if (sh == h && eq_(slots_[pos].key, key))
+        return pos;
+
+      d++;
+    }
+
+    return NPOS;
+
+  }
+
+  /*
+   * flatInsert(), Robin Hood placement of a new entry.  The
+   * entry belongs at the first slot whose resident is closer
+   * to home than it would be; everything from there up to the
+   * next free slot moves along one, which is the same table
+   * flatInsert() builds by swapping but moves each slot once
+   * rather than swapping it three ways.  Returns the new
+   * entry's slot.
+   */
+  std::size_t place(uint64_t h, Slot &&entry){
+
+    std::size_t  mask = num_slots_ - 1;
+    std::size_t  pos  = home(h);
+    std::size_t  d    = 0;
+    std::size_t  end;
+    std::size_t  prev;
+
+    while (hashes_[pos] != 0 && dist(hashes_[pos], pos) >= d){
+      pos = (pos + 1) & mask;
+      d++;
+    }
+
+    if (hashes_[pos] != 0){
+      for (end = pos; hashes_[end] != 0; end = (end + 1) & mask)
+        ;
+      prev = (end - 1) & mask;
+      new (&slots_[end]) Slot(std::move(slots_[prev]));
+      hashes_[end] = hashes_[prev];
+      for (end = prev; end != pos; end = prev){
+        prev = (end - 1) & mask;
+        slots_[end]  = std::move(slots_[prev]);
+        hashes_[end] = hashes_[prev];
+      }
+      slots_[pos] = std::move(entry);
+    }
+    else
+      new (&slots_[pos]) Slot(std::move(entry));
+
+    hashes_[pos] = h;
+
+    return pos;
+
+  }
+
+  /* flatGrow(), rehash into slots using the cached hashes */
+  void grow(std::size_t slots){
+
+    uint64_t     *oldHashes = hashes_;
+    Slot         *oldSlots  = slots_;
+    std::size_t  oldNum     = num_slots_;
+
+    alloc(slots);
+
+    for (std::size_t i = 0; i < oldNum; i++){
+      if (oldHashes[i] != 0){
+        place(oldHashes[i], std::move(oldSlots[i]));
+        oldSlots[i].~Slot();
+      }
+    }
+
+    delete[] oldHashes;
+    ::operator delete(oldSlots, std::align_val_t(alignof(Slot)));
+
+  }
+
+};
+
+
+/* ======================= Entries ======================== */
+/* ======================= Entries ======================== */
+
+/*
+ * Entries
+ * Range over a C table, any engine, by hashIterBegin() and
+ * hashIterNext().  Each element is the HashIter itself, so
+ *
+ *   for (const HashIter &e : hash::entries(table))
+ *     use(e.key, e.data);
+ *
+ * The table must not change during the loop.
+ */
+class Entries {
+
+ public:
+
+  class iterator {
+
+   public:
+
+    explicit iterator(::Hash *h = nullptr) noexcept : done_(h == nullptr) {
+      if (h != nullptr){
+        hashIterBegin(h, &it_);
+        done_ = !hashIterNext(&it_);
+      }
+    }
+
+    const HashIter &operator*() const noexcept { return it_; }
+    const HashIter *operator->() const noexcept { return &it_; }
+
+    iterator &operator++() noexcept {
+      done_ = !hashIterNext(&it_);
+      return *this;
+    }
+
+    /* Only the end of a range is ever compared against */
+    bool operator!=(const iterator &other) const noexcept {
+      return done_ != other.done_;
+    }
+
+   private:
+
+    HashIter  it_ = {};
+    bool      done_;
+
+  };
+
+  explicit Entries(::Hash *h) noexcept : hash_(h) {}
+
+  iterator begin() const noexcept { return iterator(hash_); }
+  iterator end() const noexcept { return iterator(); }
+
+ private:
+
+  ::Hash *hash_;
+
+};
+
+/* Entries of a C table, see Entries */
+inline Entries entries(::Hash *h) noexcept { return Entries(h); }
+
+} /* namespace hash */
+
+#endif
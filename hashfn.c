@@ -0,0 +1,280 @@
+/*
+ * hashfn.c
+ * String hash function family for the hash ADT, and the
+ * integer hash used by tables with integer keys.
+ *
+ * hashFnWy() follows the public domain wyhash (final version 4)
+ * by Wang Yi: keys are read 8 or 16 bytes at a time and folded
+ * with 64x64->128 bit multiplies, so a 7 byte DRG code costs a
+ * couple of multiplies rather than seven dependent steps.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "hashfn.h"
+
+/* wyhash default secret */
+static const uint64_t wySecret[4] = {
+  0xa0761d6478bd642fULL,
+  0xe7037ed1a0b428dbULL,
+  0x8ebc6af09c88c6e3ULL,
+  0x589965cc75374cc3ULL
+};
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+void wyMum(uint64_t *a, uint64_t *b);
+
+static
+uint64_t wyMix(uint64_t a, uint64_t b);
+
+static
+uint64_t wyRead8(const uint8_t *p);
+
+static
+uint64_t wyRead4(const uint8_t *p);
+
+
+/* =================== Public Functions ====================== */
+/* =================== Public Functions ====================== */
+
+/*
+ * hashFnWy()
+ * This function hashes len bytes of key with wyhash.
+ *
+ * INPUT:     key       Bytes to hash
+ *            len       Number of bytes
+ *            seed      Per table seed
+ * RETURNS:   uint64_t  Hash value
+ */
+uint64_t hashFnWy(const void *key, size_t len, uint64_t seed){
+
+  const uint8_t  *p = (const uint8_t *) key;
+  uint64_t       a;
+  uint64_t       b;
+  uint64_t       see1;
+  uint64_t       see2;
+  size_t         i;
+
+  seed ^= wyMix(seed ^ wySecret[0], wySecret[1]);
+
+  if (len <= 16){
+    if (len >= 4){
+      a = (wyRead4(p) << 32) | wyRead4(p + ((len >> 3) << 2));
+      b = (wyRead4(p + len - 4) << 32) |
+           wyRead4(p + len - 4 - ((len >> 3) << 2));
+    }
+    else if (len > 0){
+      a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) |
+          p[len - 1];
+      b = 0;
+    }
+    else {
+      a = b = 0;
+    }
+  }
+  else {
+    i = len;
+    if (i > 48){
+      see1 = seed;
+      see2 = seed;
+      do {
+        seed = wyMix(wyRead8(p) ^ wySecret[1], wyRead8(p + 8) ^ seed);
+        see1 = wyMix(wyRead8(p + 16) ^ wySecret[2], wyRead8(p + 24) ^ see1);
+        see2 = wyMix(wyRead8(p + 32) ^ wySecret[3], wyRead8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16){
+      seed = wyMix(wyRead8(p) ^ wySecret[1], wyRead8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = wyRead8(p + i - 16);
+    b = wyRead8(p + i - 8);
+  }
+
+  a ^= wySecret[1];
+  b ^= seed;
+  wyMum(&a, &b);
+
+  return wyMix(a ^ wySecret[0] ^ len, b ^ wySecret[1]);
+
+}
+
+
+/*
+ * hashFnFnv1a()
+ * This function hashes len bytes of key with 64-bit FNV-1a,
+ * starting from the standard offset basis xor the seed.
+ *
+ * INPUT:     key       Bytes to hash
+ *            len       Number of bytes
+ *            seed      Per table seed
+ * RETURNS:   uint64_t  Hash value
+ */
+uint64_t hashFnFnv1a(const void *key, size_t len, uint64_t seed){
+
+  const uint8_t  *p = (const uint8_t *) key;
+  uint64_t       h  = 0xcbf29ce484222325ULL ^ seed;
+  size_t         i;
+
+  for (i = 0; i < len; i++){
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+
+  return h;
+
+}
+
+
+/*
+ * hashFnFval()
+ * This function is the original hash_fval_string() loop,
+ * result * 33 + c, extended to the full key and seeded.
+ * Kept for comparison, it is much weaker than the others.
+ *
+ * INPUT:     key       Bytes to hash
+ *            len       Number of bytes
+ *            seed      Per table seed
+ * RETURNS:   uint64_t  Hash value
+ */
+uint64_t hashFnFval(const void *key, size_t len, uint64_t seed){
+
+  const char  *p     = (const char *) key;
+  unsigned    result = (unsigned) seed;
+  size_t      i;
+
+  for (i = 0; i < len; i++)
+    result = result * 33U + p[i];
+
+  return result;
+
+}
+
+
+/*
+ * hashFnInt()
+ * This function hashes an integer key with the MurmurHash3
+ * 64-bit finalizer, two multiply-xorshift rounds, so integer
+ * keys skip the byte loop entirely.  It is a bijection: two
+ * different keys never give the same value.
+ *
+ * INPUT:     key       Integer key, u32 keys zero extended
+ *            seed      Per table seed
+ * RETURNS:   uint64_t  Hash value
+ */
+uint64_t hashFnInt(uint64_t key, uint64_t seed){
+
+  key ^= seed;
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+
+  return key;
+
+}
+
+
+/*
+ * hashFnSeed()
+ * This function returns a seed for a new table.  It reads
+ * /dev/urandom, falling back to the clock and pid if that
+ * fails.  Setting HASH_SEED in the environment gives every
+ * table the same seed so runs can be reproduced.
+ *
+ * RETURNS:   uint64_t  Seed value
+ */
+uint64_t hashFnSeed(void){
+
+  const char  *env;
+  uint64_t    seed = 0;
+  FILE        *fp;
+
+  if ((env = getenv("HASH_SEED")) != NULL)
+    return (uint64_t) strtoull(env, NULL, 0);
+
+  if ((fp = fopen("/dev/urandom", "rb")) != NULL){
+    if (fread(&seed, sizeof(seed), 1, fp) != 1)
+      seed = 0;
+    fclose(fp);
+  }
+
+  if (seed == 0)
+    seed = wyMix((uint64_t) time(NULL) ^ wySecret[2],
+                 ((uint64_t) getpid() << 32) ^ (uint64_t) clock());
+
+  return seed;
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * wyMum()
+ * 64x64->128 bit multiply, low half to a, high half to b.
+ */
+static
+void wyMum(uint64_t *a, uint64_t *b){
+
+  __uint128_t r = (__uint128_t) *a * *b;
+
+  *a = (uint64_t) r;
+  *b = (uint64_t) (r >> 64);
+
+}
+
+/*
+ * wyMix()
+ * Multiply and fold the two halves together.
+ */
+static
+uint64_t wyMix(uint64_t a, uint64_t b){
+
+  wyMum(&a, &b);
+
+  return a ^ b;
+
+}
+
+/*
+ * wyRead8()
+ * Unaligned little endian 64-bit read.
+ */
+static
+uint64_t wyRead8(const uint8_t *p){
+
+  uint64_t v;
+
+  memcpy(&v, p, sizeof(v));
+
+  return v;
+
+}
+
+/*
+ * wyRead4()
+ * Unaligned little endian 32-bit read.
+ */
+static
+uint64_t wyRead4(const uint8_t *p){
+
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+
+  return v;
+
+}
@@ -0,0 +1,44 @@
+/*
+ * hashfn.h
+ * Header file for the string hash function family used by
+ * the hash ADT.
+ *
+ * Every function hashes exactly len bytes and mixes in a
+ * 64-bit seed, so each table can be given its own random seed
+ * and an attacker can't precompute a set of colliding keys.
+ *
+ * FUNCTIONS:   hashFnWy       wyhash, 8 bytes per step (default)
+ *              hashFnFnv1a    64-bit FNV-1a, byte at a time
+ *              hashFnFval     The original result*33 + c hash,
+ *                             now over the full key length
+ *              hashFnInt      MurmurHash3 finalizer for integer keys
+ *              hashFnSeed     Random seed for a new table
+ */
+
+#ifndef HASHFN_H
+#define HASHFN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hash function interface */
+typedef uint64_t (*HashFunc)(const void *key, size_t len, uint64_t seed);
+
+/* Function used by new tables */
+#define HASH_FN_DEFAULT  hashFnWy
+
+uint64_t hashFnWy(const void *key, size_t len, uint64_t seed);
+uint64_t hashFnFnv1a(const void *key, size_t len, uint64_t seed);
+uint64_t hashFnFval(const void *key, size_t len, uint64_t seed);
+uint64_t hashFnInt(uint64_t key, uint64_t seed);
+uint64_t hashFnSeed(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
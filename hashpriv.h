@@ -0,0 +1,291 @@
+/*
+ * hashpriv.h
+ * Private interfaces shared between the hash ADT engines.
+ * Clients should only include hash.h.
+ */
+
+#ifndef HASHPRIV_H
+#define HASHPRIV_H
+
+#include <pthread.h>
+#include "hash.h"
+
+/* Smallest open addressing tables, must be powers of two */
+#define FLAT_MIN_SLOTS   16
+#define SWISS_MIN_SLOTS  32
+
+/* Bytes per cache line, HASH_CONCURRENT segments are padded to it */
+#define HASH_CACHE_LINE  64
+
+/* HASH_CONCURRENT segment, one lock and table per cache line */
+struct HashSegment {
+  pthread_rwlock_t    lock;
+  Hash                *table;       /* Segment table, NULL if lock-free */
+  struct HashLfArray  *lfarray;     /* HASH_LOCKFREE buckets */
+  unsigned int        count;        /* HASH_LOCKFREE entries */
+  int                 node;         /* HASH_NUMA home node, else -1 */
+  unsigned int        min_buckets;  /* HASH_LOCKFREE initial size */
+  unsigned int        max_buckets;  /* HASH_LOCKFREE size limit, or 0 */
+  unsigned int        rehashes;     /* HASH_LOCKFREE statistics */
+  double              rehash_secs;
+  uint64_t            hits;
+  uint64_t            misses;
+} __attribute__((aligned(HASH_CACHE_LINE)));
+
+/* Open addressing entry in transit, see flatPlace() */
+struct HashEntry {
+  uint64_t  hashval;
+  HashKey   key;
+  void      *data;
+};
+
+/* Bucket of a hash value among n, from its top 32 bits */
+#define HASH_FASTRANGE(hv, n) \
+        ((unsigned int) ((((hv) >> 32) * (uint64_t) (n)) >> 32))
+
+/*
+ * Minimal perfect hash, see mph.c.  Slot of a key whose
+ * mixed hash is mixed, in a bucket with pilot, among size.
+ */
+#define MPH_LAMBDA       5       /* Keys per bucket on average */
+#define MPH_ALPHA        0.99    /* Keys per slot before remapping */
+#define MPH_MAX_BUCKET   64      /* Larger buckets force a new seed */
+#define MPH_SKEW         0x99999999U  /* 60% of 2^32 */
+#define MPH_DENSE(nb)    ((unsigned int) ((nb) * 3ULL / 10))
+#define MPH_POSITION(mixed, pilot, size) \
+        HASH_FASTRANGE((mixed) ^ ((uint64_t) (pilot) * 0x9E3779B97F4A7C15ULL), \
+                       (size))
+
+struct HashMph {
+  uint64_t      seed;
+  unsigned int  count;          /* Keys, and slots after remapping */
+  unsigned int  size;           /* Slots before remapping */
+  unsigned int  num_buckets;
+  unsigned int  dense;          /* Buckets taking MPH_SKEW of the keys */
+  uint16_t      *pilots;        /* Per bucket */
+  uint32_t      *remap;         /* Slot of size - count keys past count */
+};
+
+/* Largest table, and largest HASH_CONCURRENT segment */
+#define HASH_MAX_BUCKETS 0x80000000U
+
+/*
+ * Shrinking, see MIN_UTILIZATION.  A table of size buckets
+ * holding count entries, growing past load, is due to shrink
+ * when HASH_SHRINK() is true, to a size of at least
+ * HASH_SHRINK_SIZE(), which is never below its floor min.
+ */
+#define HASH_SHRINK(count, size, min, load) \
+        ((size) > (min) && \
+         (double) (count) < (load) * (MIN_UTILIZATION / MAX_UTILIZATION) * \
+                            (size))
+#define HASH_SHRINK_SIZE(count, min, load) \
+        ((unsigned int) ((count) / ((load) / 2)) + 1 > (min) ? \
+         (unsigned int) ((count) / ((load) / 2)) + 1 : (min))
+
+/* Smallest size holding count entries, for hashCompact() */
+#define HASH_COMPACT_SIZE(count, load) \
+        ((unsigned int) ((count) / (load)) + 1)
+
+/* size, but no larger than the table's max_buckets */
+#define HASH_CAP(hash, size) \
+        ((hash)->max_buckets != 0 && (size) > (hash)->max_buckets ? \
+         (hash)->max_buckets : (size))
+
+/*
+ * No stored key of the table needs freeing: arena and borrowed
+ * keys belong elsewhere and fixed size keys short enough are
+ * always inline.  Destroy can then skip the walk over the keys.
+ */
+#define HASH_KEYS_UNOWNED(hash) \
+        ((hash)->keyArena != NULL || ((hash)->flags & HASH_BORROWED) || \
+         ((hash)->keysize != HASH_KEY_STRING && \
+          (hash)->keysize <= HASH_KEY_INLINE))
+
+/* Stored key string, inline or out of line */
+#define HASH_KEY_ISHEAP(k)  ((k)->buf[HASH_KEY_INLINE] == HASH_KEY_HEAP)
+#define HASH_KEY_STR(k)     (HASH_KEY_ISHEAP(k) ? (k)->ptr : (k)->buf)
+
+/*
+ * Stored key k equal to the caller's vkey, by the table's key
+ * type.  The integer cases are memcmp()s of a constant size,
+ * which the compiler turns into a single load and compare.
+ */
+#define HASH_KEY_EQ(hash, k, vkey) \
+        ((hash)->keysize == HASH_KEY_STRING ? \
+           strcmp(HASH_KEY_STR(k), (vkey)) == 0 : \
+         (hash)->keysize == HASH_KEY_U64 ? \
+           memcmp((k)->buf, (vkey), HASH_KEY_U64) == 0 : \
+         (hash)->keysize == HASH_KEY_U32 ? \
+           memcmp((k)->buf, (vkey), HASH_KEY_U32) == 0 : \
+           memcmp(HASH_KEY_STR(k), (vkey), (hash)->keysize) == 0)
+
+/*
+ * Lookup result data, counted as a hit or a miss in the
+ * counters hits and misses of a HASH_STATS build.  Readers
+ * of a HASH_CONCURRENT segment share them, hence the atomic
+ * add.  Without HASH_STATS it is just data.
+ */
+#ifdef HASH_STATS
+#define HASH_STAT_GET(hits, misses, data) hashStatGet((hits), (misses), (data))
+
+static inline void *hashStatGet(uint64_t *hits, uint64_t *misses, void *data){
+  __atomic_fetch_add(data != NULL ? hits : misses, 1, __ATOMIC_RELAXED);
+  return data;
+}
+#else
+#define HASH_STAT_GET(hits, misses, data) (data)
+#endif
+
+/*
+ * A hashScan() slice covers the entries whose top 32 hash
+ * bits are at least lo and below hi, HASH_SCAN_END at most.
+ */
+#define HASH_SCAN_END       ((uint64_t) 1 << 32)
+#define HASH_SCAN_PREFIX(h) ((h) >> 32)
+
+/* ======== hash.c ======== */
+
+int hashAddValue(Hash *hash, const char *vkey, uint64_t hashval, void *data);
+void *hashGetValue(Hash *hash, const char *vkey, uint64_t hashval);
+void **hashFindOrAddValue(Hash *hash, const char *vkey, uint64_t hashval,
+                          void *data, int *added);
+int hashUpsertValue(Hash *hash, const char *vkey, uint64_t hashval,
+                    void *data, HashMerge merge, void **old);
+void hashDeleteValue(Hash *hash, const char *vkey, uint64_t hashval,
+                     void (*destructor)(void *data));
+unsigned int hashPrime(unsigned int value);
+unsigned int hashGrowSize(unsigned int size, double growth, unsigned int max,
+                          int pow2);
+uint64_t hashKeyValue(Hash *hash, const char *vkey);
+char *hashKeyDup(const char *vkey);
+int hashKeySet(Hash *hash, HashKey *key, const char *vkey);
+void hashKeyRelease(Hash *hash, HashKey *key);
+void hashWalk(Hash *hash, HashVisit visit, void *arg);
+uint64_t hashScanTable(Hash *hash, uint64_t lo, unsigned int count,
+                       HashVisit visit, void *arg);
+uint64_t hashScanEnd(uint64_t lo, unsigned int count, unsigned int n);
+void hashScanBuckets(struct HashNode **array, unsigned int n,
+                     uint64_t lo, uint64_t hi, HashVisit visit, void *arg);
+void hashScanRange(Hash *hash, uint64_t lo, uint64_t hi, HashVisit visit,
+                   void *arg);
+void hashSetOptions(Hash *hash, const HashOptions *options);
+void hashReleasePart(Hash *hash, unsigned int part, unsigned int parts,
+                     void (*destructor)(void *data));
+void hashStatsAdd(Hash *hash, HashStats *stats);
+void hashStatsProbe(HashStats *stats, unsigned int probe);
+void hashStatsHist(HashStats *stats, unsigned int n);
+size_t hashKeyBytes(Hash *hash, const HashKey *key);
+double hashNow(void);
+
+/* ======== flat.c ======== */
+
+int flatInit(Hash *hash, unsigned int num_slots);
+int flatAdd(Hash *hash, const char *vkey, uint64_t hashval, void *data);
+void *flatGet(Hash *hash, const char *vkey, uint64_t hashval);
+void **flatFindOrAdd(Hash *hash, const char *vkey, uint64_t hashval,
+                     void *data, int *added);
+void flatDelete(Hash *hash, const char *vkey, uint64_t hashval,
+                void (*destructor)(void *data));
+void flatDestroy(Hash *hash, void (*destructor)(void *data));
+void flatPrefetch(Hash *hash, uint64_t hashval, int stage);
+void flatPrint(Hash *hash, void (*printer)(void *data));
+void flatWalk(Hash *hash, HashVisit visit, void *arg);
+void flatStats(Hash *hash, HashStats *stats);
+int flatCompact(Hash *hash);
+int flatIterNext(Hash *hash, HashIter *it);
+void flatScan(Hash *hash, uint64_t lo, uint64_t hi, HashVisit visit,
+              void *arg);
+int flatReserve(Hash *hash, unsigned int count);
+int flatPlace(Hash *hash, struct HashEntry *entry, unsigned int limit);
+void flatRelease(Hash *hash, unsigned int first, unsigned int last,
+                 void (*destructor)(void *data));
+
+/* ======== swiss.c ======== */
+
+int swissInit(Hash *hash, unsigned int num_slots);
+int swissAdd(Hash *hash, const char *vkey, uint64_t hashval, void *data);
+void *swissGet(Hash *hash, const char *vkey, uint64_t hashval);
+void **swissFindOrAdd(Hash *hash, const char *vkey, uint64_t hashval,
+                      void *data, int *added);
+void swissDelete(Hash *hash, const char *vkey, uint64_t hashval,
+                 void (*destructor)(void *data));
+void swissDestroy(Hash *hash, void (*destructor)(void *data));
+void swissPrefetch(Hash *hash, uint64_t hashval, int stage);
+void swissPrint(Hash *hash, void (*printer)(void *data));
+void swissWalk(Hash *hash, HashVisit visit, void *arg);
+void swissStats(Hash *hash, HashStats *stats);
+int swissCompact(Hash *hash);
+int swissIterNext(Hash *hash, HashIter *it);
+void swissScan(Hash *hash, uint64_t lo, uint64_t hi, HashVisit visit,
+               void *arg);
+int swissReserve(Hash *hash, unsigned int count);
+int swissPlace(Hash *hash, struct HashEntry *entry, unsigned int limit);
+void swissRelease(Hash *hash, unsigned int first, unsigned int last,
+                  void (*destructor)(void *data));
+
+/* ======== conc.c ======== */
+
+int concInit(Hash *hash, unsigned int num_buckets);
+int concAdd(Hash *hash, const char *vkey, void *data);
+void *concGet(Hash *hash, const char *vkey);
+int concUpsert(Hash *hash, const char *vkey, void *data, HashMerge merge,
+               void **old);
+void concDelete(Hash *hash, const char *vkey, void (*destructor)(void *data));
+unsigned int concCount(Hash *hash, int size);
+void concSetHash(Hash *hash);
+void concDestroy(Hash *hash, void (*destructor)(void *data));
+void concPrint(Hash *hash, void (*printer)(void *data));
+void concWalk(Hash *hash, HashVisit visit, void *arg);
+void concStats(Hash *hash, HashStats *stats);
+unsigned int concSegmentOf(Hash *hash, uint64_t hashval);
+int concCompact(Hash *hash);
+int concReserve(Hash *hash, unsigned int count);
+void concSetOptions(Hash *hash, const HashOptions *options);
+uint64_t concScan(Hash *hash, unsigned int segment, uint64_t lo,
+                  unsigned int count, HashVisit visit, void *arg);
+
+/* ======== lockfree.c ======== */
+
+int lockfreeInit(struct HashSegment *seg, unsigned int num_buckets);
+int lockfreeAdd(Hash *hash, struct HashSegment *seg, const char *vkey,
+                uint64_t hashval, void *data);
+void *lockfreeGet(Hash *hash, struct HashSegment *seg, const char *vkey,
+                  uint64_t hashval);
+int lockfreeUpsert(Hash *hash, struct HashSegment *seg, const char *vkey,
+                   uint64_t hashval, void *data, HashMerge merge, void **old);
+void lockfreeDelete(Hash *hash, struct HashSegment *seg, const char *vkey,
+                    uint64_t hashval, void (*destructor)(void *data));
+unsigned int lockfreeSize(struct HashSegment *seg);
+void lockfreeDestroy(struct HashSegment *seg, void (*destructor)(void *data));
+void lockfreePrint(struct HashSegment *seg, void (*printer)(void *data));
+void lockfreeWalk(struct HashSegment *seg, HashVisit visit, void *arg);
+void lockfreeStats(Hash *hash, struct HashSegment *seg, HashStats *stats);
+int lockfreeCompact(Hash *hash, struct HashSegment *seg);
+int lockfreeReserve(Hash *hash, struct HashSegment *seg, unsigned int count);
+int lockfreeIterNext(struct HashSegment *seg, HashIter *it);
+uint64_t lockfreeScan(struct HashSegment *seg, uint64_t lo,
+                      unsigned int count, HashVisit visit, void *arg);
+void lockfreeRelease(struct HashSegment *seg, void (*destructor)(void *data));
+
+/* ======== mph.c ======== */
+
+int mphBuild(struct HashMph *mph, const uint64_t *hashvals, unsigned int n);
+unsigned int mphSlot(const struct HashMph *mph, uint64_t hashval);
+unsigned int mphBucket(const struct HashMph *mph, uint64_t hashval);
+void mphFree(struct HashMph *mph);
+
+/* ======== image.c ======== */
+
+int imageSave(Hash *hash, const char *path, size_t datasize, int perfect);
+int imageOpen(Hash *hash, const char *path);
+void *imageGet(Hash *hash, const char *vkey, uint64_t hashval);
+void imagePrefetch(Hash *hash, uint64_t hashval, int stage);
+void imageDestroy(Hash *hash);
+void imagePrint(Hash *hash, void (*printer)(void *data));
+void imageWalk(Hash *hash, HashVisit visit, void *arg);
+int imageIterNext(Hash *hash, HashIter *it);
+uint64_t imageScan(Hash *hash, uint64_t cursor, unsigned int count,
+                   HashVisit visit, void *arg);
+
+#endif
@@ -0,0 +1,760 @@
+/*
+ * image.c
+ * HASH_IMAGE snapshots for the Hash ADT.
+ *
+ * hashSave() writes a table out as one position independent
+ * file and hashOpen() maps it read-only and serves lookups
+ * from the mapping straight away, with no parsing, hashing or
+ * inserting.  Every reference inside the file is an offset
+ * from its start, so it can be mapped at any address and
+ * shared between processes through the page cache.
+ *
+ * Layout, each section starting on a cache line:
+ *
+ *   header     struct HashImageHeader
+ *   buckets    num_buckets + 1 uint32_t, entry index where
+ *              each bucket starts; bucket b holds entries
+ *              buckets[b] up to buckets[b + 1]
+ *   entries    count struct HashImageEntry, grouped by
+ *              bucket, full hash value and key offset
+ *   keys       NUL terminated keys packed back to back
+ *   data       count payloads of datasize bytes, each padded
+ *              to 8, in entry order
+ *
+ * hashSavePerfect() writes the same sections but replaces the
+ * bucket array with a minimal perfect hash (see mph.c): one
+ * 16 bit pilot per MPH_LAMBDA keys followed by the small
+ * remap array, entries placed at their own slot.  A lookup
+ * then reads one pilot and exactly one entry, and the index
+ * costs about 3.5 bits per key instead of 32.  Duplicate keys
+ * are dropped, and two keys with the same 64 bit hash value
+ * make the save fail.
+ *
+ * Buckets are picked with HASH_FASTRANGE() from the stored
+ * hash values, which the file was hashed with; the header
+ * records the hash function and seed so hashKeyValue() gives
+ * the same values after hashOpen().  The file is in the byte
+ * order of the machine that wrote it and hashOpen() refuses
+ * any other, or any other version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hash.h"
+#include "hashpriv.h"
+
+#define HASH_IMAGE_MAGIC      "HASHIMG"
+#define HASH_IMAGE_VERSION    2
+#define HASH_IMAGE_BYTEORDER  0x01020304
+
+/* Section alignment, and payload alignment */
+#define IMAGE_ALIGN(n, a)  (((n) + (a) - 1) & ~((uint64_t) (a) - 1))
+
+/* File header, offsets are from the start of the file */
+struct HashImageHeader {
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  byteorder;      /* HASH_IMAGE_BYTEORDER as written */
+  uint32_t  hashfn;         /* Index in imageFuncs[] */
+  uint32_t  num_buckets;
+  uint32_t  count;
+  uint32_t  datasize;       /* Payload bytes, 0 for keys only */
+  uint64_t  seed;
+  uint64_t  buckets;
+  uint64_t  entries;
+  uint64_t  keys;
+  uint64_t  data;
+  uint64_t  size;           /* Whole file */
+  uint32_t  perfect;        /* buckets holds mph pilots */
+  uint32_t  mph_size;       /* Slots before remapping */
+  uint64_t  mph_seed;
+  uint64_t  remap;          /* mph_size - count uint32_t */
+};
+
+/* Entry, in bucket or perfect hash slot order */
+struct HashImageEntry {
+  uint64_t  hashval;
+  uint64_t  key;            /* Offset in the keys section */
+};
+
+/* Mapped snapshot, with its sections located */
+struct HashImage {
+  char                         *map;
+  size_t                       size;
+  const uint32_t               *buckets;
+  const struct HashImageEntry  *entries;
+  const char                   *keys;
+  char                         *data;
+  size_t                       datasize;
+  size_t                       stride;
+  int                          perfect;
+  struct HashMph               mph;         /* Arrays in the mapping */
+};
+
+/* Entry collected by imageSave() */
+struct imageItem {
+  uint64_t    hashval;
+  const char  *key;
+  void        *data;
+  unsigned int seq;         /* Walk order, first one wins */
+};
+
+/* Items gathered by imageCollect() */
+struct imageList {
+  struct imageItem  *items;
+  unsigned int      count;
+  unsigned int      size;
+  int               error;
+};
+
+/* Hash functions a snapshot can name */
+static const HashFunc imageFuncs[] = { hashFnWy, hashFnFnv1a, hashFnFval };
+#define IMAGE_NUM_FUNCS  ((uint32_t) (sizeof(imageFuncs) / sizeof(HashFunc)))
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+void imageCollect(void *arg, const char *vkey, uint64_t hashval, void *data);
+
+static
+int imageItemCmp(const void *a, const void *b);
+
+static
+int imagePerfect(struct imageList *list, struct HashMph *mph,
+                 unsigned int *order);
+
+static
+int imageWrite(FILE *fp, const void *buf, size_t len, uint64_t *pos);
+
+static
+int imagePad(FILE *fp, uint64_t to, uint64_t *pos);
+
+
+/* ================= Engine Functions ========================= */
+/* ================= Engine Functions ========================= */
+
+/*
+ * imageSave()
+ * This function writes a snapshot of any table.  Entries are
+ * gathered with hashWalk(), counting sorted into buckets, or
+ * placed by a minimal perfect hash, and written section by
+ * section.
+ *
+ * INPUT:     hash        Table to save
+ *            path        File to write
+ *            datasize    Bytes copied from each data container
+ *            perfect     Nonzero for the perfect hash layout
+ * RETURNS:   0           Success
+ *            -1          Failure
+ */
+int imageSave(Hash *hash, const char *path, size_t datasize, int perfect){
+
+  struct HashImageHeader  hdr;
+  struct HashImageEntry   entry;
+  struct imageList        list;
+  struct HashMph          mph;
+  uint32_t                *buckets = NULL;
+  unsigned int            *order = NULL;
+  char                    *tmp;
+  uint64_t                pos = 0;
+  uint64_t                keybytes = 0;
+  uint64_t                index;
+  size_t                  stride;
+  unsigned int            num_buckets;
+  unsigned int            i;
+  unsigned int            b;
+  int                     ret = -1;
+  FILE                    *fp;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memset(&mph, 0, sizeof(mph));
+  for (hdr.hashfn = 0; hdr.hashfn < IMAGE_NUM_FUNCS; hdr.hashfn++)
+    if (imageFuncs[hdr.hashfn] == hash->hashfn)
+      break;
+  if (hdr.hashfn == IMAGE_NUM_FUNCS || datasize > UINT32_MAX ||
+      hash->keysize != HASH_KEY_STRING)
+    return -1;
+
+  memset(&list, 0, sizeof(list));
+  hashWalk(hash, imageCollect, &list);
+  if (list.error){
+    free(list.items);
+    return -1;
+  }
+
+  /* About one entry per bucket */
+  num_buckets = (list.count > 0) ? list.count : 1;
+  stride      = IMAGE_ALIGN(datasize, 8);
+
+  buckets = (uint32_t *) calloc (num_buckets + 1, sizeof(uint32_t));
+  order   = (unsigned int *) malloc ((list.count + 1) * sizeof(unsigned int));
+  tmp     = (char *) malloc (strlen(path) + 5);
+  if (buckets == NULL || order == NULL || tmp == NULL)
+    goto out;
+
+  if (perfect){
+    if (imagePerfect(&list, &mph, order) != 0)
+      goto out;
+    num_buckets = mph.num_buckets;
+    index       = num_buckets * (uint64_t) sizeof(uint16_t);
+  }
+  else {
+    /* Counting sort by bucket */
+    for (i = 0; i < list.count; i++)
+      buckets[HASH_FASTRANGE(list.items[i].hashval, num_buckets) + 1]++;
+    for (b = 0; b < num_buckets; b++)
+      buckets[b + 1] += buckets[b];
+    for (i = 0; i < list.count; i++)
+      order[buckets[HASH_FASTRANGE(list.items[i].hashval, num_buckets)]++] = i;
+    for (b = num_buckets; b > 0; b--)
+      buckets[b] = buckets[b - 1];
+    buckets[0] = 0;
+    index = (num_buckets + 1) * (uint64_t) sizeof(uint32_t);
+  }
+
+  for (i = 0; i < list.count; i++)
+    keybytes += strlen(list.items[i].key) + 1;
+
+  memcpy(hdr.magic, HASH_IMAGE_MAGIC, sizeof(HASH_IMAGE_MAGIC));
+  hdr.version     = HASH_IMAGE_VERSION;
+  hdr.byteorder   = HASH_IMAGE_BYTEORDER;
+  hdr.num_buckets = num_buckets;
+  hdr.count       = list.count;
+  hdr.datasize    = (uint32_t) datasize;
+  hdr.seed        = hash->seed;
+  hdr.buckets     = IMAGE_ALIGN(sizeof(hdr), HASH_CACHE_LINE);
+  if (perfect){
+    hdr.perfect  = 1;
+    hdr.remap    = IMAGE_ALIGN(hdr.buckets + index, sizeof(uint32_t));
+    hdr.mph_size = mph.size;
+    hdr.mph_seed = mph.seed;
+    index = hdr.remap - hdr.buckets +
+            (mph.size - mph.count) * (uint64_t) sizeof(uint32_t);
+  }
+  hdr.entries     = IMAGE_ALIGN(hdr.buckets + index, HASH_CACHE_LINE);
+  hdr.keys        = IMAGE_ALIGN(hdr.entries + list.count *
+                                (uint64_t) sizeof(entry), HASH_CACHE_LINE);
+  hdr.data        = IMAGE_ALIGN(hdr.keys + keybytes, HASH_CACHE_LINE);
+  hdr.size        = hdr.data + list.count * (uint64_t) stride;
+
+  sprintf(tmp, "%s.tmp", path);
+  if ((fp = fopen(tmp, "wb")) == NULL)
+    goto out;
+
+  if (imageWrite(fp, &hdr, sizeof(hdr), &pos) != 0 ||
+      imagePad(fp, hdr.buckets, &pos) != 0)
+    goto fail;
+
+  if (perfect){
+    if (imageWrite(fp, mph.pilots, num_buckets * sizeof(uint16_t),
+                   &pos) != 0 ||
+        imagePad(fp, hdr.remap, &pos) != 0 ||
+        imageWrite(fp, mph.remap, (mph.size - mph.count) * sizeof(uint32_t),
+                   &pos) != 0)
+      goto fail;
+  }
+  else if (imageWrite(fp, buckets, (num_buckets + 1) * sizeof(uint32_t),
+                      &pos) != 0)
+    goto fail;
+
+  if (imagePad(fp, hdr.entries, &pos) != 0)
+    goto fail;
+
+  for (i = 0, entry.key = 0; i < list.count; i++){
+    entry.hashval = list.items[order[i]].hashval;
+    if (imageWrite(fp, &entry, sizeof(entry), &pos) != 0)
+      goto fail;
+    entry.key += strlen(list.items[order[i]].key) + 1;
+  }
+
+  if (imagePad(fp, hdr.keys, &pos) != 0)
+    goto fail;
+  for (i = 0; i < list.count; i++)
+    if (imageWrite(fp, list.items[order[i]].key,
+                   strlen(list.items[order[i]].key) + 1, &pos) != 0)
+      goto fail;
+
+  for (i = 0; i < list.count; i++){
+    if (imagePad(fp, hdr.data + i * (uint64_t) stride, &pos) != 0 ||
+        (datasize > 0 && list.items[order[i]].data != NULL &&
+         imageWrite(fp, list.items[order[i]].data, datasize, &pos) != 0))
+      goto fail;
+  }
+  if (imagePad(fp, hdr.size, &pos) != 0)
+    goto fail;
+
+  if (fflush(fp) == 0 && fsync(fileno(fp)) == 0 && fclose(fp) == 0){
+    fp  = NULL;
+    ret = rename(tmp, path);
+  }
+
+ fail:
+  if (fp != NULL)
+    fclose(fp);
+  if (ret != 0)
+    unlink(tmp);
+
+ out:
+  mphFree(&mph);
+  free(list.items);
+  free(buckets);
+  free(order);
+  free(tmp);
+
+  return ret;
+
+}
+
+
+/*
+ * imageOpen()
+ * This function maps a snapshot read-only and checks that its
+ * header and sections fit the file, without reading anything
+ * past the header.
+ *
+ * INPUT:     hash        Table to fill in, engine HASH_IMAGE
+ *            path        Snapshot file
+ * RETURNS:   0           Success
+ *            -1          Cannot map the file or it is not a
+ *                        valid snapshot
+ */
+int imageOpen(Hash *hash, const char *path){
+
+  const struct HashImageHeader  *hdr;
+  struct HashImage              *image;
+  struct stat                   st;
+  void                          *map;
+  int                           fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(*hdr)){
+    close(fd);
+    return -1;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return -1;
+
+  hdr = (const struct HashImageHeader *) map;
+  if (memcmp(hdr->magic, HASH_IMAGE_MAGIC, sizeof(HASH_IMAGE_MAGIC)) != 0 ||
+      hdr->version != HASH_IMAGE_VERSION ||
+      hdr->byteorder != HASH_IMAGE_BYTEORDER ||
+      hdr->hashfn >= IMAGE_NUM_FUNCS ||
+      hdr->num_buckets == 0 ||
+      hdr->size != (uint64_t) st.st_size ||
+      hdr->buckets % sizeof(uint32_t) != 0 ||
+      hdr->entries % sizeof(uint64_t) != 0 ||
+      hdr->data % sizeof(uint64_t) != 0 ||
+      hdr->buckets < sizeof(*hdr) ||
+      (!hdr->perfect &&
+       hdr->buckets + (hdr->num_buckets + 1) * (uint64_t) sizeof(uint32_t) >
+         hdr->entries) ||
+      (hdr->perfect &&
+       (hdr->mph_size < hdr->count ||
+        hdr->remap % sizeof(uint32_t) != 0 ||
+        hdr->buckets + hdr->num_buckets * (uint64_t) sizeof(uint16_t) >
+          hdr->remap ||
+        hdr->remap + (hdr->mph_size - (uint64_t) hdr->count) *
+          sizeof(uint32_t) > hdr->entries)) ||
+      hdr->entries + hdr->count * (uint64_t) sizeof(struct HashImageEntry) >
+        hdr->keys ||
+      hdr->keys > hdr->data ||
+      hdr->data + hdr->count * IMAGE_ALIGN(hdr->datasize, 8) > hdr->size){
+    munmap(map, st.st_size);
+    return -1;
+  }
+
+  image = (struct HashImage *) malloc (sizeof(struct HashImage));
+  if (image == NULL){
+    munmap(map, st.st_size);
+    return -1;
+  }
+
+  image->map      = (char *) map;
+  image->size     = st.st_size;
+  image->buckets  = (const uint32_t *) (image->map + hdr->buckets);
+  image->entries  = (const struct HashImageEntry *)
+                    (image->map + hdr->entries);
+  image->keys     = image->map + hdr->keys;
+  image->data     = image->map + hdr->data;
+  image->datasize = hdr->datasize;
+  image->stride   = IMAGE_ALIGN(hdr->datasize, 8);
+  image->perfect  = hdr->perfect;
+
+  if (image->perfect){
+    image->mph.seed        = hdr->mph_seed;
+    image->mph.count       = hdr->count;
+    image->mph.size        = hdr->mph_size;
+    image->mph.num_buckets = hdr->num_buckets;
+    image->mph.dense       = MPH_DENSE(hdr->num_buckets);
+    image->mph.pilots      = (uint16_t *) (image->map + hdr->buckets);
+    image->mph.remap       = (uint32_t *) (image->map + hdr->remap);
+  }
+
+  /* A bad bucket array must not send lookups out of bounds */
+  if (!image->perfect && image->buckets[hdr->num_buckets] != hdr->count){
+    munmap(map, st.st_size);
+    free(image);
+    return -1;
+  }
+
+  hash->image       = image;
+  hash->num_buckets = image->perfect ? image->mph.count : hdr->num_buckets;
+  hash->count       = hdr->count;
+  hash->hashfn      = imageFuncs[hdr->hashfn];
+  hash->seed        = hdr->seed;
+
+  return 0;
+
+}
+
+
+/*
+ * imageGet()
+ * This function looks vkey up in its bucket's run of entries,
+ * or in a perfect hash snapshot at the one slot it can be.
+ *
+ * INPUT:     hash        HASH_IMAGE table
+ *            vkey        String key for lookup
+ *            hashval     hashKeyValue() of vkey
+ * RETURNS:   data        Payload in the mapping, or the stored
+ *                        key when the snapshot has no payloads
+ *            NULL        vkey not found
+ */
+void *imageGet(Hash *hash, const char *vkey, uint64_t hashval){
+
+  struct HashImage             *image = hash->image;
+  const struct HashImageEntry  *entry;
+  unsigned int                 b = HASH_FASTRANGE(hashval, hash->num_buckets);
+  unsigned int                 i;
+  unsigned int                 end;
+
+  if (image->perfect){
+    if (hash->count == 0)
+      return NULL;
+    i   = mphSlot(&image->mph, hashval);
+    end = i + 1;
+  }
+  else {
+    i   = image->buckets[b];
+    end = image->buckets[b + 1];
+  }
+  if (end > hash->count)
+    end = hash->count;
+
+  for (; i < end; i++){
+    entry = &image->entries[i];
+    if (entry->hashval == hashval &&
+        entry->key < (uint64_t) (image->data - image->keys) &&
+        strcmp(image->keys + entry->key, vkey) == 0){
+      if (image->datasize == 0)
+        return (void *) (image->keys + entry->key);
+      return image->data + i * image->stride;
+    }
+  }
+
+  return NULL;
+
+}
+
+
+/*
+ * imagePrefetch()
+ * This function is the hashBatch() step for a snapshot.
+ * Stage 0 fetches the bucket's start index, or its pilot,
+ * stage 1 its first entry, or the key's slot.
+ *
+ * INPUT:     hash        HASH_IMAGE table
+ *            hashval     hashKeyValue() of the key
+ *            stage       0 or 1
+ */
+void imagePrefetch(Hash *hash, uint64_t hashval, int stage){
+
+  struct HashImage *image = hash->image;
+  unsigned int     b      = HASH_FASTRANGE(hashval, hash->num_buckets);
+  unsigned int     slot;
+
+  if (image->perfect){
+    if (hash->count == 0)
+      return;
+    if (stage == 0)
+      __builtin_prefetch(&image->mph.pilots[mphBucket(&image->mph, hashval)]);
+    else if ((slot = mphSlot(&image->mph, hashval)) < hash->count)
+      __builtin_prefetch(&image->entries[slot]);
+  }
+  else if (stage == 0)
+    __builtin_prefetch(&image->buckets[b]);
+  else if (image->buckets[b] < hash->count)
+    __builtin_prefetch(&image->entries[image->buckets[b]]);
+
+}
+
+
+/*
+ * imageDestroy()
+ * This function unmaps a snapshot.
+ *
+ * INPUT:     hash        HASH_IMAGE table
+ */
+void imageDestroy(Hash *hash){
+
+  if (hash->image != NULL){
+    munmap(hash->image->map, hash->image->size);
+    free(hash->image);
+    hash->image = NULL;
+  }
+
+}
+
+
+/*
+ * imagePrint()
+ * This function prints every entry of a snapshot.
+ *
+ * INPUT:     hash        HASH_IMAGE table
+ *            printer     Function point to printer function.
+ */
+void imagePrint(Hash *hash, void (*printer)(void *data)){
+
+  struct HashImage  *image = hash->image;
+  unsigned int      b;
+  unsigned int      i;
+
+  for (b = 0; b < hash->num_buckets; b++){
+    for (i = image->perfect ? b : image->buckets[b];
+         i < (image->perfect ? b + 1 : image->buckets[b + 1]); i++){
+      printf ("key: %u ",b);
+      printer(image->datasize ? image->data + i * image->stride
+                              : (void *) (image->keys + image->entries[i].key));
+    }
+  }
+
+}
+
+
+/*
+ * imageWalk()
+ * This function calls visit on every entry of a snapshot.
+ *
+ * INPUT:     hash        HASH_IMAGE table
+ *            visit       Called with arg, key, hash and data
+ *            arg         Passed through to visit
+ */
+void imageWalk(Hash *hash, HashVisit visit, void *arg){
+
+  struct HashImage  *image = hash->image;
+  const char        *key;
+  unsigned int      i;
+
+  for (i = 0; i < hash->count; i++){
+    key = image->keys + image->entries[i].key;
+    visit(arg, key, image->entries[i].hashval,
+          image->datasize ? image->data + i * image->stride : (void *) key);
+  }
+
+}
+
+
+/*
+ * imageIterNext()
+ * This function moves an iterator to the next entry of a
+ * snapshot, which are in one packed array.
+ *
+ * INPUT:     hash        HASH_IMAGE table
+ *            it          Iterator, it->pos the next entry
+ * RETURNS:   1           it holds the entry
+ *            0           No entries left
+ */
+int imageIterNext(Hash *hash, HashIter *it){
+
+  struct HashImage  *image = hash->image;
+  unsigned int      i      = it->pos;
+
+  if (i >= hash->count)
+    return 0;
+
+  it->key     = image->keys + image->entries[i].key;
+  it->hashval = image->entries[i].hashval;
+  it->data    = image->datasize ? image->data + i * image->stride
+                                : (void *) it->key;
+  it->pos     = i + 1;
+
+  return 1;
+
+}
+
+
+/*
+ * imageScan()
+ * This function visits up to count entries of a snapshot from
+ * entry number cursor, see hashScan().  A snapshot never
+ * changes, so the entry number is the whole cursor.
+ *
+ * INPUT:     hash        HASH_IMAGE table
+ *            cursor      First entry to visit
+ *            count       Entries to visit
+ *            visit       Called with arg, key, hash and data
+ *            arg         Passed through to visit
+ * RETURNS:   uint64_t    Cursor for the next call, 0 at the end
+ */
+uint64_t imageScan(Hash *hash, uint64_t cursor, unsigned int count,
+                   HashVisit visit, void *arg){
+
+  HashIter it;
+
+  hashIterBegin(hash, &it);
+  for (it.pos = (unsigned int) cursor; count > 0 && imageIterNext(hash, &it);
+       count--)
+    visit(arg, it.key, it.hashval, it.data);
+
+  return (it.pos < hash->count) ? it.pos : 0;
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * imageCollect()
+ * hashWalk() visitor that appends an entry to an imageList.
+ */
+static
+void imageCollect(void *arg, const char *vkey, uint64_t hashval, void *data){
+
+  struct imageList  *list = (struct imageList *) arg;
+  struct imageItem  *items;
+  unsigned int      size;
+
+  if (list->error)
+    return;
+
+  if (list->count == list->size){
+    size  = list->size ? list->size * 2 : 1024;
+    items = (struct imageItem *) realloc (list->items,
+                                          size * sizeof(struct imageItem));
+    if (items == NULL){
+      list->error = 1;
+      return;
+    }
+    list->items = items;
+    list->size  = size;
+  }
+
+  list->items[list->count].hashval = hashval;
+  list->items[list->count].key     = vkey;
+  list->items[list->count].data    = data;
+  list->items[list->count].seq     = list->count;
+  list->count++;
+
+}
+
+/*
+ * imageItemCmp()
+ * qsort() order of items: hash value, then walk order.
+ */
+static
+int imageItemCmp(const void *a, const void *b){
+
+  const struct imageItem *x = (const struct imageItem *) a;
+  const struct imageItem *y = (const struct imageItem *) b;
+
+  if (x->hashval != y->hashval)
+    return (x->hashval < y->hashval) ? -1 : 1;
+
+  return (x->seq < y->seq) ? -1 : (x->seq > y->seq);
+
+}
+
+/*
+ * imagePerfect()
+ * Drops repeated keys from list, keeping the first walked,
+ * builds a minimal perfect hash over the rest and fills in
+ * order[slot] with the item placed at each slot.
+ *
+ * RETURNS:   0     Success
+ *            -1    Two keys share a hash value, or mphBuild()
+ *                  failed
+ */
+static
+int imagePerfect(struct imageList *list, struct HashMph *mph,
+                 unsigned int *order){
+
+  uint64_t      *hashvals;
+  unsigned int  i;
+  unsigned int  n = 0;
+  int           ret;
+
+  if (list->count > 1)
+    qsort(list->items, list->count, sizeof(struct imageItem), imageItemCmp);
+
+  for (i = 0; i < list->count; i++){
+    if (n > 0 && list->items[n - 1].hashval == list->items[i].hashval){
+      if (strcmp(list->items[n - 1].key, list->items[i].key) != 0)
+        return -1;
+      continue;
+    }
+    list->items[n++] = list->items[i];
+  }
+  list->count = n;
+
+  hashvals = (uint64_t *) malloc ((n + 1) * sizeof(uint64_t));
+  if (hashvals == NULL)
+    return -1;
+  for (i = 0; i < n; i++)
+    hashvals[i] = list->items[i].hashval;
+
+  if ((ret = mphBuild(mph, hashvals, n)) == 0)
+    for (i = 0; i < n; i++)
+      order[mphSlot(mph, hashvals[i])] = i;
+
+  free(hashvals);
+
+  return ret;
+
+}
+
+/*
+ * imageWrite()
+ * Writes len bytes and advances *pos.
+ */
+static
+int imageWrite(FILE *fp, const void *buf, size_t len, uint64_t *pos){
+
+  if (fwrite(buf, 1, len, fp) != len)
+    return -1;
+  *pos += len;
+
+  return 0;
+
+}
+
+/*
+ * imagePad()
+ * Writes zero bytes up to offset to.
+ */
+static
+int imagePad(FILE *fp, uint64_t to, uint64_t *pos){
+
+  static const char  zeros[HASH_CACHE_LINE];
+  size_t             len;
+
+  while (*pos < to){
+    len = (to - *pos < sizeof(zeros)) ? (size_t) (to - *pos) : sizeof(zeros);
+    if (imageWrite(fp, zeros, len, pos) != 0)
+      return -1;
+  }
+
+  return 0;
+
+}
@@ -0,0 +1,625 @@
+/*
+ * lockfree.c
+ * HASH_LOCKFREE segments for the Hash ADT.
+ *
+ * A HASH_LOCKFREE table is a HASH_CONCURRENT table whose
+ * segments are chained tables built for readers that take no
+ * lock at all.  The bucket array and its size sit together in
+ * one HashLfArray published through a single pointer, and
+ * every link a reader follows is written with a release store
+ * and read with an acquire load.
+ *
+ * Writers still serialize on the segment lock.  An add links a
+ * fully built node at the head of its bucket.  A delete
+ * unlinks the node and retires it, and the data container, to
+ * ebr.c.  A resize never relinks live nodes, since a reader
+ * walking an old chain could be led into a new one and miss
+ * its key; it builds a fresh array of copied nodes, publishes
+ * it, then retires the old array and nodes.  Shrinking below
+ * MIN_UTILIZATION works the same way.  The heap copy of
+ * a long key moves to the new node rather than being copied.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "hash.h"
+#include "hashpriv.h"
+#include "ebr.h"
+
+/* Bucket array of a lock-free segment */
+struct HashLfArray {
+  unsigned int     num_buckets;
+  struct HashNode  *buckets[];
+};
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+struct HashLfArray *lockfreeArray(unsigned int num_buckets);
+
+static
+int lockfreeResize(struct HashSegment *seg, unsigned int num_buckets);
+
+static
+void lockfreeFreeNode(void *ptr);
+
+
+/* ================= Engine Functions ========================= */
+/* ================= Engine Functions ========================= */
+
+/*
+ * lockfreeInit()
+ * This function gives a segment an empty bucket array.
+ *
+ * INPUT:     seg           Segment to set up
+ *            num_buckets   Hint for the number of buckets
+ * RETURNS:   0             Success
+ *            -1            Error allocating memory
+ */
+int lockfreeInit(struct HashSegment *seg, unsigned int num_buckets){
+
+  seg->table   = NULL;
+  seg->count   = 0;
+  seg->lfarray = lockfreeArray(hashPrime(num_buckets));
+
+  if (seg->lfarray == NULL)
+    return -1;
+
+  seg->min_buckets = seg->lfarray->num_buckets;
+
+  return 0;
+
+}
+
+
+/*
+ * lockfreeAdd()
+ * This function links a new node at the head of its bucket.
+ * The caller holds the segment write lock.
+ *
+ * INPUT:    hash     Outer table
+ *           seg      Segment to add key/data to.
+ *           vkey     String key
+ *           hashval  hashKeyValue() of vkey
+ *           data     Void pointer to data container
+ * RETURNS:  0        Success
+ *           -1       Failure
+ */
+int lockfreeAdd(Hash *hash, struct HashSegment *seg, const char *vkey,
+                uint64_t hashval, void *data){
+
+  struct HashLfArray  *arr;
+  struct HashNode     *node;
+  unsigned int        size;
+  unsigned int        b;
+
+  node = (struct HashNode *) malloc (sizeof(struct HashNode));
+  if (node == NULL)
+    return -1;
+
+  if (hashKeySet(hash, &node->key, vkey) != 0){
+    free(node);
+    return -1;
+  }
+
+  node->data    = data;
+  node->hashval = hashval;
+
+  arr        = seg->lfarray;
+  b          = HASH_FASTRANGE(hashval, arr->num_buckets);
+  node->next = arr->buckets[b];
+
+  /* Node is complete before readers can reach it */
+  __atomic_store_n(&arr->buckets[b], node, __ATOMIC_RELEASE);
+
+  __atomic_store_n(&seg->count, seg->count + 1, __ATOMIC_RELAXED);
+
+  if ((double) seg->count > hash->max_load * arr->num_buckets &&
+      (size = hashGrowSize(arr->num_buckets, hash->growth,
+                           seg->max_buckets, 0)) > arr->num_buckets)
+    lockfreeResize(seg, size);
+
+  return 0;
+
+}
+
+
+/*
+ * lockfreeUpsert()
+ * This function is hashUpsertValue() for a lock-free segment.
+ * The caller holds the segment write lock, so only readers
+ * run meanwhile: a merged container is published with one
+ * atomic store, and readers see either it or the old one.
+ *
+ * INPUT:    hash     Outer table
+ *           seg      Segment holding vkey
+ *           vkey     String key
+ *           hashval  hashKeyValue() of vkey
+ *           data     Void pointer to data container
+ *           merge    Merge function, or NULL to replace
+ *           old      Set to the data container that was stored
+ *                    if vkey was there.  May be NULL.
+ * RETURNS:  1        vkey added
+ *           0        vkey was there
+ *           -1       Failure
+ */
+int lockfreeUpsert(Hash *hash, struct HashSegment *seg, const char *vkey,
+                   uint64_t hashval, void *data, HashMerge merge, void **old){
+
+  struct HashLfArray  *arr = seg->lfarray;
+  struct HashNode     *node;
+
+  for (node = arr->buckets[HASH_FASTRANGE(hashval, arr->num_buckets)];
+       node != NULL; node = node->next){
+    if (node->hashval == hashval && HASH_KEY_EQ(hash, &node->key, vkey)){
+      if (old != NULL)
+        *old = node->data;
+      __atomic_store_n(&node->data,
+                       (merge != NULL) ? merge(node->data, data) : data,
+                       __ATOMIC_RELEASE);
+      return 0;
+    }
+  }
+
+  return (lockfreeAdd(hash, seg, vkey, hashval, data) == 0) ? 1 : -1;
+
+}
+
+
+/*
+ * lockfreeGet()
+ * This function looks vkey up without taking any lock.
+ *
+ * INPUT:     hash      Outer table
+ *            seg       Segment to search
+ *            vkey      String key for lookup
+ *            hashval   hashKeyValue() of vkey
+ * RETURNS:   data      Pointer to data container
+ *            NULL      vkey not found in hash table
+ */
+void *lockfreeGet(Hash *hash, struct HashSegment *seg, const char *vkey,
+                  uint64_t hashval){
+
+  struct HashLfArray  *arr;
+  struct HashNode     *node;
+  void                *data = NULL;
+
+  ebrEnter();
+
+  arr  = __atomic_load_n(&seg->lfarray, __ATOMIC_ACQUIRE);
+  node = __atomic_load_n(&arr->buckets[HASH_FASTRANGE(hashval,
+                                                      arr->num_buckets)],
+                         __ATOMIC_ACQUIRE);
+
+  while (node != NULL){
+    if (node->hashval == hashval &&
+        HASH_KEY_EQ(hash, &node->key, vkey)){
+      data = __atomic_load_n(&node->data, __ATOMIC_ACQUIRE);
+      break;
+    }
+    node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+  }
+
+  ebrExit();
+
+  return data;
+
+}
+
+
+/*
+ * lockfreeDelete()
+ * This function unlinks vkey and retires its node and data
+ * container.  The caller holds the segment write lock.
+ *
+ * INPUT:     hash         Outer table
+ *            seg          Segment to remove from
+ *            vkey         String key to remove
+ *            hashval      hashKeyValue() of vkey
+ *            destructor   Destructor for the data container
+ */
+void lockfreeDelete(Hash *hash, struct HashSegment *seg, const char *vkey,
+                    uint64_t hashval, void (*destructor)(void *data)){
+
+  struct HashLfArray  *arr = seg->lfarray;
+  struct HashNode     **link;
+  struct HashNode     *node;
+  unsigned int        size;
+
+  link = &arr->buckets[HASH_FASTRANGE(hashval, arr->num_buckets)];
+
+  for (node = *link; node != NULL; link = &node->next, node = *link){
+    if (node->hashval == hashval &&
+        HASH_KEY_EQ(hash, &node->key, vkey)){
+
+      __atomic_store_n(link, node->next, __ATOMIC_RELEASE);
+      __atomic_store_n(&seg->count, seg->count - 1, __ATOMIC_RELAXED);
+
+      if (destructor != NULL)
+        ebrRetire(node->data, destructor);
+      ebrRetire(node, lockfreeFreeNode);
+
+      /* sizes[] may have nothing smaller to offer */
+      if (HASH_SHRINK(seg->count, arr->num_buckets, seg->min_buckets,
+                      hash->max_load)){
+        size = hashPrime(HASH_SHRINK_SIZE(seg->count, seg->min_buckets,
+                                          hash->max_load));
+        if (size < arr->num_buckets)
+          lockfreeResize(seg, size);
+      }
+      break;
+    }
+  }
+
+}
+
+
+/*
+ * lockfreeSize()
+ * This function returns a segment's bucket count.
+ *
+ * INPUT:     seg        Segment
+ * RETURNS:   unsigned   Number of buckets
+ */
+unsigned int lockfreeSize(struct HashSegment *seg){
+
+  return __atomic_load_n(&seg->lfarray, __ATOMIC_ACQUIRE)->num_buckets;
+
+}
+
+
+/*
+ * lockfreeDestroy()
+ * This function frees a segment's nodes and array.  No other
+ * thread may be using the table.
+ *
+ * INPUT:    seg          Segment to destroy
+ *           destructor   Function pointer to destructor
+ */
+void lockfreeDestroy(struct HashSegment *seg, void (*destructor)(void *data)){
+
+  struct HashLfArray  *arr = seg->lfarray;
+  struct HashNode     *node;
+  struct HashNode     *next;
+  unsigned int        i;
+
+  for (i = 0; i < arr->num_buckets; i++){
+    for (node = arr->buckets[i]; node != NULL; node = next){
+      next = node->next;
+      if (destructor != NULL)
+        destructor(node->data);
+      lockfreeFreeNode(node);
+    }
+  }
+
+  free(arr);
+
+}
+
+
+/*
+ * lockfreePrint()
+ * This function prints every node of a segment.  The caller
+ * holds the segment write lock.
+ *
+ * INPUT:     seg        Segment
+ *            printer    Function point to printer function.
+ */
+void lockfreePrint(struct HashSegment *seg, void (*printer)(void *data)){
+
+  struct HashLfArray  *arr = seg->lfarray;
+  struct HashNode     *node;
+  unsigned int        i;
+
+  for (i = 0; i < arr->num_buckets; i++){
+    for (node = arr->buckets[i]; node != NULL; node = node->next){
+      printf ("key: %u ",i);
+      printer(node->data);
+    }
+  }
+
+}
+
+
+/*
+ * lockfreeWalk()
+ * This function calls visit on every node of a segment.  The
+ * caller holds the segment write lock.
+ *
+ * INPUT:     seg        Segment
+ *            visit      Called with arg, key, hash and data
+ *            arg        Passed through to visit
+ */
+void lockfreeWalk(struct HashSegment *seg, HashVisit visit, void *arg){
+
+  struct HashLfArray  *arr = seg->lfarray;
+  struct HashNode     *node;
+  unsigned int        i;
+
+  for (i = 0; i < arr->num_buckets; i++)
+    for (node = arr->buckets[i]; node != NULL; node = node->next)
+      visit(arg, HASH_KEY_STR(&node->key), node->hashval, node->data);
+
+}
+
+
+/*
+ * lockfreeIterNext()
+ * This function moves an iterator to the next node of a
+ * segment, see hashIterNext().  No thread may be writing to
+ * the table.
+ *
+ * INPUT:     seg        Segment
+ *            it         Iterator, it->node the last node and
+ *                       it->pos the next bucket to try
+ * RETURNS:   1          it holds the entry
+ *            0          No nodes left in the segment
+ */
+int lockfreeIterNext(struct HashSegment *seg, HashIter *it){
+
+  struct HashLfArray  *arr  = seg->lfarray;
+  struct HashNode     *node = (it->node != NULL) ? it->node->next : NULL;
+
+  while (node == NULL){
+    while (it->pos < arr->num_buckets && arr->buckets[it->pos] == NULL)
+      it->pos++;
+    if (it->pos >= arr->num_buckets)
+      return 0;
+    node = arr->buckets[it->pos++];
+  }
+
+  it->node    = node;
+  it->key     = HASH_KEY_STR(&node->key);
+  it->hashval = node->hashval;
+  it->data    = node->data;
+
+  return 1;
+
+}
+
+
+/*
+ * lockfreeScan()
+ * This function is hashScanTable() for a segment.  The caller
+ * holds the segment lock.
+ *
+ * INPUT:     seg        Segment
+ *            lo         First hash prefix of the slice
+ *            count      Buckets to look at, about
+ *            visit      Called with arg, key, hash and data
+ *            arg        Passed through to visit
+ * RETURNS:   uint64_t   First hash prefix of the next slice
+ */
+uint64_t lockfreeScan(struct HashSegment *seg, uint64_t lo, unsigned int count,
+                      HashVisit visit, void *arg){
+
+  struct HashLfArray  *arr = seg->lfarray;
+  uint64_t            hi   = hashScanEnd(lo, count, arr->num_buckets);
+
+  hashScanBuckets(arr->buckets, arr->num_buckets, lo, hi, visit, arg);
+
+  return hi;
+
+}
+
+
+/*
+ * lockfreeRelease()
+ * This function frees every node of a segment and empties
+ * its buckets, keeping the array, for hashDestroyParallel().
+ * No other thread may be using the table.
+ *
+ * INPUT:    seg          Segment
+ *           destructor   Function pointer to destructor
+ */
+void lockfreeRelease(struct HashSegment *seg, void (*destructor)(void *data)){
+
+  struct HashLfArray  *arr = seg->lfarray;
+  struct HashNode     *node;
+  struct HashNode     *next;
+  unsigned int        i;
+
+  for (i = 0; i < arr->num_buckets; i++){
+    for (node = arr->buckets[i]; node != NULL; node = next){
+      next = node->next;
+      if (destructor != NULL)
+        destructor(node->data);
+      lockfreeFreeNode(node);
+    }
+    arr->buckets[i] = NULL;
+  }
+
+  seg->count = 0;
+
+}
+
+
+/*
+ * lockfreeStats()
+ * This function adds a segment to stats like a HASH_CHAINED
+ * table.  The caller holds the segment lock.
+ *
+ * INPUT:     hash       The HASH_LOCKFREE table
+ *            seg        Segment
+ *            stats      Running totals, see hashStatsAdd()
+ */
+void lockfreeStats(Hash *hash, struct HashSegment *seg, HashStats *stats){
+
+  struct HashLfArray  *arr = seg->lfarray;
+  struct HashNode     *node;
+  unsigned int        len;
+  unsigned int        i;
+
+  for (i = 0; i < arr->num_buckets; i++){
+    len = 0;
+    for (node = arr->buckets[i]; node != NULL; node = node->next){
+      hashStatsProbe(stats, ++len);
+      stats->key_bytes += hashKeyBytes(hash, &node->key);
+    }
+    hashStatsHist(stats, len);
+    stats->empty += (len == 0);
+  }
+
+  stats->count        += seg->count;
+  stats->size         += arr->num_buckets;
+  stats->bucket_bytes += arr->num_buckets * sizeof(struct HashNode *);
+  stats->node_bytes   += seg->count * sizeof(struct HashNode);
+  stats->rehashes     += seg->rehashes;
+  stats->rehash_secs  += seg->rehash_secs;
+  stats->hits         += seg->hits;
+  stats->misses       += seg->misses;
+
+}
+
+
+/*
+ * lockfreeCompact()
+ * This function copies a segment into the smallest array that
+ * holds its entries within the table's load factor, which
+ * also packs the nodes into fresh allocations, and makes that
+ * the size it won't shrink below.  The size is not rounded up
+ * to sizes[], see hashCompact().  The caller holds the
+ * segment write lock.
+ *
+ * INPUT:     hash       Outer table
+ *            seg        Segment
+ * RETURNS:   0          Success
+ *            -1         Error allocating memory
+ */
+int lockfreeCompact(Hash *hash, struct HashSegment *seg){
+
+  unsigned int size = HASH_CAP(seg, HASH_COMPACT_SIZE(seg->count,
+                                                     hash->max_load));
+
+  if (lockfreeResize(seg, size) != 0)
+    return -1;
+
+  seg->min_buckets = size;
+
+  return 0;
+
+}
+
+
+/*
+ * lockfreeReserve()
+ * This function grows a segment, if need be, so count
+ * entries fit without a resize.  The caller holds the
+ * segment write lock.
+ *
+ * INPUT:     hash       Outer table
+ *            seg        Segment
+ *            count      Entries to make room for
+ * RETURNS:   0          Success
+ *            -1         Error allocating memory
+ */
+int lockfreeReserve(Hash *hash, struct HashSegment *seg, unsigned int count){
+
+  unsigned int size = HASH_CAP(seg, HASH_COMPACT_SIZE(count, hash->max_load));
+
+  if (size <= seg->lfarray->num_buckets)
+    return 0;
+
+  return lockfreeResize(seg, size);
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * lockfreeArray()
+ * This function allocates an empty bucket array.
+ */
+static
+struct HashLfArray *lockfreeArray(unsigned int num_buckets){
+
+  struct HashLfArray *arr;
+
+  arr = (struct HashLfArray *) calloc (1, sizeof(struct HashLfArray) +
+                                       num_buckets * sizeof(struct HashNode *));
+  if (arr != NULL)
+    arr->num_buckets = num_buckets;
+
+  return arr;
+
+}
+
+/*
+ * lockfreeResize()
+ * This function copies every node into an array of
+ * num_buckets and publishes it.  Readers still on the old
+ * array see it intact until they leave their read section.
+ */
+static
+int lockfreeResize(struct HashSegment *seg, unsigned int num_buckets){
+
+  struct HashLfArray  *old = seg->lfarray;
+  struct HashLfArray  *arr;
+  struct HashNode     *node;
+  struct HashNode     *next;
+  struct HashNode     *copy;
+  unsigned int        size  = num_buckets;
+  unsigned int        i;
+  unsigned int        b;
+  double              start = hashNow();
+
+  arr = lockfreeArray(size);
+  if (arr == NULL)
+    return -1;
+
+  for (i = 0; i < old->num_buckets; i++){
+    for (node = old->buckets[i]; node != NULL; node = node->next){
+
+      copy = (struct HashNode *) malloc (sizeof(struct HashNode));
+      if (copy == NULL){
+        for (b = 0; b < size; b++)
+          while ((node = arr->buckets[b]) != NULL){
+            arr->buckets[b] = node->next;
+            free(node);
+          }
+        free(arr);
+        return -1;
+      }
+
+      *copy = *node;
+      b     = HASH_FASTRANGE(node->hashval, size);
+      copy->next      = arr->buckets[b];
+      arr->buckets[b] = copy;
+    }
+  }
+
+  __atomic_store_n(&seg->lfarray, arr, __ATOMIC_RELEASE);
+
+  /* Long keys now belong to the copies, so plain free() */
+  for (i = 0; i < old->num_buckets; i++)
+    for (node = old->buckets[i]; node != NULL; node = next){
+      next = node->next;
+      ebrRetire(node, free);
+    }
+  ebrRetire(old, free);
+
+  seg->rehashes++;
+  seg->rehash_secs += hashNow() - start;
+
+  return 0;
+
+}
+
+/*
+ * lockfreeFreeNode()
+ * Frees a node and the heap copy of a long key.
+ */
+static
+void lockfreeFreeNode(void *ptr){
+
+  struct HashNode *node = (struct HashNode *) ptr;
+
+  if (HASH_KEY_ISHEAP(&node->key))
+    free(node->key.ptr);
+  free(node);
+
+}
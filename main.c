@@ -6,28 +6,60 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
 #include "hash.h"
 #include "str.h"
-
-/* USGS record structure */
-struct quadData {
-  char      quadname[41];
-  char      state[3];
-  char      drgname[9];
-  float     x1,y1,x2,y2;
-} quadData;
-
+#include "quad.h"
 
 /* Function Prototypes */
 void testSimple(void);
 void testDatafile(void);
-void testDatafile2(Hash **hash, const char *datafile);
+QuadFile *testDatafile2(Hash **hash, const char *datafile);
+void testLookupRate(const char *datafile);
+void testSnapshot(const char *datafile);
+void testIntKeys(const char *datafile);
+void testStats(const char *datafile);
+void testNuma(const char *datafile);
+void testCompact(const char *datafile);
+void testGrid(const char *datafile);
+void testIter(const char *datafile);
+void testBulk(void);
+void testOptions(const char *datafile);
+void testUpsert(const char *datafile);
+
+/* Visit counts for testIter() */
+struct testIterState {
+  struct quadRecord  *records;
+  unsigned int       count;
+  unsigned int       *seen;
+  unsigned int       other;
+};
+
+/* Totals for testBulk(), updated from several threads */
+struct testBulkState {
+  unsigned int       *ids;
+  unsigned int       visits;
+  uint64_t           sum;
+};
+
+/* Entries freed by testBulkFree() */
+static unsigned int testBulkFreed;
+
+void testIterVisit(void *arg, const char *vkey, uint64_t hashval, void *data);
+void testBulkVisit(void *arg, const char *vkey, uint64_t hashval, void *data);
+void testBulkFree(void *data);
+void *testUpsertMerge(void *old, void *data);
 void destructor(void *data);
 void printer(void *data);
 void printer2(void *data);
+void printer3(void *data);
 
 int main(void){
   Hash *hash;
+  QuadFile     *quad;
   const char   datafile[]="data/63360.lst";
 
   /* Perform simple tests */
@@ -39,9 +71,43 @@ int main(void){
   */
 
   /* Test using testDatafile2() */
-  testDatafile2(&hash,datafile);
+  quad = testDatafile2(&hash,datafile);
   printf("testDatafile(): hashDestroy\n");
-  hashDestroy(hash,&destructor);
+  hashDestroy(hash,NULL);
+  quadClose(quad);
+
+  /* Compare lookup rate of the table engines */
+  testLookupRate(datafile);
+
+  /* Save the table and serve it from the mapped file */
+  testSnapshot(datafile);
+
+  /* Key the records by packed integer DRG codes */
+  testIntKeys(datafile);
+
+  /* Table health with each hash function and engine */
+  testStats(datafile);
+
+  /* Segments spread over the NUMA nodes */
+  testNuma(datafile);
+
+  /* Shrink on delete, then compact */
+  testCompact(datafile);
+
+  /* Find quadrangles by location */
+  testGrid(datafile);
+
+  /* Iterate every engine, scan while resizing */
+  testIter(datafile);
+
+  /* Parallel build, visit and destroy */
+  testBulk();
+
+  /* Reserve, load factor, growth and size limit */
+  testOptions(datafile);
+
+  /* Count duplicates with one lookup per key */
+  testUpsert(datafile);
 
   return 0;
 }
@@ -68,10 +134,10 @@ void testSimple(void){
 
   printf("testSimple()\n");
 
-  data = (char *) malloc (strlen("dogmeat") * (sizeof(char)));
+  data = (char *) malloc ((strlen("dogmeat") + 1) * (sizeof(char)));
   strcpy(data,"dogmeat");
 
-  data3 = (char *) malloc (strlen("catmeat") * (sizeof(char)));
+  data3 = (char *) malloc ((strlen("catmeat") + 1) * (sizeof(char)));
   strcpy(data3,"catmeat");
 
   printf("Hash ADT - Test driver by Raymond E. Marcil\n");
@@ -185,66 +251,306 @@ void testDatafile(void){
  * testDatafile2()
  * This function tests the hash ADT using
  * a large USGS datafile of quadrangle
- * meta information.
+ * meta information.  The file is mapped by quadOpen()
+ * and the records, and keys, point into it, so the
+ * hash must be destroyed with a NULL destructor before
+ * the returned file is closed.
  */
-void testDatafile2(Hash **hash, const char *datafile){
+QuadFile *testDatafile2(Hash **hash, const char *datafile){
 
-  char              line[256];
-  struct quadData  *data;
-  FILE             *fp;
+  QuadFile *quad;
 
-  if ((fp = fopen(datafile,"r")) == NULL){
+  if ((quad = quadOpen(datafile)) == NULL){
     printf("Cannot open file: %s\n",datafile);
     exit(1);
   }
 
   /* Create a new hash */
   printf("testDatafile(): hashCreate()\n");
-  *hash = hashCreate(10);
+  *hash = hashCreateEngine(10,HASH_CHAINED | HASH_BORROWED);
 
   printf("testDatafile(): count: %d\n",hashCount(*hash));
   printf("testDatafile(): num_buckets: %d\n",hashSize(*hash));
 
-  while (lineRead(fp,line,256) != EOF){
+  quadLoad(*hash,quad);
 
-    data = (struct quadData *) malloc (sizeof(struct quadData));
-    if (data != NULL){
+  hashPrint(*hash,&printer3);
 
-      memset(data->quadname,0,sizeof(data->quadname));
-      memset(data->state,0,sizeof(data->state));
-      memset(data->drgname,0,sizeof(data->drgname));
+  printf("testDatafile(): count: %d\n",hashCount(*hash));
+  printf("testDatafile(): num_buckets: %d\n",hashSize(*hash));
 
-      sscanf(line,"%40c%s%s%f%f%f%f",
-             &data->quadname,
-             &data->state,
-             &data->drgname,
-             &data->x1,
-             &data->y1,
-             &data->x2,
-             &data->y2);
+  return quad;
 
-      /* Clean up data */
-      strTrimTail(data->quadname);
-      strStrip(data->drgname);
+}
 
-      /* Add container to hash */
-      hashAdd(*hash,data->drgname,data);
-    }
-    else {
+/* =================== testLookupRate() ================== */
+/* =================== testLookupRate() ================== */
+
+/*
+ * testLookupRate()
+ * This function loads the quadrangle file into each table
+ * engine and times repeated hashGet() passes over every
+ * drgname (hits) and over the same names with a
+ * character appended (misses).  Run it under
+ * "perf stat -e cache-misses" to compare cache behaviour.
+ *
+ * INPUT:     datafile    Path of quadrangle file
+ */
+void testLookupRate(const char *datafile){
+
+  static const int     engines[] = { HASH_CHAINED, HASH_FLAT, HASH_SWISS };
+  static const char   *names[]   = { "chained", "flat", "swiss" };
+  const int            passes    = 50;
+
+  Hash             *hash;
+  QuadFile         *quad;
+  struct quadRecord *records;
+  char            **misses;
+  unsigned int      n;
+  unsigned int      i;
+  unsigned int      found;
+  struct timespec   t0, t1;
+  double            secs;
+  int               e, p;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n",datafile);
+    exit(1);
+  }
+  records = quad->records;
+  n       = quad->count;
+
+  for (e = 0; e < 3; e++){
 
+    hash = hashCreateEngine(10,engines[e]);
+    quadLoad(hash,quad);
+
+    /* Build a miss key for every record */
+    misses = (char **) malloc (n * sizeof(char *));
+    if (misses == NULL){
+      printf("Error allocating memory, aborting...\n");
+      exit(1);
+    }
+    for (i = 0; i < n; i++){
+      misses[i] = (char *) malloc (strlen(records[i].drgname) + 2);
+      if (misses[i] == NULL){
         printf("Error allocating memory, aborting...\n");
         exit(1);
+      }
+      sprintf(misses[i],"%s#",records[i].drgname);
+    }
 
-    } /* end if (data != NULL) */
+    found = 0;
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    for (p = 0; p < passes; p++)
+      for (i = 0; i < n; i++)
+        found += (hashGet(hash,records[i].drgname) != NULL);
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("testLookupRate(): %-8s hits:   %u/%u  %.0f lookups/sec\n",
+           names[e],found,n * passes,(n * (double) passes) / secs);
+
+    found = 0;
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    for (p = 0; p < passes; p++)
+      for (i = 0; i < n; i++)
+        found += (hashGet(hash,misses[i]) != NULL);
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("testLookupRate(): %-8s misses: %u/%u  %.0f lookups/sec\n",
+           names[e],found,n * passes,(n * (double) passes) / secs);
+
+    for (i = 0; i < n; i++)
+      free(misses[i]);
+    free(misses);
+    hashDestroy(hash,NULL);
+  }
 
-  } /* end while (lineRead(fp,line,256) != EOF) */
+  quadClose(quad);
 
-  hashPrint(*hash,&printer2);
+}
 
-  printf("testDatafile(): count: %d\n",hashCount(*hash));
-  printf("testDatafile(): num_buckets: %d\n",hashSize(*hash));
 
-  fclose(fp);
+/* ==================== testSnapshot() =================== */
+/* ==================== testSnapshot() =================== */
+
+/*
+ * testSnapshot()
+ * This function loads the quadrangle file as flat quadData
+ * records, saves the table with hashSave() and then
+ * hashSavePerfect(), opens each snapshot with hashOpen() and
+ * checks that every drgname finds the same record in it as in
+ * the table it was saved from.
+ *
+ * INPUT:     datafile    Path of quadrangle file
+ */
+void testSnapshot(const char *datafile){
+
+  const char        snapfile[] = "63360.hash";
+  Hash             *hash;
+  Hash             *image;
+  QuadFile         *quad;
+  struct quadData  *records;
+  void             *data;
+  unsigned int      i;
+  unsigned int      same;
+  int               perfect;
+  struct timespec   t0, t1;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n",datafile);
+    exit(1);
+  }
+
+  records = (struct quadData *) malloc (quad->count * sizeof(struct quadData));
+  if (records == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+
+  hash = hashCreate(10);
+  for (i = 0; i < quad->count; i++){
+    quadPack(&quad->records[i],&records[i]);
+    hashAdd(hash,records[i].drgname,&records[i]);
+  }
+
+  for (perfect = 0; perfect < 2; perfect++){
+
+    if ((perfect ? hashSavePerfect(hash,snapfile,sizeof(struct quadData))
+                 : hashSave(hash,snapfile,sizeof(struct quadData))) != 0){
+      printf("testSnapshot(): %s failed\n",
+             perfect ? "hashSavePerfect" : "hashSave");
+      exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    image = hashOpen(snapfile);
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+    if (image == NULL){
+      printf("testSnapshot(): hashOpen failed\n");
+      exit(1);
+    }
+
+    for (i = 0, same = 0; i < quad->count; i++){
+      data = hashGet(image,records[i].drgname);
+      same += (data != NULL &&
+               memcmp(data,hashGet(hash,records[i].drgname),
+                      sizeof(struct quadData)) == 0);
+    }
+
+    printf("testSnapshot(): %-8s count: %u  hashOpen: %.1f us  "
+           "matching: %u/%u\n",
+           perfect ? "perfect" : "buckets",hashCount(image),
+           (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3,
+           same,quad->count);
+
+    hashDestroy(image,NULL);
+    unlink(snapfile);
+
+  }
+
+  hashDestroy(hash,NULL);
+  free(records);
+  quadClose(quad);
+
+}
+
+
+/* ==================== testIntKeys() ==================== */
+/* ==================== testIntKeys() ==================== */
+
+/*
+ * testIntKeys()
+ * This function loads the quadrangle file into a
+ * HASH_KEY_U64 table of each engine, keyed by quadKey() of
+ * the drgname, checks that every record is found under its
+ * key, and compares the lookup rate with the same records
+ * keyed by the drgname string.
+ *
+ * INPUT:     datafile    Path of quadrangle file
+ */
+void testIntKeys(const char *datafile){
+
+  static const int     engines[] = { HASH_CHAINED, HASH_FLAT, HASH_SWISS };
+  static const char   *names[]   = { "chained", "flat", "swiss" };
+  const int            passes    = 50;
+
+  Hash              *hash;
+  Hash              *strhash;
+  QuadFile          *quad;
+  struct quadRecord *rec;
+  uint64_t          *keys;
+  unsigned int      n;
+  unsigned int      i;
+  unsigned int      found;
+  unsigned int      same;
+  struct timespec   t0, t1;
+  double            secs, strsecs;
+  int               e, p;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n",datafile);
+    exit(1);
+  }
+  n    = quad->count;
+  keys = (uint64_t *) malloc ((n + 1) * sizeof(uint64_t));
+  if (keys == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+  for (i = 0; i < n; i++)
+    keys[i] = quadKey(quad->records[i].drgname);
+
+  for (e = 0; e < 3; e++){
+
+    hash    = hashCreateEngine(10,engines[e]);
+    strhash = hashCreateEngine(10,engines[e]);
+    if (hash == NULL || strhash == NULL ||
+        hashSetKeySize(hash,HASH_KEY_U64) != 0){
+      printf("testIntKeys(): cannot create %s table\n",names[e]);
+      exit(1);
+    }
+    for (i = 0; i < n; i++)
+      hashAddInt(hash,keys[i],&quad->records[i]);
+    quadLoad(strhash,quad);
+
+    /*
+     * Duplicate codes may find another record with the same code,
+     * and quadKey() folds case, so "41107c5" finds "41107C5".
+     */
+    for (i = 0, same = 0; i < n; i++){
+      rec   = (struct quadRecord *) hashGetInt(hash,keys[i]);
+      same += (rec != NULL && strcasecmp(rec->drgname,
+                                         quad->records[i].drgname) == 0);
+    }
+
+    found = 0;
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    for (p = 0; p < passes; p++)
+      for (i = 0; i < n; i++)
+        found += (hashGet(strhash,quad->records[i].drgname) != NULL);
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+    strsecs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    for (p = 0; p < passes; p++)
+      for (i = 0; i < n; i++)
+        found += (hashGetInt(hash,keys[i]) != NULL);
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    printf("testIntKeys(): %-8s matching: %u/%u  found: %u/%u  "
+           "string %.0f  u64 %.0f lookups/sec\n",
+           names[e],same,n,found,2 * n * passes,
+           (n * (double) passes) / strsecs,(n * (double) passes) / secs);
+
+    hashDestroy(hash,NULL);
+    hashDestroy(strhash,NULL);
+  }
+
+  free(keys);
+  quadClose(quad);
+
 }
 
 
@@ -302,3 +608,826 @@ void printer2(void *data){
     ((struct quadData *)data)->y2);
 
 }
+
+/*
+ * printer3()
+ * This function prints the USGS records read by quadOpen().
+ */
+void printer3(void *data){
+
+  printf("%s, %s, %s, (%3.3f,%3.3f), (%3.3f,%3.3f)\n",
+    ((struct quadRecord *)data)->quadname,
+    ((struct quadRecord *)data)->state,
+    ((struct quadRecord *)data)->drgname,
+    ((struct quadRecord *)data)->x1,
+    ((struct quadRecord *)data)->y1,
+    ((struct quadRecord *)data)->x2,
+    ((struct quadRecord *)data)->y2);
+
+}
+
+
+/* ===================== testStats() ===================== */
+/* ===================== testStats() ===================== */
+
+/*
+ * testStats()
+ * This function loads the quadrangle file into a chained
+ * table with each hash function, and into the open addressing
+ * engines, and prints hashStats() of each.  A hash function
+ * that clusters the DRG codes shows up as a longer max chain
+ * and a heavier histogram tail than the load factor explains.
+ *
+ * INPUT:     datafile    Path of quadrangle file
+ */
+void testStats(const char *datafile){
+
+  static const HashFunc  fns[]     = { hashFnWy, hashFnFnv1a, hashFnFval };
+  static const char     *fnNames[] = { "wyhash", "fnv1a", "fval" };
+  static const int       engines[] = { HASH_CHAINED, HASH_CHAINED,
+                                       HASH_CHAINED, HASH_FLAT, HASH_SWISS };
+  static const char     *names[]   = { "chained", "chained", "chained",
+                                       "flat", "swiss" };
+
+  Hash          *hash;
+  HashStats     stats;
+  QuadFile      *quad;
+  unsigned int  i;
+  int           t;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n",datafile);
+    exit(1);
+  }
+
+  for (t = 0; t < 5; t++){
+
+    hash = hashCreateEngine(10,engines[t]);
+    if (t < 3)
+      hashSetHashFunc(hash,fns[t]);
+    quadLoad(hash,quad);
+    for (i = 0; i < quad->count; i += 2)
+      hashGet(hash,quad->records[i].drgname);
+
+    hashStats(hash,&stats);
+    printf("testStats(): %-8s %-7s count %u size %u load %.2f "
+           "empty %.2f max %u mean %.2f rehashes %u (%.2f ms)\n",
+           names[t],(t < 3) ? fnNames[t] : "wyhash",
+           stats.count,stats.size,stats.load_factor,stats.empty_ratio,
+           stats.max_chain,stats.mean_probe,stats.rehashes,
+           stats.rehash_secs * 1e3);
+    printf("testStats(): %-8s bytes buckets %lu nodes %lu keys %lu  "
+           "hits %lu misses %lu\n",names[t],
+           (unsigned long) stats.bucket_bytes,
+           (unsigned long) stats.node_bytes,
+           (unsigned long) stats.key_bytes,
+           (unsigned long) stats.hits,(unsigned long) stats.misses);
+    printf("testStats(): %-8s histogram",names[t]);
+    for (i = 0; i < HASH_STATS_HIST && i <= stats.max_chain; i++)
+      printf(" %u",stats.histogram[i]);
+    printf("\n");
+
+    hashDestroy(hash,NULL);
+  }
+
+  quadClose(quad);
+
+}
+
+
+/* ===================== testNuma() ====================== */
+/* ===================== testNuma() ====================== */
+
+/*
+ * testNuma()
+ * This function loads the quadrangle file into HASH_NUMA
+ * tables, checks every record is found, and prints how the
+ * segments are spread over the nodes.  Each record is added
+ * from a thread moved to its segment's node, the way a NUMA
+ * aware loader would hand the keys out.
+ *
+ * INPUT:     datafile    Path of quadrangle file
+ */
+void testNuma(const char *datafile){
+
+  static const int     engines[] = { HASH_CHAINED, HASH_FLAT, HASH_SWISS,
+                                     HASH_CHAINED | HASH_LOCKFREE };
+  static const char   *names[]   = { "chained", "flat", "swiss", "lockfree" };
+
+  Hash          *hash;
+  QuadFile      *quad;
+  unsigned int  perNode[8];
+  unsigned int  found;
+  unsigned int  i;
+  int           nodes = hashNumaNodes();
+  int           node;
+  int           e;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n",datafile);
+    exit(1);
+  }
+
+  for (e = 0; e < 4; e++){
+
+    hash = hashCreateEngine(10,engines[e] | HASH_NUMA);
+    if (hash == NULL){
+      printf("testNuma(): cannot create %s table\n",names[e]);
+      exit(1);
+    }
+
+    memset(perNode,0,sizeof(perNode));
+    for (i = 0; i < HASH_SEGMENTS; i++){
+      node = hashSegmentNode(hash,i);
+      if (node >= 0 && node < 8)
+        perNode[node]++;
+    }
+
+    for (i = 0; i < quad->count; i++){
+      node = hashSegmentNode(hash,
+                             hashSegmentOf(hash,quad->records[i].drgname));
+      hashRunOnNode(node);
+      hashAdd(hash,quad->records[i].drgname,&quad->records[i]);
+    }
+
+    for (i = 0, found = 0; i < quad->count; i++)
+      found += (hashGet(hash,quad->records[i].drgname) != NULL);
+
+    printf("testNuma(): %-8s nodes %d  segments on node 0: %u  "
+           "found: %u/%u\n",
+           names[e],nodes,perNode[0],found,quad->count);
+
+    hashDestroy(hash,NULL);
+  }
+
+  quadClose(quad);
+
+}
+
+
+/* ==================== testCompact() ==================== */
+/* ==================== testCompact() ==================== */
+
+/*
+ * testCompact()
+ * This function loads the quadrangle file keyed by DRG code
+ * and quad name, long enough to live out of line, deletes
+ * fifteen records in sixteen and prints how the table shrank.
+ * It then compacts the table and checks the survivors are
+ * found, the deleted records are not, and that the table
+ * grows again when they are put back.  The file repeats one
+ * surviving record, so its deleted twin is still found.
+ *
+ * INPUT:     datafile    Path of quadrangle file
+ */
+void testCompact(const char *datafile){
+
+  static const int     engines[] = { HASH_CHAINED,
+                                     HASH_CHAINED | HASH_INCREMENTAL |
+                                     HASH_ARENA,
+                                     HASH_FLAT | HASH_ARENA, HASH_SWISS,
+                                     HASH_CHAINED | HASH_LOCKFREE };
+  static const char   *names[]   = { "chained", "incr", "flat", "swiss",
+                                     "lockfree" };
+
+  Hash          *hash;
+  HashStats     stats;
+  QuadFile      *quad;
+  char          *keys;
+  unsigned int  full;
+  unsigned int  shrunk;
+  size_t        bytes;
+  unsigned int  found;
+  unsigned int  gone;
+  unsigned int  i;
+  int           e;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n",datafile);
+    exit(1);
+  }
+
+  keys = (char *) malloc ((size_t) quad->count * 64);
+  for (i = 0; i < quad->count; i++)
+    snprintf(&keys[i * 64],64,"%s %s",quad->records[i].drgname,
+             quad->records[i].quadname);
+
+  for (e = 0; e < 5; e++){
+
+    hash = hashCreateEngine(10,engines[e]);
+    for (i = 0; i < quad->count; i++)
+      hashAdd(hash,&keys[i * 64],&quad->records[i]);
+    full = hashSize(hash);
+
+    for (i = 0; i < quad->count; i++)
+      if (i % 16 != 0)
+        hashDelete(hash,&keys[i * 64],NULL);
+    shrunk = hashSize(hash);
+    hashStats(hash,&stats);
+    bytes = stats.node_bytes + stats.key_bytes;
+
+    if (hashCompact(hash) != 0)
+      printf("testCompact(): %s hashCompact() failed\n",names[e]);
+    hashStats(hash,&stats);
+
+    for (i = 0, found = 0, gone = 0; i < quad->count; i++){
+      if (i % 16 == 0)
+        found += (hashGet(hash,&keys[i * 64]) != NULL);
+      else
+        gone  += (hashGet(hash,&keys[i * 64]) == NULL);
+    }
+
+    printf("testCompact(): %-8s size %u -> %u -> %u  nodes+keys %lu -> %lu  "
+           "found %u/%u gone %u/%u\n",names[e],full,shrunk,hashSize(hash),
+           (unsigned long) bytes,
+           (unsigned long) (stats.node_bytes + stats.key_bytes),
+           found,(quad->count + 15) / 16,
+           gone,quad->count - (quad->count + 15) / 16);
+
+    for (i = 0; i < quad->count; i++)
+      if (i % 16 != 0)
+        hashAdd(hash,&keys[i * 64],&quad->records[i]);
+    for (i = 0, found = 0; i < quad->count; i++)
+      found += (hashGet(hash,&keys[i * 64]) != NULL);
+    printf("testCompact(): %-8s refilled size %u found %u/%u\n",
+           names[e],hashSize(hash),found,quad->count);
+
+    hashDestroy(hash,NULL);
+  }
+
+  free(keys);
+  quadClose(quad);
+
+}
+
+
+/* ====================== testGrid() ===================== */
+/* ====================== testGrid() ===================== */
+
+/*
+ * testGrid()
+ * This function indexes the corners of every quadrangle with
+ * quadIndex() and checks that the center of each is found in
+ * it, then compares gridPoint() and gridRange() against a
+ * walk of every record for random points and ranges.  Last,
+ * it fills one cell past each size it grows to and checks no
+ * box went missing.
+ *
+ * INPUT:     datafile    Path of quadrangle file
+ */
+void testGrid(const char *datafile){
+
+  Grid               *grid;
+  QuadFile           *quad;
+  struct quadRecord  *rec;
+  void               *out[256];
+  unsigned int       centers = 0;
+  unsigned int       points = 0;
+  unsigned int       ranges = 0;
+  unsigned int       hits = 0;
+  unsigned int       n, brute;
+  unsigned int       i, j, t;
+  double             lat, lon, lat2, lon2;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n",datafile);
+    exit(1);
+  }
+
+  grid = gridCreate(0);
+  printf("testGrid(): quadIndex() %u/%u\n",quadIndex(grid,quad),quad->count);
+
+  for (i = 0; i < quad->count; i++){
+    rec = &quad->records[i];
+    n   = gridPoint(grid,(rec->x1 + rec->y1) / 2,(rec->x2 + rec->y2) / 2,
+                    out,256);
+    for (j = 0; j < n && j < 256; j++)
+      if (out[j] == rec){
+        centers++;
+        break;
+      }
+  }
+
+  srand(63360);
+  for (t = 0; t < 2000; t++){
+
+    /* Points and 1 by 2 degree ranges over the lower 48 */
+    lat  = 25 + 24.0 * rand() / RAND_MAX;
+    lon  = -125 + 58.0 * rand() / RAND_MAX;
+    lat2 = lat + 1;
+    lon2 = lon + 2;
+
+    n = gridPoint(grid,lat,lon,out,256);
+    for (i = 0, brute = 0; i < quad->count; i++){
+      rec = &quad->records[i];
+      brute += (lat >= rec->y1 && lat <= rec->x1 &&
+                lon >= rec->y2 && lon <= rec->x2);
+    }
+    points += (n == brute);
+    hits   += n;
+
+    n = gridRange(grid,lat,lon,lat2,lon2,out,256);
+    for (i = 0, brute = 0; i < quad->count; i++){
+      rec = &quad->records[i];
+      brute += (rec->y1 <= lat2 && rec->x1 >= lat &&
+                rec->y2 <= lon2 && rec->x2 >= lon);
+    }
+    ranges += (n == brute);
+  }
+
+  printf("testGrid(): centers found %u/%u  points match %u/2000 "
+         "(%u hits)  ranges match %u/2000\n",
+         centers,quad->count,points,hits,ranges);
+
+  gridDestroy(grid);
+  quadClose(quad);
+
+  /* One cell grown from 4 to 8, 16 and 32 boxes loses none */
+  grid = gridCreate(1.0);
+  for (i = 0, n = 0; i < 33; i++){
+    gridAdd(grid,10.25,20.25,10.75,20.75,&out[i]);
+    n += (gridPoint(grid,10.5,20.5,out + 64,64) == i + 1);
+  }
+  printf("testGrid(): growing cell kept every box %u/33\n",n);
+  gridDestroy(grid);
+
+}
+
+
+/* ====================== testIter() ===================== */
+/* ====================== testIter() ===================== */
+
+/*
+ * testIter()
+ * This function loads the quadrangle file into a table of
+ * each engine and checks that hashIterNext() visits every
+ * entry once.  It then walks the table with hashScan() a few
+ * buckets at a time while adding thousands of other keys and
+ * deleting them again between calls, so the table grows and
+ * shrinks under the cursor, and checks every record was still
+ * visited exactly once.  Last, the same for a snapshot.
+ *
+ * INPUT:     datafile    Path of quadrangle file
+ */
+void testIter(const char *datafile){
+
+  static const int     engines[] = { HASH_CHAINED,
+                                     HASH_CHAINED | HASH_INCREMENTAL,
+                                     HASH_FLAT, HASH_SWISS,
+                                     HASH_CHAINED | HASH_LOCKFREE,
+                                     HASH_SWISS | HASH_CONCURRENT };
+  static const char   *names[]   = { "chained", "incr", "flat", "swiss",
+                                     "lockfree", "conc" };
+  const char           snapfile[] = "63360.hash";
+
+  Hash                  *hash;
+  Hash                  *image;
+  HashIter              it;
+  QuadFile              *quad;
+  struct testIterState  state;
+  unsigned int          *seen;
+  char                  *extra;
+  uint64_t              cursor;
+  unsigned int          nextra;
+  unsigned int          added, deleted;
+  unsigned int          n, once, calls, grew;
+  unsigned int          i, j;
+  int                   e;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n",datafile);
+    exit(1);
+  }
+
+  nextra = quad->count * 3;
+  seen   = (unsigned int *) malloc (quad->count * sizeof(unsigned int));
+  extra  = (char *) malloc ((size_t) nextra * 16);
+  if (seen == NULL || extra == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+  for (i = 0; i < nextra; i++)
+    snprintf(&extra[i * 16],16,"extra%u",i);
+
+  state.records = quad->records;
+  state.count   = quad->count;
+  state.seen    = seen;
+
+  for (e = 0; e < 6; e++){
+
+    hash = hashCreateEngine(10,engines[e]);
+    for (i = 0; i < quad->count; i++)
+      hashAdd(hash,quad->records[i].drgname,&quad->records[i]);
+
+    /* Data is the record, so each should turn up once */
+    memset(seen,0,quad->count * sizeof(unsigned int));
+    hashIterBegin(hash,&it);
+    for (n = 0; hashIterNext(&it); n++)
+      seen[(struct quadRecord *) it.data - quad->records]++;
+    for (i = 0, once = 0; i < quad->count; i++)
+      once += (seen[i] == 1);
+
+    printf("testIter(): %-8s iter %u/%u entries, %u once",
+           names[e],n,hashCount(hash),once);
+
+    /* Records in the table are 1, the rest 0 */
+    for (i = 0; i < quad->count; i++)
+      seen[i] = (seen[i] == 1) ? 1 : 0;
+
+    cursor = 0;
+    calls  = 0;
+    grew   = hashSize(hash);
+    added  = deleted = 0;
+    do {
+      cursor = hashScan(hash,cursor,64,testIterVisit,&state);
+      calls++;
+      if (added < nextra)
+        for (j = 0; j < 128 && added < nextra; j++, added++)
+          hashAdd(hash,&extra[added * 16],NULL);
+      else
+        for (j = 0; j < 128 && deleted < nextra; j++, deleted++)
+          hashDelete(hash,&extra[deleted * 16],NULL);
+      if (hashSize(hash) > grew)
+        grew = hashSize(hash);
+    } while (cursor != 0);
+
+    /* Each record scanned once is now 1 + 1 */
+    for (i = 0, n = 0; i < quad->count; i++)
+      n += (seen[i] == 2);
+    printf("  scan %u calls, size up to %u, %u/%u once\n",
+           calls,grew,n,once);
+
+    hashDestroy(hash,NULL);
+  }
+
+  hash = hashCreateEngine(10,HASH_FLAT);
+  for (i = 0; i < quad->count; i++)
+    hashAdd(hash,quad->records[i].drgname,&quad->records[i]);
+  if (hashSave(hash,snapfile,0) != 0 || (image = hashOpen(snapfile)) == NULL){
+    printf("testIter(): snapshot failed\n");
+    exit(1);
+  }
+
+  hashIterBegin(image,&it);
+  for (n = 0; hashIterNext(&it); )
+    n += (hashGet(hash,(char *) it.key) != NULL);
+  cursor      = 0;
+  state.other = 0;
+  do
+    cursor = hashScan(image,cursor,1000,testIterVisit,&state);
+  while (cursor != 0);
+  printf("testIter(): image    iter %u/%u entries  scan %u\n",
+         n,hashCount(image),state.other);
+
+  hashDestroy(image,NULL);
+  unlink(snapfile);
+  hashDestroy(hash,NULL);
+  free(extra);
+  free(seen);
+  quadClose(quad);
+
+}
+
+/*
+ * testIterVisit()
+ * hashScan() visitor for testIter(), counting visits of each
+ * record in seen[] and of anything else in other.
+ */
+void testIterVisit(void *arg, const char *vkey, uint64_t hashval, void *data){
+
+  struct testIterState  *state = (struct testIterState *) arg;
+  struct quadRecord     *rec   = (struct quadRecord *) data;
+
+  (void) vkey;
+  (void) hashval;
+
+  if (rec >= state->records && rec < state->records + state->count)
+    state->seen[rec - state->records]++;
+  else
+    state->other++;
+
+}
+
+
+/* ====================== testBulk() ===================== */
+/* ====================== testBulk() ===================== */
+
+/*
+ * testBulk()
+ * This function builds a table of each engine from 120000
+ * keys with hashBuildBulk() on four threads, and checks that
+ * every key is found with its own data container.  It then
+ * visits the table with hashForEach() and frees it with
+ * hashDestroyParallel(), checking each entry was seen once.
+ *
+ * INPUT:     NONE
+ */
+void testBulk(void){
+
+  static const int     engines[] = { HASH_CHAINED,
+                                     HASH_CHAINED | HASH_INCREMENTAL,
+                                     HASH_CHAINED | HASH_ARENA,
+                                     HASH_FLAT, HASH_SWISS,
+                                     HASH_SWISS | HASH_ARENA,
+                                     HASH_CHAINED | HASH_LOCKFREE,
+                                     HASH_FLAT | HASH_CONCURRENT };
+  static const char   *names[]   = { "chained", "incr", "arena", "flat",
+                                     "swiss", "swissa", "lockfree", "conc" };
+  const unsigned int   n = 120000;
+
+  Hash                  *hash;
+  struct testBulkState  state;
+  char                  **keys;
+  char                  *text;
+  void                  **values;
+  unsigned int          *ids;
+  unsigned int          added, found;
+  unsigned int          i;
+  uint64_t              sum;
+  int                   e;
+
+  keys   = (char **) malloc (n * sizeof(char *));
+  values = (void **) malloc (n * sizeof(void *));
+  ids    = (unsigned int *) malloc (n * sizeof(unsigned int));
+  text   = (char *) malloc ((size_t) n * 16);
+  if (keys == NULL || values == NULL || ids == NULL || text == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+
+  for (i = 0, sum = 0; i < n; i++){
+    snprintf(&text[i * 16],16,"bulk%u",i);
+    keys[i]   = &text[i * 16];
+    ids[i]    = i;
+    values[i] = &ids[i];
+    sum      += i;
+  }
+
+  for (e = 0; e < 8; e++){
+
+    hash  = hashCreateEngine(10,engines[e]);
+    added = hashBuildBulk(hash,keys,values,n,4);
+
+    for (i = 0, found = 0; i < n; i++)
+      found += (hashGet(hash,keys[i]) == values[i]);
+
+    memset(&state,0,sizeof(state));
+    state.ids = ids;
+    hashForEach(hash,testBulkVisit,&state,4);
+
+    printf("testBulk(): %-8s added %u/%u, count %u, found %u, "
+           "visited %u%s",
+           names[e],added,n,hashCount(hash),found,state.visits,
+           (state.sum == sum) ? "" : " (wrong data)");
+
+    testBulkFreed = 0;
+    hashDestroyParallel(hash,testBulkFree,4);
+    printf(", freed %u\n",testBulkFreed);
+  }
+
+  free(text);
+  free(ids);
+  free(values);
+  free(keys);
+
+}
+
+/*
+ * testBulkVisit()
+ * hashForEach() visitor for testBulk(), adding up the id of
+ * each entry's data container.
+ */
+void testBulkVisit(void *arg, const char *vkey, uint64_t hashval, void *data){
+
+  struct testBulkState  *state = (struct testBulkState *) arg;
+
+  (void) vkey;
+  (void) hashval;
+
+  __atomic_fetch_add(&state->visits, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&state->sum, *(unsigned int *) data, __ATOMIC_RELAXED);
+
+}
+
+/*
+ * testBulkFree()
+ * hashDestroyParallel() destructor for testBulk().  The data
+ * containers are one array, so only count them.
+ */
+void testBulkFree(void *data){
+
+  (void) data;
+
+  __atomic_fetch_add(&testBulkFreed, 1, __ATOMIC_RELAXED);
+
+}
+
+
+/* ==================== testOptions() ==================== */
+/* ==================== testOptions() ==================== */
+
+/*
+ * testOptions()
+ * This function loads the quadrangle file into a table of
+ * each engine three ways: after hashReserve(), which should
+ * leave nothing to rehash during the load, into a table
+ * with a load factor of .5 growing four times at a time, and
+ * into one limited to 4096 buckets or slots, which chained
+ * tables fill past their load factor and open addressing
+ * ones stop taking entries at.
+ *
+ * INPUT:     datafile    Path of quadrangle file
+ */
+void testOptions(const char *datafile){
+
+  static const int     engines[] = { HASH_CHAINED,
+                                     HASH_CHAINED | HASH_INCREMENTAL,
+                                     HASH_FLAT, HASH_SWISS,
+                                     HASH_CHAINED | HASH_LOCKFREE,
+                                     HASH_SWISS | HASH_CONCURRENT };
+  static const char   *names[]   = { "chained", "incr", "flat", "swiss",
+                                     "lockfree", "conc" };
+  static const HashOptions  sparse = { .max_load = .5, .growth = 4,
+                                       .min_buckets = 1000 };
+  static const HashOptions  capped = { .max_buckets = 4096 };
+
+  Hash              *hash;
+  QuadFile          *quad;
+  HashStats         stats;
+  unsigned int      rehashes;
+  unsigned int      added;
+  unsigned int      found;
+  unsigned int      i;
+  int               e;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n",datafile);
+    exit(1);
+  }
+
+  for (e = 0; e < 6; e++){
+
+    hash = hashCreateEngine(10,engines[e]);
+    hashReserve(hash,quad->count);
+    hashStats(hash,&stats);
+    rehashes = stats.rehashes;
+    for (i = 0; i < quad->count; i++)
+      hashAdd(hash,quad->records[i].drgname,&quad->records[i]);
+    hashStats(hash,&stats);
+    printf("testOptions(): %-8s reserve %u rehashes in load, load %.2f",
+           names[e],stats.rehashes - rehashes,stats.load_factor);
+    hashDestroy(hash,NULL);
+
+    hash = hashCreateOptions(engines[e],&sparse);
+    for (i = 0; i < quad->count; i++)
+      hashAdd(hash,quad->records[i].drgname,&quad->records[i]);
+    hashStats(hash,&stats);
+    printf("  sparse %u rehashes, load %.2f",stats.rehashes,stats.load_factor);
+    hashDestroy(hash,NULL);
+
+    hash = hashCreateOptions(engines[e],&capped);
+    for (i = 0, added = 0; i < quad->count; i++)
+      added += (hashAdd(hash,quad->records[i].drgname,
+                        &quad->records[i]) == 0);
+    for (i = 0, found = 0; i < quad->count; i++)
+      found += (hashGet(hash,quad->records[i].drgname) ==
+                &quad->records[i]);
+    printf("  capped size %u, added %u, found %u\n",
+           hashSize(hash),added,found);
+    hashDestroy(hash,NULL);
+  }
+
+  if (hashCreateOptions(HASH_FLAT,
+                        &(HashOptions) { .max_load = 1.5 }) != NULL ||
+      hashCreateOptions(HASH_CHAINED,
+                        &(HashOptions) { .growth = 1 }) != NULL)
+    printf("testOptions(): bad options accepted\n");
+
+  quadClose(quad);
+
+}
+
+
+/* ==================== testUpsert() ===================== */
+/* ==================== testUpsert() ===================== */
+
+/*
+ * testUpsert()
+ * This function counts how often each DRG name occurs in the
+ * quadrangle file with hashUpsert(), in a table of each
+ * engine.  The counts should add up to the record count over
+ * hashCount() distinct names.  hashEmplace() of every record
+ * should then find its name with the first occurrence's
+ * counter and add nothing, and hashFindOrInsert() should add
+ * new names and hand back their slots to fill in.  Last,
+ * hashUpsert() with no merge replaces each name's data with
+ * its record and should hand back what it replaced.
+ *
+ * INPUT:     datafile    Path of quadrangle file
+ */
+void testUpsert(const char *datafile){
+
+  static const int     engines[] = { HASH_CHAINED,
+                                     HASH_CHAINED | HASH_INCREMENTAL,
+                                     HASH_CHAINED | HASH_ARENA,
+                                     HASH_FLAT, HASH_SWISS,
+                                     HASH_CHAINED | HASH_LOCKFREE,
+                                     HASH_FLAT | HASH_CONCURRENT,
+                                     HASH_SWISS | HASH_CONCURRENT };
+  static const char   *names[]   = { "chained", "incr", "arena", "flat",
+                                     "swiss", "lockfree", "cflat",
+                                     "cswiss" };
+  const unsigned int   extra = 1000;
+
+  Hash                  *hash;
+  QuadFile              *quad;
+  struct testBulkState  state;
+  unsigned int          *counts;
+  unsigned int          added, present, inserted, replaced;
+  unsigned int          i;
+  char                  key[16];
+  void                  *existing;
+  void                  *old;
+  void                  **slot;
+  int                   e, ins;
+
+  if ((quad = quadOpen(datafile)) == NULL){
+    printf("Cannot open file: %s\n",datafile);
+    exit(1);
+  }
+
+  counts = (unsigned int *) malloc ((quad->count + extra) *
+                                    sizeof(unsigned int));
+  if (counts == NULL){
+    printf("Error allocating memory, aborting...\n");
+    exit(1);
+  }
+
+  for (e = 0; e < 8; e++){
+
+    hash = hashCreateEngine(10,engines[e]);
+
+    for (i = 0, added = 0; i < quad->count; i++){
+      counts[i] = 1;
+      added += (hashUpsert(hash,quad->records[i].drgname,&counts[i],
+                           testUpsertMerge,NULL) == 1);
+    }
+
+    for (i = 0, present = 0; i < quad->count; i++){
+      existing = NULL;
+      present += (hashEmplace(hash,quad->records[i].drgname,
+                              &quad->records[i],&existing) == 0 &&
+                  existing == hashGet(hash,quad->records[i].drgname) &&
+                  *(unsigned int *) existing > 0);
+    }
+
+    /* Slots are handed out only where no lock guards them */
+    for (i = 0, inserted = 0; i < extra; i++){
+      snprintf(key,sizeof(key),"upsert%u",i);
+      counts[quad->count + i] = 0;
+      if ((slot = hashFindOrInsert(hash,key,&ins)) != NULL && ins){
+        *slot = &counts[quad->count + i];
+        inserted += (hashFindOrInsert(hash,key,&ins) == slot && !ins);
+      }
+      else if (hashEmplace(hash,key,&counts[quad->count + i],NULL) == 1)
+        inserted++;
+    }
+
+    memset(&state,0,sizeof(state));
+    hashForEach(hash,testBulkVisit,&state,1);
+
+    for (i = 0, replaced = 0; i < quad->count; i++){
+      existing = hashGet(hash,quad->records[i].drgname);
+      old      = NULL;
+      replaced += (hashUpsert(hash,quad->records[i].drgname,
+                              &quad->records[i],NULL,&old) == 0 &&
+                   old == existing &&
+                   hashGet(hash,quad->records[i].drgname) ==
+                   &quad->records[i]);
+    }
+
+    printf("testUpsert(): %-8s distinct %u, added %u, total %u, "
+           "present %u, inserted %u/%u, replaced %u\n",
+           names[e],hashCount(hash) - inserted,added,
+           (unsigned int) state.sum,present,inserted,extra,replaced);
+
+    hashDestroy(hash,NULL);
+  }
+
+  free(counts);
+  quadClose(quad);
+
+}
+
+/*
+ * testUpsertMerge()
+ * hashUpsert() merge for testUpsert(), adds the new count to
+ * the one stored.
+ */
+void *testUpsertMerge(void *old, void *data){
+
+  *(unsigned int *) old += *(unsigned int *) data;
+
+  return old;
+
+}
@@ -0,0 +1,298 @@
+/*
+ * mph.c
+ * Minimal perfect hash builder for HASH_IMAGE snapshots.
+ *
+ * Given the hash values of a fixed set of n keys this finds a
+ * function mapping each of them to its own slot in 0..n-1, in
+ * the PTHash style:
+ *
+ *   The keys are split into about n / MPH_LAMBDA buckets by
+ *   the top bits of their hash.  Buckets are skewed, 60% of
+ *   the keys going to 30% of the buckets, which makes the
+ *   large buckets placed first larger and the small ones
+ *   placed last, when the table is nearly full, smaller.
+ *
+ *   Buckets are placed largest first.  Each gets the smallest
+ *   16 bit pilot p for which every key lands on a free slot
+ *   of a table of size n / MPH_ALPHA, slot mixed from the key
+ *   hash and p.  The pilot is all that is stored per bucket.
+ *
+ *   Keys that landed past n - 1 are sent to the slots left
+ *   free below n through a small remap array.
+ *
+ * A lookup is then: bucket, pilot, one slot, and the caller
+ * checks the one key stored there.  Pilots cost 16 / MPH_LAMBDA
+ * bits per key and the remap about 32 * (1 - MPH_ALPHA) more.
+ * If some bucket finds no pilot the build starts over with a
+ * new seed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "hashpriv.h"
+
+/* Attempts with fresh seeds before giving up */
+#define MPH_ATTEMPTS  32
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+int mphTry(struct HashMph *mph, const uint64_t *hashvals, unsigned int n);
+
+static
+uint64_t mphMix(uint64_t x);
+
+
+/* ================= Engine Functions ========================= */
+/* ================= Engine Functions ========================= */
+
+/*
+ * mphBuild()
+ * This function builds a minimal perfect hash over n distinct
+ * hash values.  The pilots and remap arrays are malloc()ed
+ * into mph and released with mphFree().
+ *
+ * INPUT:     mph         Filled in on success
+ *            hashvals    hashKeyValue() of every key, distinct
+ *            n           Number of keys
+ * RETURNS:   0           Success
+ *            -1          Error allocating memory, or no
+ *                        function found (duplicate values)
+ */
+int mphBuild(struct HashMph *mph, const uint64_t *hashvals, unsigned int n){
+
+  int attempt;
+  int ret;
+
+  memset(mph, 0, sizeof(struct HashMph));
+
+  mph->count       = n;
+  mph->num_buckets = (n + MPH_LAMBDA - 1) / MPH_LAMBDA;
+  mph->size        = (unsigned int) (n / MPH_ALPHA);
+  if (mph->num_buckets == 0)
+    mph->num_buckets = 1;
+  mph->dense       = MPH_DENSE(mph->num_buckets);
+  if (mph->size < n)
+    mph->size = n;
+  if (mph->size == 0)
+    mph->size = 1;
+
+  mph->pilots = (uint16_t *) malloc (mph->num_buckets * sizeof(uint16_t));
+  mph->remap  = (uint32_t *) malloc ((mph->size - n + 1) * sizeof(uint32_t));
+  if (mph->pilots == NULL || mph->remap == NULL){
+    mphFree(mph);
+    return -1;
+  }
+
+  for (attempt = 0; attempt < MPH_ATTEMPTS; attempt++){
+    mph->seed = mphMix(0x5EED0000ULL + attempt);
+    if ((ret = mphTry(mph, hashvals, n)) <= 0)
+      break;
+  }
+
+  if (attempt == MPH_ATTEMPTS || ret != 0){
+    mphFree(mph);
+    return -1;
+  }
+
+  return 0;
+
+}
+
+
+/*
+ * mphSlot()
+ * This function returns the slot, in 0..count-1, of a key
+ * that was in the set.  Any other key gets some slot too, so
+ * the caller must check the key found there.
+ *
+ * INPUT:     mph         Perfect hash
+ *            hashval     hashKeyValue() of the key
+ * RETURNS:   unsigned    Slot
+ */
+unsigned int mphSlot(const struct HashMph *mph, uint64_t hashval){
+
+  unsigned int slot;
+
+  slot = MPH_POSITION(mphMix(hashval ^ mph->seed),
+                      mph->pilots[mphBucket(mph, hashval)], mph->size);
+
+  return (slot < mph->count) ? slot : mph->remap[slot - mph->count];
+
+}
+
+
+/*
+ * mphBucket()
+ * This function returns the skewed bucket of a hash value.
+ *
+ * INPUT:     mph         Perfect hash
+ *            hashval     hashKeyValue() of the key
+ * RETURNS:   unsigned    Bucket
+ */
+unsigned int mphBucket(const struct HashMph *mph, uint64_t hashval){
+
+  /* 60% of the keys, by top bits, into the first 30% of buckets */
+  if ((uint32_t) (hashval >> 32) < MPH_SKEW && mph->dense > 0)
+    return HASH_FASTRANGE(hashval << 32, mph->dense);
+
+  return mph->dense + HASH_FASTRANGE(hashval << 32,
+                                     mph->num_buckets - mph->dense);
+
+}
+
+
+/*
+ * mphFree()
+ * This function frees what mphBuild() allocated.
+ *
+ * INPUT:     mph         Perfect hash
+ */
+void mphFree(struct HashMph *mph){
+
+  free(mph->pilots);
+  free(mph->remap);
+  mph->pilots = NULL;
+  mph->remap  = NULL;
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * mphTry()
+ * This function places every bucket with the current seed.
+ *
+ * RETURNS:   0     Every bucket placed
+ *            1     Some bucket found no pilot, try another seed
+ *            -1    Error allocating memory
+ */
+static
+int mphTry(struct HashMph *mph, const uint64_t *hashvals, unsigned int n){
+
+  unsigned int  *start;     /* First key of each bucket in keys[] */
+  unsigned int  *keys;      /* Key indexes grouped by bucket */
+  unsigned int  *order;     /* Buckets, largest first */
+  unsigned int  *bysize;
+  uint64_t      *mixed;     /* Slot hash of each key */
+  uint64_t      *taken;     /* Slot bitmap */
+  unsigned int  slots[MPH_MAX_BUCKET];
+  unsigned int  nb = mph->num_buckets;
+  unsigned int  maxsize = 0;
+  unsigned int  b, i, j, k, s, len;
+  unsigned int  free_slot;
+  uint32_t      p;
+  int           ret = -1;
+
+  start  = (unsigned int *) calloc (nb + 1, sizeof(unsigned int));
+  keys   = (unsigned int *) malloc ((n + 1) * sizeof(unsigned int));
+  order  = (unsigned int *) malloc (nb * sizeof(unsigned int));
+  bysize = (unsigned int *) calloc (MPH_MAX_BUCKET + 2, sizeof(unsigned int));
+  mixed  = (uint64_t *) malloc ((n + 1) * sizeof(uint64_t));
+  taken  = (uint64_t *) calloc ((mph->size + 63) / 64, sizeof(uint64_t));
+  if (start == NULL || keys == NULL || order == NULL || bysize == NULL ||
+      mixed == NULL || taken == NULL)
+    goto out;
+
+  /* Group the keys by bucket */
+  for (i = 0; i < n; i++){
+    start[mphBucket(mph, hashvals[i]) + 1]++;
+    mixed[i] = mphMix(hashvals[i] ^ mph->seed);
+  }
+  for (b = 0; b < nb; b++){
+    if (start[b + 1] > maxsize)
+      maxsize = start[b + 1];
+    start[b + 1] += start[b];
+  }
+  ret = 1;
+  if (maxsize > MPH_MAX_BUCKET)
+    goto out;
+  for (i = 0; i < n; i++)
+    keys[start[mphBucket(mph, hashvals[i])]++] = i;
+  for (b = nb; b > 0; b--)
+    start[b] = start[b - 1];
+  start[0] = 0;
+
+  /* Buckets by size, largest first */
+  for (b = 0; b < nb; b++)
+    bysize[MPH_MAX_BUCKET - (start[b + 1] - start[b]) + 1]++;
+  for (s = 0; s <= MPH_MAX_BUCKET; s++)
+    bysize[s + 1] += bysize[s];
+  for (b = 0; b < nb; b++)
+    order[bysize[MPH_MAX_BUCKET - (start[b + 1] - start[b])]++] = b;
+
+  for (k = 0; k < nb; k++){
+    b   = order[k];
+    len = start[b + 1] - start[b];
+    mph->pilots[b] = 0;
+    if (len == 0)
+      continue;
+
+    for (p = 0; p <= UINT16_MAX; p++){
+      for (i = 0; i < len; i++){
+        slots[i] = MPH_POSITION(mixed[keys[start[b] + i]], p, mph->size);
+        if (taken[slots[i] / 64] & (1ULL << (slots[i] % 64)))
+          break;
+        for (j = 0; j < i && slots[j] != slots[i]; j++)
+          ;
+        if (j < i)
+          break;
+      }
+      if (i == len)
+        break;
+    }
+    if (p > UINT16_MAX)
+      goto out;
+
+    mph->pilots[b] = (uint16_t) p;
+    for (i = 0; i < len; i++)
+      taken[slots[i] / 64] |= 1ULL << (slots[i] % 64);
+  }
+
+  /* Slots past count go to the free ones below it */
+  free_slot = 0;
+  for (s = n; s < mph->size; s++){
+    mph->remap[s - n] = 0;
+    if (taken[s / 64] & (1ULL << (s % 64))){
+      while (taken[free_slot / 64] & (1ULL << (free_slot % 64)))
+        free_slot++;
+      mph->remap[s - n] = free_slot++;
+    }
+  }
+
+  ret = 0;
+
+ out:
+  free(start);
+  free(keys);
+  free(order);
+  free(bysize);
+  free(mixed);
+  free(taken);
+
+  return ret;
+
+}
+
+/*
+ * mphMix()
+ * The splitmix64 finalizer, so slots use bits unrelated to the
+ * ones that picked the bucket.
+ */
+static
+uint64_t mphMix(uint64_t x){
+
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+
+  return x;
+
+}
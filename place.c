@@ -0,0 +1,217 @@
+/*
+ * place.c
+ * NUMA placement helpers for the Hash ADT.
+ *
+ * A HASH_NUMA table gives each segment a home node.  The
+ * segment's bucket or slot arrays are moved there when they
+ * are allocated and after every resize, with mbind() and
+ * MPOL_MF_MOVE so pages a writer on another node already
+ * touched move too.  The policy is MPOL_PREFERRED, so a full
+ * node spills over instead of failing the allocation.
+ *
+ * Only whole pages inside a block are moved.  Arrays smaller
+ * than a page share their pages with other allocations and
+ * are left where malloc() put them.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "place.h"
+
+#ifdef HASH_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#define MPOL_PREFERRED  1
+#define MPOL_MF_MOVE    (1 << 1)
+#endif
+
+/* Node count, found on first use */
+static int placeNodeCount = 0;
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+#if !defined(HASH_LIBNUMA) && defined(__linux__)
+static
+int placeCpuList(int node, cpu_set_t *set);
+#endif
+
+
+/* ==================== placeNodes() ===================== */
+/* ==================== placeNodes() ===================== */
+
+/*
+ * placeNodes()
+ * This function returns the number of NUMA nodes, 1 on a
+ * machine without NUMA or where it can't be told.
+ *
+ * RETURNS:   int     Nodes, numbered 0 .. nodes - 1
+ */
+int placeNodes(void){
+
+  int   nodes = 1;
+#if !defined(HASH_LIBNUMA) && defined(__linux__)
+  char  path[64];
+  int   n;
+#endif
+
+  if (placeNodeCount > 0)
+    return placeNodeCount;
+
+#ifdef HASH_LIBNUMA
+  if (numa_available() >= 0)
+    nodes = numa_max_node() + 1;
+#elif defined(__linux__)
+  for (n = 0; n < PLACE_MAX_NODES; n++){
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", n);
+    if (access(path, F_OK) == 0)
+      nodes = n + 1;
+  }
+#endif
+
+  placeNodeCount = nodes;
+
+  return nodes;
+
+}
+
+
+/* ================== placeRunOnNode() =================== */
+/* ================== placeRunOnNode() =================== */
+
+/*
+ * placeRunOnNode()
+ * This function restricts the calling thread to the CPUs of
+ * node, so the memory it touches first is allocated there
+ * and HASH_NUMA segments homed there are local to it.
+ *
+ * INPUT:     node    Node number
+ * RETURNS:   0       Success
+ *            -1      No such node, or not supported here
+ */
+int placeRunOnNode(int node){
+
+#if !defined(HASH_LIBNUMA) && defined(__linux__)
+  cpu_set_t set;
+#endif
+
+  if (node < 0 || node >= placeNodes())
+    return -1;
+
+#ifdef HASH_LIBNUMA
+  if (numa_available() < 0)
+    return -1;
+  return numa_run_on_node(node);
+#elif defined(__linux__)
+  if (placeCpuList(node, &set) != 0)
+    return -1;
+  return sched_setaffinity(0, sizeof(set), &set);
+#else
+  return -1;
+#endif
+
+}
+
+
+/* ===================== placeMove() ===================== */
+/* ===================== placeMove() ===================== */
+
+/*
+ * placeMove()
+ * This function makes node the preferred node of the whole
+ * pages of a block and moves any already there.  Failure is
+ * not an error, the block just stays where it is.
+ *
+ * INPUT:     addr    Start of the block
+ *            len     Bytes
+ *            node    Node number
+ */
+void placeMove(void *addr, size_t len, int node){
+
+#if defined(HASH_LIBNUMA) || defined(__linux__)
+  uintptr_t      page  = (uintptr_t) sysconf(_SC_PAGESIZE);
+  uintptr_t      start = ((uintptr_t) addr + page - 1) & ~(page - 1);
+  uintptr_t      end   = ((uintptr_t) addr + len) & ~(page - 1);
+  unsigned long  mask[PLACE_MAX_NODES / (8 * sizeof(unsigned long)) + 1];
+
+  if (addr == NULL || node < 0 || node >= placeNodes() ||
+      placeNodes() < 2 || end <= start)
+    return;
+
+  memset(mask, 0, sizeof(mask));
+  mask[node / (8 * sizeof(unsigned long))] |=
+    1UL << (node % (8 * sizeof(unsigned long)));
+
+#ifdef HASH_LIBNUMA
+  mbind((void *) start, end - start, MPOL_PREFERRED, mask,
+        8 * sizeof(mask), MPOL_MF_MOVE);
+#else
+  syscall(SYS_mbind, (void *) start, end - start, MPOL_PREFERRED, mask,
+          8 * sizeof(mask), MPOL_MF_MOVE);
+#endif
+#else
+  (void) addr;
+  (void) len;
+  (void) node;
+#endif
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+#if !defined(HASH_LIBNUMA) && defined(__linux__)
+
+/*
+ * placeCpuList()
+ * This function reads the CPUs of node, a list such as
+ * "0-3,8-11", from sysfs into set.
+ *
+ * RETURNS:   0     Success
+ *            -1    No such node
+ */
+static
+int placeCpuList(int node, cpu_set_t *set){
+
+  char  path[64];
+  char  line[1024];
+  char  *p;
+  long  lo, hi;
+  FILE  *fp;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+           node);
+  if ((fp = fopen(path, "r")) == NULL)
+    return -1;
+  if (fgets(line, sizeof(line), fp) == NULL){
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+
+  CPU_ZERO(set);
+  for (p = line; *p >= '0' && *p <= '9'; ){
+    lo = hi = strtol(p, &p, 10);
+    if (*p == '-')
+      hi = strtol(p + 1, &p, 10);
+    for (; lo <= hi && lo < CPU_SETSIZE; lo++)
+      CPU_SET(lo, set);
+    if (*p == ',')
+      p++;
+  }
+
+  return CPU_COUNT(set) > 0 ? 0 : -1;
+
+}
+
+#endif
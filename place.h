@@ -0,0 +1,31 @@
+/*
+ * place.h
+ * Header file for the NUMA placement helpers used by HASH_NUMA
+ * tables.
+ *
+ * Built with -DHASH_LIBNUMA they go through libnuma (link
+ * with -lnuma).  Otherwise they read the node layout from
+ * /sys/devices/system/node and call sched_setaffinity() and
+ * the mbind() system call directly.  Where neither exists
+ * there is one node and placement does nothing.
+ *
+ * FUNCTIONS:        placeNodes         Number of NUMA nodes.
+ *                   placeRunOnNode     Run the calling thread on
+ *                                      the CPUs of a node.
+ *                   placeMove          Move the pages of a block
+ *                                      to a node.
+ */
+
+#ifndef PLACE_H
+#define PLACE_H
+
+#include <stddef.h>
+
+/* Most nodes looked for without libnuma */
+#define PLACE_MAX_NODES  64
+
+int placeNodes(void);
+int placeRunOnNode(int node);
+void placeMove(void *addr, size_t len, int node);
+
+#endif
@@ -0,0 +1,736 @@
+/*
+ * quad.c
+ * Reader for USGS quadrangle files such as data/63360.lst.
+ *
+ * Each line holds a 40 column quadrangle name followed by the
+ * state, the DRG code and four corner coordinates, separated
+ * by blanks.  The old loader read it a getc() at a time and
+ * ran sscanf() and a malloc() per line.
+ *
+ * quadOpen() instead maps the whole file privately and
+ * writable, finds the lines with memchr() and parses the
+ * columns in place: names are cut with a NUL written into the
+ * mapping, the DRG code is stripped to alphanumerics where it
+ * lies and the coordinates go through quadFloat() rather than
+ * sscanf().  The only allocation is the record array, sized
+ * by a first newline count.  Pages are copied by the kernel
+ * as they are written, nothing is copied by us.
+ *
+ * quadOpenParallel() runs the count and the parse on several
+ * threads, each over its own newline aligned chunk of the
+ * mapping, and quadLoadParallel() spreads the adds into a
+ * HASH_CONCURRENT table across threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "hash.h"
+#include "grid.h"
+#include "quad.h"
+
+/* Fault the whole mapping in at once where supported */
+#ifdef MAP_POPULATE
+#define QUAD_MAP_POPULATE  MAP_POPULATE
+#else
+#define QUAD_MAP_POPULATE  0
+#endif
+
+/* Records handed to hashAddBatch() at once */
+#define QUAD_LOAD_CHUNK  256
+
+/* Smallest chunk worth a thread of its own */
+#define QUAD_MIN_CHUNK   (1 << 20)
+
+/* Share of the file, or of the records, for one thread */
+struct quadChunk {
+  QuadFile      *quad;
+  char          *start;     /* First line, just past a newline */
+  char          *stop;      /* Start of the next chunk */
+  char          *end;       /* End of the mapping */
+  Hash          *hash;      /* quadLoadParallel() table */
+  unsigned int  lines;      /* Lines in the chunk */
+  unsigned int  first;      /* Index of the chunk's first record */
+  unsigned int  count;      /* Records parsed or to add */
+  unsigned int  added;      /* Records added */
+};
+
+/* Exact powers of ten for quadFloat() */
+static const double quadPow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+  1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21,
+  1e22
+};
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+void quadRun(struct quadChunk *chunks, int nthreads,
+             void *(*worker)(void *arg));
+
+static
+void *quadCountWorker(void *arg);
+
+static
+void *quadParseWorker(void *arg);
+
+static
+void *quadLoadWorker(void *arg);
+
+static
+unsigned int quadAddRange(Hash *hash, struct quadRecord *records,
+                          unsigned int n);
+
+static
+int quadParseLine(char *line, char *eol, char *end, struct quadRecord *rec);
+
+static
+char *quadSkipBlanks(char *p, char *eol);
+
+static
+char *quadTrimBlanks(char *line, char *p);
+
+static
+char *quadToken(char *p, char *eol);
+
+static
+float quadFloat(char **pp, char *eol);
+
+
+/* =================== Public Functions ====================== */
+/* =================== Public Functions ====================== */
+
+/*
+ * quadOpen()
+ * This function maps a quadrangle file and parses every line
+ * into a record on the calling thread.  Lines too short to
+ * hold a DRG code are skipped.
+ *
+ * INPUT:     path        Path of quadrangle file
+ * RETURNS:   quad        Mapped file and its records
+ *            NULL        Cannot open or map the file, or
+ *                        error allocating memory
+ */
+QuadFile *quadOpen(const char *path){
+
+  return quadOpenParallel(path, 1);
+
+}
+
+
+/*
+ * quadOpenParallel()
+ * This function maps a quadrangle file, cuts it into nthreads
+ * newline aligned chunks and parses them side by side.  Each
+ * worker first counts the lines of its chunk, so after one
+ * pass the record array can be allocated once and every
+ * worker knows where its records start; a second pass parses.
+ * Records come out in file order.  Small files use fewer
+ * threads, one per QUAD_MIN_CHUNK bytes.
+ *
+ * INPUT:     path        Path of quadrangle file
+ *            nthreads    Number of threads, the caller's
+ *                        included
+ * RETURNS:   quad        Mapped file and its records
+ *            NULL        Cannot open or map the file, or
+ *                        error allocating memory
+ */
+QuadFile *quadOpenParallel(const char *path, int nthreads){
+
+  QuadFile          *quad;
+  struct quadChunk  chunks[QUAD_MAX_THREADS];
+  struct stat       st;
+  char              *p;
+  char              *end;
+  unsigned int      lines = 0;
+  int               fd;
+  int               i;
+
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return NULL;
+
+  if (fstat(fd, &st) != 0){
+    close(fd);
+    return NULL;
+  }
+
+  quad = (QuadFile *) malloc (sizeof(QuadFile));
+  if (quad == NULL){
+    close(fd);
+    return NULL;
+  }
+  memset(quad, 0, sizeof(QuadFile));
+
+  quad->size = (size_t) st.st_size;
+  if (quad->size == 0){
+    close(fd);
+    return quad;
+  }
+
+  if (nthreads > QUAD_MAX_THREADS)
+    nthreads = QUAD_MAX_THREADS;
+  if ((size_t) nthreads > quad->size / QUAD_MIN_CHUNK + 1)
+    nthreads = (int) (quad->size / QUAD_MIN_CHUNK + 1);
+  if (nthreads < 1)
+    nthreads = 1;
+
+  /* Prefaulting is serial, let parallel workers fault their own */
+  quad->map = (char *) mmap(NULL, quad->size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE |
+                            (nthreads == 1 ? QUAD_MAP_POPULATE : 0), fd, 0);
+  close(fd);
+  if (quad->map == MAP_FAILED){
+    free(quad);
+    return NULL;
+  }
+#ifdef MADV_SEQUENTIAL
+  madvise(quad->map, quad->size, MADV_SEQUENTIAL);
+#endif
+
+  end = quad->map + quad->size;
+
+  /* Chunks start just past a newline */
+  memset(chunks, 0, sizeof(chunks));
+  chunks[0].start = quad->map;
+  for (i = 1; i < nthreads; i++){
+    p = quad->map + quad->size / nthreads * i;
+    if (p < chunks[i - 1].start)
+      p = chunks[i - 1].start;
+    else if ((p = (char *) memchr(p, '\n', end - p)) == NULL)
+      p = end;
+    else
+      p++;
+    chunks[i].start    = p;
+    chunks[i - 1].stop = p;
+  }
+  chunks[nthreads - 1].stop = end;
+
+  for (i = 0; i < nthreads; i++){
+    chunks[i].quad = quad;
+    chunks[i].end  = end;
+  }
+
+  quadRun(chunks, nthreads, quadCountWorker);
+
+  for (i = 0; i < nthreads; i++){
+    chunks[i].first = lines;
+    lines += chunks[i].lines;
+  }
+
+  quad->records = (struct quadRecord *) malloc ((lines ? lines : 1) *
+                                                sizeof(struct quadRecord));
+  if (quad->records == NULL){
+    munmap(quad->map, quad->size);
+    free(quad);
+    return NULL;
+  }
+
+  quadRun(chunks, nthreads, quadParseWorker);
+
+  /* Close the gaps left by skipped lines */
+  for (i = 0; i < nthreads; i++){
+    if (chunks[i].first != quad->count)
+      memmove(&quad->records[quad->count], &quad->records[chunks[i].first],
+              chunks[i].count * sizeof(struct quadRecord));
+    quad->count += chunks[i].count;
+  }
+
+  return quad;
+
+}
+
+
+/*
+ * quadLoad()
+ * This function adds every record of a quadrangle file to a
+ * hash, keyed by drgname.  The records stay owned by the
+ * QuadFile, so destroy the hash with a NULL destructor before
+ * quadClose().  A HASH_BORROWED table keeps the keys in the
+ * mapping too.  The table is sized for every record first, so
+ * it doesn't rehash on the way; should that fail it just
+ * grows as it goes.
+ *
+ * INPUT:     hash        Hash table to load
+ *            quad        File from quadOpen()
+ * RETURNS:   unsigned    Number of records added
+ */
+unsigned int quadLoad(Hash *hash, QuadFile *quad){
+
+  hashReserve(hash, hashCount(hash) + quad->count);
+
+  return quadAddRange(hash, quad->records, quad->count);
+
+}
+
+
+/*
+ * quadLoadParallel()
+ * This function is quadLoad() split over nthreads threads,
+ * each adding a contiguous share of the records.  Only a
+ * HASH_CONCURRENT table can take adds from several threads,
+ * where the segment locks keep the threads mostly out of each
+ * other's way; any other table is loaded by the caller alone.
+ *
+ * INPUT:     hash        Hash table to load
+ *            quad        File from quadOpen()
+ *            nthreads    Number of threads, the caller's
+ *                        included
+ * RETURNS:   unsigned    Number of records added
+ */
+unsigned int quadLoadParallel(Hash *hash, QuadFile *quad, int nthreads){
+
+  struct quadChunk  chunks[QUAD_MAX_THREADS];
+  unsigned int      added = 0;
+  unsigned int      share;
+  int               i;
+
+  if (nthreads > QUAD_MAX_THREADS)
+    nthreads = QUAD_MAX_THREADS;
+  if (nthreads <= 1 || (hash->flags & HASH_CONCURRENT) == 0 ||
+      quad->count < (unsigned int) nthreads * QUAD_LOAD_CHUNK)
+    return quadLoad(hash, quad);
+
+  hashReserve(hash, hashCount(hash) + quad->count);
+
+  memset(chunks, 0, sizeof(chunks));
+  share = quad->count / nthreads;
+  for (i = 0; i < nthreads; i++){
+    chunks[i].quad  = quad;
+    chunks[i].hash  = hash;
+    chunks[i].first = share * i;
+    chunks[i].count = (i == nthreads - 1) ? quad->count - share * i : share;
+  }
+
+  quadRun(chunks, nthreads, quadLoadWorker);
+
+  for (i = 0; i < nthreads; i++)
+    added += chunks[i].added;
+
+  return added;
+
+}
+
+
+/*
+ * quadIndex()
+ * This function adds the corners of every record to a grid,
+ * with the record as the data container, so quadrangles can
+ * be found by where they are as well as by DRG code.
+ *
+ * INPUT:     grid        Grid from gridCreate()
+ *            quad        File from quadOpen()
+ * RETURNS:   unsigned    Number of records added
+ */
+unsigned int quadIndex(Grid *grid, QuadFile *quad){
+
+  struct quadRecord  *rec;
+  unsigned int       added = 0;
+  unsigned int       i;
+
+  for (i = 0; i < quad->count; i++){
+    rec = &quad->records[i];
+    if (gridAdd(grid, rec->x1, rec->x2, rec->y1, rec->y2, rec) == 0)
+      added++;
+  }
+
+  return added;
+
+}
+
+
+/*
+ * quadClose()
+ * This function unmaps a quadrangle file and frees its
+ * records.
+ *
+ * INPUT:     quad        File from quadOpen()
+ */
+void quadClose(QuadFile *quad){
+
+  if (quad == NULL)
+    return;
+
+  if (quad->map != NULL)
+    munmap(quad->map, quad->size);
+  free(quad->records);
+  free(quad);
+
+}
+
+
+/*
+ * quadPack()
+ * This function copies a record into a flat quadData, which
+ * needs no mapping and can go into a hashSave() snapshot.
+ * Strings longer than their field are cut.
+ *
+ * INPUT:     rec         Record from quadOpen()
+ *            data        quadData to fill in
+ */
+void quadPack(const struct quadRecord *rec, struct quadData *data){
+
+  memset(data, 0, sizeof(struct quadData));
+  strncpy(data->quadname, rec->quadname, sizeof(data->quadname) - 1);
+  strncpy(data->state, rec->state, sizeof(data->state) - 1);
+  strncpy(data->drgname, rec->drgname, sizeof(data->drgname) - 1);
+  data->x1 = rec->x1;
+  data->y1 = rec->y1;
+  data->x2 = rec->x2;
+  data->y2 = rec->y2;
+
+}
+
+
+/*
+ * quadKey()
+ * This function packs a DRG code into an integer key for a
+ * HASH_KEY_U64 table.  Each alphanumeric is a digit 1..36 of a
+ * base 37 number, so codes of up to QUAD_KEY_CHARS characters
+ * that differ other than in case get different keys; letters
+ * are folded, so "41107c5" and "41107C5" share one, and other
+ * characters are skipped the way the drgname column is
+ * stripped.
+ *
+ * INPUT:     drgname     DRG code such as "36084A5"
+ * RETURNS:   uint64_t    Packed key, 0 for an empty code
+ */
+uint64_t quadKey(const char *drgname){
+
+  uint64_t      key = 0;
+  unsigned int  n   = 0;
+  int           c;
+
+  for (; (c = (unsigned char) *drgname) != '\0' && n < QUAD_KEY_CHARS;
+       drgname++){
+    if (c >= '0' && c <= '9')
+      key = key * 37 + (c - '0') + 1;
+    else if (c >= 'A' && c <= 'Z')
+      key = key * 37 + (c - 'A') + 11;
+    else if (c >= 'a' && c <= 'z')
+      key = key * 37 + (c - 'a') + 11;
+    else
+      continue;
+    n++;
+  }
+
+  return key;
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * quadRun()
+ * This function runs worker on every chunk, chunk 0 on the
+ * calling thread and the rest on threads of their own.  A
+ * chunk whose thread cannot be started is run by the caller.
+ */
+static
+void quadRun(struct quadChunk *chunks, int nthreads,
+             void *(*worker)(void *arg)){
+
+  pthread_t  threads[QUAD_MAX_THREADS];
+  int        started[QUAD_MAX_THREADS];
+  int        i;
+
+  for (i = 1; i < nthreads; i++)
+    started[i] = (pthread_create(&threads[i], NULL, worker,
+                                 &chunks[i]) == 0);
+
+  worker(&chunks[0]);
+
+  for (i = 1; i < nthreads; i++){
+    if (started[i])
+      pthread_join(threads[i], NULL);
+    else
+      worker(&chunks[i]);
+  }
+
+}
+
+/*
+ * quadCountWorker()
+ * Counts the lines of a chunk, the last may lack its newline.
+ */
+static
+void *quadCountWorker(void *arg){
+
+  struct quadChunk  *chunk = (struct quadChunk *) arg;
+  char              *p;
+  char              *eol;
+
+  for (p = chunk->start; p < chunk->stop; p = eol + 1){
+    chunk->lines++;
+    if ((eol = (char *) memchr(p, '\n', chunk->stop - p)) == NULL)
+      break;
+  }
+
+  return NULL;
+
+}
+
+/*
+ * quadParseWorker()
+ * Parses the lines of a chunk into the records from its
+ * first index on.
+ */
+static
+void *quadParseWorker(void *arg){
+
+  struct quadChunk   *chunk = (struct quadChunk *) arg;
+  struct quadRecord  *rec   = chunk->quad->records + chunk->first;
+  char               *p;
+  char               *eol;
+
+  for (p = chunk->start; p < chunk->stop; p = eol + 1){
+    if ((eol = (char *) memchr(p, '\n', chunk->stop - p)) == NULL)
+      eol = chunk->stop;
+    if (quadParseLine(p, eol, chunk->end, &rec[chunk->count]) == 0)
+      chunk->count++;
+  }
+
+  return NULL;
+
+}
+
+/*
+ * quadLoadWorker()
+ * Adds a chunk's share of the records.
+ */
+static
+void *quadLoadWorker(void *arg){
+
+  struct quadChunk *chunk = (struct quadChunk *) arg;
+
+  chunk->added = quadAddRange(chunk->hash,
+                              chunk->quad->records + chunk->first,
+                              chunk->count);
+
+  return NULL;
+
+}
+
+/*
+ * quadAddRange()
+ * Adds n records through hashAddBatch(), QUAD_LOAD_CHUNK at
+ * a time.
+ */
+static
+unsigned int quadAddRange(Hash *hash, struct quadRecord *records,
+                          unsigned int n){
+
+  char          *keys[QUAD_LOAD_CHUNK];
+  void          *data[QUAD_LOAD_CHUNK];
+  unsigned int  added = 0;
+  unsigned int  i;
+  unsigned int  k;
+
+  for (i = 0; i < n; i += k){
+    for (k = 0; k < QUAD_LOAD_CHUNK && i + k < n; k++){
+      keys[k] = records[i + k].drgname;
+      data[k] = &records[i + k];
+    }
+    added += hashAddBatch(hash, keys, k, data);
+  }
+
+  return added;
+
+}
+
+/*
+ * quadParseLine()
+ * This function parses one line in place.  Fields are found
+ * first and only then terminated, since a terminator may land
+ * on the blank that separates two fields.
+ *
+ * RETURNS:   0     Record filled in
+ *            -1    Line has no DRG code
+ */
+static
+int quadParseLine(char *line, char *eol, char *end, struct quadRecord *rec){
+
+  char  *name_end;
+  char  *state;
+  char  *state_end;
+  char  *drg;
+  char  *drg_end;
+  char  *p;
+  char  *q;
+
+  if (eol - line <= QUAD_NAME_WIDTH)
+    return -1;
+
+  name_end = quadTrimBlanks(line, line + QUAD_NAME_WIDTH);
+
+  state     = quadSkipBlanks(line + QUAD_NAME_WIDTH, eol);
+  state_end = quadToken(state, eol);
+  drg       = quadSkipBlanks(state_end, eol);
+  drg_end   = quadToken(drg, eol);
+
+  /* Every terminator needs a byte of its own */
+  if (drg == drg_end || name_end == state || drg_end == end)
+    return -1;
+
+  p = drg_end;
+  rec->x1 = quadFloat(&p, eol);
+  rec->y1 = quadFloat(&p, eol);
+  rec->x2 = quadFloat(&p, eol);
+  rec->y2 = quadFloat(&p, eol);
+
+  /* Alphanumerics only, as strStrip() does */
+  for (p = q = drg; p < drg_end; p++)
+    if (isalnum((unsigned char) *p))
+      *q++ = *p;
+  *q = '\0';
+
+  *name_end  = '\0';
+  *state_end = '\0';
+
+  rec->quadname = line;
+  rec->state    = state;
+  rec->drgname  = drg;
+
+  return 0;
+
+}
+
+/*
+ * quadSkipBlanks()
+ * Returns the first non-blank at or after p, or eol.
+ */
+static
+char *quadSkipBlanks(char *p, char *eol){
+
+  uint64_t word;
+
+  /* Columns are padded with runs of spaces, step over 8 at once */
+  while (eol - p >= 8){
+    memcpy(&word, p, sizeof(word));
+    if (word != 0x2020202020202020ULL)
+      break;
+    p += 8;
+  }
+
+  while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+    p++;
+
+  return p;
+
+}
+
+/*
+ * quadTrimBlanks()
+ * Returns the end of line[] up to p with trailing blanks
+ * dropped.
+ */
+static
+char *quadTrimBlanks(char *line, char *p){
+
+  uint64_t word;
+
+  while (p - line >= 8){
+    memcpy(&word, p - 8, sizeof(word));
+    if (word != 0x2020202020202020ULL)
+      break;
+    p -= 8;
+  }
+
+  while (p > line && (p[-1] == ' ' || p[-1] == '\t'))
+    p--;
+
+  return p;
+
+}
+
+/*
+ * quadToken()
+ * Returns the first blank at or after p, or eol.
+ */
+static
+char *quadToken(char *p, char *eol){
+
+  while (p < eol && *p != ' ' && *p != '\t' && *p != '\r')
+    p++;
+
+  return p;
+
+}
+
+/*
+ * quadFloat()
+ * This function parses a decimal number such as -84.75 or
+ * 1.5e3 at *pp and moves *pp past it.  Up to 19 significant
+ * digits are gathered in an integer and scaled once by an
+ * exact power of ten, so the usual short coordinates come out
+ * rounded the same as with strtod().  A missing number reads
+ * as 0.
+ */
+static
+float quadFloat(char **pp, char *eol){
+
+  char      *p = quadSkipBlanks(*pp, eol);
+  uint64_t  mant = 0;
+  int       digits = 0;
+  int       exp10 = 0;
+  int       eneg = 0;
+  int       e = 0;
+  int       neg = 0;
+  double    value;
+
+  if (p < eol && (*p == '-' || *p == '+'))
+    neg = (*p++ == '-');
+
+  for (; p < eol && *p >= '0' && *p <= '9'; p++){
+    if (digits < 19){
+      mant = mant * 10 + (*p - '0');
+      digits += (mant != 0);
+    }
+    else
+      exp10++;
+  }
+
+  if (p < eol && *p == '.'){
+    for (p++; p < eol && *p >= '0' && *p <= '9'; p++){
+      if (digits < 19){
+        mant = mant * 10 + (*p - '0');
+        digits += (mant != 0);
+        exp10--;
+      }
+    }
+  }
+
+  if (p < eol && (*p == 'e' || *p == 'E')){
+    p++;
+    if (p < eol && (*p == '-' || *p == '+'))
+      eneg = (*p++ == '-');
+    for (; p < eol && *p >= '0' && *p <= '9'; p++)
+      if (e < 10000)
+        e = e * 10 + (*p - '0');
+    exp10 += eneg ? -e : e;
+  }
+
+  *pp = quadToken(p, eol);
+
+  value = (double) mant;
+  while (exp10 > 22){
+    value *= 1e22;
+    exp10 -= 22;
+  }
+  while (exp10 < -22){
+    value /= 1e22;
+    exp10 += 22;
+  }
+  value = (exp10 < 0) ? value / quadPow10[-exp10] : value * quadPow10[exp10];
+
+  return (float) (neg ? -value : value);
+
+}
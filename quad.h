@@ -0,0 +1,82 @@
+/*
+ * quad.h
+ * Header file for the USGS quadrangle file reader.
+ *
+ * quadOpen() maps a quadrangle list such as data/63360.lst
+ * and parses every line in place.  The records it returns
+ * point into the mapping rather than holding copies, so they
+ * stay valid until quadClose().
+ *
+ * FUNCTIONS:        quadOpen           Map and parse a quadrangle file.
+ *                   quadOpenParallel   quadOpen() on several threads.
+ *                   quadLoad           Add every record to a hash.
+ *                   quadLoadParallel   quadLoad() on several threads.
+ *                   quadIndex          Add every record to a grid.
+ *                   quadClose          Unmap the file, free the records.
+ *                   quadPack           Copy a record into a quadData.
+ *                   quadKey            Pack a DRG code into an integer.
+ */
+
+#ifndef QUAD_H
+#define QUAD_H
+
+#include <stddef.h>
+#include "hash.h"
+#include "grid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Width of the quadrangle name column */
+#define QUAD_NAME_WIDTH  40
+
+/* Longest DRG code quadKey() packs, 37^12 < 2^64 */
+#define QUAD_KEY_CHARS   12
+
+/* Most threads quadOpenParallel() and quadLoadParallel() use */
+#define QUAD_MAX_THREADS 64
+
+/*
+ * USGS record, strings point into the mapped file.  x1 and
+ * y1 are the latitudes, x2 and y2 the longitudes, of the
+ * north-east and south-west corners.
+ */
+struct quadRecord {
+  char      *quadname;    /* Trailing blanks cut */
+  char      *state;
+  char      *drgname;     /* Alphanumerics only, the hash key */
+  float     x1,y1,x2,y2;
+};
+
+/* USGS record with its strings held in place, for hashSave() */
+struct quadData {
+  char      quadname[QUAD_NAME_WIDTH + 1];
+  char      state[3];
+  char      drgname[9];
+  float     x1,y1,x2,y2;
+};
+
+typedef struct QuadFile {
+
+  char               *map;       /* Private writable mapping */
+  size_t             size;       /* Bytes mapped */
+  struct quadRecord  *records;
+  unsigned int       count;
+
+} QuadFile;
+
+QuadFile *quadOpen(const char *path);
+QuadFile *quadOpenParallel(const char *path, int nthreads);
+unsigned int quadLoad(Hash *hash, QuadFile *quad);
+unsigned int quadLoadParallel(Hash *hash, QuadFile *quad, int nthreads);
+unsigned int quadIndex(Grid *grid, QuadFile *quad);
+void quadClose(QuadFile *quad);
+void quadPack(const struct quadRecord *rec, struct quadData *data);
+uint64_t quadKey(const char *drgname);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
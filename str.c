@@ -10,6 +10,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 
 /* ================== Public Functions =================== */
 /* ================== Public Functions =================== */
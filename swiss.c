@@ -0,0 +1,958 @@
+/*
+ * swiss.c
+ * HASH_SWISS engine for the Hash ADT.
+ *
+ * Open addressing with one control byte per slot, after the
+ * Swiss table design.  A control byte is either EMPTY, DELETED
+ * or, for a full slot, 7 bits of the key's hash.  Probing loads
+ * a whole group of control bytes at once and compares them all
+ * against the hash fragment in a few instructions; only slots
+ * whose fragment matches have their full cached hash, and
+ * then their key strings, compared.
+ *
+ * The group matcher is picked at runtime when the table is
+ * created:  AVX2 (32 slots per group), SSE2 (16 slots) or a
+ * portable scalar version working on 8 slots per 64-bit word.
+ * The group width is fixed for the life of the table since it
+ * decides where entries are placed.
+ *
+ * The control array has SWISS_CLONE extra bytes mirroring the
+ * first bytes of the table so a group load starting near the
+ * end wraps around without a branch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "hashpriv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SWISS_X86 1
+#endif
+
+/* Control byte values, full slots hold 0x00 - 0x7f */
+#define SWISS_EMPTY    ((uint8_t) 0x80)
+#define SWISS_DELETED  ((uint8_t) 0xfe)
+
+/* Mirrored tail bytes, the widest group */
+#define SWISS_CLONE    32
+
+/* Hash fragment kept in the control byte */
+#define SWISS_H2(h)    ((uint8_t) (((h) >> 25) & 0x7f))
+
+/* One more entry would pass the load factor */
+#define SWISS_FULL(hash) ((double) ((hash)->count + (hash)->tombstones + 1) > \
+                          (hash)->max_load * (hash)->num_buckets)
+
+/* =============== Private Function Prototypes ================*/
+/* =============== Private Function Prototypes ================*/
+
+static
+int swissAlloc(Hash *hash, unsigned int num_slots);
+
+static
+void swissSetCtrl(Hash *hash, unsigned int pos, uint8_t c);
+
+static
+unsigned int swissFindFree(Hash *hash, uint64_t hashval);
+
+static
+int swissRebuild(Hash *hash, unsigned int num_slots);
+
+static
+int swissGrow(Hash *hash);
+
+static
+unsigned int swissSlots(unsigned int count);
+
+static
+unsigned int swissNextFull(Hash *hash, unsigned int pos);
+
+static
+int swissFindScalar(Hash *hash, const char *vkey, uint64_t hashval);
+
+#ifdef SWISS_X86
+static
+int swissFindSse2(Hash *hash, const char *vkey, uint64_t hashval);
+
+static
+int swissFindAvx2(Hash *hash, const char *vkey, uint64_t hashval);
+#endif
+
+
+/* ================= Engine Functions ========================= */
+/* ================= Engine Functions ========================= */
+
+/*
+ * swissInit()
+ * This function sets up an empty HASH_SWISS table and picks
+ * the widest group matcher this CPU supports.  The slot count
+ * is num_slots rounded up to a power of two.
+ *
+ * INPUT:     hash        Hash table with engine set
+ *            num_slots   Hint for the number of slots
+ * RETURNS:   0           Success
+ *            -1          Error allocating memory
+ */
+int swissInit(Hash *hash, unsigned int num_slots){
+
+  hash->group = 8;
+  hash->probe = swissFindScalar;
+
+#ifdef SWISS_X86
+  if (getenv("HASH_SWISS_SCALAR") == NULL){
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){
+      hash->group = 32;
+      hash->probe = swissFindAvx2;
+    }
+    else if (__builtin_cpu_supports("sse2")){
+      hash->group = 16;
+      hash->probe = swissFindSse2;
+    }
+  }
+#endif
+
+  hash->count      = 0;
+  hash->tombstones = 0;
+
+  return swissAlloc(hash, swissSlots(num_slots));
+
+}
+
+
+/*
+ * swissAdd()
+ * This function adds a new key/data pair to a HASH_SWISS
+ * table.  Full and deleted slots both count against the
+ * load factor since both lengthen probe sequences.
+ *
+ * INPUT:    hash     Hash table to add key/data to.
+ *           vkey     String key
+ *           hashval  hashKeyValue() of vkey
+ *           data     Void pointer to data container
+ * RETURNS:  0        Success
+ *           -1       Failure
+ */
+int swissAdd(Hash *hash, const char *vkey, uint64_t hashval, void *data){
+
+  unsigned int  pos;
+  HashKey       key;
+
+  if (SWISS_FULL(hash) && swissGrow(hash) != 0)
+    return -1;
+
+  if (hashKeySet(hash, &key, vkey) != 0)
+    return -1;
+
+  pos = swissFindFree(hash, hashval);
+
+  if (hash->ctrl[pos] == SWISS_DELETED)
+    hash->tombstones--;
+
+  swissSetCtrl(hash, pos, SWISS_H2(hashval));
+  hash->hashes[pos] = hashval;
+  hash->keys[pos]   = key;
+  hash->values[pos] = data;
+  hash->count++;
+
+  return 0;
+
+}
+
+
+/*
+ * swissFindOrAdd()
+ * This function returns the value slot of vkey, adding vkey
+ * with data first if it is not there.  A miss leaves the
+ * matcher at the first EMPTY slot of its last group, which is
+ * where swissFindFree() would put vkey unless tombstones lie
+ * earlier on the probe sequence, so the key is matched and
+ * placed in one probe.
+ *
+ * INPUT:    hash     Hash table
+ *           vkey     String key
+ *           hashval  hashKeyValue() of vkey
+ *           data     Void pointer to data container for a new key
+ *           added    Set to 1 if vkey was added, else 0
+ * RETURNS:  slot     Value slot of vkey
+ *           NULL     Failure
+ */
+void **swissFindOrAdd(Hash *hash, const char *vkey, uint64_t hashval,
+                      void *data, int *added){
+
+  int           found = hash->probe(hash, vkey, hashval);
+  unsigned int  pos;
+  HashKey       key;
+
+  *added = 0;
+  if (found >= 0)
+    return &hash->values[found];
+
+  if (SWISS_FULL(hash)){
+    if (swissGrow(hash) != 0)
+      return NULL;
+    pos = swissFindFree(hash, hashval);
+  }
+  else if (hash->tombstones == 0)
+    pos = (unsigned int) (-1 - found);
+  else
+    pos = swissFindFree(hash, hashval);
+
+  if (hashKeySet(hash, &key, vkey) != 0)
+    return NULL;
+
+  if (hash->ctrl[pos] == SWISS_DELETED)
+    hash->tombstones--;
+
+  swissSetCtrl(hash, pos, SWISS_H2(hashval));
+  hash->hashes[pos] = hashval;
+  hash->keys[pos]   = key;
+  hash->values[pos] = data;
+  hash->count++;
+  *added = 1;
+
+  return &hash->values[pos];
+
+}
+
+
+/*
+ * swissGet()
+ * This function returns the data container for vkey.
+ *
+ * INPUT:     hash      Pointer to hash table.
+ *            vkey      String key for lookup
+ *            hashval   hashKeyValue() of vkey
+ * RETURNS:   data      Pointer to data container
+ *            NULL      vkey not found in hash table
+ */
+void *swissGet(Hash *hash, const char *vkey, uint64_t hashval){
+
+  int pos = hash->probe(hash, vkey, hashval);
+
+  return (pos < 0) ? NULL : hash->values[pos];
+
+}
+
+
+/*
+ * swissDelete()
+ * This function removes vkey from the table, leaving a
+ * DELETED marker so later probe sequences stay intact.
+ *
+ * INPUT:     hash         Pointer to hash table.
+ *            vkey         String key to remove
+ *            hashval      hashKeyValue() of vkey
+ *            destructor   Destructor for the data container
+ */
+void swissDelete(Hash *hash, const char *vkey, uint64_t hashval,
+                 void (*destructor)(void *data)){
+
+  int pos = hash->probe(hash, vkey, hashval);
+
+  if (pos < 0)
+    return;
+
+  hashKeyRelease(hash, &hash->keys[pos]);
+  if (destructor != NULL)
+    destructor(hash->values[pos]);
+
+  swissSetCtrl(hash, (unsigned int) pos, SWISS_DELETED);
+  hash->hashes[pos] = 0;
+  hash->values[pos] = NULL;
+
+  hash->count--;
+  hash->tombstones++;
+
+  /* Failing to shrink just leaves the table as it is */
+  if (HASH_SHRINK(hash->count, hash->num_buckets, hash->min_buckets,
+                  hash->max_load))
+    swissRebuild(hash, swissSlots(HASH_SHRINK_SIZE(hash->count,
+                                                   hash->min_buckets,
+                                                   hash->max_load)));
+
+}
+
+
+/*
+ * swissDestroy()
+ * This function frees every key, data container and
+ * the slot arrays.  hashDestroy() frees the rest.
+ *
+ * INPUT:    hash         Pointer to hash table
+ *           destructor   Function pointer to destructor
+ */
+void swissDestroy(Hash *hash, void (*destructor)(void *data)){
+
+  unsigned int i;
+
+  /* Nothing to free but the arrays, so don't read them */
+  if (destructor != NULL || !HASH_KEYS_UNOWNED(hash)){
+    for (i = swissNextFull(hash, 0); i < hash->num_buckets;
+         i = swissNextFull(hash, i + 1)){
+      hashKeyRelease(hash, &hash->keys[i]);
+      if (destructor != NULL)
+        destructor(hash->values[i]);
+    }
+  }
+
+  free(hash->ctrl);
+  free(hash->hashes);
+  free(hash->keys);
+  free(hash->values);
+
+}
+
+
+/*
+ * swissPrefetch()
+ * This function starts loading what a lookup of hashval will
+ * read, so a batch can overlap the cache misses of many keys.
+ * Stage 0 fetches the first control group probed.  Stage 1,
+ * once it has arrived, fetches the hash, key and value of the
+ * first of the next 8 slots whose H2 matches, if any, so most
+ * misses cost one line.
+ *
+ * INPUT:     hash      Pointer to hash table
+ *            hashval   hashKeyValue() of the key
+ *            stage     0 or 1
+ */
+void swissPrefetch(Hash *hash, uint64_t hashval, int stage){
+
+  const uint64_t lsbs = 0x0101010101010101ULL;
+  const uint64_t msbs = 0x8080808080808080ULL;
+
+  unsigned int  pos  = (unsigned int) (hashval >> hash->shift);
+  uint64_t      word;
+  uint64_t      x;
+  uint64_t      match;
+
+  if (stage == 0){
+    __builtin_prefetch(&hash->ctrl[pos]);
+    return;
+  }
+
+  /* First 8 control bytes, as in swissFindScalar() */
+  memcpy(&word, hash->ctrl + pos, sizeof(word));
+  x     = word ^ (lsbs * SWISS_H2(hashval));
+  match = (x - lsbs) & ~x & msbs;
+
+  if (match != 0){
+    pos = (pos + (__builtin_ctzll(match) >> 3)) & (hash->num_buckets - 1);
+    __builtin_prefetch(&hash->hashes[pos]);
+    __builtin_prefetch(&hash->keys[pos]);
+    __builtin_prefetch(&hash->values[pos]);
+  }
+
+}
+
+
+/*
+ * swissPrint()
+ * This function prints every full slot.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            printer    Function point to printer function.
+ */
+void swissPrint(Hash *hash, void (*printer)(void *data)){
+
+  unsigned int i;
+
+  for (i = 0; i < hash->num_buckets; i++){
+    if ((hash->ctrl[i] & 0x80) == 0){
+      printf ("key: %u ",i);
+      printer(hash->values[i]);
+    }
+  }
+
+}
+
+
+/*
+ * swissWalk()
+ * This function calls visit on every FULL slot.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            visit      Called with arg, key, hash and data
+ *            arg        Passed through to visit
+ */
+void swissWalk(Hash *hash, HashVisit visit, void *arg){
+
+  unsigned int i;
+
+  for (i = swissNextFull(hash, 0); i < hash->num_buckets;
+       i = swissNextFull(hash, i + 1))
+    visit(arg, HASH_KEY_STR(&hash->keys[i]), hash->hashes[i],
+          hash->values[i]);
+
+}
+
+
+/*
+ * swissIterNext()
+ * This function moves an iterator to the next full slot,
+ * reading the control bytes 8 at a time to find it.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            it         Iterator, it->pos the next slot to try
+ * RETURNS:   1          it holds the entry
+ *            0          No full slots left
+ */
+int swissIterNext(Hash *hash, HashIter *it){
+
+  unsigned int i = swissNextFull(hash, it->pos);
+
+  if (i >= hash->num_buckets){
+    it->pos = hash->num_buckets;
+    return 0;
+  }
+
+  it->key     = HASH_KEY_STR(&hash->keys[i]);
+  it->hashval = hash->hashes[i];
+  it->data    = hash->values[i];
+  it->pos     = i + 1;
+
+  return 1;
+
+}
+
+
+/*
+ * swissScan()
+ * This function visits the entries whose hash prefix is at
+ * least lo and below hi, see hashScan().  Their home slots are
+ * a run of the table.  An entry sits no further from home than
+ * the group holding the first EMPTY slot past it, so the scan
+ * ends one group past the first EMPTY slot beyond the run.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            lo, hi     Hash prefixes of the slice
+ *            visit      Called with arg, key, hash and data
+ *            arg        Passed through to visit
+ */
+void swissScan(Hash *hash, uint64_t lo, uint64_t hi, HashVisit visit,
+               void *arg){
+
+  unsigned int  mask  = hash->num_buckets - 1;
+  unsigned int  first = (unsigned int) (lo >> (hash->shift - 32));
+  unsigned int  span  = (unsigned int) ((hi - 1) >> (hash->shift - 32)) - first;
+  unsigned int  end   = hash->num_buckets;
+  unsigned int  off, pos;
+  uint64_t      prefix;
+
+  for (off = 0; off < end; off++){
+    pos = (first + off) & mask;
+    if (hash->ctrl[pos] & 0x80){
+      if (hash->ctrl[pos] == SWISS_EMPTY && off > span &&
+          end == hash->num_buckets)
+        end = (off + hash->group < end) ? off + hash->group : end;
+      continue;
+    }
+    prefix = HASH_SCAN_PREFIX(hash->hashes[pos]);
+    if (prefix >= lo && prefix < hi)
+      visit(arg, HASH_KEY_STR(&hash->keys[pos]), hash->hashes[pos],
+            hash->values[pos]);
+  }
+
+}
+
+
+/*
+ * swissStats()
+ * This function adds the table to stats, with the number of
+ * groups each entry sits past its home group in the
+ * histogram.
+ *
+ * INPUT:     hash       Pointer to hash table
+ *            stats      Running totals, see hashStatsAdd()
+ */
+void swissStats(Hash *hash, HashStats *stats){
+
+  unsigned int  mask = hash->num_buckets - 1;
+  unsigned int  i;
+  unsigned int  groups;
+
+  for (i = 0; i < hash->num_buckets; i++){
+    if (hash->ctrl[i] == SWISS_EMPTY){
+      stats->empty++;
+      continue;
+    }
+    if (hash->ctrl[i] & 0x80)
+      continue;
+    groups = ((i - (unsigned int) (hash->hashes[i] >> hash->shift)) & mask) /
+             hash->group;
+    hashStatsHist(stats, groups);
+    hashStatsProbe(stats, groups + 1);
+    stats->key_bytes += hashKeyBytes(hash, &hash->keys[i]);
+  }
+
+  stats->count        += hash->count;
+  stats->size         += hash->num_buckets;
+  stats->tombstones   += hash->tombstones;
+  stats->bucket_bytes += (size_t) hash->num_buckets *
+                         (sizeof(uint64_t) + sizeof(HashKey) + sizeof(void *)) +
+                         hash->num_buckets + SWISS_CLONE;
+
+}
+
+
+/*
+ * swissCompact()
+ * This function rebuilds the table with the fewest slots that
+ * hold its entries within its load factor, which also drops
+ * every DELETED marker, and makes that the size it won't
+ * shrink below.
+ *
+ * INPUT:    hash     Hash table
+ * RETURNS:  0        Success
+ *           -1       Error allocating memory
+ */
+int swissCompact(Hash *hash){
+
+  unsigned int slots = HASH_CAP(hash,
+                                swissSlots(HASH_COMPACT_SIZE(hash->count,
+                                                             hash->max_load)));
+
+  if (swissRebuild(hash, slots) != 0)
+    return -1;
+
+  hash->min_buckets = hash->num_buckets;
+
+  return 0;
+
+}
+
+
+/*
+ * swissReserve()
+ * This function grows the table, if need be, so count
+ * entries fit within its load factor, up to its size limit.
+ *
+ * INPUT:    hash     Hash table
+ *           count    Entries to make room for
+ * RETURNS:  0        Success
+ *           -1       Error allocating memory
+ */
+int swissReserve(Hash *hash, unsigned int count){
+
+  unsigned int slots = HASH_CAP(hash,
+                                swissSlots(HASH_COMPACT_SIZE(count +
+                                                             hash->tombstones,
+                                                             hash->max_load)));
+
+  if (slots <= hash->num_buckets)
+    return 0;
+
+  return swissRebuild(hash, slots);
+
+}
+
+
+/*
+ * swissPlace()
+ * This function puts an entry in the first free slot from its
+ * home on, the slot swissFindFree() picks, but below slot
+ * limit, so threads building a table with hashBuildBulk() can
+ * each fill their own run of slots.  The caller counts the
+ * entries.
+ *
+ * INPUT:    hash     Hash table with room for the entry
+ *           entry    Entry to place
+ *           limit    First slot not to use, 0 for no limit
+ * RETURNS:  0        Placed
+ *           -1       No free slot below limit
+ */
+int swissPlace(Hash *hash, struct HashEntry *entry, unsigned int limit){
+
+  unsigned int pos = (unsigned int) (entry->hashval >> hash->shift);
+
+  if (limit == 0)
+    pos = swissFindFree(hash, entry->hashval);
+  else {
+    while (pos < limit && (hash->ctrl[pos] & 0x80) == 0)
+      pos++;
+    if (pos >= limit)
+      return -1;
+  }
+
+  if (hash->ctrl[pos] == SWISS_DELETED)
+    hash->tombstones--;
+
+  swissSetCtrl(hash, pos, SWISS_H2(entry->hashval));
+  hash->hashes[pos] = entry->hashval;
+  hash->keys[pos]   = entry->key;
+  hash->values[pos] = entry->data;
+
+  return 0;
+
+}
+
+
+/*
+ * swissRelease()
+ * This function frees the keys and data containers of slots
+ * first up to last and marks them EMPTY, so
+ * hashDestroyParallel() threads can each take a share of the
+ * table.  Bytes are tested one at a time so no thread reads
+ * another's share.  The cloned tail is left alone, the table
+ * is only destroyed after this.
+ *
+ * INPUT:    hash         Hash table
+ *           first, last  Slots, last not included
+ *           destructor   Function pointer to destructor
+ */
+void swissRelease(Hash *hash, unsigned int first, unsigned int last,
+                  void (*destructor)(void *data)){
+
+  unsigned int i;
+
+  for (i = first; i < last; i++){
+    if ((hash->ctrl[i] & 0x80) == 0){
+      hashKeyRelease(hash, &hash->keys[i]);
+      if (destructor != NULL)
+        destructor(hash->values[i]);
+      hash->ctrl[i] = SWISS_EMPTY;
+    }
+  }
+
+}
+
+
+/* ====================== Private Functions ====================== */
+/* ====================== Private Functions ====================== */
+
+/*
+ * swissAlloc()
+ * This function allocates the control bytes, all EMPTY, and
+ * zeroed hash, key and value arrays of num_slots entries.
+ */
+static
+int swissAlloc(Hash *hash, unsigned int num_slots){
+
+  unsigned int bits = 0;
+
+  hash->ctrl   = (uint8_t *) malloc (num_slots + SWISS_CLONE);
+  hash->hashes = (uint64_t *) calloc (num_slots, sizeof(uint64_t));
+  hash->keys   = (HashKey *) calloc (num_slots, sizeof(HashKey));
+  hash->values = (void **) calloc (num_slots, sizeof(void *));
+
+  if (hash->ctrl == NULL || hash->hashes == NULL ||
+      hash->keys == NULL || hash->values == NULL){
+    free(hash->ctrl);
+    free(hash->hashes);
+    free(hash->keys);
+    free(hash->values);
+    return -1;
+  }
+
+  memset(hash->ctrl, SWISS_EMPTY, num_slots + SWISS_CLONE);
+
+  while ((1U << bits) < num_slots)
+    bits++;
+
+  hash->num_buckets = num_slots;
+  hash->shift       = 64 - bits;
+
+  return 0;
+
+}
+
+
+/*
+ * swissSetCtrl()
+ * This function sets a control byte and its mirror in
+ * the cloned tail.
+ */
+static
+void swissSetCtrl(Hash *hash, unsigned int pos, uint8_t c){
+
+  hash->ctrl[pos] = c;
+  if (pos < SWISS_CLONE)
+    hash->ctrl[hash->num_buckets + pos] = c;
+
+}
+
+
+/*
+ * swissFindFree()
+ * This function walks the probe sequence for hashval a group
+ * at a time and returns the first EMPTY or DELETED slot in
+ * the first group that has one.  Only used on insert so it is
+ * plain C for every matcher.
+ */
+static
+unsigned int swissFindFree(Hash *hash, uint64_t hashval){
+
+  unsigned int  mask = hash->num_buckets - 1;
+  unsigned int  pos  = (unsigned int) (hashval >> hash->shift);
+  unsigned int  i;
+
+  for (;;){
+    for (i = 0; i < hash->group; i++)
+      if (hash->ctrl[pos + i] & 0x80)
+        return (pos + i) & mask;
+
+    pos = (pos + hash->group) & mask;
+  }
+
+}
+
+
+/*
+ * swissRebuild()
+ * This function moves every entry into fresh arrays of
+ * num_slots slots, dropping all DELETED markers.  Entries are
+ * placed by their cached hash so no key is read.
+ */
+static
+int swissRebuild(Hash *hash, unsigned int num_slots){
+
+  uint8_t       *oldCtrl  = hash->ctrl;
+  uint64_t      *oldHashes = hash->hashes;
+  HashKey       *oldKeys  = hash->keys;
+  void          **oldVals = hash->values;
+  unsigned int  oldSlots  = hash->num_buckets;
+  unsigned int  oldShift  = hash->shift;
+  unsigned int  i;
+  unsigned int  pos;
+  uint64_t      hashval;
+  double        start     = hashNow();
+
+  if (swissAlloc(hash, num_slots) != 0){
+    hash->ctrl   = oldCtrl;
+    hash->hashes = oldHashes;
+    hash->keys   = oldKeys;
+    hash->values = oldVals;
+    hash->shift  = oldShift;
+    return -1;
+  }
+
+  for (i = 0; i < oldSlots; i++){
+    if ((oldCtrl[i] & 0x80) == 0){
+      hashval = oldHashes[i];
+      pos     = swissFindFree(hash, hashval);
+      swissSetCtrl(hash, pos, SWISS_H2(hashval));
+      hash->hashes[pos] = hashval;
+      hash->keys[pos]   = oldKeys[i];
+      hash->values[pos] = oldVals[i];
+    }
+  }
+
+  hash->tombstones = 0;
+
+  free(oldCtrl);
+  free(oldHashes);
+  free(oldKeys);
+  free(oldVals);
+
+  hash->rehashes++;
+  hash->rehash_secs += hashNow() - start;
+
+  return 0;
+
+}
+
+
+/*
+ * swissGrow()
+ * This function makes room for one more entry, called when
+ * SWISS_FULL().  A table that is mostly tombstones is cleaned
+ * up in place, otherwise it grows.  A table at its size limit
+ * takes no more.
+ */
+static
+int swissGrow(Hash *hash){
+
+  unsigned int slots = hash->num_buckets;
+
+  if ((double) (hash->count + 1) > hash->max_load * slots / 2)
+    slots = hashGrowSize(slots, hash->growth, hash->max_buckets, 1);
+
+  if ((double) (hash->count + 1) > hash->max_load * slots)
+    return -1;
+
+  return swissRebuild(hash, slots);
+
+}
+
+
+/*
+ * swissSlots()
+ * This function returns the power of two slot count, no
+ * smaller than SWISS_MIN_SLOTS, for at least count slots.
+ */
+static
+unsigned int swissSlots(unsigned int count){
+
+  unsigned int slots = SWISS_MIN_SLOTS;
+
+  while (slots < count && slots < 0x80000000U)
+    slots <<= 1;
+
+  return slots;
+
+}
+
+
+/*
+ * swissNextFull()
+ * This function returns the first full slot at or after pos,
+ * or num_buckets if there is none.  Control bytes are read 8
+ * at a time, a full one being a byte with its top bit clear.
+ * The cloned tail keeps the last load inside the array.
+ */
+static
+unsigned int swissNextFull(Hash *hash, unsigned int pos){
+
+  const uint64_t msbs = 0x8080808080808080ULL;
+
+  uint64_t      word;
+  uint64_t      full;
+
+  for (; pos < hash->num_buckets; pos += 8){
+    memcpy(&word, hash->ctrl + pos, sizeof(word));
+    full = ~word & msbs;
+    if (full != 0){
+      pos += __builtin_ctzll(full) >> 3;
+      return (pos < hash->num_buckets) ? pos : hash->num_buckets;
+    }
+  }
+
+  return hash->num_buckets;
+
+}
+
+/* ======================== Group Matchers ======================= */
+/* ======================== Group Matchers ======================= */
+
+/*
+ * Each matcher returns the slot holding vkey, or if vkey is not
+ * there -1 - slot, where slot is the first EMPTY slot of the
+ * last group probed.  They walk the same probe sequence, one
+ * group of hash->group slots at a time starting at the home
+ * slot, and stop at the first group containing an EMPTY slot.
+ */
+
+/*
+ * swissFindScalar()
+ * Portable matcher working on 8 control bytes per 64-bit word.
+ */
+static
+int swissFindScalar(Hash *hash, const char *vkey, uint64_t hashval){
+
+  const uint64_t lsbs = 0x0101010101010101ULL;
+  const uint64_t msbs = 0x8080808080808080ULL;
+
+  unsigned int  mask = hash->num_buckets - 1;
+  unsigned int  pos  = (unsigned int) (hashval >> hash->shift);
+  uint64_t      h2   = lsbs * SWISS_H2(hashval);
+  uint64_t      word;
+  uint64_t      x;
+  uint64_t      match;
+  unsigned int  slot;
+
+  for (;;){
+    memcpy(&word, hash->ctrl + pos, sizeof(word));
+
+    /* Bytes equal to h2, may include false positives */
+    x     = word ^ h2;
+    match = (x - lsbs) & ~x & msbs;
+
+    while (match != 0){
+      slot = (pos + (__builtin_ctzll(match) >> 3)) & mask;
+      if (hash->hashes[slot] == hashval &&
+          HASH_KEY_EQ(hash, &hash->keys[slot], vkey))
+        return (int) slot;
+      match &= match - 1;
+    }
+
+    /* Any EMPTY byte ends the probe */
+    x = word & ~(word << 6) & msbs;
+    if (x != 0)
+      return -1 - (int) ((pos + (__builtin_ctzll(x) >> 3)) & mask);
+
+    pos = (pos + 8) & mask;
+  }
+
+}
+
+#ifdef SWISS_X86
+
+/*
+ * swissFindSse2()
+ * Matcher comparing 16 control bytes per step with SSE2.
+ */
+__attribute__((target("sse2")))
+static
+int swissFindSse2(Hash *hash, const char *vkey, uint64_t hashval){
+
+  unsigned int  mask  = hash->num_buckets - 1;
+  unsigned int  pos   = (unsigned int) (hashval >> hash->shift);
+  __m128i       h2    = _mm_set1_epi8((char) SWISS_H2(hashval));
+  __m128i       empty = _mm_set1_epi8((char) SWISS_EMPTY);
+  __m128i       group;
+  unsigned int  match;
+  unsigned int  slot;
+
+  for (;;){
+    group = _mm_loadu_si128((const __m128i *) (hash->ctrl + pos));
+    match = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(group, h2));
+
+    while (match != 0){
+      slot = (pos + __builtin_ctz(match)) & mask;
+      if (hash->hashes[slot] == hashval &&
+          HASH_KEY_EQ(hash, &hash->keys[slot], vkey))
+        return (int) slot;
+      match &= match - 1;
+    }
+
+    match = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(group, empty));
+    if (match != 0)
+      return -1 - (int) ((pos + __builtin_ctz(match)) & mask);
+
+    pos = (pos + 16) & mask;
+  }
+
+}
+
+/*
+ * swissFindAvx2()
+ * Matcher comparing 32 control bytes per step with AVX2.
+ */
+__attribute__((target("avx2")))
+static
+int swissFindAvx2(Hash *hash, const char *vkey, uint64_t hashval){
+
+  unsigned int  mask  = hash->num_buckets - 1;
+  unsigned int  pos   = (unsigned int) (hashval >> hash->shift);
+  __m256i       h2    = _mm256_set1_epi8((char) SWISS_H2(hashval));
+  __m256i       empty = _mm256_set1_epi8((char) SWISS_EMPTY);
+  __m256i       group;
+  unsigned int  match;
+  unsigned int  slot;
+
+  for (;;){
+    group = _mm256_loadu_si256((const __m256i *) (hash->ctrl + pos));
+    match = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(group, h2));
+
+    while (match != 0){
+      slot = (pos + __builtin_ctz(match)) & mask;
+      if (hash->hashes[slot] == hashval &&
+          HASH_KEY_EQ(hash, &hash->keys[slot], vkey))
+        return (int) slot;
+      match &= match - 1;
+    }
+
+    match = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(group,
+                                                                  empty));
+    if (match != 0)
+      return -1 - (int) ((pos + __builtin_ctz(match)) & mask);
+
+    pos = (pos + 32) & mask;
+  }
+
+}
+
+#endif
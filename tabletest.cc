@@ -0,0 +1,246 @@
+/*
+ * tabletest.cc
+ * Test driver for the hash::Table template in hash.hpp, build
+ * with "make tabletest".
+ *
+ * Every member of the Table is run against a
+ * std::unordered_map given the same operations, with integer
+ * and with string keys, and a moved-from Table is checked to
+ * be an empty table that can be used again.  Prints one line
+ * per test and exits non-zero if any of them failed.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "hash.hpp"
+
+/* Function Prototypes */
+int testTableInt(unsigned int ops);
+int testTableString(unsigned int ops);
+int testTableMove(void);
+template <class K, class V>
+int testTableSame(hash::Table<K, V> &table,
+                  const std::unordered_map<K, V> &map);
+
+int main(void){
+
+  int failed = 0;
+
+  failed += testTableInt(400000);
+  failed += testTableString(200000);
+  failed += testTableMove();
+
+  return (failed == 0) ? 0 : 1;
+
+}
+
+
+/* ==================== testTableInt() =================== */
+/* ==================== testTableInt() =================== */
+
+/*
+ * testTableInt()
+ * This function runs ops random insert(), operator[],
+ * emplace(), find() and erase() calls on 5000 integer keys
+ * against a Table and an unordered_map, checking every
+ * result as it goes, with a clear() and a reserve() half way.
+ *
+ * INPUT:     ops       Number of operations
+ * RETURNS:   0         Table and map agree
+ *            1         They do not
+ */
+int testTableInt(unsigned int ops){
+
+  hash::Table<uint64_t, int>              table;
+  std::unordered_map<uint64_t, int>       map;
+  std::pair<int *, bool>                  got;
+  unsigned int                            wrong = 0;
+  unsigned int                            i;
+  uint64_t                                key;
+  int                                     *value;
+
+  srand(1);
+  for (i = 0; i < ops; i++){
+
+    key = (uint64_t) (rand() % 5000) * 0x10001ULL;
+
+    if (i == ops / 2){
+      table.clear();
+      map.clear();
+      table.reserve(20000);
+      wrong += (table.capacity() * MAX_UTILIZATION < 20000);
+    }
+
+    switch (rand() % 5){
+      case 0:
+        wrong += (table.insert(key, (int) i) !=
+                  map.insert({ key, (int) i }).second);
+        break;
+      case 1:
+        table[key] += 1;
+        map[key]   += 1;
+        break;
+      case 2:
+        got = table.emplace(key, -(int) i);
+        wrong += (got.second != map.emplace(key, -(int) i).second ||
+                  *got.first != map[key]);
+        break;
+      case 3:
+        value = table.find(key);
+        wrong += ((value == nullptr) != (map.find(key) == map.end()) ||
+                  (value != nullptr && *value != map[key]));
+        break;
+      default:
+        wrong += (table.erase(key) != (map.erase(key) == 1));
+        break;
+    }
+  }
+
+  wrong += testTableSame(table, map);
+
+  printf("testTableInt(): %u ops, size %zu, capacity %zu, %s\n",
+         ops, table.size(), table.capacity(), wrong ? "WRONG" : "ok");
+
+  return wrong != 0;
+
+}
+
+
+/* ================== testTableString() ================== */
+/* ================== testTableString() ================== */
+
+/*
+ * testTableString()
+ * This function is testTableInt() for std::string keys and
+ * values, looked up by char * as well, which also checks that
+ * values are moved rather than lost when entries shift.
+ *
+ * INPUT:     ops       Number of operations
+ * RETURNS:   0         Table and map agree
+ *            1         They do not
+ */
+int testTableString(unsigned int ops){
+
+  hash::Table<std::string, std::string>             table;
+  std::unordered_map<std::string, std::string>      map;
+  unsigned int                                      wrong = 0;
+  unsigned int                                      i;
+  char                                              key[32];
+  std::string                                       *value;
+
+  srand(2);
+  for (i = 0; i < ops; i++){
+
+    snprintf(key, sizeof(key), "drg%d", rand() % 3000);
+
+    switch (rand() % 4){
+      case 0:
+        wrong += (table.insert(key, key) != map.insert({ key, key }).second);
+        break;
+      case 1:
+        table[key] += "+";
+        map[key]   += "+";
+        break;
+      case 2:
+        value = table.find((const char *) key);
+        wrong += ((value == nullptr) != (map.find(key) == map.end()) ||
+                  (value != nullptr && *value != map[key]));
+        break;
+      default:
+        wrong += (table.erase(std::string(key)) != (map.erase(key) == 1));
+        break;
+    }
+  }
+
+  wrong += testTableSame(table, map);
+
+  printf("testTableString(): %u ops, size %zu, %s\n",
+         ops, table.size(), wrong ? "WRONG" : "ok");
+
+  return wrong != 0;
+
+}
+
+
+/* =================== testTableMove() =================== */
+/* =================== testTableMove() =================== */
+
+/*
+ * testTableMove()
+ * This function moves a loaded Table by construction and by
+ * assignment, checks the entries went along, then uses the
+ * moved-from Table again starting with reserve(), which used
+ * to loop forever on its 0 slots.
+ *
+ * RETURNS:   0         Moves behaved
+ *            1         They did not
+ */
+int testTableMove(void){
+
+  hash::Table<uint64_t, int>              table;
+  hash::Table<uint64_t, int>              other;
+  std::unordered_map<uint64_t, int>       map;
+  unsigned int                            wrong = 0;
+  uint64_t                                i;
+
+  for (i = 0; i < 1000; i++){
+    table.insert(i, (int) i);
+    map[i] = (int) i;
+  }
+
+  hash::Table<uint64_t, int> moved(std::move(table));
+  wrong += testTableSame(moved, map);
+  wrong += (table.size() != 0 || table.find((uint64_t) 1) != nullptr ||
+            table.erase((uint64_t) 1));
+
+  other = std::move(moved);
+  wrong += testTableSame(other, map);
+  wrong += (moved.size() != 0 || moved.capacity() != 0);
+
+  table.reserve(100);
+  wrong += (table.capacity() < 100 / MAX_UTILIZATION);
+  moved[7] = 7;
+  wrong += (moved.size() != 1 || *moved.find((uint64_t) 7) != 7);
+  for (i = 0; i < 100; i++)
+    table.emplace(i, (int) i);
+  wrong += (table.size() != 100);
+
+  printf("testTableMove(): %s\n", wrong ? "WRONG" : "ok");
+
+  return wrong != 0;
+
+}
+
+
+/*
+ * testTableSame()
+ * This function checks table and map hold the same entries,
+ * both through find() and through forEach().
+ *
+ * RETURNS:   0         Same entries
+ *            1         Not the same
+ */
+template <class K, class V>
+int testTableSame(hash::Table<K, V> &table,
+                  const std::unordered_map<K, V> &map){
+
+  std::size_t  visited = 0;
+  int          wrong   = (table.size() != map.size());
+
+  for (const auto &e : map){
+    const V *value = table.find(e.first);
+    wrong |= (value == nullptr || *value != e.second);
+  }
+
+  table.forEach([&](const K &key, const V &value){
+    auto it = map.find(key);
+    wrong |= (it == map.end() || it->second != value);
+    visited++;
+  });
+
+  return wrong || visited != map.size();
+
+}